@@ -24,6 +24,9 @@
 #include <qtconcurrentrun.h>
 #include <QCryptographicHash>
 
+#include <algorithm>
+#include <vector>
+
 #ifdef ZLIB_FOUND
 #include <zlib.h>
 #endif
@@ -204,6 +207,68 @@ static bool checksumComputationEnabled()
     return enabled;
 }
 
+ChecksumCalculator::ChecksumCalculator(const QByteArray &checksumType)
+    : _checksumType(checksumType)
+{
+    if (!checksumComputationEnabled())
+        return;
+
+    if (checksumType == checkSumMD5C) {
+        _cryptoHash = std::make_unique<QCryptographicHash>(QCryptographicHash::Md5);
+    } else if (checksumType == checkSumSHA1C) {
+        _cryptoHash = std::make_unique<QCryptographicHash>(QCryptographicHash::Sha1);
+    } else if (checksumType == checkSumSHA2C) {
+        _cryptoHash = std::make_unique<QCryptographicHash>(QCryptographicHash::Sha256);
+    }
+#if QT_VERSION >= QT_VERSION_CHECK(5, 9, 0)
+    else if (checksumType == checkSumSHA3C) {
+        _cryptoHash = std::make_unique<QCryptographicHash>(QCryptographicHash::Sha3_256);
+    }
+#endif
+#ifdef ZLIB_FOUND
+    else if (checksumType == checkSumAdlerC) {
+        _adler32 = true;
+        _adler32Value = adler32(0L, Z_NULL, 0);
+    }
+#endif
+}
+
+ChecksumCalculator::~ChecksumCalculator()
+{
+}
+
+bool ChecksumCalculator::isValid() const
+{
+#ifdef ZLIB_FOUND
+    if (_adler32)
+        return true;
+#endif
+    return _cryptoHash != nullptr;
+}
+
+void ChecksumCalculator::addData(const char *data, qint64 length)
+{
+    if (_cryptoHash) {
+        _cryptoHash->addData(data, length);
+    }
+#ifdef ZLIB_FOUND
+    else if (_adler32) {
+        _adler32Value = adler32(_adler32Value, reinterpret_cast<const Bytef *>(data), length);
+    }
+#endif
+}
+
+QByteArray ChecksumCalculator::result()
+{
+    if (_cryptoHash)
+        return _cryptoHash->result().toHex();
+#ifdef ZLIB_FOUND
+    if (_adler32)
+        return QByteArray::number(static_cast<unsigned int>(_adler32Value), 16);
+#endif
+    return QByteArray();
+}
+
 ComputeChecksum::ComputeChecksum(QObject *parent)
     : QObject(parent)
 {
@@ -215,24 +280,29 @@ ComputeChecksum::~ComputeChecksum()
 
 void ComputeChecksum::setChecksumType(const QByteArray &type)
 {
-    _checksumType = type;
+    _checksumTypes = QByteArrayList{ type };
 }
 
 QByteArray ComputeChecksum::checksumType() const
 {
-    return _checksumType;
+    return _checksumTypes.value(0);
+}
+
+void ComputeChecksum::setChecksumTypes(const QByteArrayList &types)
+{
+    _checksumTypes = types;
 }
 
 void ComputeChecksum::start(const QString &filePath)
 {
-    qCInfo(lcChecksums) << "Computing" << checksumType() << "checksum of" << filePath << "in a thread";
+    qCInfo(lcChecksums) << "Computing" << checksumTypes() << "checksum of" << filePath << "in a thread";
     startImpl(std::make_unique<QFile>(filePath));
 }
 
 void ComputeChecksum::start(std::unique_ptr<QIODevice> device)
 {
     ENFORCE(device);
-    qCInfo(lcChecksums) << "Computing" << checksumType() << "checksum of device" << device.get() << "in a thread";
+    qCInfo(lcChecksums) << "Computing" << checksumTypes() << "checksum of device" << device.get() << "in a thread";
     ASSERT(!device->parent());
 
     startImpl(std::move(device));
@@ -249,8 +319,8 @@ void ComputeChecksum::startImpl(std::unique_ptr<QIODevice> device)
     auto sharedDevice = QSharedPointer<QIODevice>(device.release());
 
     // Bug: The thread will keep running even if ComputeChecksum is deleted.
-    auto type = checksumType();
-    _watcher.setFuture(QtConcurrent::run([sharedDevice, type]() {
+    auto types = checksumTypes();
+    _watcher.setFuture(QtConcurrent::run([sharedDevice, types]() {
         if (!sharedDevice->open(QIODevice::ReadOnly)) {
             if (auto file = qobject_cast<QFile *>(sharedDevice.data())) {
                 qCWarning(lcChecksums) << "Could not open file" << file->fileName()
@@ -259,9 +329,9 @@ void ComputeChecksum::startImpl(std::unique_ptr<QIODevice> device)
                 qCWarning(lcChecksums) << "Could not open device" << sharedDevice.data()
                         << "for reading to compute a checksum" << sharedDevice->errorString();
             }
-            return QByteArray();
+            return QByteArrayList();
         }
-        auto result = ComputeChecksum::computeNow(sharedDevice.data(), type);
+        auto result = ComputeChecksum::computeMultipleNow(sharedDevice.data(), types);
         sharedDevice->close();
         return result;
     }));
@@ -280,69 +350,95 @@ QByteArray ComputeChecksum::computeNowOnFile(const QString &filePath, const QByt
 
 QByteArray ComputeChecksum::computeNow(QIODevice *device, const QByteArray &checksumType)
 {
+    return computeMultipleNow(device, QByteArrayList{ checksumType }).value(0);
+}
+
+QByteArrayList ComputeChecksum::computeMultipleNow(QIODevice *device, const QByteArrayList &checksumTypes)
+{
+    QByteArrayList result;
+    for (int i = 0; i < checksumTypes.size(); ++i)
+        result.append(QByteArray());
+
     if (!checksumComputationEnabled()) {
         qCWarning(lcChecksums) << "Checksum computation disabled by environment variable";
-        return QByteArray();
+        return result;
     }
 
-    if (checksumType == checkSumMD5C) {
-        return calcMd5(device);
-    } else if (checksumType == checkSumSHA1C) {
-        return calcSha1(device);
-    } else if (checksumType == checkSumSHA2C) {
-        return calcCryptoHash(device, QCryptographicHash::Sha256);
+    std::vector<std::unique_ptr<ChecksumCalculator>> calculators;
+    for (const auto &type : checksumTypes) {
+        calculators.push_back(std::make_unique<ChecksumCalculator>(type));
+        // for an unknown checksum or no checksum, we're done right now
+        if (!calculators.back()->isValid() && !type.isEmpty())
+            qCWarning(lcChecksums) << "Unknown checksum type:" << type;
     }
-#if QT_VERSION >= QT_VERSION_CHECK(5, 9, 0)
-    else if (checksumType == checkSumSHA3C) {
-        return calcCryptoHash(device, QCryptographicHash::Sha3_256);
-    }
-#endif
-#ifdef ZLIB_FOUND
-    else if (checksumType == checkSumAdlerC) {
-        return calcAdler32(device);
-    }
-#endif
-    // for an unknown checksum or no checksum, we're done right now
-    if (!checksumType.isEmpty()) {
-        qCWarning(lcChecksums) << "Unknown checksum type:" << checksumType;
+    if (std::none_of(calculators.begin(), calculators.end(), [](const std::unique_ptr<ChecksumCalculator> &c) { return c->isValid(); }))
+        return result;
+
+    // Read the data once and feed it to all calculators
+    QByteArray buf(BUFSIZE, Qt::Uninitialized);
+    while (!device->atEnd()) {
+        const qint64 size = device->read(buf.data(), BUFSIZE);
+        if (size < 0) {
+            qCWarning(lcChecksums) << "Error reading from device" << device << "to compute checksums" << device->errorString();
+            return result;
+        }
+        if (size == 0)
+            break;
+        for (const auto &calculator : calculators)
+            calculator->addData(buf.constData(), size);
     }
-    return QByteArray();
+
+    for (size_t i = 0; i < calculators.size(); ++i)
+        result[i] = calculators[i]->result();
+    return result;
 }
 
 void ComputeChecksum::slotCalculationDone()
 {
-    QByteArray checksum = _watcher.future().result();
-    if (!checksum.isNull()) {
-        emit done(_checksumType, checksum);
-    } else {
-        emit done(QByteArray(), QByteArray());
+    const QByteArrayList results = _watcher.future().result();
+    QByteArrayList types, checksums;
+    for (int i = 0; i < _checksumTypes.size(); ++i) {
+        const auto checksum = results.value(i);
+        types.append(checksum.isEmpty() ? QByteArray() : _checksumTypes[i]);
+        checksums.append(checksum);
     }
+    emit done(types.value(0), checksums.value(0));
+    emit checksumsComputed(types, checksums);
 }
 
-
 ValidateChecksumHeader::ValidateChecksumHeader(QObject *parent)
     : QObject(parent)
 {
 }
 
-ComputeChecksum *ValidateChecksumHeader::prepareStart(const QByteArray &checksumHeader)
+bool ValidateChecksumHeader::parseExpectedChecksum(const QByteArray &checksumHeader)
 {
     // If the incoming header is empty no validation can happen. Just continue.
     if (checksumHeader.isEmpty()) {
         emit validated(QByteArray(), QByteArray());
-        return nullptr;
+        return false;
     }
 
     if (!parseChecksumHeader(checksumHeader, &_expectedChecksumType, &_expectedChecksum)) {
         qCWarning(lcChecksums) << "Checksum header malformed:" << checksumHeader;
         emit validationFailed(tr("The checksum header is malformed."));
-        return nullptr;
+        return false;
     }
+    return true;
+}
+
+ComputeChecksum *ValidateChecksumHeader::prepareStart(const QByteArray &checksumHeader)
+{
+    if (!parseExpectedChecksum(checksumHeader))
+        return nullptr;
 
     auto calculator = new ComputeChecksum(this);
-    calculator->setChecksumType(_expectedChecksumType);
-    connect(calculator, &ComputeChecksum::done,
-        this, &ValidateChecksumHeader::slotChecksumCalculated);
+    QByteArrayList types = { _expectedChecksumType };
+    if (!_contentChecksumType.isEmpty() && _contentChecksumType != _expectedChecksumType)
+        types.append(_contentChecksumType);
+    calculator->setChecksumTypes(types);
+    connect(calculator, &ComputeChecksum::checksumsComputed,
+        this, &ValidateChecksumHeader::slotChecksumsCalculated);
     return calculator;
 }
 
@@ -358,9 +454,17 @@ void ValidateChecksumHeader::start(std::unique_ptr<QIODevice> device, const QByt
         calculator->start(std::move(device));
 }
 
-void ValidateChecksumHeader::slotChecksumCalculated(const QByteArray &checksumType,
-    const QByteArray &checksum)
+void ValidateChecksumHeader::validate(const QByteArray &checksumHeader, const QByteArray &checksumType, const QByteArray &checksum)
+{
+    if (parseExpectedChecksum(checksumHeader))
+        slotChecksumsCalculated({ checksumType }, { checksum });
+}
+
+void ValidateChecksumHeader::slotChecksumsCalculated(const QByteArrayList &checksumTypes,
+    const QByteArrayList &checksums)
 {
+    const auto checksumType = checksumTypes.value(0);
+    const auto checksum = checksums.value(0);
     if (checksumType != _expectedChecksumType) {
         emit validationFailed(tr("The checksum header contained an unknown checksum type '%1'").arg(QString::fromLatin1(_expectedChecksumType)));
         return;
@@ -369,6 +473,8 @@ void ValidateChecksumHeader::slotChecksumCalculated(const QByteArray &checksumTy
         emit validationFailed(tr("The downloaded file does not match the checksum, it will be resumed."));
         return;
     }
+    if (checksumTypes.size() > 1 && !checksumTypes[1].isEmpty())
+        emit contentChecksumComputed(checksumTypes[1], checksums[1]);
     emit validated(checksumType, checksum);
 }
 
@@ -23,11 +23,13 @@
 
 #include <QObject>
 #include <QByteArray>
+#include <QByteArrayList>
 #include <QFutureWatcher>
 
 #include <memory>
 
 class QFile;
+class QCryptographicHash;
 
 namespace OCC {
 
@@ -75,8 +77,42 @@ QByteArray OCSYNC_EXPORT calcSha1(QIODevice *device);
 QByteArray OCSYNC_EXPORT calcAdler32(QIODevice *device);
 #endif
 
+/**
+ * Computes a checksum incrementally from consecutive chunks of data.
+ *
+ * Unknown or empty checksum types, or disabled checksum computations,
+ * make the calculator invalid. An invalid calculator ignores the data and
+ * its result() is empty.
+ * \ingroup libsync
+ */
+class OCSYNC_EXPORT ChecksumCalculator
+{
+public:
+    explicit ChecksumCalculator(const QByteArray &checksumType);
+    ~ChecksumCalculator();
+
+    bool isValid() const;
+    QByteArray checksumType() const { return _checksumType; }
+
+    void addData(const char *data, qint64 length);
+
+    /// The hex encoded checksum of all data added so far. Call only once.
+    QByteArray result();
+
+private:
+    QByteArray _checksumType;
+    std::unique_ptr<QCryptographicHash> _cryptoHash;
+#ifdef ZLIB_FOUND
+    bool _adler32 = false;
+    unsigned long _adler32Value = 0;
+#endif
+};
+
 /**
  * Computes the checksum of a file.
+ *
+ * Several checksum types can be computed in a single pass over the data,
+ * see setChecksumTypes().
  * \ingroup libsync
  */
 class OCSYNC_EXPORT ComputeChecksum : public QObject
@@ -93,6 +129,15 @@ public:
 
     QByteArray checksumType() const;
 
+    /**
+     * Sets several checksum types to be computed in the same pass.
+     *
+     * done() reports the first one, checksumsComputed() all of them.
+     */
+    void setChecksumTypes(const QByteArrayList &types);
+
+    QByteArrayList checksumTypes() const { return _checksumTypes; }
+
     /**
      * Computes the checksum for the given file path.
      *
@@ -115,6 +160,14 @@ public:
      */
     static QByteArray computeNow(QIODevice *device, const QByteArray &checksumType);
 
+    /**
+     * Computes several checksums synchronously, reading the device only once.
+     *
+     * Returns one checksum per type, in the same order. Checksums that could
+     * not be computed are empty.
+     */
+    static QByteArrayList computeMultipleNow(QIODevice *device, const QByteArrayList &checksumTypes);
+
     /**
      * Computes the checksum synchronously on file. Convenience wrapper for computeNow().
      */
@@ -123,16 +176,23 @@ public:
 signals:
     void done(const QByteArray &checksumType, const QByteArray &checksum);
 
+    /**
+     * Emitted together with done(), with one entry per type in checksumTypes().
+     *
+     * Types and checksums that could not be computed are empty.
+     */
+    void checksumsComputed(const QByteArrayList &checksumTypes, const QByteArrayList &checksums);
+
 private slots:
     void slotCalculationDone();
 
 private:
     void startImpl(std::unique_ptr<QIODevice> device);
 
-    QByteArray _checksumType;
+    QByteArrayList _checksumTypes;
 
     // watcher for the checksum calculation thread
-    QFutureWatcher<QByteArray> _watcher;
+    QFutureWatcher<QByteArrayList> _watcher;
 };
 
 /**
@@ -164,18 +224,39 @@ public:
      */
     void start(std::unique_ptr<QIODevice> device, const QByteArray &checksumHeader);
 
+    /**
+     * Check an already computed checksum against the provided checksumHeader
+     *
+     * Like the other start() but doesn't read any data. The signals are
+     * emitted before this function returns.
+     */
+    void validate(const QByteArray &checksumHeader, const QByteArray &checksumType, const QByteArray &checksum);
+
+    /**
+     * Also compute a content checksum of this type while validating.
+     *
+     * If it differs from the type in the checksum header, it is computed in
+     * the same pass and reported with contentChecksumComputed() right before
+     * validated(). Nothing is reported if the header is empty.
+     */
+    void setContentChecksumType(const QByteArray &type) { _contentChecksumType = type; }
+
 signals:
     void validated(const QByteArray &checksumType, const QByteArray &checksum);
     void validationFailed(const QString &errMsg);
+    void contentChecksumComputed(const QByteArray &checksumType, const QByteArray &checksum);
 
 private slots:
-    void slotChecksumCalculated(const QByteArray &checksumType, const QByteArray &checksum);
+    void slotChecksumsCalculated(const QByteArrayList &checksumTypes, const QByteArrayList &checksums);
 
 private:
+    /// Emits validated() or validationFailed() and returns false if there's nothing to compute
+    bool parseExpectedChecksum(const QByteArray &checksumHeader);
     ComputeChecksum *prepareStart(const QByteArray &checksumHeader);
 
     QByteArray _expectedChecksumType;
     QByteArray _expectedChecksum;
+    QByteArray _contentChecksumType;
 };
 
 /**
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "pinstatetrie.h"
+
+namespace OCC {
+
+static quint8 stateBit(PinState state)
+{
+    return state == PinState::Inherited ? 0 : quint8(1 << static_cast<int>(state));
+}
+
+void PinStateTrie::Node::updateStatesBelow()
+{
+    statesBelow = 0;
+    for (const auto &child : children)
+        statesBelow |= child.second->statesBelow | stateBit(child.second->state);
+}
+
+void PinStateTrie::clear()
+{
+    _root.state = PinState::Inherited;
+    _root.statesBelow = 0;
+    _root.children.clear();
+}
+
+void PinStateTrie::set(const QByteArray &path, PinState state)
+{
+    const QList<QByteArray> components = path.isEmpty() ? QList<QByteArray>() : path.split('/');
+    QVector<Node *> nodes = { &_root };
+    for (const auto &component : components) {
+        auto &child = nodes.last()->children[component];
+        if (!child)
+            child.reset(new Node);
+        nodes.append(child.get());
+    }
+    nodes.last()->state = state;
+    prune(nodes, components);
+}
+
+void PinStateTrie::wipe(const QByteArray &path)
+{
+    if (path.isEmpty()) {
+        clear();
+        return;
+    }
+
+    const QList<QByteArray> components = path.split('/');
+    QVector<Node *> nodes = { &_root };
+    for (int i = 0; i < components.size() - 1; ++i) {
+        auto it = nodes.last()->children.find(components[i]);
+        if (it == nodes.last()->children.end())
+            return;
+        nodes.append(it->second.get());
+    }
+    if (nodes.last()->children.erase(components.last()) == 0)
+        return;
+    nodes.last()->updateStatesBelow();
+    prune(nodes, components.mid(0, components.size() - 1));
+}
+
+void PinStateTrie::prune(const QVector<Node *> &nodes, const QList<QByteArray> &components)
+{
+    // nodes[i] is the node of the first i components; update them bottom up
+    // and drop the ones that don't hold any state anymore
+    for (int i = nodes.size() - 1; i >= 0; --i) {
+        Node *node = nodes[i];
+        node->updateStatesBelow();
+        if (i > 0 && node->state == PinState::Inherited && node->children.empty())
+            nodes[i - 1]->children.erase(components[i - 1]);
+    }
+}
+
+const PinStateTrie::Node *PinStateTrie::find(const QByteArray &path) const
+{
+    const Node *node = &_root;
+    if (path.isEmpty())
+        return node;
+    for (const auto &component : path.split('/')) {
+        auto it = node->children.find(component);
+        if (it == node->children.end())
+            return nullptr;
+        node = it->second.get();
+    }
+    return node;
+}
+
+PinState PinStateTrie::raw(const QByteArray &path) const
+{
+    const Node *node = find(path);
+    return node ? node->state : PinState::Inherited;
+}
+
+PinState PinStateTrie::effective(const QByteArray &path) const
+{
+    // If the root path has no setting, assume AlwaysLocal
+    PinState result = _root.state == PinState::Inherited ? PinState::AlwaysLocal : _root.state;
+    if (path.isEmpty())
+        return result;
+
+    const Node *node = &_root;
+    for (const auto &component : path.split('/')) {
+        auto it = node->children.find(component);
+        if (it == node->children.end())
+            break;
+        node = it->second.get();
+        if (node->state != PinState::Inherited)
+            result = node->state;
+    }
+    return result;
+}
+
+PinState PinStateTrie::effectiveRecursive(const QByteArray &path) const
+{
+    const PinState base = effective(path);
+    const Node *node = find(path);
+    if (node && (node->statesBelow & ~stateBit(base)) != 0)
+        return PinState::Inherited;
+    return base;
+}
+
+} // namespace OCC
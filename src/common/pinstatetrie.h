@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include "ocsynclib.h"
+#include "common/pinstate.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QVector>
+
+#include <map>
+#include <memory>
+
+namespace OCC {
+
+/**
+ * The explicit pin states of paths, as a tree of path components.
+ *
+ * Lookups take time proportional to the depth of the path. Only states
+ * other than Inherited are stored, an Inherited state removes the entry.
+ *
+ * Paths have no leading or trailing slash, "" is the root.
+ * See SyncJournalDb::PinStateInterface for the meaning of the lookups.
+ */
+class OCSYNC_EXPORT PinStateTrie
+{
+public:
+    void clear();
+
+    void set(const QByteArray &path, PinState state);
+    /// Removes the states of the path and everything below it
+    void wipe(const QByteArray &path);
+
+    /// The explicit state of the path, or Inherited
+    PinState raw(const QByteArray &path) const;
+    /// The state of the path or of its closest parent that has one; AlwaysLocal if none has
+    PinState effective(const QByteArray &path) const;
+    /// effective(), or Inherited if something below the path has a different state
+    PinState effectiveRecursive(const QByteArray &path) const;
+
+private:
+    struct Node
+    {
+        PinState state = PinState::Inherited;
+        // Bit n is set if a node below has the PinState n
+        quint8 statesBelow = 0;
+        std::map<QByteArray, std::unique_ptr<Node>> children;
+
+        void updateStatesBelow();
+    };
+
+    const Node *find(const QByteArray &path) const;
+    void prune(const QVector<Node *> &nodes, const QList<QByteArray> &components);
+
+    Node _root;
+};
+
+} // namespace OCC
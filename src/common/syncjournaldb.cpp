@@ -94,6 +94,13 @@ SyncJournalDb::SyncJournalDb(const QString &dbFilePath, QObject *parent)
     , _transaction(0)
     , _metadataTableIsEmpty(false)
 {
+    _groupCommitTimer.setSingleShot(true);
+    connect(&_groupCommitTimer, &QTimer::timeout, this, [this] {
+        QMutexLocker lock(&_mutex);
+        if (_groupCommitPending > 0)
+            commitInternal(QStringLiteral("group commit timeout"));
+    });
+
     // Allow forcing the journal mode for debugging
     static QByteArray envJournalMode = qgetenv("OWNCLOUD_SQLITE_JOURNAL_MODE");
     _journalMode = envJournalMode;
@@ -517,6 +524,17 @@ bool SyncJournalDb::checkConnect()
         return sqlFail("Create table conflicts", createQuery);
     }
 
+    createQuery.prepare("CREATE TABLE IF NOT EXISTS directorysnapshots("
+                        "path TEXT PRIMARY KEY,"
+                        "modtime INTEGER(8),"
+                        "inode INTEGER(8),"
+                        "childcount INTEGER,"
+                        "childrenhash INTEGER(8)"
+                        ");");
+    if (!createQuery.exec()) {
+        return sqlFail("Create table directorysnapshots", createQuery);
+    }
+
     createQuery.prepare("CREATE TABLE IF NOT EXISTS version("
                         "major INTEGER(8),"
                         "minor INTEGER(8),"
@@ -640,9 +658,12 @@ void SyncJournalDb::close()
     qCInfo(lcDb) << "Closing DB" << _dbFile;
 
     commitTransaction();
+    _groupCommitPending = 0;
     _db.close();
     clearEtagStorageFilter();
     _metadataTableIsEmpty = false;
+    _pinStates.clear();
+    _pinStatesLoaded = false;
 }
 
 
@@ -720,8 +741,23 @@ bool SyncJournalDb::updateMetadataTableStructure()
     }
 
     if (1) {
+        // Directory listings are ordered by path||'/', see getFilesBelowPath().
+        // Indexing that expression allows sqlite to return rows in index order
+        // instead of sorting the whole result in a temporary b-tree.
+        SqlQuery query(_db);
+        query.prepare("CREATE INDEX IF NOT EXISTS metadata_path_sort ON metadata(path||'/');");
+        if (!query.exec()) {
+            sqlFail("updateMetadataTableStructure: create index path sort", query);
+            re = false;
+        }
+        commitInternal("update database structure: add path sort index");
+    }
+
+    if (1) {
+        // The index is dropped whenever the database is opened, see checkConnect(),
+        // so changing its columns doesn't need a migration.
         SqlQuery query(_db);
-        query.prepare("CREATE INDEX IF NOT EXISTS metadata_parent ON metadata(parent_hash(path));");
+        query.prepare("CREATE INDEX IF NOT EXISTS metadata_parent ON metadata(parent_hash(path), path||'/');");
         if (!query.exec()) {
             sqlFail("updateMetadataTableStructure: create index parent", query);
             re = false;
@@ -942,6 +978,7 @@ bool SyncJournalDb::setFileRecord(const SyncJournalFileRecord &_record)
 
         // Can't be true anymore.
         _metadataTableIsEmpty = false;
+        ++_fileRecordsRevision;
 
         return true;
     } else {
@@ -966,6 +1003,7 @@ bool SyncJournalDb::deleteFileRecord(const QString &filename, bool recursively)
 
         if (!_deleteFileRecordPhash.exec())
             return false;
+        ++_fileRecordsRevision;
 
         if (recursively) {
             if (!_deleteFileRecordRecursively.initOrReset(QByteArrayLiteral("DELETE FROM metadata WHERE " IS_PREFIX_PATH_OF("?1", "path")), _db))
@@ -983,7 +1021,24 @@ bool SyncJournalDb::deleteFileRecord(const QString &filename, bool recursively)
 }
 
 
+quint64 SyncJournalDb::fileRecordsRevision()
+{
+    QMutexLocker locker(&_mutex);
+    return _fileRecordsRevision;
+}
+
 bool SyncJournalDb::getFileRecord(const QByteArray &filename, SyncJournalFileRecord *rec)
+{
+    if (filename.isEmpty()) {
+        // Reset the output var in case the caller is reusing it.
+        Q_ASSERT(rec);
+        rec->_path.clear();
+        return true;
+    }
+    return getFileRecordByPHash(getPHash(filename), rec);
+}
+
+bool SyncJournalDb::getFileRecordByPHash(qint64 phash, SyncJournalFileRecord *rec)
 {
     QMutexLocker locker(&_mutex);
 
@@ -998,27 +1053,25 @@ bool SyncJournalDb::getFileRecord(const QByteArray &filename, SyncJournalFileRec
     if (!checkConnect())
         return false;
 
-    if (!filename.isEmpty()) {
-        if (!_getFileRecordQuery.initOrReset(QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE phash=?1"), _db))
-            return false;
+    if (!_getFileRecordQuery.initOrReset(QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE phash=?1"), _db))
+        return false;
 
-        _getFileRecordQuery.bindValue(1, getPHash(filename));
+    _getFileRecordQuery.bindValue(1, phash);
 
-        if (!_getFileRecordQuery.exec()) {
-            close();
-            return false;
-        }
+    if (!_getFileRecordQuery.exec()) {
+        close();
+        return false;
+    }
 
-        auto next = _getFileRecordQuery.next();
-        if (!next.ok) {
-            QString err = _getFileRecordQuery.error();
-            qCWarning(lcDb) << "No journal entry found for " << filename << "Error: " << err;
-            close();
-            return false;
-        }
-        if (next.hasData) {
-            fillFileRecordFromGetQuery(*rec, _getFileRecordQuery);
-        }
+    auto next = _getFileRecordQuery.next();
+    if (!next.ok) {
+        QString err = _getFileRecordQuery.error();
+        qCWarning(lcDb) << "No journal entry found for phash" << phash << "Error: " << err;
+        close();
+        return false;
+    }
+    if (next.hasData) {
+        fillFileRecordFromGetQuery(*rec, _getFileRecordQuery);
     }
     return true;
 }
@@ -1088,6 +1141,36 @@ bool SyncJournalDb::getFileRecordsByFileId(const QByteArray &fileId, const std::
     return true;
 }
 
+bool SyncJournalDb::getFileIdentifiers(const std::function<void(qint64, quint64, const QByteArray &)> &rowCallback)
+{
+    QMutexLocker locker(&_mutex);
+
+    if (_metadataTableIsEmpty)
+        return true; // no error, yet nothing found
+
+    if (!checkConnect())
+        return false;
+
+    SqlQuery query(_db);
+    if (query.prepare("SELECT phash, inode, fileid FROM metadata;") != 0)
+        return false;
+
+    if (!query.exec())
+        return false;
+
+    forever {
+        auto next = query.next();
+        if (!next.ok)
+            return false;
+        if (!next.hasData)
+            break;
+
+        rowCallback(query.int64Value(0), query.int64Value(1), query.baValue(2));
+    }
+
+    return true;
+}
+
 bool SyncJournalDb::getFilesBelowPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord&)> &rowCallback)
 {
     QMutexLocker locker(&_mutex);
@@ -1114,7 +1197,9 @@ bool SyncJournalDb::getFilesBelowPath(const QByteArray &path, const std::functio
         // database instead
         if (!_getFilesBelowPathQuery.initOrReset(QByteArrayLiteral(
                 GET_FILE_RECORD_QUERY
-                " WHERE " IS_PREFIX_PATH_OF("?1", "path")
+                // Same as IS_PREFIX_PATH_OF, but expressed on path||'/' so that
+                // the metadata_path_sort index serves both the range and the order.
+                " WHERE (path||'/') > (?1||'/') AND (path||'/') < (?1||'0')"
                 // We want to ensure that the contents of a directory are sorted
                 // directly behind the directory itself. Without this ORDER BY
                 // an ordering like foo, foo-2, foo/file would be returned.
@@ -1258,7 +1343,10 @@ bool SyncJournalDb::updateLocalMetadata(const QString &filename,
     _setFileRecordLocalMetadataQuery.bindValue(2, inode);
     _setFileRecordLocalMetadataQuery.bindValue(3, modtime);
     _setFileRecordLocalMetadataQuery.bindValue(4, size);
-    return _setFileRecordLocalMetadataQuery.exec();
+    if (!_setFileRecordLocalMetadataQuery.exec())
+        return false;
+    ++_fileRecordsRevision;
+    return true;
 }
 
 Optional<SyncJournalDb::HasHydratedDehydrated> SyncJournalDb::hasHydratedOrDehydratedFiles(const QByteArray &filename)
@@ -1376,6 +1464,79 @@ void SyncJournalDb::setDownloadInfo(const QString &file, const SyncJournalDb::Do
     }
 }
 
+quint64 SyncJournalDb::DirectorySnapshot::hashRecords(const QVector<SyncJournalFileRecord> &records)
+{
+    quint64 hash = 0;
+    for (const auto &rec : records) {
+        const quint64 parts[] = {
+            c_jhash64(reinterpret_cast<const uint8_t *>(rec._path.constData()), rec._path.size(), 0),
+            rec._inode,
+            quint64(rec._modtime),
+            quint64(rec._fileSize)
+        };
+        // Summing makes the result independent of the order of the records
+        hash += c_jhash64(reinterpret_cast<const uint8_t *>(parts), sizeof(parts), 0);
+    }
+    return hash;
+}
+
+SyncJournalDb::DirectorySnapshot SyncJournalDb::getDirectorySnapshot(const QByteArray &path)
+{
+    QMutexLocker locker(&_mutex);
+
+    DirectorySnapshot res;
+
+    if (!checkConnect())
+        return res;
+
+    if (!_getDirectorySnapshotQuery.initOrReset(QByteArrayLiteral(
+            "SELECT modtime, inode, childcount, childrenhash FROM directorysnapshots WHERE path=?1"), _db)) {
+        return res;
+    }
+    _getDirectorySnapshotQuery.bindValue(1, path);
+    if (!_getDirectorySnapshotQuery.exec())
+        return res;
+
+    if (_getDirectorySnapshotQuery.next().hasData) {
+        res._modtime = _getDirectorySnapshotQuery.int64Value(0);
+        res._inode = _getDirectorySnapshotQuery.int64Value(1);
+        res._childCount = _getDirectorySnapshotQuery.intValue(2);
+        res._childrenHash = _getDirectorySnapshotQuery.int64Value(3);
+        res._valid = true;
+    }
+    return res;
+}
+
+void SyncJournalDb::setDirectorySnapshot(const QByteArray &path, const DirectorySnapshot &snapshot)
+{
+    QMutexLocker locker(&_mutex);
+
+    if (!checkConnect())
+        return;
+
+    if (snapshot._valid) {
+        if (!_setDirectorySnapshotQuery.initOrReset(QByteArrayLiteral(
+                "INSERT OR REPLACE INTO directorysnapshots "
+                "(path, modtime, inode, childcount, childrenhash) "
+                "VALUES (?1, ?2, ?3, ?4, ?5)"), _db)) {
+            return;
+        }
+        _setDirectorySnapshotQuery.bindValue(1, path);
+        _setDirectorySnapshotQuery.bindValue(2, snapshot._modtime);
+        _setDirectorySnapshotQuery.bindValue(3, qint64(snapshot._inode));
+        _setDirectorySnapshotQuery.bindValue(4, snapshot._childCount);
+        _setDirectorySnapshotQuery.bindValue(5, qint64(snapshot._childrenHash));
+        _setDirectorySnapshotQuery.exec();
+    } else {
+        if (!_deleteDirectorySnapshotQuery.initOrReset(QByteArrayLiteral(
+                "DELETE FROM directorysnapshots WHERE path=?1"), _db)) {
+            return;
+        }
+        _deleteDirectorySnapshotQuery.bindValue(1, path);
+        _deleteDirectorySnapshotQuery.exec();
+    }
+}
+
 QVector<SyncJournalDb::DownloadInfo> SyncJournalDb::getAndDeleteStaleDownloadInfos(const QSet<QString> &keep)
 {
     QVector<SyncJournalDb::DownloadInfo> empty_result;
@@ -1597,6 +1758,10 @@ void SyncJournalDb::deleteStaleFlagsEntries()
 
     SqlQuery delQuery("DELETE FROM flags WHERE path != '' AND path NOT IN (SELECT path from metadata);", _db);
     delQuery.exec();
+
+    // Reloaded on next use
+    _pinStates.clear();
+    _pinStatesLoaded = false;
 }
 
 int SyncJournalDb::errorBlackListEntryCount()
@@ -2076,6 +2241,8 @@ void SyncJournalDb::clearFileTable()
     SqlQuery query(_db);
     query.prepare("DELETE FROM metadata;");
     query.exec();
+    query.prepare("DELETE FROM directorysnapshots;");
+    query.exec();
 }
 
 void SyncJournalDb::markVirtualFileForDownloadRecursively(const QByteArray &path)
@@ -2100,92 +2267,55 @@ void SyncJournalDb::markVirtualFileForDownloadRecursively(const QByteArray &path
     query.exec();
 }
 
+bool SyncJournalDb::loadPinStates()
+{
+    if (_pinStatesLoaded)
+        return true;
+
+    SqlQuery query("SELECT path, pinState FROM flags WHERE pinState is not null AND pinState != 0;", _db);
+    if (!query.exec())
+        return false;
+    _pinStates.clear();
+    forever {
+        auto next = query.next();
+        if (!next.ok) {
+            _pinStates.clear();
+            return false;
+        }
+        if (!next.hasData)
+            break;
+        _pinStates.set(query.baValue(0), static_cast<PinState>(query.intValue(1)));
+    }
+    _pinStatesLoaded = true;
+    return true;
+}
+
 Optional<PinState> SyncJournalDb::PinStateInterface::rawForPath(const QByteArray &path)
 {
     QMutexLocker lock(&_db->_mutex);
-    if (!_db->checkConnect())
+    if (!_db->checkConnect() || !_db->loadPinStates())
         return {};
 
-    auto &query = _db->_getRawPinStateQuery;
-    ASSERT(query.initOrReset(QByteArrayLiteral(
-            "SELECT pinState FROM flags WHERE path == ?1;"),
-        _db->_db));
-    query.bindValue(1, path);
-    query.exec();
-
-    auto next = query.next();
-    if (!next.ok)
-        return {};
     // no-entry means Inherited
-    if (!next.hasData)
-        return PinState::Inherited;
-
-    return static_cast<PinState>(query.intValue(0));
+    return _db->_pinStates.raw(path);
 }
 
 Optional<PinState> SyncJournalDb::PinStateInterface::effectiveForPath(const QByteArray &path)
 {
     QMutexLocker lock(&_db->_mutex);
-    if (!_db->checkConnect())
+    if (!_db->checkConnect() || !_db->loadPinStates())
         return {};
 
-    auto &query = _db->_getEffectivePinStateQuery;
-    ASSERT(query.initOrReset(QByteArrayLiteral(
-            "SELECT pinState FROM flags WHERE"
-            // explicitly allow "" to represent the root path
-            // (it'd be great if paths started with a / and "/" could be the root)
-            " (" IS_PREFIX_PATH_OR_EQUAL("path", "?1") " OR path == '')"
-            " AND pinState is not null AND pinState != 0"
-            " ORDER BY length(path) DESC LIMIT 1;"),
-        _db->_db));
-    query.bindValue(1, path);
-    query.exec();
-
-    auto next = query.next();
-    if (!next.ok)
-        return {};
-    // If the root path has no setting, assume AlwaysLocal
-    if (!next.hasData)
-        return PinState::AlwaysLocal;
-
-    return static_cast<PinState>(query.intValue(0));
+    return _db->_pinStates.effective(path);
 }
 
 Optional<PinState> SyncJournalDb::PinStateInterface::effectiveForPathRecursive(const QByteArray &path)
 {
-    // Get the item's effective pin state. We'll compare subitem's pin states
-    // against this.
-    const auto basePin = effectiveForPath(path);
-    if (!basePin)
-        return {};
-
     QMutexLocker lock(&_db->_mutex);
-    if (!_db->checkConnect())
+    if (!_db->checkConnect() || !_db->loadPinStates())
         return {};
 
-    // Find all the non-inherited pin states below the item
-    auto &query = _db->_getSubPinsQuery;
-    ASSERT(query.initOrReset(QByteArrayLiteral(
-            "SELECT DISTINCT pinState FROM flags WHERE"
-            " (" IS_PREFIX_PATH_OF("?1", "path") " OR ?1 == '')"
-            " AND pinState is not null and pinState != 0;"),
-        _db->_db));
-    query.bindValue(1, path);
-    query.exec();
-
-    // Check if they are all identical
-    forever {
-        auto next = query.next();
-        if (!next.ok)
-            return {};
-        if (!next.hasData)
-            break;
-        const auto subPin = static_cast<PinState>(query.intValue(0));
-        if (subPin != *basePin)
-            return PinState::Inherited;
-    }
-
-    return *basePin;
+    return _db->_pinStates.effectiveRecursive(path);
 }
 
 void SyncJournalDb::PinStateInterface::setForPath(const QByteArray &path, PinState state)
@@ -2205,7 +2335,10 @@ void SyncJournalDb::PinStateInterface::setForPath(const QByteArray &path, PinSta
         _db->_db));
     query.bindValue(1, path);
     query.bindValue(2, static_cast<int>(state));
-    query.exec();
+    if (query.exec() && _db->_pinStatesLoaded)
+        _db->_pinStates.set(path, state);
+    else
+        _db->_pinStatesLoaded = false;
 }
 
 void SyncJournalDb::PinStateInterface::wipeForPathAndBelow(const QByteArray &path)
@@ -2221,7 +2354,10 @@ void SyncJournalDb::PinStateInterface::wipeForPathAndBelow(const QByteArray &pat
             " (" IS_PREFIX_PATH_OR_EQUAL("?1", "path") " OR ?1 == '');"),
         _db->_db));
     query.bindValue(1, path);
-    query.exec();
+    if (query.exec() && _db->_pinStatesLoaded)
+        _db->_pinStates.wipe(path);
+    else
+        _db->_pinStatesLoaded = false;
 }
 
 Optional<QVector<QPair<QByteArray, PinState>>>
@@ -2267,6 +2403,30 @@ void SyncJournalDb::commitIfNeededAndStartNewTransaction(const QString &context)
     }
 }
 
+void SyncJournalDb::groupCommit(const QString &context)
+{
+    QMutexLocker lock(&_mutex);
+    if (_groupCommitMaxCommits <= 1 || _transaction != 1) {
+        commitInternal(context);
+        return;
+    }
+    if (++_groupCommitPending >= _groupCommitMaxCommits) {
+        commitInternal(context);
+        return;
+    }
+    if (_groupCommitPending == 1)
+        _groupCommitTimer.start();
+}
+
+void SyncJournalDb::setGroupCommitLimits(int maxCommits, std::chrono::milliseconds maxDelay)
+{
+    QMutexLocker lock(&_mutex);
+    _groupCommitMaxCommits = maxCommits;
+    _groupCommitTimer.setInterval(int(maxDelay.count()));
+    if (maxCommits <= 1 && _groupCommitPending > 0)
+        commitInternal(QStringLiteral("group commits disabled"));
+}
+
 bool SyncJournalDb::open()
 {
     QMutexLocker lock(&_mutex);
@@ -2283,6 +2443,7 @@ void SyncJournalDb::commitInternal(const QString &context, bool startTrans)
 {
     qCDebug(lcDb) << "Transaction commit " << context << (startTrans ? "and starting new transaction" : "");
     commitTransaction();
+    _groupCommitPending = 0;
 
     if (startTrans) {
         startTransaction();
@@ -2316,4 +2477,14 @@ bool operator==(const SyncJournalDb::UploadInfo &lhs,
         && lhs._contentChecksum == rhs._contentChecksum;
 }
 
+bool operator==(const SyncJournalDb::DirectorySnapshot &lhs,
+    const SyncJournalDb::DirectorySnapshot &rhs)
+{
+    return lhs._modtime == rhs._modtime
+        && lhs._inode == rhs._inode
+        && lhs._childCount == rhs._childCount
+        && lhs._childrenHash == rhs._childrenHash
+        && lhs._valid == rhs._valid;
+}
+
 } // namespace OCC
@@ -23,6 +23,8 @@
 #include <qmutex.h>
 #include <QDateTime>
 #include <QHash>
+#include <QTimer>
+#include <chrono>
 #include <functional>
 
 #include "common/utility.h"
@@ -30,6 +32,7 @@
 #include "common/syncjournalfilerecord.h"
 #include "common/result.h"
 #include "common/pinstate.h"
+#include "common/pinstatetrie.h"
 
 namespace OCC {
 class SyncJournalFileRecord;
@@ -59,8 +62,15 @@ public:
     // To verify that the record could be found check with SyncJournalFileRecord::isValid()
     bool getFileRecord(const QString &filename, SyncJournalFileRecord *rec) { return getFileRecord(filename.toUtf8(), rec); }
     bool getFileRecord(const QByteArray &filename, SyncJournalFileRecord *rec);
+    bool getFileRecordByPHash(qint64 phash, SyncJournalFileRecord *rec);
     bool getFileRecordByInode(quint64 inode, SyncJournalFileRecord *rec);
     bool getFileRecordsByFileId(const QByteArray &fileId, const std::function<void(const SyncJournalFileRecord &)> &rowCallback);
+    /** Calls rowCallback with the path hash, inode and file id of every record.
+     *
+     * Used to build in-memory lookup tables without loading the full records.
+     * See getPHash() and getFileRecordByPHash().
+     */
+    bool getFileIdentifiers(const std::function<void(qint64 phash, quint64 inode, const QByteArray &fileId)> &rowCallback);
     bool getFilesBelowPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord&)> &rowCallback);
     bool listFilesInPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord&)> &rowCallback);
     bool setFileRecord(const SyncJournalFileRecord &record);
@@ -72,6 +82,13 @@ public:
     bool updateLocalMetadata(const QString &filename,
         qint64 modtime, qint64 size, quint64 inode);
 
+    /** Counter that changes whenever a file record is written or deleted.
+     *
+     * Lets in-memory lookup tables built with getFileIdentifiers() notice
+     * that they are out of date.
+     */
+    quint64 fileRecordsRevision();
+
     /// Return value for hasHydratedOrDehydratedFiles()
     struct HasHydratedDehydrated
     {
@@ -150,6 +167,29 @@ public:
     // Return the list of transfer ids that were removed.
     QVector<uint> deleteStaleUploadInfos(const QSet<QString> &keep);
 
+    /**
+     * Summary of a local directory, taken when discovery listed it and
+     * found its entries in sync with the database.
+     *
+     * As long as the directory's mtime and inode and the records of its
+     * children are unchanged, the local listing of the directory can be
+     * skipped, see LocalDiscoveryStyle::DirectorySnapshots.
+     */
+    struct DirectorySnapshot
+    {
+        qint64 _modtime = 0;
+        quint64 _inode = 0;
+        int _childCount = 0;
+        quint64 _childrenHash = 0;
+        bool _valid = false;
+
+        /// Hash of the (path, inode, modtime, size) of the records, independent of their order
+        static quint64 hashRecords(const QVector<SyncJournalFileRecord> &records);
+    };
+    DirectorySnapshot getDirectorySnapshot(const QByteArray &path);
+    /// Storing an invalid snapshot deletes the one of the path
+    void setDirectorySnapshot(const QByteArray &path, const DirectorySnapshot &snapshot);
+
     SyncJournalErrorBlacklistRecord errorBlacklistEntry(const QString &);
     bool deleteStaleErrorBlacklistEntries(const QSet<QString> &keep);
 
@@ -216,6 +256,21 @@ public:
     void commit(const QString &context, bool startTrans = true);
     void commitIfNeededAndStartNewTransaction(const QString &context);
 
+    /**
+     * Like commit(), but with group commits enabled the changes may stay in
+     * the open transaction until maxCommits group commits were requested or
+     * maxDelay passed since the first of them. Any commit() writes them too.
+     *
+     * Only use this for changes that the next discovery can reconstruct if
+     * they get lost in a crash, like the records of propagated items. State
+     * that is needed to resume a network operation, like upload and download
+     * infos, must be written with commit() before the operation starts.
+     */
+    void groupCommit(const QString &context);
+
+    /// maxCommits <= 1 disables group commits
+    void setGroupCommitLimits(int maxCommits, std::chrono::milliseconds maxDelay);
+
     /** Open the db if it isn't already.
      *
      * This usually creates some temporary files next to the db file, like
@@ -283,6 +338,9 @@ public:
     /** Grouping for all functions relating to pin states,
      *
      * Use internalPinStates() to get at them.
+     *
+     * The lookups are answered from an in-memory copy of the flags table
+     * that is loaded on first use and updated along with the table.
      */
     struct OCSYNC_EXPORT PinStateInterface
     {
@@ -401,6 +459,12 @@ private:
     QMap<QByteArray, int> _checksymTypeCache;
     int _transaction;
     bool _metadataTableIsEmpty;
+    quint64 _fileRecordsRevision = 0;
+
+    // See groupCommit()
+    int _groupCommitMaxCommits = 1;
+    int _groupCommitPending = 0;
+    QTimer _groupCommitTimer;
 
     SqlQuery _getFileRecordQuery;
     SqlQuery _getFileRecordQueryByInode;
@@ -417,6 +481,9 @@ private:
     SqlQuery _getUploadInfoQuery;
     SqlQuery _setUploadInfoQuery;
     SqlQuery _deleteUploadInfoQuery;
+    SqlQuery _getDirectorySnapshotQuery;
+    SqlQuery _setDirectorySnapshotQuery;
+    SqlQuery _deleteDirectorySnapshotQuery;
     SqlQuery _deleteFileRecordPhash;
     SqlQuery _deleteFileRecordRecursively;
     SqlQuery _getErrorBlacklistQuery;
@@ -431,13 +498,15 @@ private:
     SqlQuery _getConflictRecordQuery;
     SqlQuery _setConflictRecordQuery;
     SqlQuery _deleteConflictRecordQuery;
-    SqlQuery _getRawPinStateQuery;
-    SqlQuery _getEffectivePinStateQuery;
-    SqlQuery _getSubPinsQuery;
     SqlQuery _countDehydratedFilesQuery;
     SqlQuery _setPinStateQuery;
     SqlQuery _wipePinStateQuery;
 
+    // The pin states of the flags table, see PinStateInterface
+    PinStateTrie _pinStates;
+    bool _pinStatesLoaded = false;
+    bool loadPinStates();
+
     /* Storing etags to these folders, or their parent folders, is filtered out.
      *
      * When schedulePathForRemoteDiscovery() is called some etags to _invalid_ in the
@@ -467,6 +536,12 @@ operator==(const SyncJournalDb::DownloadInfo &lhs,
 bool OCSYNC_EXPORT
 operator==(const SyncJournalDb::UploadInfo &lhs,
     const SyncJournalDb::UploadInfo &rhs);
+bool OCSYNC_EXPORT
+operator==(const SyncJournalDb::DirectorySnapshot &lhs,
+    const SyncJournalDb::DirectorySnapshot &rhs);
 
 } // namespace OCC
+
+Q_DECLARE_METATYPE(OCC::SyncJournalDb::DirectorySnapshot)
+
 #endif // SYNCJOURNALDB_H
@@ -232,6 +232,18 @@ static CSYNC_EXCLUDE_TYPE _csync_excluded_common(const QString &path, bool exclu
 
 using namespace OCC;
 
+/**
+ * Results of the traversal GlobMatchers.
+ *
+ * A path can match several patterns; like in the bname regex, exclude
+ * wins over excluderemove and both win over a trigger.
+ */
+enum GlobResult {
+    GlobTrigger = 1,
+    GlobExcludeRemove = 2,
+    GlobExclude = 3
+};
+
 ExcludedFiles::ExcludedFiles()
     : _clientVersion(MIRALL_VERSION_MAJOR, MIRALL_VERSION_MINOR, MIRALL_VERSION_PATCH)
 {
@@ -251,6 +263,7 @@ void ExcludedFiles::addExcludeFilePath(const QString &path)
 void ExcludedFiles::setExcludeConflictFiles(bool onoff)
 {
     _excludeConflictFiles = onoff;
+    _directoryVerdicts.clear();
 }
 
 void ExcludedFiles::addManualExclude(const QString &expr)
@@ -277,6 +290,11 @@ void ExcludedFiles::setClientVersion(ExcludedFiles::Version version)
     _clientVersion = version;
 }
 
+void ExcludedFiles::setUseGlobMatchers(bool onoff)
+{
+    _useGlobMatchers = onoff;
+}
+
 bool ExcludedFiles::reloadExcludeFiles()
 {
     _allExcludes.clear();
@@ -340,19 +358,12 @@ bool ExcludedFiles::isExcluded(
         return true;
     }
 
-    if (excludeHidden) {
-        QString path = filePath;
-        // Check all path subcomponents, but to *not* check the base path:
-        // We do want to be able to sync with a hidden folder as the target.
-        while (path.size() > basePath.size()) {
-            QFileInfo fi(path);
-            if (fi.isHidden() || fi.fileName().startsWith(QLatin1Char('.'))) {
-                return true;
-            }
-
-            // Get the parent path
-            path = fi.absolutePath();
-        }
+    QString relativePath = filePath.mid(basePath.size());
+    if (relativePath.startsWith(QLatin1Char('/'))) {
+        relativePath.remove(0, 1);
+    }
+    if (relativePath.endsWith(QLatin1Char('/'))) {
+        relativePath.chop(1);
     }
 
     QFileInfo fi(filePath);
@@ -361,12 +372,68 @@ bool ExcludedFiles::isExcluded(
         type = ItemTypeDirectory;
     }
 
-    QString relativePath = filePath.mid(basePath.size());
-    if (relativePath.endsWith(QLatin1Char('/'))) {
-        relativePath.chop(1);
+    return isExcludedRelative(relativePath, basePath, type, excludeHidden && fi.isHidden(), excludeHidden);
+}
+
+bool ExcludedFiles::isExcludedRelative(
+    const QString &relativePath,
+    const QString &basePath,
+    ItemType type,
+    bool isHidden,
+    bool excludeHidden) const
+{
+    if (relativePath.isEmpty()) {
+        // We do want to be able to sync with a hidden folder as the target.
+        return false;
+    }
+
+    if (basePath != _directoryVerdictsBasePath || excludeHidden != _directoryVerdictsExcludeHidden) {
+        _directoryVerdicts.clear();
+        _directoryVerdictsBasePath = basePath;
+        _directoryVerdictsExcludeHidden = excludeHidden;
+    }
+
+    const int lastSlash = relativePath.lastIndexOf(QLatin1Char('/'));
+    if (lastSlash > 0 && isDirectoryExcluded(relativePath.left(lastSlash), basePath, excludeHidden)) {
+        return true;
     }
 
-    return fullPatternMatch(relativePath, type) != CSYNC_NOT_EXCLUDED;
+    if (excludeHidden && (isHidden || relativePath.midRef(lastSlash + 1).startsWith(QLatin1Char('.')))) {
+        return true;
+    }
+
+    // The parents are not excluded, so the traversal match is enough
+    return traversalPatternMatch(relativePath, type) != CSYNC_NOT_EXCLUDED;
+}
+
+bool ExcludedFiles::isDirectoryExcluded(const QString &relativePath, const QString &basePath, bool excludeHidden) const
+{
+    auto it = _directoryVerdicts.constFind(relativePath);
+    if (it != _directoryVerdicts.constEnd()) {
+        return *it;
+    }
+
+    bool excluded = false;
+    const int lastSlash = relativePath.lastIndexOf(QLatin1Char('/'));
+    if (lastSlash > 0) {
+        excluded = isDirectoryExcluded(relativePath.left(lastSlash), basePath, excludeHidden);
+    }
+    if (!excluded && excludeHidden) {
+        excluded = relativePath.midRef(lastSlash + 1).startsWith(QLatin1Char('.'))
+            || QFileInfo(QDir(basePath).filePath(relativePath)).isHidden();
+    }
+    if (!excluded) {
+        excluded = traversalPatternMatch(relativePath, ItemTypeDirectory) != CSYNC_NOT_EXCLUDED;
+    }
+
+    // Keep the cache bounded, a sync folder rarely has that many directories
+    // the user is actively looking at
+    static const int maxDirectoryVerdicts = 10000;
+    if (_directoryVerdicts.size() >= maxDirectoryVerdicts) {
+        _directoryVerdicts.clear();
+    }
+    _directoryVerdicts.insert(relativePath, excluded);
+    return excluded;
 }
 
 CSYNC_EXCLUDE_TYPE ExcludedFiles::traversalPatternMatch(const QString &path, ItemType filetype) const
@@ -385,6 +452,30 @@ CSYNC_EXCLUDE_TYPE ExcludedFiles::traversalPatternMatch(const QString &path, Ite
         bnameStr = path.midRef(lastSlash + 1);
     }
 
+    if (_useGlobMatchers && _globMatchersUsable) {
+        const auto &bnameMatcher = filetype == ItemTypeDirectory ? _bnameTraversalMatcherDir : _bnameTraversalMatcherFile;
+        switch (bnameMatcher.matchWhole(bnameStr)) {
+        case GlobExclude:
+            return CSYNC_FILE_EXCLUDE_LIST;
+        case GlobExcludeRemove:
+            return CSYNC_FILE_EXCLUDE_AND_REMOVE;
+        case GlobTrigger:
+            break;
+        default:
+            return CSYNC_NOT_EXCLUDED;
+        }
+
+        const auto &fullMatcher = filetype == ItemTypeDirectory ? _fullTraversalMatcherDir : _fullTraversalMatcherFile;
+        switch (fullMatcher.matchPrefixes(QStringRef(&path))) {
+        case GlobExclude:
+            return CSYNC_FILE_EXCLUDE_LIST;
+        case GlobExcludeRemove:
+            return CSYNC_FILE_EXCLUDE_AND_REMOVE;
+        default:
+            return CSYNC_NOT_EXCLUDED;
+        }
+    }
+
     QRegularExpressionMatch m;
     if (filetype == ItemTypeDirectory) {
         m = _bnameTraversalRegexDir.match(bnameStr);
@@ -574,6 +665,8 @@ QString ExcludedFiles::extractBnameTrigger(const QString &exclude, bool wildcard
 
 void ExcludedFiles::prepare()
 {
+    _directoryVerdicts.clear();
+
     // Build regular expressions for the different cases.
     //
     // To compose the _bnameTraversalRegex, _fullTraversalRegex and _fullRegex
@@ -615,6 +708,22 @@ void ExcludedFiles::prepare()
         pattern.append(appendMe);
     };
 
+    // The glob matchers take the patterns as they are. Like for the regexes,
+    // the Dir matchers get the file-and-dir patterns too.
+    const bool caseInsensitive = OCC::Utility::fsCasePreserving();
+    for (auto matcher : { &_bnameTraversalMatcherFile, &_bnameTraversalMatcherDir, &_fullTraversalMatcherFile, &_fullTraversalMatcherDir }) {
+        matcher->clear();
+        matcher->setCaseInsensitive(caseInsensitive);
+    }
+    _globMatchersUsable = true;
+    auto globAppend = [this](GlobMatcher &fileMatcher, GlobMatcher &dirMatcher, const QString &pattern,
+                          GlobResult result, bool wildcardsMatchSlash, bool dirOnly) {
+        if (!dirOnly && !fileMatcher.addPattern(pattern, result, wildcardsMatchSlash))
+            _globMatchersUsable = false;
+        if (!dirMatcher.addPattern(pattern, result, wildcardsMatchSlash))
+            _globMatchersUsable = false;
+    };
+
     for (auto exclude : _allExcludes) {
         if (exclude[0] == '\n')
             continue; // empty line
@@ -637,16 +746,21 @@ void ExcludedFiles::prepare()
         auto &fullFileDir = removeExcluded ? fullFileDirRemove : fullFileDirKeep;
         auto &fullDir = removeExcluded ? fullDirRemove : fullDirKeep;
 
+        const GlobResult globResult = removeExcluded ? GlobExcludeRemove : GlobExclude;
+
         auto regexExclude = convertToRegexpSyntax(exclude, _wildcardsMatchSlash);
         if (!fullPath) {
             regexAppend(bnameFileDir, bnameDir, regexExclude, matchDirOnly);
+            globAppend(_bnameTraversalMatcherFile, _bnameTraversalMatcherDir, exclude, globResult, _wildcardsMatchSlash, matchDirOnly);
         } else {
             regexAppend(fullFileDir, fullDir, regexExclude, matchDirOnly);
+            globAppend(_fullTraversalMatcherFile, _fullTraversalMatcherDir, exclude, globResult, _wildcardsMatchSlash, matchDirOnly);
 
             // For activation, trigger on the 'bname' part of the full pattern.
             QString bnameExclude = extractBnameTrigger(exclude, _wildcardsMatchSlash);
             auto regexBname = convertToRegexpSyntax(bnameExclude, true);
             regexAppend(bnameTriggerFileDir, bnameTriggerDir, regexBname, matchDirOnly);
+            globAppend(_bnameTraversalMatcherFile, _bnameTraversalMatcherDir, bnameExclude, GlobTrigger, true, matchDirOnly);
         }
     }
 
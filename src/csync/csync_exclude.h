@@ -24,7 +24,9 @@
 #include "ocsynclib.h"
 
 #include "csync.h"
+#include "csync_globmatcher.h"
 
+#include <QHash>
 #include <QObject>
 #include <QSet>
 #include <QString>
@@ -97,6 +99,29 @@ public:
         const QString &basePath,
         bool excludeHidden) const;
 
+    /**
+     * Checks whether a file or directory should be excluded, without
+     * looking at the item on disk.
+     *
+     * The caller knows the item's type and hidden attribute, for example
+     * from the journal or from a file system notification. The verdicts
+     * for its parent directories are cached until the exclude patterns
+     * change, so repeated queries for items in the same directory are cheap.
+     * Only the hidden attribute of a directory is looked up, once, and only
+     * when hidden files are excluded.
+     *
+     * @param relativePath path relative to basePath, should not start with a /
+     * @param basePath     folder path from which to apply exclude rules, ends with a /
+     * @param isHidden     whether the item has the hidden attribute; names
+     *                     starting with a . are considered hidden anyway
+     */
+    bool isExcludedRelative(
+        const QString &relativePath,
+        const QString &basePath,
+        ItemType type,
+        bool isHidden,
+        bool excludeHidden) const;
+
     /**
      * Adds an exclude pattern.
      *
@@ -122,6 +147,12 @@ public:
      */
     void setClientVersion(Version version);
 
+    /**
+     * Whether traversalPatternMatch() uses the glob matchers or the regular
+     * expressions. Only used for testing and benchmarks.
+     */
+    void setUseGlobMatchers(bool onoff);
+
     /**
      * @brief Check if the given path should be excluded in a traversal situation.
      *
@@ -201,9 +232,16 @@ private:
      * Note: The traversal matcher will return not-excluded on some paths that the
      * full matcher would exclude. Example: "b" is excluded. traversal("b/c")
      * returns not-excluded because "c" isn't a bname activation pattern.
+     *
+     * The traversal regexes are mirrored by GlobMatchers that are used instead
+     * if they support all patterns. They do the same but don't suffer from
+     * the regex engine trying hundreds of alternatives for every path.
      */
     void prepare();
 
+    /// Whether a directory or one of its parents is excluded, cached in _directoryVerdicts
+    bool isDirectoryExcluded(const QString &relativePath, const QString &basePath, bool excludeHidden) const;
+
     static QString extractBnameTrigger(const QString &exclude, bool wildcardsMatchSlash);
     static QString convertToRegexpSyntax(QString exclude, bool wildcardsMatchSlash);
 
@@ -224,6 +262,24 @@ private:
     QRegularExpression _fullRegexFile;
     QRegularExpression _fullRegexDir;
 
+    /// see prepare()
+    GlobMatcher _bnameTraversalMatcherFile;
+    GlobMatcher _bnameTraversalMatcherDir;
+    GlobMatcher _fullTraversalMatcherFile;
+    GlobMatcher _fullTraversalMatcherDir;
+    bool _globMatchersUsable = false;
+    bool _useGlobMatchers = true;
+
+    /**
+     * Cached results of isDirectoryExcluded(), by folder-relative path.
+     *
+     * Only valid for _directoryVerdictsBasePath and _directoryVerdictsExcludeHidden,
+     * cleared in prepare() and when it grows too large.
+     */
+    mutable QHash<QString, bool> _directoryVerdicts;
+    mutable QString _directoryVerdictsBasePath;
+    mutable bool _directoryVerdictsExcludeHidden = false;
+
     bool _excludeConflictFiles = true;
 
     /**
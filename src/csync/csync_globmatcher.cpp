@@ -0,0 +1,470 @@
+/*
+ * libcsync -- a library to sync a directory with another
+ *
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "csync_globmatcher.h"
+
+#include <algorithm>
+
+// Upper bound for the cached DFA states, the cache is dropped when it is reached.
+// Each state has a transition table for ASCII, 512 bytes.
+static const int maxDfaStates = 2048;
+
+void GlobMatcher::LiteralTable::clear()
+{
+    _entries.clear();
+    _lengths.clear();
+}
+
+void GlobMatcher::LiteralTable::insert(const QString &text, int result, bool starMatchesSlash)
+{
+    LiteralEntry entry;
+    entry.text = text;
+    entry.result = result;
+    entry.starMatchesSlash = starMatchesSlash;
+    _entries.insert(qHash(QStringRef(&text)), entry);
+
+    auto it = std::lower_bound(_lengths.begin(), _lengths.end(), text.size());
+    if (it == _lengths.end() || *it != text.size())
+        _lengths.insert(it, text.size());
+}
+
+int GlobMatcher::LiteralTable::value(const QStringRef &text, bool restHasSlash) const
+{
+    int result = 0;
+    const uint hash = qHash(text);
+    for (auto it = _entries.constFind(hash); it != _entries.constEnd() && it.key() == hash; ++it) {
+        if (it->text == text && (it->starMatchesSlash || !restHasSlash))
+            result = qMax(result, it->result);
+    }
+    return result;
+}
+
+void GlobMatcher::clear()
+{
+    _patternCount = 0;
+    _literals.clear();
+    _prefixes.clear();
+    _suffixes.clear();
+    _patterns.clear();
+    _classes.clear();
+    resetDfa();
+}
+
+void GlobMatcher::setCaseInsensitive(bool caseInsensitive)
+{
+    _caseInsensitive = caseInsensitive;
+}
+
+bool GlobMatcher::addPattern(const QString &pattern, int result, bool wildcardsMatchSlash)
+{
+    QVector<Token> tokens;
+    if (!parse(pattern, wildcardsMatchSlash, tokens) || tokens.size() >= 0xffff || _patterns.size() >= 0xffff)
+        return false;
+    ++_patternCount;
+
+    // "literal", "literal*" and "*literal" are looked up in the tables
+    int from = 0;
+    int to = tokens.size();
+    bool isPrefix = false;
+    bool isSuffix = false;
+    if (to > 0 && tokens[to - 1].type == Token::AnyString) {
+        isPrefix = true;
+        --to;
+    } else if (to > 0 && tokens[0].type == Token::AnyString) {
+        isSuffix = true;
+        ++from;
+    }
+    const bool isLiteral = std::all_of(tokens.constBegin() + from, tokens.constBegin() + to,
+        [](const Token &token) { return token.type == Token::Literal; });
+    if (isLiteral) {
+        QString text;
+        for (int i = from; i < to; ++i) {
+            const uint c = tokens[i].ch;
+            if (QChar::requiresSurrogates(c)) {
+                text.append(QChar(QChar::highSurrogate(c)));
+                text.append(QChar(QChar::lowSurrogate(c)));
+            } else {
+                text.append(QChar(c));
+            }
+        }
+        if (isPrefix) {
+            _prefixes.insert(text, result, tokens.last().matchesSlash);
+        } else if (isSuffix) {
+            _suffixes.insert(text, result, tokens.first().matchesSlash);
+        } else {
+            _literals.insert(text, result, false);
+        }
+        return true;
+    }
+
+    Pattern p;
+    p.tokens = tokens;
+    p.result = result;
+    _patterns.append(p);
+    resetDfa();
+    return true;
+}
+
+bool GlobMatcher::parse(const QString &pattern, bool wildcardsMatchSlash, QVector<Token> &tokens)
+{
+    // Follows ExcludedFiles::convertToRegexpSyntax()
+    auto addLiteral = [&](uint c) {
+        Token token = { Token::Literal, false, _caseInsensitive ? QChar::toCaseFolded(c) : c };
+        tokens.append(token);
+    };
+    const int len = pattern.size();
+    for (int i = 0; i < len; ++i) {
+        uint c = pattern[i].unicode();
+        switch (c) {
+        case '*':
+            // Several stars are the same as one
+            if (tokens.isEmpty() || tokens.last().type != Token::AnyString) {
+                Token token = { Token::AnyString, wildcardsMatchSlash, 0 };
+                tokens.append(token);
+            }
+            break;
+        case '?': {
+            Token token = { Token::AnyChar, wildcardsMatchSlash, 0 };
+            tokens.append(token);
+            break;
+        }
+        case '[': {
+            // Find the end of the bracket expression
+            int j = i + 1;
+            for (; j < len; ++j) {
+                if (pattern[j] == QLatin1Char(']'))
+                    break;
+                if (j != len - 1 && pattern[j] == QLatin1Char('\\') && pattern[j + 1] == QLatin1Char(']'))
+                    ++j;
+            }
+            if (j == len) {
+                // no matching ], it's a literal [
+                addLiteral(c);
+                break;
+            }
+            CharClass charClass;
+            if (!parseClass(pattern.mid(i + 1, j - i - 1), charClass))
+                return false;
+            Token token = { Token::Class, false, uint(_classes.size()) };
+            tokens.append(token);
+            _classes.append(charClass);
+            i = j;
+            break;
+        }
+        case '\\':
+            if (i == len - 1) {
+                addLiteral(c);
+                break;
+            }
+            // '\*' is a literal *, but '\z' is a literal \ followed by a z
+            switch (pattern[i + 1].unicode()) {
+            case '*':
+            case '?':
+            case '[':
+            case '\\':
+                ++i;
+                addLiteral(pattern[i].unicode());
+                break;
+            default:
+                addLiteral(c);
+                break;
+            }
+            break;
+        default:
+            if (QChar::isHighSurrogate(c) && i + 1 < len && pattern[i + 1].isLowSurrogate()) {
+                ++i;
+                c = QChar::surrogateToUcs4(c, pattern[i].unicode());
+            }
+            addLiteral(c);
+            break;
+        }
+    }
+    return true;
+}
+
+bool GlobMatcher::parseClass(const QString &expr, CharClass &charClass) const
+{
+    // The expression ends up in a regular expression on the fallback path, only
+    // accept what means the same there: characters, ranges and escaped punctuation.
+    const int len = expr.size();
+    int i = 0;
+    if (i < len && (expr[i] == QLatin1Char('!') || expr[i] == QLatin1Char('^'))) {
+        charClass.negated = true;
+        ++i;
+    }
+    if (i == len)
+        return false;
+
+    auto readChar = [&](uint &c) {
+        c = expr[i].unicode();
+        if (c == '\\') {
+            if (i + 1 == len)
+                return false;
+            c = expr[i + 1].unicode();
+            // \d, \w, \x41 and friends
+            if (c < 128 && QChar(c).isLetterOrNumber())
+                return false;
+            i += 2;
+            return true;
+        }
+        // [:alpha:], [.a.] and [=a=]
+        if (c == '[' && i + 1 < len
+            && (expr[i + 1] == QLatin1Char(':') || expr[i + 1] == QLatin1Char('.') || expr[i + 1] == QLatin1Char('='))) {
+            return false;
+        }
+        if (QChar::isHighSurrogate(c) && i + 1 < len && expr[i + 1].isLowSurrogate()) {
+            c = QChar::surrogateToUcs4(c, expr[i + 1].unicode());
+            i += 2;
+            return true;
+        }
+        ++i;
+        return true;
+    };
+
+    while (i < len) {
+        uint first = 0;
+        if (!readChar(first))
+            return false;
+        uint last = first;
+        // A - that is not the last character makes a range
+        if (i + 1 < len && expr[i] == QLatin1Char('-')) {
+            ++i;
+            if (!readChar(last) || last < first)
+                return false;
+        }
+        charClass.ranges.append(qMakePair(first, last));
+    }
+    return true;
+}
+
+bool GlobMatcher::tokenMatches(const Token &token, uint c) const
+{
+    switch (token.type) {
+    case Token::Literal:
+        return token.ch == c;
+    case Token::AnyChar:
+    case Token::AnyString:
+        return token.matchesSlash || c != '/';
+    case Token::Class: {
+        const auto &charClass = _classes[token.ch];
+        auto contains = [&](uint ch) {
+            for (const auto &range : charClass.ranges) {
+                if (ch >= range.first && ch <= range.second)
+                    return true;
+            }
+            return false;
+        };
+        bool found = contains(c);
+        if (!found && _caseInsensitive)
+            found = contains(QChar::toUpper(c)) || contains(QChar::toLower(c));
+        return found != charClass.negated;
+    }
+    }
+    return false;
+}
+
+void GlobMatcher::closure(NfaSet &set) const
+{
+    // A * can match nothing, so the position after it is reached too
+    for (int i = 0; i < set.size(); ++i) {
+        const quint32 position = set[i];
+        const auto &tokens = _patterns[position >> 16].tokens;
+        const int index = position & 0xffff;
+        if (index < tokens.size() && tokens[index].type == Token::AnyString)
+            set.append(position + 1);
+    }
+    std::sort(set.begin(), set.end());
+    set.erase(std::unique(set.begin(), set.end()), set.end());
+}
+
+int GlobMatcher::addDfaState(NfaSet set) const
+{
+    if (set.isEmpty())
+        return deadState;
+    auto it = _dfaStateIds.constFind(set);
+    if (it != _dfaStateIds.constEnd())
+        return *it;
+
+    if (_dfaStates.size() >= maxDfaStates)
+        resetDfa();
+
+    DfaState state;
+    state.result = 0;
+    for (auto position : set) {
+        const auto &pattern = _patterns[position >> 16];
+        if (int(position & 0xffff) == pattern.tokens.size())
+            state.result = qMax(state.result, pattern.result);
+    }
+    state.nfa = set;
+
+    const int id = _dfaStates.size();
+    _dfaStates.append(state);
+    _dfaStateIds.insert(set, id);
+    _asciiTransitions.insert(_asciiTransitions.end(), 128, unknownState);
+    return id;
+}
+
+int GlobMatcher::startState() const
+{
+    if (_startState == unknownState) {
+        NfaSet set;
+        for (int i = 0; i < _patterns.size(); ++i)
+            set.append(quint32(i) << 16);
+        closure(set);
+        _startState = addDfaState(set);
+    }
+    return _startState;
+}
+
+int GlobMatcher::transition(int state, uint c) const
+{
+    if (c < 128) {
+        const int known = _asciiTransitions[state * 128 + c];
+        if (known != unknownState)
+            return known;
+    } else {
+        auto it = _transitions.constFind((quint64(state) << 32) | c);
+        if (it != _transitions.constEnd())
+            return *it;
+    }
+
+    NfaSet next;
+    for (auto position : _dfaStates[state].nfa) {
+        const auto &tokens = _patterns[position >> 16].tokens;
+        const int index = position & 0xffff;
+        if (index == tokens.size() || !tokenMatches(tokens[index], c))
+            continue;
+        next.append(tokens[index].type == Token::AnyString ? position : position + 1);
+    }
+    closure(next);
+
+    const auto generation = _dfaGeneration;
+    const int target = addDfaState(next);
+    if (generation != _dfaGeneration) {
+        // The cache was dropped, state does not exist anymore
+        return target;
+    }
+    if (c < 128) {
+        _asciiTransitions[state * 128 + c] = target;
+    } else {
+        _transitions.insert((quint64(state) << 32) | c, target);
+    }
+    return target;
+}
+
+void GlobMatcher::resetDfa() const
+{
+    _dfaStates.clear();
+    _dfaStateIds.clear();
+    _asciiTransitions.clear();
+    _transitions.clear();
+    _startState = unknownState;
+    ++_dfaGeneration;
+}
+
+int GlobMatcher::matchTables(const QStringRef &str) const
+{
+    int result = _literals.isEmpty() ? 0 : _literals.value(str, false);
+    const int len = str.size();
+    if (!_prefixes.isEmpty()) {
+        const int lastSlash = str.lastIndexOf(QLatin1Char('/'));
+        for (int length : _prefixes.lengths()) {
+            if (length > len)
+                break;
+            result = qMax(result, _prefixes.value(str.left(length), lastSlash >= length));
+        }
+    }
+    if (!_suffixes.isEmpty()) {
+        const int firstSlash = str.indexOf(QLatin1Char('/'));
+        for (int length : _suffixes.lengths()) {
+            if (length > len)
+                break;
+            result = qMax(result, _suffixes.value(str.right(length), firstSlash >= 0 && firstSlash < len - length));
+        }
+    }
+    return result;
+}
+
+int GlobMatcher::matchWhole(const QStringRef &input) const
+{
+    QString folded;
+    QStringRef str = input;
+    if (_caseInsensitive) {
+        folded = input.toString().toCaseFolded();
+        str = QStringRef(&folded);
+    }
+
+    int result = matchTables(str);
+    if (_patterns.isEmpty())
+        return result;
+
+    const int len = str.size();
+    int state = startState();
+    for (int i = 0; i < len && state != deadState; ++i) {
+        uint c = str.at(i).unicode();
+        if (QChar::isHighSurrogate(c) && i + 1 < len && str.at(i + 1).isLowSurrogate()) {
+            ++i;
+            c = QChar::surrogateToUcs4(c, str.at(i).unicode());
+        }
+        state = transition(state, c);
+    }
+    if (state != deadState)
+        result = qMax(result, _dfaStates[state].result);
+    return result;
+}
+
+int GlobMatcher::matchPrefixes(const QStringRef &input) const
+{
+    QString folded;
+    QStringRef str = input;
+    if (_caseInsensitive) {
+        folded = input.toString().toCaseFolded();
+        str = QStringRef(&folded);
+    }
+
+    const int len = str.size();
+    const bool hasTables = !_literals.isEmpty() || !_prefixes.isEmpty() || !_suffixes.isEmpty();
+    int result = 0;
+    int state = _patterns.isEmpty() ? deadState : startState();
+    for (int i = 0; i < len; ++i) {
+        uint c = str.at(i).unicode();
+        if (c == '/') {
+            if (hasTables)
+                result = qMax(result, matchTables(str.left(i)));
+            if (state != deadState)
+                result = qMax(result, _dfaStates[state].result);
+        }
+        if (state == deadState) {
+            if (!hasTables)
+                return result;
+            continue;
+        }
+        if (QChar::isHighSurrogate(c) && i + 1 < len && str.at(i + 1).isLowSurrogate()) {
+            ++i;
+            c = QChar::surrogateToUcs4(c, str.at(i).unicode());
+        }
+        state = transition(state, c);
+    }
+    if (hasTables)
+        result = qMax(result, matchTables(str));
+    if (state != deadState)
+        result = qMax(result, _dfaStates[state].result);
+    return result;
+}
@@ -0,0 +1,170 @@
+/*
+ * libcsync -- a library to sync a directory with another
+ *
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef _CSYNC_GLOBMATCHER_H
+#define _CSYNC_GLOBMATCHER_H
+
+#include "ocsynclib.h"
+
+#include <QHash>
+#include <QMultiHash>
+#include <QString>
+#include <QVector>
+
+/**
+ * Matches a string against many glob patterns at once.
+ *
+ * The patterns use the syntax of the exclude files: * and ? wildcards,
+ * [...] bracket expressions and \ escapes. Each pattern has a result
+ * value, a match returns the highest result of all matching patterns
+ * and 0 if none matches.
+ *
+ * Patterns that are a literal, or a literal with a single leading or
+ * trailing *, are looked up in hash tables by the string or its suffix
+ * or prefix. All other patterns are combined into one automaton that is
+ * turned into a DFA lazily while matching; the DFA states are cached.
+ *
+ * Matching fills the cache, so a GlobMatcher must not be used from
+ * several threads at once.
+ */
+class OCSYNC_EXPORT GlobMatcher
+{
+public:
+    void clear();
+
+    /// Matching ignores the case. Must be set before patterns are added.
+    void setCaseInsensitive(bool caseInsensitive);
+
+    /**
+     * Adds a pattern with a result > 0.
+     *
+     * If wildcardsMatchSlash is false, * and ? do not match a /.
+     *
+     * Returns false if the pattern uses bracket expression syntax that
+     * is not supported, like character classes. The pattern is not
+     * added then.
+     */
+    bool addPattern(const QString &pattern, int result, bool wildcardsMatchSlash);
+
+    bool isEmpty() const { return _patternCount == 0; }
+
+    /// The highest result of the patterns that match the whole string
+    int matchWhole(const QStringRef &str) const;
+
+    /**
+     * The highest result of the patterns that match the string up to its end
+     * or up to one of its slashes.
+     */
+    int matchPrefixes(const QStringRef &str) const;
+
+private:
+    struct Token
+    {
+        enum Type : quint8 {
+            Literal,
+            AnyChar,
+            AnyString,
+            Class
+        };
+        Type type;
+        bool matchesSlash;
+        uint ch; // Literal: the code point, Class: index into _classes
+    };
+
+    struct CharClass
+    {
+        bool negated = false;
+        QVector<QPair<uint, uint>> ranges;
+    };
+
+    struct Pattern
+    {
+        QVector<Token> tokens;
+        int result;
+    };
+
+    // Strings looked up by their hash, so that parts of a string can be
+    // looked up without copying them
+    struct LiteralEntry
+    {
+        QString text;
+        int result;
+        bool starMatchesSlash;
+    };
+    class LiteralTable
+    {
+    public:
+        void clear();
+        void insert(const QString &text, int result, bool starMatchesSlash);
+        int value(const QStringRef &text, bool restHasSlash) const;
+        bool isEmpty() const { return _entries.isEmpty(); }
+        const QVector<int> &lengths() const { return _lengths; }
+
+    private:
+        QMultiHash<uint, LiteralEntry> _entries;
+        QVector<int> _lengths;
+    };
+
+    // A set of positions in the patterns, (pattern index << 16) | token index
+    using NfaSet = QVector<quint32>;
+
+    struct DfaState
+    {
+        NfaSet nfa;
+        int result;
+    };
+
+    enum : int {
+        deadState = -1,
+        unknownState = -2
+    };
+
+    bool parse(const QString &pattern, bool wildcardsMatchSlash, QVector<Token> &tokens);
+    bool parseClass(const QString &expr, CharClass &charClass) const;
+    bool tokenMatches(const Token &token, uint c) const;
+
+    void closure(NfaSet &set) const;
+    int addDfaState(NfaSet set) const;
+    int startState() const;
+    int transition(int state, uint c) const;
+    void resetDfa() const;
+
+    int matchTables(const QStringRef &str) const;
+
+    bool _caseInsensitive = false;
+    int _patternCount = 0;
+
+    LiteralTable _literals;
+    LiteralTable _prefixes; // "literal*"
+    LiteralTable _suffixes; // "*literal"
+
+    QVector<Pattern> _patterns;
+    QVector<CharClass> _classes;
+
+    // The lazily built DFA for _patterns
+    mutable QVector<DfaState> _dfaStates;
+    mutable QHash<NfaSet, int> _dfaStateIds;
+    mutable QVector<int> _asciiTransitions; // 128 per state
+    mutable QHash<quint64, int> _transitions; // (state << 32) | code point, for non-ASCII
+    mutable int _startState = unknownState;
+    mutable quint32 _dfaGeneration = 0;
+};
+
+#endif /* _CSYNC_GLOBMATCHER_H */
@@ -28,6 +28,9 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcAccountState, "gui.account.state", QtInfoMsg)
 
+static const char uploadLimitC[] = "uploadLimit";
+static const char downloadLimitC[] = "downloadLimit";
+
 AccountState::AccountState(AccountPtr account)
     : QObject()
     , _account(account)
@@ -51,14 +54,18 @@ AccountState::~AccountState()
 {
 }
 
-AccountState *AccountState::loadFromSettings(AccountPtr account, QSettings & /*settings*/)
+AccountState *AccountState::loadFromSettings(AccountPtr account, QSettings &settings)
 {
     auto accountState = new AccountState(account);
+    accountState->_uploadLimit = settings.value(QLatin1String(uploadLimitC), 0).toInt();
+    accountState->_downloadLimit = settings.value(QLatin1String(downloadLimitC), 0).toInt();
     return accountState;
 }
 
-void AccountState::writeToSettings(QSettings & /*settings*/)
+void AccountState::writeToSettings(QSettings &settings)
 {
+    settings.setValue(QLatin1String(uploadLimitC), _uploadLimit);
+    settings.setValue(QLatin1String(downloadLimitC), _downloadLimit);
 }
 
 AccountPtr AccountState::account() const
@@ -132,6 +132,15 @@ public:
      */
     void tagLastSuccessfullETagRequest();
 
+    /** Bandwidth limits for all folders of this account, in kB/s.
+     *
+     * 0 means no limit beyond the global one, see Folder::setDirtyNetworkLimits().
+     */
+    int uploadLimit() const { return _uploadLimit; }
+    void setUploadLimit(int kBytesPerSecond) { _uploadLimit = kBytesPerSecond; }
+    int downloadLimit() const { return _downloadLimit; }
+    void setDownloadLimit(int kBytesPerSecond) { _downloadLimit = kBytesPerSecond; }
+
 public slots:
     /// Triggers a ping to the server to update state and
     /// connection status and errors.
@@ -170,6 +179,9 @@ private:
      * Milliseconds for which to delay reconnection after 503/maintenance.
      */
     int _maintenanceToConnectedDelay;
+
+    int _uploadLimit = 0;
+    int _downloadLimit = 0;
 };
 }
 
@@ -17,6 +17,7 @@
 
 #include "account.h"
 #include "accountstate.h"
+#include "bandwidthscheduler.h"
 #include "folder.h"
 #include "folderman.h"
 #include "logger.h"
@@ -320,7 +321,7 @@ void Folder::slotRunEtagJob()
 
     AccountPtr account = _accountState->account();
 
-    if (_requestEtagJob) {
+    if (isEtagCheckRunning()) {
         qCInfo(lcFolder) << remoteUrl().toString() << "has ETag job queued, not trying to sync";
         return;
     }
@@ -525,19 +526,62 @@ int Folder::slotWipeErrorBlacklist()
 
 void Folder::slotWatchedPathChanged(const QString &path)
 {
-    if (!path.startsWith(this->path())) {
-        qCDebug(lcFolder) << "Changed path is not contained in folder, ignoring:" << path;
-        return;
+    slotWatchedPathsChanged(QSet<QString>{ path }, QSet<QString>());
+}
+
+void Folder::slotWatchedPathsChanged(const QSet<QString> &paths, const QSet<QString> &rescanDirectories)
+{
+    // The changes inside these weren't reported one by one. Listing them here
+    // would block the GUI thread: the local discovery of the sync rediscovers
+    // them completely, and finds nothing if the changes were our own.
+    bool needsSync = false;
+    QStringList touchedPaths;
+    QStringList rescannedPaths;
+    for (const auto &path : rescanDirectories) {
+        if (path + QLatin1Char('/') == this->path()) {
+            slotNextSyncFullLocalDiscovery();
+        } else if (path.startsWith(this->path())) {
+            touchedPaths.append(path.mid(this->path().size()));
+            rescannedPaths.append(path);
+        } else {
+            continue;
+        }
+        needsSync = true;
     }
 
-    auto relativePath = path.midRef(this->path().size());
+    QStringList changedPaths;
+    for (const auto &path : paths) {
+        if (!path.startsWith(this->path())) {
+            qCDebug(lcFolder) << "Changed path is not contained in folder, ignoring:" << path;
+            continue;
+        }
+        touchedPaths.append(path.mid(this->path().size()));
+        changedPaths.append(path);
+    }
 
     // Add to list of locally modified paths
     //
     // We do this before checking for our own sync-related changes to make
     // extra sure to not miss relevant changes.
+    _localDiscoveryTracker->addTouchedPaths(touchedPaths);
+
+    for (const auto &path : rescannedPaths)
+        emit watchedFileChangedExternally(path);
+    for (const auto &path : changedPaths) {
+        if (isRelevantWatchedChange(path))
+            needsSync = true;
+    }
+
+    // Also schedule this folder for a sync, but only after some delay:
+    // The sync will not upload files that were changed too recently.
+    if (needsSync)
+        scheduleThisFolderSoon();
+}
+
+bool Folder::isRelevantWatchedChange(const QString &path)
+{
+    auto relativePath = path.midRef(this->path().size());
     auto relativePathBytes = relativePath.toUtf8();
-    _localDiscoveryTracker->addTouchedPath(relativePathBytes);
 
 // The folder watcher fires a lot of bogus notifications during
 // a sync operation, both for actual user files and the database
@@ -550,7 +594,7 @@ void Folder::slotWatchedPathChanged(const QString &path)
     // Use the path to figure out whether it was our own change
     if (_engine->wasFileTouched(path)) {
         qCDebug(lcFolder) << "Changed path was touched by SyncEngine, ignoring:" << path;
-        return;
+        return false;
     }
 #endif
 
@@ -572,16 +616,13 @@ void Folder::slotWatchedPathChanged(const QString &path)
     }
     if (spurious) {
         qCInfo(lcFolder) << "Ignoring spurious notification for file" << relativePath;
-        return; // probably a spurious notification
+        return false; // probably a spurious notification
     }
 
     warnOnNewExcludedItem(record, relativePath);
 
     emit watchedFileChangedExternally(path);
-
-    // Also schedule this folder for a sync, but only after some delay:
-    // The sync will not upload files that were changed too recently.
-    scheduleThisFolderSoon();
+    return true;
 }
 
 void Folder::implicitlyHydrateFile(const QString &relativepath)
@@ -831,6 +872,13 @@ void Folder::startSync(const QStringList &pathList)
             LocalDiscoveryStyle::DatabaseAndFilesystem,
             _localDiscoveryTracker->localDiscoveryPaths());
         _localDiscoveryTracker->startSyncPartialDiscovery();
+    } else if (!hasDoneFullLocalDiscovery && _localDiscoverySnapshotsUsable) {
+        qCInfo(lcFolder) << "Allowing local discovery to read unchanged directories from the database";
+        _engine->setLocalDiscoveryOptions(LocalDiscoveryStyle::DirectorySnapshots);
+        _localDiscoveryTracker->startSyncFullDiscovery();
+        // Files modified in place don't change their directory: the next
+        // sync does the full local discovery, see slotSyncFinished()
+        _localDiscoverySnapshotsUsable = false;
     } else {
         qCInfo(lcFolder) << "Forbidding local discovery to read from the database";
         _engine->setLocalDiscoveryOptions(LocalDiscoveryStyle::FilesystemOnly);
@@ -889,7 +937,17 @@ void Folder::setDirtyNetworkLimits()
         uploadLimit = 0;
     }
 
-    _engine->setNetworkLimits(uploadLimit, downloadLimit);
+    // Absolute limits are shared by all folders, relative ones are
+    // measured per sync run. The limits of the account apply in addition
+    // to the global ones.
+    auto scheduler = BandwidthScheduler::instance();
+    scheduler->setGlobalLimit(BandwidthScheduler::Upload, qMax(0, uploadLimit));
+    scheduler->setGlobalLimit(BandwidthScheduler::Download, qMax(0, downloadLimit));
+    const Account *account = _accountState->account().data();
+    scheduler->setAccountLimit(account, BandwidthScheduler::Upload, qMax(0, _accountState->uploadLimit()) * 1000);
+    scheduler->setAccountLimit(account, BandwidthScheduler::Download, qMax(0, _accountState->downloadLimit()) * 1000);
+
+    _engine->setNetworkLimits(qMin(0, uploadLimit), qMin(0, downloadLimit));
 }
 
 void Folder::slotSyncError(const QString &message, ErrorCategory category)
@@ -986,6 +1044,17 @@ void Folder::slotSyncFinished(bool success)
         // the folder again.
         scheduleThisFolderSoon();
     }
+
+    // A sync that read unchanged directories from their snapshots misses files
+    // modified in place. Don't wait for the next change to do the full local
+    // discovery that finds them.
+    if (_engine->lastLocalDiscoveryStyle() == LocalDiscoveryStyle::DirectorySnapshots
+        && (_syncResult.status() == SyncResult::Success
+            || _syncResult.status() == SyncResult::Problem)
+        && success) {
+        qCInfo(lcFolder) << "Scheduling the full local discovery after the snapshot sync";
+        scheduleThisFolderSoon();
+    }
 }
 
 void Folder::slotEmitFinishedDelayed()
@@ -1075,6 +1144,7 @@ void Folder::slotScheduleThisFolder()
 void Folder::slotNextSyncFullLocalDiscovery()
 {
     _timeSinceLastFullLocalDiscovery.invalidate();
+    _localDiscoverySnapshotsUsable = false;
 }
 
 void Folder::schedulePathForLocalDiscovery(const QString &relativePath)
@@ -1183,8 +1253,8 @@ void Folder::registerFolderWatcher()
         return;
 
     _folderWatcher.reset(new FolderWatcher(this));
-    connect(_folderWatcher.data(), &FolderWatcher::pathChanged,
-        this, &Folder::slotWatchedPathChanged);
+    connect(_folderWatcher.data(), &FolderWatcher::pathsChanged,
+        this, &Folder::slotWatchedPathsChanged);
     connect(_folderWatcher.data(), &FolderWatcher::lostChanges,
         this, &Folder::slotNextSyncFullLocalDiscovery);
     connect(_folderWatcher.data(), &FolderWatcher::becameUnreliable,
@@ -1253,6 +1323,11 @@ void FolderDefinition::save(QSettings &settings, const FolderDefinition &folder)
         settings.setValue(QLatin1String("navigationPaneClsid"), folder.navigationPaneClsid);
     else
         settings.remove(QLatin1String("navigationPaneClsid"));
+
+    if (folder.syncPriority != 0)
+        settings.setValue(QLatin1String("syncPriority"), folder.syncPriority);
+    else
+        settings.remove(QLatin1String("syncPriority"));
 }
 
 bool FolderDefinition::load(QSettings &settings, const QString &alias,
@@ -1265,6 +1340,7 @@ bool FolderDefinition::load(QSettings &settings, const QString &alias,
     folder->paused = settings.value(QLatin1String("paused")).toBool();
     folder->ignoreHiddenFiles = settings.value(QLatin1String("ignoreHiddenFiles"), QVariant(true)).toBool();
     folder->navigationPaneClsid = settings.value(QLatin1String("navigationPaneClsid")).toUuid();
+    folder->syncPriority = settings.value(QLatin1String("syncPriority"), 0).toInt();
 
     folder->virtualFilesMode = Vfs::Off;
     QString vfsModeString = settings.value(QStringLiteral("virtualFilesMode")).toString();
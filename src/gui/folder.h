@@ -24,6 +24,7 @@
 #include "syncoptions.h"
 
 #include <QObject>
+#include <QSet>
 #include <QStringList>
 #include <QUuid>
 #include <set>
@@ -75,6 +76,9 @@ public:
     /// Whether the vfs mode shall silently be updated if possible
     bool upgradeVfsMode = false;
 
+    /// Scheduled folders with a higher priority start syncing first
+    int syncPriority = 0;
+
     /// Saves the folder definition into the current settings group.
     static void save(QSettings &settings, const FolderDefinition &folder);
 
@@ -164,6 +168,8 @@ public:
     void setNavigationPaneClsid(const QUuid &clsid) { _definition.navigationPaneClsid = clsid; }
     QUuid navigationPaneClsid() const { return _definition.navigationPaneClsid; }
 
+    int syncPriority() const { return _definition.syncPriority; }
+
     /**
      * remote folder path with server url
      */
@@ -223,6 +229,10 @@ public:
     Vfs &vfs() { return *_vfs; }
 
     RequestEtagJob *etagJob() { return _requestEtagJob; }
+    /// Whether the root etag is being checked, by etagJob() or by a batched check of FolderMan
+    bool isEtagCheckRunning() const { return _requestEtagJob || _batchedEtagJob; }
+    /// Set by FolderMan while the root etag is checked together with those of sibling folders
+    void setBatchedEtagJob(AbstractNetworkJob *job) { _batchedEtagJob = job; }
     std::chrono::milliseconds msecSinceLastSync() const { return std::chrono::milliseconds(_timeSinceLastSyncDone.elapsed()); }
     std::chrono::milliseconds msecLastSyncDuration() const { return _lastSyncDuration; }
     int consecutiveFollowUpSyncs() const { return _consecutiveFollowUpSyncs; }
@@ -338,6 +348,18 @@ public slots:
        */
     void slotWatchedPathChanged(const QString &path);
 
+    /**
+     * The root etag was retrieved, by the folder's own check or by a
+     * batched one of FolderMan. Schedules a sync if it changed.
+     */
+    void etagRetreived(const QString &);
+
+    /**
+     * Triggered by the folder watcher with the changes of a coalescing
+     * window. The contents of rescanDirectories are rediscovered completely.
+     */
+    void slotWatchedPathsChanged(const QSet<QString> &paths, const QSet<QString> &rescanDirectories);
+
     /**
      * Mark a virtual file as being requested for download, and start a sync.
      *
@@ -378,7 +400,6 @@ private slots:
     void slotItemCompleted(const SyncFileItemPtr &);
 
     void slotRunEtagJob();
-    void etagRetreived(const QString &);
     void etagRetreivedFromSyncEngine(const QString &);
 
     void slotEmitFinishedDelayed();
@@ -422,6 +443,9 @@ private:
 
     void showSyncResultPopup();
 
+    /// Whether a change reported by the watcher is not our own or spurious
+    bool isRelevantWatchedChange(const QString &path);
+
     void checkLocalPath();
 
     void setSyncOptions();
@@ -448,10 +472,19 @@ private:
     SyncResult _syncResult;
     QScopedPointer<SyncEngine> _engine;
     QPointer<RequestEtagJob> _requestEtagJob;
+    QPointer<AbstractNetworkJob> _batchedEtagJob;
     QString _lastEtag;
     QElapsedTimer _timeSinceLastSyncDone;
     QElapsedTimer _timeSinceLastSyncStart;
     QElapsedTimer _timeSinceLastFullLocalDiscovery;
+
+    /**
+     * Whether the first sync of the session may skip the local directories
+     * that are unchanged since the snapshots of the previous run, see
+     * LocalDiscoveryStyle::DirectorySnapshots. It doesn't count as a full
+     * local discovery.
+     */
+    bool _localDiscoverySnapshotsUsable = true;
     std::chrono::milliseconds _lastSyncDuration;
 
     /// The number of syncs that failed in a row.
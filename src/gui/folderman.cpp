@@ -23,6 +23,7 @@
 #include "accountmanager.h"
 #include "filesystem.h"
 #include "lockwatcher.h"
+#include "changenotificationlistener.h"
 #include "common/asserts.h"
 #include <syncengine.h>
 
@@ -47,7 +48,6 @@ FolderMan *FolderMan::_instance = 0;
 
 FolderMan::FolderMan(QObject *parent)
     : QObject(parent)
-    , _currentSyncFolder(0)
     , _syncEnabled(true)
     , _lockWatcher(new LockWatcher)
     , _navigationPaneHelper(this)
@@ -65,6 +65,10 @@ FolderMan::FolderMan(QObject *parent)
     QObject::connect(&_etagPollTimer, &QTimer::timeout, this, &FolderMan::slotEtagPollTimerTimeout);
     _etagPollTimer.start();
 
+    _maxConcurrentSyncs = cfg.maxConcurrentSyncs();
+    if (_maxConcurrentSyncs > 1)
+        qCInfo(lcFolderMan) << "Up to" << _maxConcurrentSyncs << "folders sync at the same time";
+
     _startScheduledSyncTimer.setSingleShot(true);
     connect(&_startScheduledSyncTimer, &QTimer::timeout,
         this, &FolderMan::slotStartScheduledFolderSync);
@@ -143,7 +147,7 @@ int FolderMan::unloadAndDeleteAllFolders()
     ASSERT(_folderMap.isEmpty());
 
     _lastSyncFolder = 0;
-    _currentSyncFolder = 0;
+    _currentSyncFolders.clear();
     _scheduledFolders.clear();
     emit folderListChanged(_folderMap);
     emit scheduleQueueChanged();
@@ -659,6 +663,8 @@ void FolderMan::slotAccountStateChanged()
     }
     QString accountName = accountState->account()->displayName();
 
+    updateChangeListener(accountState);
+
     if (accountState->isConnected()) {
         qCInfo(lcFolderMan) << "Account" << accountName << "connected, scheduling its folders";
 
@@ -713,7 +719,7 @@ void FolderMan::startScheduledSyncSoon()
     if (_scheduledFolders.empty()) {
         return;
     }
-    if (isAnySyncRunning()) {
+    if (runningSyncCount() >= _maxConcurrentSyncs) {
         return;
     }
 
@@ -751,7 +757,7 @@ void FolderMan::startScheduledSyncSoon()
   */
 void FolderMan::slotStartScheduledFolderSync()
 {
-    if (isAnySyncRunning()) {
+    if (runningSyncCount() >= _maxConcurrentSyncs) {
         for (auto f : _folderMap) {
             if (f->isSyncRunning())
                 qCInfo(lcFolderMan) << "Currently folder " << f->remoteUrl().toString() << " is running, wait for finish!";
@@ -769,34 +775,86 @@ void FolderMan::slotStartScheduledFolderSync()
         return;
     }
 
-    // Find the first folder in the queue that can be synced.
-    Folder *folder = 0;
-    while (!_scheduledFolders.isEmpty()) {
-        Folder *g = _scheduledFolders.dequeue();
-        if (g->canSync()) {
-            folder = g;
+    // Start syncing as many folders as allowed
+    while (runningSyncCount() < _maxConcurrentSyncs) {
+        Folder *folder = takeNextScheduledFolder();
+        if (!folder)
             break;
-        }
-    }
 
-    emit scheduleQueueChanged();
-
-    // Start syncing this folder!
-    if (folder) {
         // Safe to call several times, and necessary to try again if
         // the folder path didn't exist previously.
         folder->registerFolderWatcher();
         registerFolderWithSocketApi(folder);
 
-        _currentSyncFolder = folder;
+        _currentSyncFolders.append(folder);
         folder->startSync(QStringList());
     }
+
+    emit scheduleQueueChanged();
+}
+
+Folder *FolderMan::takeNextScheduledFolder()
+{
+    int best = -1;
+    bool bestAccountIdle = false;
+    for (int i = 0; i < _scheduledFolders.size();) {
+        Folder *f = _scheduledFolders.at(i);
+        if (!f->canSync()) {
+            _scheduledFolders.removeAt(i);
+            continue;
+        }
+        // Stays scheduled until its current sync is done
+        if (f->isSyncRunning()) {
+            ++i;
+            continue;
+        }
+
+        bool accountIdle = true;
+        for (auto running : _currentSyncFolders) {
+            if (running->accountState() == f->accountState())
+                accountIdle = false;
+        }
+        if (best == -1
+            || f->syncPriority() > _scheduledFolders.at(best)->syncPriority()
+            || (f->syncPriority() == _scheduledFolders.at(best)->syncPriority() && accountIdle && !bestAccountIdle)) {
+            best = i;
+            bestAccountIdle = accountIdle;
+        }
+        ++i;
+    }
+    if (best == -1)
+        return nullptr;
+    return _scheduledFolders.takeAt(best);
+}
+
+// With a leading and without a trailing slash, "/" for the root
+static QString normalizedRemotePath(QString path)
+{
+    if (!path.startsWith(QLatin1Char('/')))
+        path.prepend(QLatin1Char('/'));
+    while (path.size() > 1 && path.endsWith(QLatin1Char('/')))
+        path.chop(1);
+    return path;
+}
+
+// Folders whose root is in the same Depth:1 listing are checked together
+static QString etagListingPath(const QString &remotePath)
+{
+    const QString path = normalizedRemotePath(remotePath);
+    if (path == QLatin1String("/"))
+        return path;
+    int slash = path.lastIndexOf(QLatin1Char('/'));
+    return slash <= 0 ? QStringLiteral("/") : path.left(slash);
 }
 
 void FolderMan::slotEtagPollTimerTimeout()
 {
     ConfigFile cfg;
     auto polltime = cfg.remotePollInterval();
+    // With change notifications the etag checks are only a fallback
+    const auto notifiedPolltime = qMax<std::chrono::milliseconds>(polltime, std::chrono::minutes(30));
+
+    QHash<QPair<AccountState *, QString>, QList<Folder *>> batches;
 
     foreach (Folder *f, _folderMap) {
         if (!f) {
@@ -811,18 +869,123 @@ void FolderMan::slotEtagPollTimerTimeout()
         if (_disabledFolders.contains(f)) {
             continue;
         }
-        if (f->etagJob() || f->isBusy() || !f->canSync()) {
+        if (f->isEtagCheckRunning() || f->isBusy() || !f->canSync()) {
             continue;
         }
-        if (f->msecSinceLastSync() < polltime) {
+        auto listener = _changeListeners.value(f->accountState());
+        if (f->msecSinceLastSync() < (listener && listener->isActive() ? notifiedPolltime : polltime)) {
             continue;
         }
-        QMetaObject::invokeMethod(f, "slotRunEtagJob", Qt::QueuedConnection);
+        batches[qMakePair(f->accountState(), etagListingPath(f->remotePath()))].append(f);
+    }
+
+    for (auto it = batches.constBegin(); it != batches.constEnd(); ++it) {
+        if (it->size() == 1) {
+            QMetaObject::invokeMethod(it->first(), "slotRunEtagJob", Qt::QueuedConnection);
+        } else {
+            startBatchedEtagJob(it.key().second, *it);
+        }
+    }
+}
+
+void FolderMan::startBatchedEtagJob(const QString &listingPath, const QList<Folder *> &folders)
+{
+    qCInfo(lcFolderMan) << "Checking" << folders.size() << "folders for changes via the ETags in" << listingPath;
+
+    const auto account = folders.first()->accountState()->account();
+    auto job = new LsColJob(account, listingPath, this);
+    job->setProperties(QList<QByteArray>() << "getetag");
+    job->setTimeout(60 * 1000);
+
+    // The folders by their remote path
+    QHash<QString, QPointer<Folder>> folderForPath;
+    QList<QPointer<Folder>> batchFolders;
+    for (auto f : folders) {
+        folderForPath.insert(normalizedRemotePath(f->remotePath()), f);
+        batchFolders.append(f);
+        f->setBatchedEtagJob(job);
+    }
+
+    // The hrefs are full paths, like "/owncloud/remote.php/webdav/listingPath/name"
+    QString davRoot = account->davUrl().path();
+    if (davRoot.endsWith(QLatin1Char('/')))
+        davRoot.chop(1);
+    connect(job, &LsColJob::directoryListingIterated, this,
+        [folderForPath, davRoot](const QString &href, const QMap<QString, QString> &properties) {
+            if (!href.startsWith(davRoot))
+                return;
+            auto folder = folderForPath.value(normalizedRemotePath(href.mid(davRoot.size())));
+            if (!folder || !properties.contains(QStringLiteral("getetag")))
+                return;
+            const QString etagText = properties.value(QStringLiteral("getetag"));
+            const QByteArray parsedTag = parseEtag(etagText.toUtf8());
+            folder->etagRetreived(parsedTag.isEmpty() ? etagText : QString::fromUtf8(parsedTag));
+        });
+    connect(job, &LsColJob::finishedWithError, this, [batchFolders](QNetworkReply *reply) {
+        qCInfo(lcFolderMan) << "Batched ETag check failed:" << reply->errorString() << "- checking the folders one by one";
+        for (const auto &f : batchFolders) {
+            if (f) {
+                f->setBatchedEtagJob(nullptr);
+                QMetaObject::invokeMethod(f, "slotRunEtagJob", Qt::QueuedConnection);
+            }
+        }
+    });
+    job->start();
+}
+
+void FolderMan::updateChangeListener(AccountState *accountState)
+{
+    auto listener = _changeListeners.value(accountState);
+    const bool wanted = accountState->isConnected()
+        && ChangeNotificationListener::isSupported(accountState->account());
+    if (!wanted) {
+        if (listener) {
+            _changeListeners.remove(accountState);
+            delete listener;
+        }
+        return;
+    }
+    if (listener)
+        return;
+
+    qCInfo(lcFolderMan) << "Listening for change notifications of" << accountState->account()->displayName();
+    listener = new ChangeNotificationListener(accountState->account(), this);
+    connect(listener, &ChangeNotificationListener::pathsChanged, this, [this, accountState](const QStringList &paths) {
+        scheduleFoldersForRemoteChanges(accountState, paths);
+    });
+    connect(listener, &ChangeNotificationListener::lostChanges, this, [this, accountState] {
+        scheduleFoldersForRemoteChanges(accountState, { QStringLiteral("/") });
+    });
+    _changeListeners.insert(accountState, listener);
+    listener->start();
+}
+
+void FolderMan::scheduleFoldersForRemoteChanges(AccountState *accountState, const QStringList &paths)
+{
+    auto isAtOrBelow = [](const QString &path, const QString &parent) {
+        return parent == QLatin1String("/")
+            || path == parent
+            || (path.startsWith(parent) && path.at(parent.size()) == QLatin1Char('/'));
+    };
+    for (auto f : _folderMap) {
+        if (!f || f->accountState() != accountState || !f->canSync())
+            continue;
+        const QString root = normalizedRemotePath(f->remotePath());
+        for (const auto &changed : paths) {
+            const QString path = normalizedRemotePath(changed);
+            if (isAtOrBelow(path, root) || isAtOrBelow(root, path)) {
+                qCInfo(lcFolderMan) << "Server notified about changes in" << path << ", scheduling" << f->shortGuiLocalPath();
+                scheduleFolder(f);
+                break;
+            }
+        }
     }
 }
 
 void FolderMan::slotRemoveFoldersForAccount(AccountState *accountState)
 {
+    delete _changeListeners.take(accountState);
+
     QVarLengthArray<Folder *, 16> foldersToRemove;
     Folder::MapIterator i(_folderMap);
     while (i.hasNext()) {
@@ -873,7 +1036,7 @@ void FolderMan::slotScheduleFolderByTime()
     foreach (auto &f, _folderMap) {
         // Never schedule if syncing is disabled or when we're currently
         // querying the server for etags
-        if (!f->canSync() || f->etagJob()) {
+        if (!f->canSync() || f->isEtagCheckRunning()) {
             continue;
         }
 
@@ -914,7 +1077,7 @@ void FolderMan::slotScheduleFolderByTime()
 
 bool FolderMan::isAnySyncRunning() const
 {
-    if (_currentSyncFolder)
+    if (!_currentSyncFolders.isEmpty())
         return true;
 
     for (auto f : _folderMap) {
@@ -955,12 +1118,19 @@ void FolderMan::slotFolderSyncFinished(const SyncResult &)
         qPrintable(f->accountState()->account()->displayName()),
         qPrintable(f->remoteUrl().toString()));
 
-    if (f == _currentSyncFolder) {
-        _lastSyncFolder = _currentSyncFolder;
-        _currentSyncFolder = 0;
+    if (_currentSyncFolders.removeAll(f) > 0)
+        _lastSyncFolder = f;
+    startScheduledSyncSoon();
+}
+
+int FolderMan::runningSyncCount() const
+{
+    int count = _currentSyncFolders.size();
+    for (auto f : _folderMap) {
+        if (f->isSyncRunning() && !_currentSyncFolders.contains(f))
+            ++count;
     }
-    if (!isAnySyncRunning())
-        startScheduledSyncSoon();
+    return count;
 }
 
 Folder *FolderMan::addFolder(AccountState *accountState, const FolderDefinition &folderDefinition)
@@ -1512,7 +1682,12 @@ QQueue<Folder *> FolderMan::scheduleQueue() const
 
 Folder *FolderMan::currentSyncFolder() const
 {
-    return _currentSyncFolder;
+    return _currentSyncFolders.value(0);
+}
+
+QList<Folder *> FolderMan::currentSyncFolders() const
+{
+    return _currentSyncFolders;
 }
 
 void FolderMan::restartApplication()
@@ -33,6 +33,7 @@ class Application;
 class SyncResult;
 class SocketApi;
 class LockWatcher;
+class ChangeNotificationListener;
 
 /**
  * @brief The FolderMan class
@@ -51,6 +52,9 @@ class LockWatcher;
  * - The folder etag on the server has changed
  *   (_etagPollTimer)
  *
+ * - The server notified about remote changes in the folder
+ *   (_changeListeners and scheduleFoldersForRemoteChanges())
+ *
  * - The locks of a monitored file are released
  *   (_lockWatcher and slotWatchedFileUnlocked())
  *
@@ -191,6 +195,13 @@ public:
      */
     Folder *currentSyncFolder() const;
 
+    /**
+     * All folders that are currently syncing as-scheduled.
+     *
+     * Up to ConfigFile::maxConcurrentSyncs() folders sync at the same time.
+     */
+    QList<Folder *> currentSyncFolders() const;
+
     /**
      * Returns true if any folder is currently syncing.
      *
@@ -312,6 +323,33 @@ private:
     /** Will start a sync after a bit of delay. */
     void startScheduledSyncSoon();
 
+    /** Checks the root etags of several folders of an account with one PROPFIND
+     *
+     * The Depth:1 listing of listingPath contains the roots of all folders.
+     * If it fails, the folders check their etags individually.
+     */
+    void startBatchedEtagJob(const QString &listingPath, const QList<Folder *> &folders);
+
+    /// Starts or stops listening for change notifications of the account
+    void updateChangeListener(AccountState *accountState);
+
+    /**
+     * Schedules the folders of the account whose root is one of the paths,
+     * contains one of them or lies below one of them.
+     */
+    void scheduleFoldersForRemoteChanges(AccountState *accountState, const QStringList &paths);
+
+    /** Number of syncs running, scheduled or externally managed ones */
+    int runningSyncCount() const;
+
+    /** Takes the scheduled folder that should sync next from the queue
+     *
+     * Folders with a higher syncPriority go first. Among equal ones, folders
+     * of accounts without a running sync are preferred, so that one account
+     * can't hold up the others. Otherwise the queue order is kept.
+     */
+    Folder *takeNextScheduledFolder();
+
     // finds all folder configuration files
     // and create the folders
     QString getBackupName(QString fullPathName) const;
@@ -327,8 +365,9 @@ private:
     QSet<Folder *> _disabledFolders;
     Folder::Map _folderMap;
     QString _folderConfigPath;
-    Folder *_currentSyncFolder;
+    QList<Folder *> _currentSyncFolders;
     QPointer<Folder> _lastSyncFolder;
+    int _maxConcurrentSyncs;
     bool _syncEnabled;
 
     /// Folder aliases from the settings that weren't read
@@ -339,6 +378,9 @@ private:
     /// The currently running etag query
     QPointer<RequestEtagJob> _currentEtagJob;
 
+    /// Change notification listeners of the connected accounts that support them
+    QHash<AccountState *, ChangeNotificationListener *> _changeListeners;
+
     /// Watches files that couldn't be synced due to locks
     QScopedPointer<LockWatcher> _lockWatcher;
 
@@ -43,6 +43,9 @@ FolderWatcher::FolderWatcher(Folder *folder)
     : QObject(folder)
     , _folder(folder)
 {
+    _coalesceTimer.setSingleShot(true);
+    _coalesceTimer.setInterval(coalesceMsecs);
+    connect(&_coalesceTimer, &QTimer::timeout, this, &FolderWatcher::flushPendingChanges);
 }
 
 FolderWatcher::~FolderWatcher()
@@ -127,6 +130,15 @@ int FolderWatcher::testLinuxWatchCount() const
 #endif
 }
 
+bool FolderWatcher::testLinuxUsesFanotify() const
+{
+#ifdef Q_OS_LINUX
+    return _d->testUsesFanotify();
+#else
+    return false;
+#endif
+}
+
 void FolderWatcher::changeDetected(const QString &path)
 {
     QStringList paths(path);
@@ -149,8 +161,6 @@ void FolderWatcher::changeDetected(const QStringList &paths)
     _lastPaths = pathsSet;
     _timer.restart();
 
-    QSet<QString> changedPaths;
-
     // ------- handle ignores:
     for (int i = 0; i < paths.size(); ++i) {
         QString path = paths[i];
@@ -162,16 +172,61 @@ void FolderWatcher::changeDetected(const QStringList &paths)
             continue;
         }
 
-        changedPaths.insert(path);
+        const QString parentDir = path.left(path.lastIndexOf(QLatin1Char('/')));
+        if (_pendingRescans.contains(parentDir))
+            continue;
+        auto &dirChanges = _pendingChanges[parentDir];
+        dirChanges.insert(path);
+        if (dirChanges.size() > collapseThreshold) {
+            qCInfo(lcFolderWatcher) << "Too many changes in" << parentDir << "- rescanning it";
+            _pendingChanges.remove(parentDir);
+            _pendingRescans.insert(parentDir);
+        }
     }
-    if (changedPaths.isEmpty()) {
-        return;
+
+    // Don't restart a running timer: a stream of changes must not
+    // delay them indefinitely
+    if (!_coalesceTimer.isActive() && (!_pendingChanges.isEmpty() || !_pendingRescans.isEmpty()))
+        _coalesceTimer.start();
+}
+
+void FolderWatcher::flushPendingChanges()
+{
+    auto isInRescannedDirectory = [this](const QString &path) {
+        for (int i = path.lastIndexOf(QLatin1Char('/')); i > 0; i = path.lastIndexOf(QLatin1Char('/'), i - 1)) {
+            if (_pendingRescans.contains(path.left(i)))
+                return true;
+        }
+        return false;
+    };
+
+    QSet<QString> changedPaths;
+    for (const auto &dirChanges : _pendingChanges) {
+        for (const auto &path : dirChanges) {
+            if (!isInRescannedDirectory(path))
+                changedPaths.insert(path);
+        }
+    }
+    QSet<QString> rescanDirectories;
+    for (const auto &dir : _pendingRescans) {
+        if (!isInRescannedDirectory(dir))
+            rescanDirectories.insert(dir);
     }
+    _pendingChanges.clear();
+    _pendingRescans.clear();
+
+    if (changedPaths.isEmpty() && rescanDirectories.isEmpty())
+        return;
 
-    qCInfo(lcFolderWatcher) << "Detected changes in paths:" << changedPaths;
+    qCInfo(lcFolderWatcher) << "Detected changes in" << changedPaths.size() << "paths and" << rescanDirectories.size() << "directories";
+    qCDebug(lcFolderWatcher) << "Changed paths:" << changedPaths << rescanDirectories;
     foreach (const QString &path, changedPaths) {
         emit pathChanged(path);
     }
+    foreach (const QString &path, rescanDirectories) {
+        emit pathChanged(path);
+    }
+    emit pathsChanged(changedPaths, rescanDirectories);
 }
 
 } // namespace OCC
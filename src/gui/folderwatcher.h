@@ -26,8 +26,7 @@
 #include <QHash>
 #include <QScopedPointer>
 #include <QSet>
-
-class QTimer;
+#include <QTimer>
 
 namespace OCC {
 
@@ -43,6 +42,10 @@ class Folder;
  * for changes in the local file system. Changes are signalled
  * through the pathChanged() signal.
  *
+ * The changes are also collected for coalesceMsecs and signalled together
+ * through pathsChanged(). Directories with more than collapseThreshold
+ * changed entries in that time are reported instead of their entries.
+ *
  * @ingroup gui
  */
 
@@ -52,6 +55,12 @@ class FolderWatcher : public QObject
 public:
     // Construct, connect signals, call init()
     explicit FolderWatcher(Folder *folder = 0L);
+
+    /// How long changes are collected before pathsChanged() is emitted
+    static const int coalesceMsecs = 200;
+    /// Changed entries of a directory after which only the directory is reported
+    static const int collapseThreshold = 100;
+
     virtual ~FolderWatcher();
 
     /**
@@ -81,12 +90,23 @@ public:
 
     /// For testing linux behavior only
     int testLinuxWatchCount() const;
+    /// For testing linux behavior only
+    bool testLinuxUsesFanotify() const;
 
 signals:
     /** Emitted when one of the watched directories or one
      *  of the contained files is changed. */
     void pathChanged(const QString &path);
 
+    /**
+     * Emitted with the changes of the last coalescing window.
+     *
+     * paths are the changed files and directories, without the ones inside
+     * rescanDirectories: these had too many changes to list them, all their
+     * contents must be looked at again.
+     */
+    void pathsChanged(const QSet<QString> &paths, const QSet<QString> &rescanDirectories);
+
     /**
      * Emitted if some notifications were lost.
      *
@@ -110,6 +130,7 @@ protected slots:
 
 private slots:
     void startNotificationTestWhenReady();
+    void flushPendingChanges();
 
 protected:
     QHash<QString, int> _pendingPathes;
@@ -119,6 +140,11 @@ private:
     QTime _timer;
     QSet<QString> _lastPaths;
     Folder *_folder;
+
+    // The changes of the current coalescing window, by parent directory
+    QHash<QString, QSet<QString>> _pendingChanges;
+    QSet<QString> _pendingRescans;
+    QTimer _coalesceTimer;
     bool _isReliable = true;
 
     /** Path of the expected test notification */
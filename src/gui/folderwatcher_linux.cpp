@@ -15,22 +15,46 @@
 #include "config.h"
 
 #include <sys/inotify.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/fanotify.h>
 
 #include "folder.h"
 #include "folderwatcher_linux.h"
+#include "configfile.h"
 
 #include <cerrno>
+#include <climits>
 #include <QStringList>
 #include <QObject>
+#include <QThreadPool>
 #include <QVarLengthArray>
 
+// Reporting the directory handle and the name needs Linux 5.9
+#ifdef FAN_REPORT_DFID_NAME
+#define HAVE_FANOTIFY_DFID_NAME
+#endif
+
 namespace OCC {
 
+// The parent of watches that are detached from the tree while they are moved
+static const int detachedParent = -2;
+
 FolderWatcherPrivate::FolderWatcherPrivate(FolderWatcher *p, const QString &path)
     : QObject()
     , _parent(p)
     , _folder(path)
 {
+    if (ConfigFile().folderWatcherBackend() == QLatin1String("fanotify")) {
+        if (fanotifyInit(path)) {
+            _fanotify = true;
+            return;
+        }
+        qCInfo(lcFolderWatcher) << "fanotify is not available, falling back to inotify";
+    }
+
     _fd = inotify_init();
     if (_fd != -1) {
         _socket.reset(new QSocketNotifier(_fd, QSocketNotifier::Read));
@@ -44,43 +68,138 @@ FolderWatcherPrivate::FolderWatcherPrivate(FolderWatcher *p, const QString &path
 
 FolderWatcherPrivate::~FolderWatcherPrivate()
 {
+    if (_walkAbort)
+        _walkAbort->store(1);
+    if (_fanotify) {
+        _socket.reset();
+        close(_fd);
+        close(_fanotifyMountFd);
+    }
 }
 
-// attention: result list passed by reference!
-bool FolderWatcherPrivate::findFoldersBelow(const QDir &dir, QStringList &fullList)
+FolderWatcherWalkJob::FolderWatcherWalkJob(const QString &path, int maxDepth, const QSharedPointer<QAtomicInt> &abort)
+    : QObject()
+    , QRunnable()
+    , _path(path)
+    , _maxDepth(maxDepth)
+    , _abort(abort)
 {
-    bool ok = true;
-    if (!(dir.exists() && dir.isReadable())) {
-        qCDebug(lcFolderWatcher) << "Non existing path coming in: " << dir.absolutePath();
-        ok = false;
+    qRegisterMetaType<QVector<FolderWatcherWalkEntry>>("QVector<FolderWatcherWalkEntry>");
+}
+
+void FolderWatcherWalkJob::run()
+{
+    addEntry(-1, QString());
+    int fd = open(QFile::encodeName(_path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd != -1) {
+        walk(fd, 0, 0);
     } else {
-        QStringList nameFilter;
-        nameFilter << QLatin1String("*");
-        QDir::Filters filter = QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks | QDir::Hidden;
-        const QStringList pathes = dir.entryList(nameFilter, filter);
-
-        QStringList::const_iterator constIterator;
-        for (constIterator = pathes.constBegin(); constIterator != pathes.constEnd();
-             ++constIterator) {
-            const QString fullPath(dir.path() + QLatin1String("/") + (*constIterator));
-            fullList.append(fullPath);
-            ok = findFoldersBelow(QDir(fullPath), fullList);
+        qCDebug(lcFolderWatcher) << "Non existing path coming in: " << _path;
+    }
+    if (!_batch.isEmpty())
+        emit foldersFound(_batch);
+    emit finished();
+}
+
+// Takes ownership of dirFd
+void FolderWatcherWalkJob::walk(int dirFd, int index, int depth)
+{
+    DIR *dir = fdopendir(dirFd);
+    if (!dir) {
+        close(dirFd);
+        return;
+    }
+
+    QVector<QByteArray> subdirs;
+    while (auto dirent = readdir(dir)) {
+        if (qstrcmp(dirent->d_name, ".") == 0 || qstrcmp(dirent->d_name, "..") == 0)
+            continue;
+        bool isDir = dirent->d_type == DT_DIR;
+        if (dirent->d_type == DT_UNKNOWN) {
+            struct stat st;
+            isDir = fstatat(dirfd(dir), dirent->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
         }
+        if (isDir)
+            subdirs.append(QByteArray(dirent->d_name));
+    }
+
+    for (const auto &subdir : subdirs) {
+        if (_abort->load())
+            break;
+        const int childIndex = addEntry(index, QFile::decodeName(subdir));
+        if (_maxDepth != 0 && depth + 1 >= _maxDepth)
+            continue;
+        int childFd = openat(dirfd(dir), subdir.constData(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (childFd != -1)
+            walk(childFd, childIndex, depth + 1);
     }
+    closedir(dir);
+}
 
-    return ok;
+int FolderWatcherWalkJob::addEntry(int parent, const QString &name)
+{
+    _batch.append(FolderWatcherWalkEntry{ parent, name });
+    // Small batches, so that the watches are registered while the walk goes on
+    if (_batch.size() >= 500) {
+        emit foldersFound(_batch);
+        _batch.clear();
+    }
+    return _entryCount++;
 }
 
-void FolderWatcherPrivate::inotifyRegisterPath(const QString &path)
+QString FolderWatcherPrivate::watchPath(int watch) const
 {
+    auto it = _watches.constFind(watch);
+    if (it == _watches.constEnd())
+        return QString();
+    if (it->parent == -1)
+        return it->name;
+    const QString parentPath = watchPath(it->parent);
+    if (parentPath.isNull())
+        return QString();
+    return parentPath + QLatin1Char('/') + it->name;
+}
+
+QString FolderWatcherPrivate::anchorPath(const Anchor &anchor) const
+{
+    if (anchor.watch == -1)
+        return anchor.name;
+    if (anchor.name.isEmpty())
+        return watchPath(anchor.watch);
+    return watchPath(anchor.watch) + QLatin1Char('/') + anchor.name;
+}
+
+FolderWatcherPrivate::Anchor FolderWatcherPrivate::childAnchor(const Anchor &parent, const QString &name)
+{
+    if (parent.name.isEmpty())
+        return Anchor{ parent.watch, name };
+    return Anchor{ parent.watch, parent.name + QLatin1Char('/') + name };
+}
+
+FolderWatcherPrivate::Anchor FolderWatcherPrivate::inotifyRegisterPath(const Anchor &anchor, bool checkIgnored)
+{
+    // The parent went away while its subdirectories were listed
+    if (anchor.watch != -1 && !_watches.contains(anchor.watch))
+        return anchor;
+
+    const QString path = anchorPath(anchor);
     if (path.isEmpty())
-        return;
+        return anchor;
+    if (checkIgnored && _parent->pathIsIgnored(path)) {
+        qCDebug(lcFolderWatcher) << "* Not adding" << path;
+        return anchor;
+    }
 
-    int wd = inotify_add_watch(_fd, path.toUtf8().constData(),
+    int wd = inotify_add_watch(_fd, QFile::encodeName(path).constData(),
         IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT | IN_ONLYDIR);
     if (wd > -1) {
-        _watchToPath.insert(wd, path);
-        _pathToWatch.insert(path, wd);
+        // Already watched, for example found by the walk and by a notification
+        if (_watches.contains(wd))
+            return Anchor{ wd, QString() };
+        _watches.insert(wd, Watch{ anchor.watch, anchor.name, {} });
+        if (anchor.watch != -1)
+            _watches[anchor.watch].children.append(wd);
+        return Anchor{ wd, QString() };
     } else {
         // If we're running out of memory or inotify watches, become
         // unreliable.
@@ -91,42 +210,65 @@ void FolderWatcherPrivate::inotifyRegisterPath(const QString &path)
                    "Check the FAQ for details."));
         }
     }
+    return anchor;
 }
 
 void FolderWatcherPrivate::slotAddFolderRecursive(const QString &path)
 {
-    if (_pathToWatch.contains(path))
-        return;
-
-    int subdirs = 0;
     qCDebug(lcFolderWatcher) << "(+) Watcher:" << path;
 
-    QDir inPath(path);
-    inotifyRegisterPath(inPath.absolutePath());
-
-    QStringList allSubfolders;
-    if (!findFoldersBelow(QDir(path), allSubfolders)) {
-        qCWarning(lcFolderWatcher) << "Could not traverse all sub folders";
-    }
-    QStringListIterator subfoldersIt(allSubfolders);
-    while (subfoldersIt.hasNext()) {
-        QString subfolder = subfoldersIt.next();
-        QDir folder(subfolder);
-        if (folder.exists() && !_pathToWatch.contains(folder.absolutePath())) {
-            subdirs++;
-            if (_parent->pathIsIgnored(subfolder)) {
-                qCDebug(lcFolderWatcher) << "* Not adding" << folder.path();
-                continue;
+    // Walk the subtrees of the root in parallel
+    startWalk(inotifyRegisterPath(Anchor{ -1, QDir(path).absolutePath() }, false), 1);
+}
+
+void FolderWatcherPrivate::addFolderRecursive(int parentWatch, const QString &name)
+{
+    for (int child : _watches.value(parentWatch).children) {
+        if (_watches.value(child).name == name)
+            return;
+    }
+    qCDebug(lcFolderWatcher) << "(+) Watcher:" << name << "in" << watchPath(parentWatch);
+
+    // Watch the new directory right away so its first changes are seen
+    auto anchor = inotifyRegisterPath(Anchor{ parentWatch, name }, false);
+    startWalk(anchor, 0);
+}
+
+void FolderWatcherPrivate::startWalk(const Anchor &root, int maxDepth)
+{
+    if (!_walkAbort)
+        _walkAbort.reset(new QAtomicInt(0));
+
+    auto job = new FolderWatcherWalkJob(anchorPath(root), maxDepth, _walkAbort);
+    // The anchors of the entries found so far
+    auto anchors = QSharedPointer<QVector<Anchor>>::create();
+    connect(job, &FolderWatcherWalkJob::foldersFound, this, [this, root, anchors](const QVector<FolderWatcherWalkEntry> &entries) {
+        for (const auto &entry : entries) {
+            if (entry.parent == -1) {
+                anchors->append(inotifyRegisterPath(root, false));
+            } else {
+                anchors->append(inotifyRegisterPath(childAnchor(anchors->at(entry.parent), entry.name), true));
             }
-            inotifyRegisterPath(folder.absolutePath());
-        } else {
-            qCDebug(lcFolderWatcher) << "    `-> discarded:" << folder.path();
         }
-    }
+    });
+    connect(job, &FolderWatcherWalkJob::finished, this, [this, maxDepth, anchors] {
+        if (maxDepth == 1) {
+            for (int i = 1; i < anchors->size(); ++i) {
+                // Ignored directories, and ones that could not be watched,
+                // got no watch of their own: don't descend into them
+                if (anchors->at(i).name.isEmpty())
+                    startWalk(anchors->at(i), 0);
+            }
+        }
+        if (--_runningWalks == 0) {
+            _ready = true;
+            qCDebug(lcFolderWatcher) << "Watching" << _watches.size() << "directories";
+        }
+    });
 
-    if (subdirs > 0) {
-        qCDebug(lcFolderWatcher) << "    `-> and" << subdirs << "subdirectories";
-    }
+    ++_runningWalks;
+    _ready = false;
+    QThreadPool::globalInstance()->start(job); // QThreadPool takes ownership
 }
 
 void FolderWatcherPrivate::slotReceivedNotification(int fd)
@@ -157,6 +299,9 @@ void FolderWatcherPrivate::slotReceivedNotification(int fd)
         }
     } while (false);
 
+    // Directories moved away, by the cookie that pairs them with their new name
+    QHash<quint32, QVector<QPair<int, QString>>> movedFolders;
+
     // iterate events in buffer
     unsigned int ulen = len;
     for (i = 0; i + sizeof(inotify_event) < ulen; i += sizeof(inotify_event) + (event ? event->len : 0)) {
@@ -178,45 +323,261 @@ void FolderWatcherPrivate::slotReceivedNotification(int fd)
             || fileName.startsWith(".sync_")) {
             continue;
         }
-        const QString p = _watchToPath[event->wd] + '/' + fileName;
+        const QString dir = watchPath(event->wd);
+        if (dir.isNull())
+            continue;
+        const QString name = QFile::decodeName(fileName);
+        const QString p = dir + '/' + name;
         _parent->changeDetected(p);
 
-        if ((event->mask & (IN_MOVED_TO | IN_CREATE))
-            && QFileInfo(p).isDir()
-            && !_parent->pathIsIgnored(p)) {
-            slotAddFolderRecursive(p);
-        }
-        if (event->mask & (IN_MOVED_FROM | IN_DELETE)) {
-            removeFoldersBelow(p);
+        if (!(event->mask & IN_ISDIR))
+            continue;
+        if (event->mask & IN_MOVED_FROM) {
+            movedFolders.insert(event->cookie, detachFoldersBelow(event->wd, name));
+        } else if (event->mask & IN_DELETE) {
+            removeFoldersBelow(event->wd, name);
+        } else if (event->mask & (IN_MOVED_TO | IN_CREATE)) {
+            if (_parent->pathIsIgnored(p))
+                continue;
+            // The watches stay with a renamed directory, only its node moves
+            auto moved = movedFolders.take(event->cookie);
+            if ((event->mask & IN_MOVED_TO) && !moved.isEmpty()) {
+                for (const auto &watch : moved) {
+                    auto &node = _watches[watch.first];
+                    node.parent = event->wd;
+                    node.name = name + watch.second;
+                    _watches[event->wd].children.append(watch.first);
+                }
+            } else {
+                addFolderRecursive(event->wd, name);
+            }
         }
     }
+
+    // Moved out of the watched tree, or ignored at their new place
+    for (const auto &moved : movedFolders) {
+        for (const auto &watch : moved)
+            removeWatch(watch.first);
+    }
 }
 
-void FolderWatcherPrivate::removeFoldersBelow(const QString &path)
+void FolderWatcherPrivate::removeWatch(int watch)
 {
-    auto it = _pathToWatch.find(path);
-    if (it == _pathToWatch.end())
+    auto it = _watches.find(watch);
+    if (it == _watches.end())
         return;
+    const auto children = it->children;
+    const int parent = it->parent;
+    _watches.erase(it);
+    inotify_rm_watch(_fd, watch);
+
+    for (int child : children)
+        removeWatch(child);
+    auto parentIt = _watches.find(parent);
+    if (parentIt != _watches.end())
+        parentIt->children.removeOne(watch);
+}
 
-    QString pathSlash = path + '/';
+QVector<QPair<int, QString>> FolderWatcherPrivate::detachFoldersBelow(int parentWatch, const QString &name)
+{
+    // The suffixes of the names below name, "" for name itself
+    QVector<QPair<int, QString>> detached;
+    auto parentIt = _watches.find(parentWatch);
+    if (parentIt == _watches.end())
+        return detached;
 
-    // Remove the entry and all subentries
-    while (it != _pathToWatch.end()) {
-        auto itPath = it.key();
-        if (!itPath.startsWith(path))
-            break;
-        if (itPath != path && !itPath.startsWith(pathSlash)) {
-            // order is 'foo', 'foo bar', 'foo/bar'
+    auto &children = parentIt->children;
+    for (int i = 0; i < children.size();) {
+        const int child = children.at(i);
+        auto &node = _watches[child];
+        if (node.name == name
+            || (node.name.startsWith(name) && node.name.at(name.size()) == QLatin1Char('/'))) {
+            detached.append(qMakePair(child, node.name.mid(name.size())));
+            node.parent = detachedParent;
+            children.removeAt(i);
+        } else {
+            ++i;
+        }
+    }
+    return detached;
+}
+
+void FolderWatcherPrivate::removeFoldersBelow(int parentWatch, const QString &name)
+{
+    for (const auto &watch : detachFoldersBelow(parentWatch, name)) {
+        qCDebug(lcFolderWatcher) << "Removed watch for" << name << watch.second;
+        removeWatch(watch.first);
+    }
+}
+
+bool FolderWatcherPrivate::fanotifyInit(const QString &path)
+{
+#ifdef HAVE_FANOTIFY_DFID_NAME
+    const QByteArray root = QFile::encodeName(QDir(path).absolutePath());
+
+    // Resolving the reported handles needs CAP_DAC_READ_SEARCH, check that first
+    _fanotifyMountFd = open(root.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (_fanotifyMountFd == -1) {
+        qCWarning(lcFolderWatcher) << "Could not open" << path << strerror(errno);
+        return false;
+    }
+    QByteArray handleBuffer(sizeof(file_handle) + MAX_HANDLE_SZ, 0);
+    auto handle = reinterpret_cast<file_handle *>(handleBuffer.data());
+    handle->handle_bytes = MAX_HANDLE_SZ;
+    int mountId = 0;
+    int testFd = -1;
+    if (name_to_handle_at(AT_FDCWD, root.constData(), handle, &mountId, 0) == 0)
+        testFd = open_by_handle_at(_fanotifyMountFd, handle, O_PATH | O_CLOEXEC);
+    if (testFd == -1) {
+        qCInfo(lcFolderWatcher) << "Cannot resolve file handles:" << strerror(errno);
+        close(_fanotifyMountFd);
+        return false;
+    }
+    close(testFd);
+
+    _fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK | FAN_REPORT_DFID_NAME, O_RDONLY | O_CLOEXEC | O_LARGEFILE);
+    if (_fd == -1) {
+        qCInfo(lcFolderWatcher) << "fanotify_init() failed:" << strerror(errno);
+        close(_fanotifyMountFd);
+        return false;
+    }
+    // Mount marks can't report creations, deletions and renames: mark the file system
+    const uint64_t mask = FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_DELETE_SELF | FAN_MOVE_SELF
+        | FAN_CLOSE_WRITE | FAN_ATTRIB | FAN_ONDIR;
+    if (fanotify_mark(_fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, mask, AT_FDCWD, root.constData()) == -1) {
+        qCInfo(lcFolderWatcher) << "fanotify_mark() failed:" << strerror(errno);
+        close(_fd);
+        close(_fanotifyMountFd);
+        return false;
+    }
+
+    _fanotifyRoot = QDir(path).absolutePath();
+    _fanotifyCanonicalRoot = QDir(path).canonicalPath();
+    _socket.reset(new QSocketNotifier(_fd, QSocketNotifier::Read));
+    connect(_socket.data(), &QSocketNotifier::activated, this, &FolderWatcherPrivate::slotReceivedFanotifyNotification);
+    qCInfo(lcFolderWatcher) << "Using fanotify for" << path;
+    return true;
+#else
+    Q_UNUSED(path);
+    return false;
+#endif
+}
+
+QString FolderWatcherPrivate::fanotifyPathForHandle(const QByteArray &handle)
+{
+#ifdef HAVE_FANOTIFY_DFID_NAME
+    auto it = _fanotifyHandleToPath.constFind(handle);
+    if (it != _fanotifyHandleToPath.constEnd())
+        return *it;
+
+    // The const_cast is fine, open_by_handle_at doesn't modify the handle
+    int fd = open_by_handle_at(_fanotifyMountFd, reinterpret_cast<file_handle *>(const_cast<char *>(handle.constData())), O_PATH | O_CLOEXEC);
+    if (fd == -1)
+        return QString();
+    char target[PATH_MAX];
+    const ssize_t len = readlink(QByteArray("/proc/self/fd/" + QByteArray::number(fd)).constData(), target, sizeof(target));
+    close(fd);
+    if (len <= 0 || len == sizeof(target))
+        return QString();
+
+    // Most events are for few directories, but the whole file system is marked
+    if (_fanotifyHandleToPath.size() > 100000) {
+        _fanotifyHandleToPath.clear();
+        _fanotifyPathToHandle.clear();
+    }
+    const QString path = QFile::decodeName(QByteArray(target, int(len)));
+    // A directory that was replaced without us noticing
+    _fanotifyHandleToPath.remove(_fanotifyPathToHandle.value(path));
+    _fanotifyHandleToPath.insert(handle, path);
+    _fanotifyPathToHandle.insert(path, handle);
+    return path;
+#else
+    Q_UNUSED(handle);
+    return QString();
+#endif
+}
+
+void FolderWatcherPrivate::fanotifyForgetPathsBelow(const QString &path)
+{
+    // Siblings like "path 2" may sort between path and the paths below it
+    auto it = _fanotifyPathToHandle.lowerBound(path);
+    while (it != _fanotifyPathToHandle.end() && it.key().startsWith(path)) {
+        if (it.key().size() == path.size() || it.key().at(path.size()) == QLatin1Char('/')) {
+            _fanotifyHandleToPath.remove(it.value());
+            it = _fanotifyPathToHandle.erase(it);
+        } else {
             ++it;
-            continue;
         }
+    }
+}
+
+void FolderWatcherPrivate::slotReceivedFanotifyNotification(int fd)
+{
+#ifdef HAVE_FANOTIFY_DFID_NAME
+    alignas(fanotify_event_metadata) char buffer[8192];
+    QStringList changedPaths;
+    ssize_t len;
+    while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+        auto metadata = reinterpret_cast<fanotify_event_metadata *>(buffer);
+        for (; FAN_EVENT_OK(metadata, len); metadata = FAN_EVENT_NEXT(metadata, len)) {
+            if (metadata->vers != FANOTIFY_METADATA_VERSION)
+                continue;
+            if (metadata->mask & FAN_Q_OVERFLOW) {
+                qCWarning(lcFolderWatcher) << "fanotify queue overflow";
+                emit _parent->lostChanges();
+                continue;
+            }
+            if (metadata->event_len < sizeof(*metadata) + sizeof(fanotify_event_info_fid))
+                continue;
+            auto fid = reinterpret_cast<fanotify_event_info_fid *>(metadata + 1);
+            if (fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME && fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID)
+                continue;
+            auto handle = reinterpret_cast<file_handle *>(fid->handle);
+            const QByteArray handleData(reinterpret_cast<const char *>(handle), int(sizeof(file_handle) + handle->handle_bytes));
+            QByteArray fileName;
+            if (fid->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME) {
+                fileName = reinterpret_cast<const char *>(handle->f_handle + handle->handle_bytes);
+                if (fileName == ".")
+                    fileName.clear();
+            }
+
+            // Events for other parts of the file system, or in directories
+            // that are gone already; the change of the parent is reported anyway
+            const QString dir = fanotifyPathForHandle(handleData);
 
-        auto wid = it.value();
-        inotify_rm_watch(_fd, wid);
-        _watchToPath.remove(wid);
-        it = _pathToWatch.erase(it);
-        qCDebug(lcFolderWatcher) << "Removed watch for" << itPath;
+            // Renamed or deleted directories make the cached paths below them stale
+            if ((metadata->mask & FAN_ONDIR) && !dir.isEmpty()) {
+                if (metadata->mask & (FAN_MOVED_FROM | FAN_DELETE)) {
+                    if (!fileName.isEmpty())
+                        fanotifyForgetPathsBelow(dir + QLatin1Char('/') + QFile::decodeName(fileName));
+                } else if ((metadata->mask & (FAN_MOVE_SELF | FAN_DELETE_SELF)) && fileName.isEmpty()) {
+                    fanotifyForgetPathsBelow(dir);
+                }
+            }
+            if (dir.isEmpty() || !(dir == _fanotifyCanonicalRoot || dir.startsWith(_fanotifyCanonicalRoot + QLatin1Char('/'))))
+                continue;
+
+            // Filter out journal changes - redundant with filtering in
+            // FolderWatcher::pathIsIgnored.
+            if (fileName.startsWith("._sync_")
+                || fileName.startsWith(".csync_journal.db")
+                || fileName.startsWith(".sync_")) {
+                continue;
+            }
+            QString path = _fanotifyRoot + dir.midRef(_fanotifyCanonicalRoot.size());
+            if (!fileName.isEmpty())
+                path += QLatin1Char('/') + QFile::decodeName(fileName);
+            changedPaths.append(path);
+        }
     }
+    if (len == -1 && errno != EAGAIN)
+        qCWarning(lcFolderWatcher) << "Reading fanotify events failed:" << strerror(errno);
+
+    if (!changedPaths.isEmpty())
+        _parent->changeDetected(changedPaths);
+#else
+    Q_UNUSED(fd);
+#endif
 }
 
 } // ns mirall
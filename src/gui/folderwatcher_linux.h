@@ -19,7 +19,12 @@
 #include <QString>
 #include <QSocketNotifier>
 #include <QHash>
+#include <QMap>
 #include <QDir>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QAtomicInt>
+#include <QVector>
 
 #include "folderwatcher.h"
 
@@ -27,8 +32,63 @@ class QTimer;
 
 namespace OCC {
 
+/// A directory found by FolderWatcherWalkJob; parent is the index of its parent's entry
+struct FolderWatcherWalkEntry
+{
+    int parent;
+    QString name;
+};
+
+/**
+ * @brief Lists the directories below a path for the inotify watcher
+ *
+ * Runs in the thread pool and reads the directories through file
+ * descriptors relative to their parent, using the entry type from
+ * readdir to avoid stat calls. The first entry is the path itself.
+ * The results are reported in batches, parents before their children.
+ *
+ * @ingroup gui
+ */
+class FolderWatcherWalkJob : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    /// maxDepth 0 walks the whole tree, 1 only the direct subdirectories
+    FolderWatcherWalkJob(const QString &path, int maxDepth, const QSharedPointer<QAtomicInt> &abort);
+
+    void run() Q_DECL_OVERRIDE;
+
+signals:
+    void foldersFound(QVector<FolderWatcherWalkEntry> entries);
+    void finished();
+
+private:
+    void walk(int dirFd, int index, int depth);
+    int addEntry(int parent, const QString &name);
+
+    QString _path;
+    int _maxDepth;
+    QSharedPointer<QAtomicInt> _abort;
+    QVector<FolderWatcherWalkEntry> _batch;
+    int _entryCount = 0;
+};
+
 /**
  * @brief Linux (inotify) API implementation of FolderWatcher
+ *
+ * The directories to watch are found by FolderWatcherWalkJob in the
+ * background, the subtrees of the root in parallel, and registered as
+ * they come in. The watches form a tree where every watch only knows its
+ * parent and its name, so renaming a directory just moves its node.
+ *
+ * inotify needs a watch for every directory, which takes long to set up
+ * and can exhaust the user's watches for huge trees. If configured (see
+ * ConfigFile::folderWatcherBackend()) and permitted, a fanotify mark on
+ * the whole file system is used instead. It reports the changed entries
+ * by directory file handle and name, and the handles are resolved to
+ * paths on demand. That needs CAP_SYS_ADMIN and CAP_DAC_READ_SEARCH;
+ * without them the watcher falls back to inotify.
+ *
  * @ingroup gui
  */
 class FolderWatcherPrivate : public QObject
@@ -39,28 +99,75 @@ public:
     FolderWatcherPrivate(FolderWatcher *p, const QString &path);
     ~FolderWatcherPrivate();
 
-    int testWatchCount() const { return _pathToWatch.size(); }
+    int testWatchCount() const { return _watches.size(); }
+    bool testUsesFanotify() const { return _fanotify; }
 
-    /// On linux the watcher is ready when the ctor finished.
+    /// On linux the watcher is ready when all directories were walked.
     bool _ready = 1;
 
 protected slots:
     void slotReceivedNotification(int fd);
     void slotAddFolderRecursive(const QString &path);
+    void slotReceivedFanotifyNotification(int fd);
 
 protected:
-    bool findFoldersBelow(const QDir &dir, QStringList &fullList);
-    void inotifyRegisterPath(const QString &path);
-    void removeFoldersBelow(const QString &path);
+    /**
+     * A path relative to a watched directory, or an absolute one if watch
+     * is -1. The name is empty for the watched directory itself.
+     */
+    struct Anchor
+    {
+        int watch;
+        QString name;
+    };
+
+    QString watchPath(int watch) const;
+    QString anchorPath(const Anchor &anchor) const;
+    static Anchor childAnchor(const Anchor &parent, const QString &name);
+
+    /// Returns the anchor of the new watch, or the given one if the path is not watched
+    Anchor inotifyRegisterPath(const Anchor &anchor, bool checkIgnored);
+    void addFolderRecursive(int parentWatch, const QString &name);
+    void startWalk(const Anchor &root, int maxDepth);
+    void removeWatch(int watch);
+    /// The watches for name and below it, detached from the parent
+    QVector<QPair<int, QString>> detachFoldersBelow(int parentWatch, const QString &name);
+    void removeFoldersBelow(int parentWatch, const QString &name);
+
+    /// Sets up the fanotify mark, false if it is not available
+    bool fanotifyInit(const QString &path);
+    /// The path of a directory reported by fanotify, null if it is gone
+    QString fanotifyPathForHandle(const QByteArray &handle);
+    /// Drops the cached handles of path and the directories below it
+    void fanotifyForgetPathsBelow(const QString &path);
 
 private:
     FolderWatcher *_parent;
 
+    // A watched directory: its name may contain slashes if directories
+    // in between are not watched. The root has parent -1 and an absolute name.
+    struct Watch
+    {
+        int parent;
+        QString name;
+        QVector<int> children;
+    };
+
     QString _folder;
-    QHash<int, QString> _watchToPath;
-    QMap<QString, int> _pathToWatch;
+    QHash<int, Watch> _watches;
     QScopedPointer<QSocketNotifier> _socket;
     int _fd;
+    int _runningWalks = 0;
+    QSharedPointer<QAtomicInt> _walkAbort;
+
+    // fanotify: the paths of directory handles, and the root in both
+    // the canonical form reported by the kernel and the one used by the folder
+    bool _fanotify = false;
+    int _fanotifyMountFd = -1;
+    QHash<QByteArray, QString> _fanotifyHandleToPath;
+    QMap<QString, QByteArray> _fanotifyPathToHandle;
+    QString _fanotifyCanonicalRoot;
+    QString _fanotifyRoot;
 };
 }
 
@@ -55,6 +55,8 @@ BandwidthManager::BandwidthManager(OwncloudPropagator *p)
 {
     _currentUploadLimit = _propagator->_uploadLimit.fetchAndAddAcquire(0);
     _currentDownloadLimit = _propagator->_downloadLimit.fetchAndAddAcquire(0);
+    _uploadBucket.setRate(qMax(qint64(0), _currentUploadLimit));
+    _downloadBucket.setRate(qMax(qint64(0), _currentDownloadLimit));
 
     QObject::connect(&_switchingTimer, &QTimer::timeout, this, &BandwidthManager::switchingTimerExpired);
     _switchingTimer.setInterval(10 * 1000);
@@ -62,9 +64,8 @@ BandwidthManager::BandwidthManager(OwncloudPropagator *p)
     QMetaObject::invokeMethod(this, "switchingTimerExpired", Qt::QueuedConnection);
 
     // absolute uploads/downloads
-    QObject::connect(&_absoluteLimitTimer, &QTimer::timeout, this, &BandwidthManager::absoluteLimitTimerExpired);
-    _absoluteLimitTimer.setInterval(1000);
-    _absoluteLimitTimer.start();
+    QObject::connect(BandwidthScheduler::instance(), &BandwidthScheduler::limitsChanged,
+        this, &BandwidthManager::schedulerLimitsChanged);
 
     // Relative uploads
     QObject::connect(&_relativeUploadMeasuringTimer, &QTimer::timeout,
@@ -89,13 +90,40 @@ BandwidthManager::BandwidthManager(OwncloudPropagator *p)
 
 BandwidthManager::~BandwidthManager()
 {
+    // The scheduler must not use our buckets anymore
+    Q_FOREACH (UploadDevice *ud, _uploadDeviceList) {
+        BandwidthScheduler::instance()->unregisterConsumer(ud);
+    }
+    Q_FOREACH (GETJob *j, _downloadJobList) {
+        BandwidthScheduler::instance()->unregisterConsumer(j);
+    }
+}
+
+bool BandwidthManager::usingSchedulerLimit(BandwidthScheduler::Direction direction)
+{
+    return BandwidthScheduler::instance()->isLimited(_propagator->account().data(), direction);
+}
+
+qint64 BandwidthManager::takeUploadQuota(UploadDevice *device, qint64 wanted)
+{
+    if (!usingAbsoluteUploadLimit())
+        return 0;
+    return BandwidthScheduler::instance()->take(device, wanted);
+}
+
+qint64 BandwidthManager::takeDownloadQuota(GETJob *job, qint64 wanted)
+{
+    if (!usingAbsoluteDownloadLimit())
+        return 0;
+    return BandwidthScheduler::instance()->take(job, wanted);
 }
 
 void BandwidthManager::registerUploadDevice(UploadDevice *p)
 {
-    _absoluteUploadDeviceList.append(p);
-    _relativeUploadDeviceList.append(p);
+    _uploadDeviceList.append(p);
     QObject::connect(p, &QObject::destroyed, this, &BandwidthManager::unregisterUploadDevice);
+    BandwidthScheduler::instance()->registerConsumer(p, _propagator->account().data(),
+        BandwidthScheduler::Upload, &_uploadBucket, "readyRead");
 
     if (usingAbsoluteUploadLimit()) {
         p->setBandwidthLimited(true);
@@ -112,8 +140,8 @@ void BandwidthManager::registerUploadDevice(UploadDevice *p)
 void BandwidthManager::unregisterUploadDevice(QObject *o)
 {
     auto p = reinterpret_cast<UploadDevice *>(o); // note, we might already be in the ~QObject
-    _absoluteUploadDeviceList.removeAll(p);
-    _relativeUploadDeviceList.removeAll(p);
+    _uploadDeviceList.removeAll(p);
+    BandwidthScheduler::instance()->unregisterConsumer(o);
     if (p == _relativeLimitCurrentMeasuredDevice) {
         _relativeLimitCurrentMeasuredDevice = 0;
         _relativeUploadLimitProgressAtMeasuringRestart = 0;
@@ -124,6 +152,8 @@ void BandwidthManager::registerDownloadJob(GETJob *j)
 {
     _downloadJobList.append(j);
     QObject::connect(j, &QObject::destroyed, this, &BandwidthManager::unregisterDownloadJob);
+    BandwidthScheduler::instance()->registerConsumer(j, _propagator->account().data(),
+        BandwidthScheduler::Download, &_downloadBucket, "slotReadyRead");
 
     if (usingAbsoluteDownloadLimit()) {
         j->setBandwidthLimited(true);
@@ -141,6 +171,7 @@ void BandwidthManager::unregisterDownloadJob(QObject *o)
 {
     GETJob *j = reinterpret_cast<GETJob *>(o); // note, we might already be in the ~QObject
     _downloadJobList.removeAll(j);
+    BandwidthScheduler::instance()->unregisterConsumer(o);
     if (_relativeLimitCurrentMeasuredJob == j) {
         _relativeLimitCurrentMeasuredJob = 0;
         _relativeDownloadLimitProgressAtMeasuringRestart = 0;
@@ -149,7 +180,7 @@ void BandwidthManager::unregisterDownloadJob(QObject *o)
 
 void BandwidthManager::relativeUploadMeasuringTimerExpired()
 {
-    if (!usingRelativeUploadLimit() || _relativeUploadDeviceList.count() == 0) {
+    if (!usingRelativeUploadLimit() || _uploadDeviceList.count() == 0) {
         // Not in this limiting mode, just wait 1 sec to continue the cycle
         _relativeUploadDelayTimer.setInterval(1000);
         _relativeUploadDelayTimer.start();
@@ -162,7 +193,7 @@ void BandwidthManager::relativeUploadMeasuringTimerExpired()
         return;
     }
 
-    qCDebug(lcBandwidthManager) << _relativeUploadDeviceList.count() << "Starting Delay";
+    qCDebug(lcBandwidthManager) << _uploadDeviceList.count() << "Starting Delay";
 
     qint64 relativeLimitProgressMeasured = (_relativeLimitCurrentMeasuredDevice->_readWithProgress
                                                + _relativeLimitCurrentMeasuredDevice->_read)
@@ -193,9 +224,9 @@ void BandwidthManager::relativeUploadMeasuringTimerExpired()
     _relativeUploadDelayTimer.setInterval(realWaitTimeMsec);
     _relativeUploadDelayTimer.start();
 
-    int deviceCount = _relativeUploadDeviceList.count();
+    int deviceCount = _uploadDeviceList.count();
     qint64 quotaPerDevice = relativeLimitProgressDifference * (uploadLimitPercent / 100.0) / deviceCount + 1.0;
-    Q_FOREACH (UploadDevice *ud, _relativeUploadDeviceList) {
+    Q_FOREACH (UploadDevice *ud, _uploadDeviceList) {
         ud->setBandwidthLimited(true);
         ud->setChoked(false);
         ud->giveBandwidthQuota(quotaPerDevice);
@@ -213,15 +244,15 @@ void BandwidthManager::relativeUploadDelayTimerExpired()
         return; // oh, not actually needed
     }
 
-    if (_relativeUploadDeviceList.isEmpty()) {
+    if (_uploadDeviceList.isEmpty()) {
         return;
     }
 
-    qCDebug(lcBandwidthManager) << _relativeUploadDeviceList.count() << "Starting measuring";
+    qCDebug(lcBandwidthManager) << _uploadDeviceList.count() << "Starting measuring";
 
     // Take first device and then append it again (= we round robin all devices)
-    _relativeLimitCurrentMeasuredDevice = _relativeUploadDeviceList.takeFirst();
-    _relativeUploadDeviceList.append(_relativeLimitCurrentMeasuredDevice);
+    _relativeLimitCurrentMeasuredDevice = _uploadDeviceList.takeFirst();
+    _uploadDeviceList.append(_relativeLimitCurrentMeasuredDevice);
 
     _relativeUploadLimitProgressAtMeasuringRestart = (_relativeLimitCurrentMeasuredDevice->_readWithProgress
                                                          + _relativeLimitCurrentMeasuredDevice->_read)
@@ -230,7 +261,7 @@ void BandwidthManager::relativeUploadDelayTimerExpired()
     _relativeLimitCurrentMeasuredDevice->setChoked(false);
 
     // choke all other UploadDevices
-    Q_FOREACH (UploadDevice *ud, _relativeUploadDeviceList) {
+    Q_FOREACH (UploadDevice *ud, _uploadDeviceList) {
         if (ud != _relativeLimitCurrentMeasuredDevice) {
             ud->setBandwidthLimited(true);
             ud->setChoked(true);
@@ -341,54 +372,52 @@ void BandwidthManager::switchingTimerExpired()
     if (newUploadLimit != _currentUploadLimit) {
         qCInfo(lcBandwidthManager) << "Upload Bandwidth limit changed" << _currentUploadLimit << newUploadLimit;
         _currentUploadLimit = newUploadLimit;
-        Q_FOREACH (UploadDevice *ud, _relativeUploadDeviceList) {
-            if (newUploadLimit == 0) {
-                ud->setBandwidthLimited(false);
-                ud->setChoked(false);
-            } else if (newUploadLimit > 0) {
-                ud->setBandwidthLimited(true);
-                ud->setChoked(false);
-            } else if (newUploadLimit < 0) {
-                ud->setBandwidthLimited(true);
-                ud->setChoked(true);
-            }
-        }
+        _uploadBucket.setRate(qMax(qint64(0), newUploadLimit));
+        applyUploadLimitMode();
     }
     qint64 newDownloadLimit = _propagator->_downloadLimit.fetchAndAddAcquire(0);
     if (newDownloadLimit != _currentDownloadLimit) {
         qCInfo(lcBandwidthManager) << "Download Bandwidth limit changed" << _currentDownloadLimit << newDownloadLimit;
         _currentDownloadLimit = newDownloadLimit;
-        Q_FOREACH (GETJob *j, _downloadJobList) {
-            if (usingAbsoluteDownloadLimit()) {
-                j->setBandwidthLimited(true);
-                j->setChoked(false);
-            } else if (usingRelativeDownloadLimit()) {
-                j->setBandwidthLimited(true);
-                j->setChoked(true);
-            } else {
-                j->setBandwidthLimited(false);
-                j->setChoked(false);
-            }
-        }
+        _downloadBucket.setRate(qMax(qint64(0), newDownloadLimit));
+        applyDownloadLimitMode();
     }
 }
 
-void BandwidthManager::absoluteLimitTimerExpired()
+void BandwidthManager::schedulerLimitsChanged()
+{
+    applyUploadLimitMode();
+    applyDownloadLimitMode();
+}
+
+void BandwidthManager::applyUploadLimitMode()
 {
-    if (usingAbsoluteUploadLimit() && _absoluteUploadDeviceList.count() > 0) {
-        qint64 quotaPerDevice = _currentUploadLimit / qMax(1, _absoluteUploadDeviceList.count());
-        qCDebug(lcBandwidthManager) << quotaPerDevice << _absoluteUploadDeviceList.count() << _currentUploadLimit;
-        Q_FOREACH (UploadDevice *device, _absoluteUploadDeviceList) {
-            device->giveBandwidthQuota(quotaPerDevice);
-            qCDebug(lcBandwidthManager) << "Gave " << quotaPerDevice / 1024.0 << " kB to" << device;
+    Q_FOREACH (UploadDevice *ud, _uploadDeviceList) {
+        if (usingRelativeUploadLimit()) {
+            ud->setBandwidthLimited(true);
+            ud->setChoked(true);
+        } else if (usingAbsoluteUploadLimit()) {
+            ud->setBandwidthLimited(true);
+            ud->setChoked(false);
+        } else {
+            ud->setBandwidthLimited(false);
+            ud->setChoked(false);
         }
     }
-    if (usingAbsoluteDownloadLimit() && _downloadJobList.count() > 0) {
-        qint64 quotaPerJob = _currentDownloadLimit / qMax(1, _downloadJobList.count());
-        qCDebug(lcBandwidthManager) << quotaPerJob << _downloadJobList.count() << _currentDownloadLimit;
-        Q_FOREACH (GETJob *j, _downloadJobList) {
-            j->giveBandwidthQuota(quotaPerJob);
-            qCDebug(lcBandwidthManager) << "Gave " << quotaPerJob / 1024.0 << " kB to" << j;
+}
+
+void BandwidthManager::applyDownloadLimitMode()
+{
+    Q_FOREACH (GETJob *j, _downloadJobList) {
+        if (usingRelativeDownloadLimit()) {
+            j->setBandwidthLimited(true);
+            j->setChoked(true);
+        } else if (usingAbsoluteDownloadLimit()) {
+            j->setBandwidthLimited(true);
+            j->setChoked(false);
+        } else {
+            j->setBandwidthLimited(false);
+            j->setChoked(false);
         }
     }
 }
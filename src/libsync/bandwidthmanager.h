@@ -20,6 +20,8 @@
 #include <QTimer>
 #include <QIODevice>
 
+#include "bandwidthscheduler.h"
+
 namespace OCC {
 
 class UploadDevice;
@@ -37,11 +39,21 @@ public:
     BandwidthManager(OwncloudPropagator *p);
     ~BandwidthManager();
 
-    bool usingAbsoluteUploadLimit() { return _currentUploadLimit > 0; }
+    /// Absolute limits are this sync run's own ones, and the global and account ones of the BandwidthScheduler
+    bool usingAbsoluteUploadLimit() { return _currentUploadLimit > 0 || (_currentUploadLimit == 0 && usingSchedulerLimit(BandwidthScheduler::Upload)); }
     bool usingRelativeUploadLimit() { return _currentUploadLimit < 0; }
-    bool usingAbsoluteDownloadLimit() { return _currentDownloadLimit > 0; }
+    bool usingAbsoluteDownloadLimit() { return _currentDownloadLimit > 0 || (_currentDownloadLimit == 0 && usingSchedulerLimit(BandwidthScheduler::Download)); }
     bool usingRelativeDownloadLimit() { return _currentDownloadLimit < 0; }
 
+    /** Quota for a limited transfer that used up what it was given.
+     *
+     * With absolute limits the quota comes from the BandwidthScheduler, which
+     * wakes the transfer up again when it returned 0. With relative limits
+     * the quota is handed out by the measuring cycle and this returns 0.
+     */
+    qint64 takeUploadQuota(UploadDevice *device, qint64 wanted);
+    qint64 takeDownloadQuota(GETJob *job, qint64 wanted);
+
 
 public slots:
     void registerUploadDevice(UploadDevice *);
@@ -50,8 +62,8 @@ public slots:
     void registerDownloadJob(GETJob *);
     void unregisterDownloadJob(QObject *);
 
-    void absoluteLimitTimerExpired();
     void switchingTimerExpired();
+    void schedulerLimitsChanged();
 
     void relativeUploadMeasuringTimerExpired();
     void relativeUploadDelayTimerExpired();
@@ -60,6 +72,10 @@ public slots:
     void relativeDownloadDelayTimerExpired();
 
 private:
+    bool usingSchedulerLimit(BandwidthScheduler::Direction direction);
+    void applyUploadLimitMode();
+    void applyDownloadLimitMode();
+
     // for switching between absolute and relative bw limiting
     QTimer _switchingTimer;
 
@@ -67,12 +83,11 @@ private:
     // by the propagator emitting the changed limit values to us as signal
     OwncloudPropagator *_propagator;
 
-    // for absolute up/down bw limiting
-    QTimer _absoluteLimitTimer;
+    // for absolute up/down bw limiting of this sync run, see BandwidthScheduler
+    TokenBucket _uploadBucket;
+    TokenBucket _downloadBucket;
 
-    // FIXME merge these two lists
-    QLinkedList<UploadDevice *> _absoluteUploadDeviceList;
-    QLinkedList<UploadDevice *> _relativeUploadDeviceList;
+    QLinkedList<UploadDevice *> _uploadDeviceList;
 
     QTimer _relativeUploadMeasuringTimer;
 
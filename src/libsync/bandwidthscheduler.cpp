@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "bandwidthscheduler.h"
+#include "account.h"
+
+#include <QLoggingCategory>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcBandwidthScheduler, "sync.bandwidthscheduler", QtInfoMsg)
+
+// The bucket holds 100ms worth of data, but not less than this
+static const qint64 minimumBurst = 4 * 1024;
+// Smallest allowance per tick, to avoid fragmenting the transfers too much
+static const qint64 minimumShare = 1024;
+
+void TokenBucket::setRate(qint64 bytesPerSecond)
+{
+    _rate = qMax(qint64(0), bytesPerSecond);
+    _tokens = qMin(_tokens, double(burst()));
+}
+
+qint64 TokenBucket::burst() const
+{
+    return qMax(minimumBurst, _rate / 10);
+}
+
+void TokenBucket::refill(qint64 nowMsecs)
+{
+    if (_lastRefill >= 0 && nowMsecs > _lastRefill)
+        _tokens = qMin(double(burst()), _tokens + double(_rate) * (nowMsecs - _lastRefill) / 1000.);
+    _lastRefill = nowMsecs;
+}
+
+void TokenBucket::consume(qint64 bytes)
+{
+    _tokens = qMax(0., _tokens - bytes);
+}
+
+BandwidthScheduler *BandwidthScheduler::_instance = nullptr;
+
+BandwidthScheduler *BandwidthScheduler::instance()
+{
+    if (!_instance) {
+        _instance = new BandwidthScheduler();
+    }
+    return _instance;
+}
+
+BandwidthScheduler::BandwidthScheduler()
+{
+    _clock.start();
+    _tickTimer.setInterval(tickMsecs);
+    connect(&_tickTimer, &QTimer::timeout, this, &BandwidthScheduler::slotTick);
+}
+
+void BandwidthScheduler::setGlobalLimit(Direction direction, qint64 bytesPerSecond)
+{
+    if (_global[direction].rate() == bytesPerSecond)
+        return;
+    qCInfo(lcBandwidthScheduler) << "Global" << (direction == Upload ? "upload" : "download") << "limit" << bytesPerSecond;
+    _global[direction].setRate(bytesPerSecond);
+    emit limitsChanged();
+}
+
+qint64 BandwidthScheduler::globalLimit(Direction direction) const
+{
+    return _global[direction].rate();
+}
+
+void BandwidthScheduler::setAccountLimit(const Account *account, Direction direction, qint64 bytesPerSecond)
+{
+    auto it = _accounts.find(account);
+    if (it == _accounts.end()) {
+        if (bytesPerSecond == 0)
+            return;
+        // The buckets go away with the account, a new one may get the same address
+        connect(account, &QObject::destroyed, this, [this, account] { _accounts.remove(account); });
+        it = _accounts.insert(account, {});
+    }
+    auto &bucket = (*it)[direction];
+    if (bucket.rate() == bytesPerSecond)
+        return;
+    qCInfo(lcBandwidthScheduler) << "Account" << account << (direction == Upload ? "upload" : "download") << "limit" << bytesPerSecond;
+    bucket.setRate(bytesPerSecond);
+    emit limitsChanged();
+}
+
+qint64 BandwidthScheduler::accountLimit(const Account *account, Direction direction) const
+{
+    auto it = _accounts.constFind(account);
+    return it == _accounts.constEnd() ? 0 : (*it)[direction].rate();
+}
+
+bool BandwidthScheduler::isLimited(const Account *account, Direction direction) const
+{
+    return globalLimit(direction) > 0 || accountLimit(account, direction) > 0;
+}
+
+void BandwidthScheduler::registerConsumer(QObject *consumer, const Account *account, Direction direction,
+    TokenBucket *localBucket, const char *wakeUpMethod)
+{
+    Consumer c;
+    c.account = account;
+    c.direction = direction;
+    c.localBucket = localBucket;
+    c.wakeUpMethod = wakeUpMethod;
+    _consumers.insert(consumer, c);
+}
+
+void BandwidthScheduler::unregisterConsumer(QObject *consumer)
+{
+    _consumers.remove(consumer);
+}
+
+QVector<TokenBucket *> BandwidthScheduler::bucketsFor(const Consumer &consumer)
+{
+    QVector<TokenBucket *> buckets;
+    if (_global[consumer.direction].isLimited())
+        buckets.append(&_global[consumer.direction]);
+    auto it = _accounts.find(consumer.account);
+    if (it != _accounts.end() && (*it)[consumer.direction].isLimited())
+        buckets.append(&(*it)[consumer.direction]);
+    if (consumer.localBucket && consumer.localBucket->isLimited())
+        buckets.append(consumer.localBucket);
+    return buckets;
+}
+
+int BandwidthScheduler::activeConsumersUsing(const TokenBucket *bucket, const Consumer &consumer, qint64 slot) const
+{
+    const bool isGlobal = bucket == &_global[consumer.direction];
+    const bool isLocal = bucket == consumer.localBucket;
+    int count = 0;
+    for (const auto &other : _consumers) {
+        // Transfers that are queued in the network layer don't count
+        if (other.direction != consumer.direction || other.lastActiveSlot < slot - 2)
+            continue;
+        if (isGlobal
+            || (isLocal && other.localBucket == bucket)
+            || (!isLocal && other.account == consumer.account)) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+qint64 BandwidthScheduler::take(QObject *consumer, qint64 wanted)
+{
+    auto it = _consumers.find(consumer);
+    if (it == _consumers.end() || wanted <= 0)
+        return wanted;
+
+    const auto buckets = bucketsFor(*it);
+    if (buckets.isEmpty())
+        return wanted;
+
+    const qint64 now = _clock.elapsed();
+    const qint64 slot = now / tickMsecs;
+    if (it->slot != slot) {
+        it->slot = slot;
+        it->takenInSlot = 0;
+    }
+    it->lastActiveSlot = slot;
+
+    qint64 granted = wanted;
+    for (auto bucket : buckets) {
+        bucket->refill(now);
+        // With several active transfers each one gets its part of the rate per tick
+        const int active = activeConsumersUsing(bucket, *it, slot);
+        const qint64 allowance = active <= 1
+            ? bucket->burst()
+            : qMax(minimumShare, bucket->rate() * tickMsecs / 1000 / active);
+        granted = qMin(granted, qMin(allowance - it->takenInSlot, bucket->available()));
+    }
+
+    if (granted <= 0) {
+        if (!_waiting.contains(consumer))
+            _waiting.append(consumer);
+        if (!_tickTimer.isActive())
+            _tickTimer.start();
+        return 0;
+    }
+    for (auto bucket : buckets)
+        bucket->consume(granted);
+    it->takenInSlot += granted;
+    return granted;
+}
+
+void BandwidthScheduler::slotTick()
+{
+    // Wake up the waiting consumers in the order they ran out of quota.
+    // The ones that don't get anything queue up again at the end.
+    const auto waiting = _waiting;
+    _waiting.clear();
+    for (const auto &consumer : waiting) {
+        if (!consumer)
+            continue;
+        auto it = _consumers.constFind(consumer.data());
+        if (it == _consumers.constEnd())
+            continue;
+        QMetaObject::invokeMethod(consumer.data(), it->wakeUpMethod, Qt::QueuedConnection);
+    }
+    if (_waiting.isEmpty() && waiting.isEmpty())
+        _tickTimer.stop();
+}
+}
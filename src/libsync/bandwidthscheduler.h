@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#pragma once
+
+#include "owncloudlib.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+
+#include <array>
+
+namespace OCC {
+
+class Account;
+
+/**
+ * @brief Bytes that may be transferred, refilled at a fixed rate
+ *
+ * At most burst() bytes accumulate while nobody takes them.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT TokenBucket
+{
+public:
+    /// 0 means unlimited
+    void setRate(qint64 bytesPerSecond);
+    qint64 rate() const { return _rate; }
+    bool isLimited() const { return _rate > 0; }
+
+    /// Adds the tokens for the time since the last refill; nowMsecs is monotonic
+    void refill(qint64 nowMsecs);
+
+    qint64 available() const { return qint64(_tokens); }
+    void consume(qint64 bytes);
+    qint64 burst() const;
+
+private:
+    qint64 _rate = 0;
+    double _tokens = 0;
+    qint64 _lastRefill = -1;
+};
+
+/**
+ * @brief Process-wide bandwidth limiting of all transfers
+ *
+ * Uploads and downloads of all folders take their quota from token buckets:
+ * a global one per direction, one per account and direction, and optionally
+ * one owned by the BandwidthManager of their sync run. A transfer may only
+ * proceed with bytes available in all limited buckets that apply to it.
+ *
+ * The buckets are refilled continuously; transfers that found them empty
+ * are woken up round-robin every tickMsecs. To share a bucket fairly, a
+ * transfer gets at most the bucket's rate divided by the number of
+ * transfers that recently used it, per tick.
+ *
+ * All functions must be called from the main thread.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT BandwidthScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    enum Direction {
+        Upload = 0,
+        Download = 1
+    };
+
+    static const int tickMsecs = 50;
+
+    static BandwidthScheduler *instance();
+
+    /// Limits in bytes per second, 0 for unlimited
+    void setGlobalLimit(Direction direction, qint64 bytesPerSecond);
+    qint64 globalLimit(Direction direction) const;
+    void setAccountLimit(const Account *account, Direction direction, qint64 bytesPerSecond);
+    qint64 accountLimit(const Account *account, Direction direction) const;
+
+    /// Whether the global or the account limit applies to transfers of the account
+    bool isLimited(const Account *account, Direction direction) const;
+
+    /** Registers a transfer.
+     *
+     * localBucket may be null; it is not owned. wakeUpMethod is invoked
+     * (queued) on the consumer after a take() returned 0 and quota is
+     * available again.
+     */
+    void registerConsumer(QObject *consumer, const Account *account, Direction direction,
+        TokenBucket *localBucket, const char *wakeUpMethod);
+    void unregisterConsumer(QObject *consumer);
+
+    /** Returns how many of the wanted bytes the consumer may transfer now.
+     *
+     * Consumers that are not registered are not limited.
+     */
+    qint64 take(QObject *consumer, qint64 wanted);
+
+signals:
+    void limitsChanged();
+
+private slots:
+    void slotTick();
+
+private:
+    BandwidthScheduler();
+    static BandwidthScheduler *_instance;
+
+    struct Consumer
+    {
+        const Account *account;
+        Direction direction;
+        TokenBucket *localBucket;
+        const char *wakeUpMethod;
+
+        // Fair sharing: bytes taken in the current tick
+        qint64 slot = -1;
+        qint64 takenInSlot = 0;
+        qint64 lastActiveSlot = -1;
+    };
+
+    QVector<TokenBucket *> bucketsFor(const Consumer &consumer);
+    int activeConsumersUsing(const TokenBucket *bucket, const Consumer &consumer, qint64 slot) const;
+
+    std::array<TokenBucket, 2> _global;
+    QHash<const Account *, std::array<TokenBucket, 2>> _accounts; // removed when the account is destroyed
+    QHash<QObject *, Consumer> _consumers;
+    QList<QPointer<QObject>> _waiting;
+    QElapsedTimer _clock;
+    QTimer _tickTimer;
+};
+}
@@ -136,6 +136,26 @@ bool Capabilities::chunkingParallelUploadDisabled() const
     return _capabilities["dav"].toMap()["chunkingParallelUploadDisabled"].toBool();
 }
 
+bool Capabilities::propfindDepthInfinity() const
+{
+    static const auto depthInfinity = qgetenv("OWNCLOUD_PROPFIND_DEPTH_INFINITY");
+    if (depthInfinity == "0")
+        return false;
+    if (depthInfinity == "1")
+        return true;
+    return _capabilities["dav"].toMap()["propfind"].toMap()["depth_infinity"].toBool();
+}
+
+bool Capabilities::bulkUpload() const
+{
+    static const auto bulkUpload = qgetenv("OWNCLOUD_BULK_UPLOAD");
+    if (bulkUpload == "0")
+        return false;
+    if (bulkUpload == "1")
+        return true;
+    return _capabilities["dav"].toMap()["bulkupload"].toByteArray() >= "1.0";
+}
+
 bool Capabilities::privateLinkPropertyAvailable() const
 {
     return _capabilities["files"].toMap()["privateLinks"].toBool();
@@ -175,6 +195,11 @@ bool Capabilities::versioningEnabled() const
     return _capabilities["files"].toMap()["versioning"].toBool();
 }
 
+QString Capabilities::changeNotificationsEndpoint() const
+{
+    return _capabilities[QStringLiteral("core")].toMap()[QStringLiteral("change-notifications")].toMap()[QStringLiteral("endpoint")].toString();
+}
+
 QString Capabilities::zsyncSupportedVersion() const
 {
     return _capabilities[QStringLiteral("dav")].toMap()[QStringLiteral("zsync")].toString();
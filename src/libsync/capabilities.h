@@ -49,6 +49,28 @@ public:
     /// disable parallel upload in chunking
     bool chunkingParallelUploadDisabled() const;
 
+    /**
+     * Whether the server accepts PROPFIND requests with "Depth: infinity".
+     *
+     * Used to list a whole new remote subtree with a single request during
+     * discovery instead of one request per directory.
+     *
+     * Path: dav/propfind/depth_infinity
+     * Default: false
+     */
+    bool propfindDepthInfinity() const;
+
+    /**
+     * Whether the server accepts several small files in one multipart POST.
+     *
+     * Used to upload many small new or changed files with fewer requests,
+     * see PropagateUploadFileBulk.
+     *
+     * Path: dav/bulkupload (version, at least "1.0")
+     * Default: false
+     */
+    bool bulkUpload() const;
+
     /// Whether the "privatelink" DAV property is available
     bool privateLinkPropertyAvailable() const;
 
@@ -134,6 +156,19 @@ public:
     /** Is versioning available? */
     bool versioningEnabled() const;
 
+    /**
+     * OCS path the client can long-poll to learn about remote changes.
+     *
+     * The endpoint answers when something changed below a folder root, or
+     * after a server-side timeout, with the changed paths and a cursor to
+     * pass in the next request. See ChangeNotificationListener.
+     *
+     * Path: core/change-notifications/endpoint
+     * Default: empty, meaning "not supported"
+     * Example: "ocs/v2.php/apps/notify_push/changes"
+     */
+    QString changeNotificationsEndpoint() const;
+
 private:
     QVariantMap _capabilities;
 };
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "changenotificationlistener.h"
+#include "account.h"
+#include "capabilities.h"
+#include "networkjobs.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QNetworkReply>
+#include <QUrlQuery>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcChangeNotifications, "sync.changenotifications", QtInfoMsg)
+
+// Give the server some time to answer after its own timeout
+static const int pollTimeoutMarginMsecs = 30 * 1000;
+
+ChangeNotificationListener::ChangeNotificationListener(AccountPtr account, QObject *parent)
+    : QObject(parent)
+    , _account(account)
+{
+    _retryTimer.setSingleShot(true);
+    connect(&_retryTimer, &QTimer::timeout, this, &ChangeNotificationListener::sendRequest);
+}
+
+ChangeNotificationListener::~ChangeNotificationListener()
+{
+    stop();
+}
+
+bool ChangeNotificationListener::isSupported(const AccountPtr &account)
+{
+    return !account->capabilities().changeNotificationsEndpoint().isEmpty();
+}
+
+void ChangeNotificationListener::start()
+{
+    if (_running)
+        return;
+    _running = true;
+    _retryMsecs = minimumRetryMsecs;
+    sendRequest();
+}
+
+void ChangeNotificationListener::stop()
+{
+    _running = false;
+    _retryTimer.stop();
+    if (_job) {
+        disconnect(_job.data(), nullptr, this, nullptr);
+        if (_job->reply())
+            _job->reply()->abort();
+        _job.clear();
+    }
+    setActive(false);
+}
+
+void ChangeNotificationListener::sendRequest()
+{
+    if (!_running || _job)
+        return;
+    const QString endpoint = _account->capabilities().changeNotificationsEndpoint();
+    if (endpoint.isEmpty()) {
+        qCInfo(lcChangeNotifications) << "Server no longer advertises change notifications";
+        stop();
+        return;
+    }
+
+    _job = new JsonApiJob(_account, endpoint, this);
+    if (!_cursor.isEmpty()) {
+        QUrlQuery query;
+        query.addQueryItem(QStringLiteral("cursor"), _cursor);
+        _job->addQueryParams(query);
+    }
+    _job->setTimeout(pollTimeoutMsecs + pollTimeoutMarginMsecs);
+    connect(_job.data(), &JsonApiJob::jsonReceived, this, &ChangeNotificationListener::slotJsonReceived);
+    _job->start();
+}
+
+void ChangeNotificationListener::slotJsonReceived(const QJsonDocument &json, int statusCode)
+{
+    _job.clear();
+    if (!_running)
+        return;
+
+    const auto data = json.object().value(QStringLiteral("ocs")).toObject().value(QStringLiteral("data")).toObject();
+    const QString cursor = data.value(QStringLiteral("cursor")).toString();
+    if ((statusCode != 100 && statusCode != 200) || cursor.isEmpty()) {
+        qCWarning(lcChangeNotifications) << "Change notification request failed with status" << statusCode
+                                         << ", retrying in" << _retryMsecs << "ms";
+        retryLater();
+        return;
+    }
+
+    const bool lost = data.value(QStringLiteral("reset")).toBool();
+    _cursor = cursor;
+    _retryMsecs = minimumRetryMsecs;
+    setActive(true);
+
+    QStringList paths;
+    for (const auto &path : data.value(QStringLiteral("paths")).toArray())
+        paths.append(path.toString());
+
+    // Request the next changes before processing these, so nothing is missed
+    sendRequest();
+
+    if (lost) {
+        qCInfo(lcChangeNotifications) << "Server lost track of the changes, checking everything";
+        emit lostChanges();
+    } else if (!paths.isEmpty()) {
+        qCInfo(lcChangeNotifications) << "Remote changes in" << paths;
+        emit pathsChanged(paths);
+    }
+}
+
+void ChangeNotificationListener::retryLater()
+{
+    setActive(false);
+    _retryTimer.start(_retryMsecs);
+    _retryMsecs = qMin(_retryMsecs * 2, int(maximumRetryMsecs));
+}
+
+void ChangeNotificationListener::setActive(bool active)
+{
+    if (_active == active)
+        return;
+    _active = active;
+    emit activeChanged(active);
+}
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#pragma once
+
+#include "owncloudlib.h"
+#include "accountfwd.h"
+
+#include <QObject>
+#include <QPointer>
+#include <QStringList>
+#include <QTimer>
+
+class QJsonDocument;
+
+namespace OCC {
+
+class JsonApiJob;
+
+/**
+ * @brief Learns about remote changes from the server's change notification endpoint
+ *
+ * The endpoint is advertised by Capabilities::changeNotificationsEndpoint().
+ * It is long-polled: a request only returns once something changed or the
+ * server timed it out. The answer looks like
+ *
+ *   {"ocs": {"meta": {"statuscode": 200}, "data": {
+ *       "cursor": "17", "paths": ["/Photos", "/Documents/Work"], "reset": false}}}
+ *
+ * The paths are relative to the user's dav root. The cursor is passed back in
+ * the next request so that no change gets lost between two requests. The
+ * first request has no cursor and only establishes one. If the server could
+ * not keep the changes since the cursor, it answers with reset set, and
+ * lostChanges() is emitted.
+ *
+ * While the listener is active, polling the etags of the folders is only a
+ * fallback. When a request fails the listener becomes inactive and retries
+ * with an increasing delay.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT ChangeNotificationListener : public QObject
+{
+    Q_OBJECT
+public:
+    /// How long the server may hold a request before answering
+    static const int pollTimeoutMsecs = 5 * 60 * 1000;
+    static const int minimumRetryMsecs = 30 * 1000;
+    static const int maximumRetryMsecs = 10 * 60 * 1000;
+
+    explicit ChangeNotificationListener(AccountPtr account, QObject *parent = nullptr);
+    ~ChangeNotificationListener();
+
+    /// Whether the server advertises the endpoint
+    static bool isSupported(const AccountPtr &account);
+
+    void start();
+    void stop();
+
+    /// Whether the last request succeeded and a request is outstanding
+    bool isActive() const { return _active; }
+
+signals:
+    /// Something changed at or below these remote paths
+    void pathsChanged(const QStringList &paths);
+
+    /// Changes may have been missed, everything needs to be checked
+    void lostChanges();
+
+    void activeChanged(bool active);
+
+private slots:
+    void sendRequest();
+    void slotJsonReceived(const QJsonDocument &json, int statusCode);
+
+private:
+    void setActive(bool active);
+    void retryLater();
+
+    AccountPtr _account;
+    QPointer<JsonApiJob> _job;
+    QString _cursor;
+    bool _active = false;
+    bool _running = false;
+    int _retryMsecs = minimumRetryMsecs;
+    QTimer _retryTimer;
+};
+}
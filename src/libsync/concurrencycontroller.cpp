@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "concurrencycontroller.h"
+
+#include <QLoggingCategory>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcConcurrency, "sync.propagator.concurrency", QtInfoMsg)
+
+// Number of windows to wait after an increase that did not pay off
+static const int holdWindowsAfterNoGain = 5;
+
+void ConcurrencyController::reset(int initial, int minimum, int maximum)
+{
+    _minimum = qMax(1, minimum);
+    _maximum = qMax(_minimum, maximum);
+    _current = qBound(_minimum, initial, _maximum);
+    _windowStart = -1;
+    _windowBytes = 0;
+    _windowLatencySum = 0;
+    _windowLatencyCount = 0;
+    _minimumLatency = -1;
+    _throughput = 0;
+    _lastStep = Step::Hold;
+    _holdWindows = 0;
+}
+
+void ConcurrencyController::addTransferredBytes(qint64 bytes)
+{
+    if (bytes > 0)
+        _windowBytes += bytes;
+}
+
+void ConcurrencyController::addResponseLatency(qint64 msecs)
+{
+    if (msecs < 0)
+        return;
+    _windowLatencySum += msecs;
+    ++_windowLatencyCount;
+    if (_minimumLatency < 0 || msecs < _minimumLatency)
+        _minimumLatency = msecs;
+}
+
+bool ConcurrencyController::update(qint64 nowMsecs)
+{
+    if (_windowStart < 0) {
+        _windowStart = nowMsecs;
+        return false;
+    }
+    const qint64 elapsed = nowMsecs - _windowStart;
+    if (elapsed < windowMsecs)
+        return false;
+
+    const qint64 bytes = _windowBytes;
+    const qint64 latency = _windowLatencyCount ? _windowLatencySum / _windowLatencyCount : -1;
+    _windowStart = nowMsecs;
+    _windowBytes = 0;
+    _windowLatencySum = 0;
+    _windowLatencyCount = 0;
+
+    if (bytes == 0) {
+        // Nothing was transferred, there is nothing to learn from this window
+        return false;
+    }
+
+    const qint64 previousThroughput = _throughput;
+    _throughput = bytes * 1000 / elapsed;
+
+    int next = _current;
+    Step step = Step::Hold;
+    if (latency >= 0 && _minimumLatency >= 0 && latency > 2 * _minimumLatency + 100) {
+        next = qMax(_minimum, _current / 2);
+        step = Step::Decreased;
+    } else if (_holdWindows > 0) {
+        --_holdWindows;
+    } else if (_lastStep == Step::Increased && _throughput * 10 < previousThroughput * 11) {
+        next = qMax(_minimum, _current - 1);
+        step = Step::Decreased;
+        _holdWindows = holdWindowsAfterNoGain;
+    } else {
+        next = qMin(_maximum, _current + 1);
+        step = Step::Increased;
+    }
+
+    if (next == _current) {
+        _lastStep = Step::Hold;
+        return false;
+    }
+    qCInfo(lcConcurrency) << "Transfer concurrency" << _current << "->" << next
+                          << "throughput:" << _throughput << "latency:" << latency << "lowest latency:" << _minimumLatency;
+    _current = next;
+    _lastStep = step;
+    return true;
+}
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#pragma once
+
+#include "owncloudlib.h"
+
+#include <QtGlobal>
+
+namespace OCC {
+
+/**
+ * @brief Tunes the number of concurrent transfers of a sync run
+ *
+ * The propagator feeds the transferred bytes and the observed response
+ * latencies, and calls update() regularly. At the end of each measurement
+ * window the concurrency is adjusted additive-increase/multiplicative-decrease
+ * style:
+ *  - When the latency grows well above the lowest one seen, the link is
+ *    considered congested and the concurrency is halved.
+ *  - When the last increase did not improve the throughput by at least 10%,
+ *    it is undone and no new attempt is made for a few windows.
+ *  - Otherwise one more transfer is allowed.
+ *
+ * Windows without transferred bytes are ignored.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT ConcurrencyController
+{
+public:
+    /// Length of a measurement window
+    static const qint64 windowMsecs = 2000;
+
+    /// Starts over with the given concurrency, bounded by minimum and maximum
+    void reset(int initial, int minimum, int maximum);
+
+    int current() const { return _current; }
+
+    /// Throughput in bytes per second measured in the last window
+    qint64 throughput() const { return _throughput; }
+
+    void addTransferredBytes(qint64 bytes);
+    void addResponseLatency(qint64 msecs);
+
+    /** Closes the measurement window if it is over.
+     *
+     * nowMsecs is a monotonic timestamp. Returns true if the concurrency changed.
+     */
+    bool update(qint64 nowMsecs);
+
+private:
+    enum class Step {
+        Hold,
+        Increased,
+        Decreased
+    };
+
+    int _minimum = 1;
+    int _maximum = 1;
+    int _current = 1;
+
+    qint64 _windowStart = -1;
+    qint64 _windowBytes = 0;
+    qint64 _windowLatencySum = 0;
+    int _windowLatencyCount = 0;
+    qint64 _minimumLatency = -1;
+
+    qint64 _throughput = 0;
+    Step _lastStep = Step::Hold;
+    int _holdWindows = 0;
+};
+}
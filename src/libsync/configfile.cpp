@@ -88,6 +88,8 @@ static const char newBigFolderSizeLimitC[] = "newBigFolderSizeLimit";
 static const char useNewBigFolderSizeLimitC[] = "useNewBigFolderSizeLimit";
 static const char confirmExternalStorageC[] = "confirmExternalStorage";
 static const char moveToTrashC[] = "moveToTrash";
+static const char folderWatcherBackendC[] = "folderWatcherBackend";
+static const char maxConcurrentSyncsC[] = "maxConcurrentSyncs";
 
 static const char deltaSyncEnabledC[] = "DeltaSync/enabled";
 static const char deltaSyncMinimumFileSizeC[] = "DeltaSync/minFileSize";
@@ -734,6 +736,18 @@ void ConfigFile::setMoveToTrash(bool isChecked)
     setValue(moveToTrashC, isChecked);
 }
 
+QString ConfigFile::folderWatcherBackend() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return settings.value(QLatin1String(folderWatcherBackendC), QStringLiteral("inotify")).toString();
+}
+
+int ConfigFile::maxConcurrentSyncs() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return qMax(1, settings.value(QLatin1String(maxConcurrentSyncsC), 1).toInt());
+}
+
 bool ConfigFile::deltaSyncEnabled() const
 {
     QSettings settings(configFile(), QSettings::IniFormat);
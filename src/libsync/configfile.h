@@ -147,6 +147,12 @@ public:
     bool moveToTrash() const;
     void setMoveToTrash(bool);
 
+    /** Which API the folder watcher uses on Linux: "inotify" (default) or "fanotify" */
+    QString folderWatcherBackend() const;
+
+    /** How many folders may sync at the same time, 1 (default) syncs them one after another */
+    int maxConcurrentSyncs() const;
+
     static bool setConfDir(const QString &value);
 
     bool optionalDesktopNotifications() const;
@@ -18,6 +18,7 @@
 #include <QDebug>
 #include <algorithm>
 #include <set>
+#include <ctime>
 #include <QTextCodec>
 #include "vio/csync_vio_local.h"
 #include <QFileInfo>
@@ -37,8 +38,17 @@ void ProcessDirectoryJob::start()
     qCInfo(lcDisco) << "STARTING" << _currentFolder._server << _queryServer << _currentFolder._local << _queryLocal;
 
     if (_queryServer == NormalQuery) {
-        _serverJob = startAsyncServerQuery();
+        // The listing may already be known from a Depth:infinity PROPFIND of a parent
+        auto listing = _discoveryData->_remoteSubtreeListings.find(_currentFolder._server);
+        if (listing != _discoveryData->_remoteSubtreeListings.end()) {
+            _serverNormalQueryEntries = std::move(*listing);
+            _discoveryData->_remoteSubtreeListings.erase(listing);
+            _serverQueryDone = true;
+        } else {
+            _serverJob = startAsyncServerQuery();
+        }
     } else {
+        _discoveryData->dropRemoteSubtreeListings(_currentFolder._server);
         _serverQueryDone = true;
     }
 
@@ -50,20 +60,28 @@ void ProcessDirectoryJob::start()
         }
     }
 
-    if (_queryLocal == NormalQuery) {
+    if (_queryLocal == NormalQuery && _discoveryData->_useDirectorySnapshots
+        && _currentFolder._local == _currentFolder._original) {
+        // Decided once the db query compared the directory with its snapshot
+        _checkDirectorySnapshot = true;
+    } else if (_queryLocal == NormalQuery) {
         startAsyncLocalQuery();
     } else {
         _localQueryDone = true;
     }
 
-    if (_localQueryDone && _serverQueryDone) {
+    startAsyncDbQuery();
+}
+
+void ProcessDirectoryJob::processIfReady()
+{
+    if (_localQueryDone && _serverQueryDone && _dbQueryDone)
         process();
-    }
 }
 
 void ProcessDirectoryJob::process()
 {
-    ASSERT(_localQueryDone && _serverQueryDone);
+    ASSERT(_localQueryDone && _serverQueryDone && _dbQueryDone);
 
     QString localDir;
 
@@ -83,20 +101,34 @@ void ProcessDirectoryJob::process()
     }
     _serverNormalQueryEntries.clear();
 
-    // fetch all the name from the DB
+    // all the names from the DB, see startAsyncDbQuery()
     auto pathU8 = _currentFolder._original.toUtf8();
-    if (!_discoveryData->_statedb->listFilesInPath(pathU8, [&](const SyncJournalFileRecord &rec) {
-            auto name = pathU8.isEmpty() ? rec._path : QString::fromUtf8(rec._path.constData() + (pathU8.size() + 1));
-            if (rec.isVirtualFile() && isVfsWithSuffix())
-                chopVirtualFileSuffix(name);
-            auto &dbEntry = entries[name].dbEntry;
-            dbEntry = rec;
-            setupDbPinStateActions(dbEntry);
-        })) {
-        dbError();
-        return;
+
+    // Directories that changed in the last seconds may change again without
+    // their mtime changing, don't take snapshots of these
+    if (_queryLocal == NormalQuery && _localDirModtime >= 0
+        && _localDirModtime < qint64(time(nullptr)) - 2
+        && _currentFolder._local == _currentFolder._original) {
+        SyncJournalDb::DirectorySnapshot snapshot;
+        snapshot._modtime = _localDirModtime;
+        snapshot._inode = _localDirInode;
+        snapshot._childCount = _dbEntries.size();
+        snapshot._childrenHash = SyncJournalDb::DirectorySnapshot::hashRecords(_dbEntries);
+        snapshot._valid = true;
+        if (!(snapshot == _storedSnapshot))
+            _discoveryData->_directorySnapshots.insert(pathU8, snapshot);
     }
 
+    for (auto &rec : _dbEntries) {
+        auto name = pathU8.isEmpty() ? rec._path : QString::fromUtf8(rec._path.constData() + (pathU8.size() + 1));
+        if (rec.isVirtualFile() && isVfsWithSuffix())
+            chopVirtualFileSuffix(name);
+        auto &dbEntry = entries[name].dbEntry;
+        dbEntry = std::move(rec);
+        setupDbPinStateActions(dbEntry);
+    }
+    _dbEntries.clear();
+
     for (auto &e : _localNormalQueryEntries) {
         // Normally for vfs-suffix files the local entries need the suffix removed.
         // However, don't do it if "foo.owncloud" exists on the server or in the db
@@ -147,10 +179,13 @@ void ProcessDirectoryJob::process()
         bool isHidden = e.localEntry.isHidden || (f.first[0] == '.' && f.first != QLatin1String(".sys.admin#recall#"));
         if (handleExcluded(path._target, e.localEntry.name,
                 e.localEntry.isDirectory || e.serverEntry.isDirectory, isHidden,
-                e.localEntry.isSymLink))
+                e.localEntry.isSymLink)) {
+            _discoveryData->dropRemoteSubtreeListings(path._server);
             continue;
+        }
 
         if (_queryServer == InBlackList || _discoveryData->isInSelectiveSyncBlackList(path._original)) {
+            _discoveryData->dropRemoteSubtreeListings(path._server);
             processBlacklisted(path, e.localEntry, e.dbEntry);
             continue;
         }
@@ -449,6 +484,8 @@ void ProcessDirectoryJob::processFileAnalyzeRemoteInfo(
                     --_pendingAsyncJobs;
                     if (!result) {
                         processFileAnalyzeLocalInfo(item, tmp_path, localEntry, serverEntry, dbEntry, _queryServer);
+                    } else {
+                        _discoveryData->dropRemoteSubtreeListings(tmp_path._server);
                     }
                     QTimer::singleShot(0, _discoveryData, &DiscoveryPhase::scheduleMoreJobs);
                 });
@@ -599,7 +636,7 @@ void ProcessDirectoryJob::processFileAnalyzeRemoteInfo(
             async = true;
         }
     };
-    if (!_discoveryData->_statedb->getFileRecordsByFileId(serverEntry.fileId, renameCandidateProcessing)) {
+    if (!_discoveryData->getFileRecordsByFileId(serverEntry.fileId, renameCandidateProcessing)) {
         dbError();
         return;
     }
@@ -647,10 +684,13 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
         // conflict we don't need to recurse into it. (local c1.owncloud, c1/ ; remote: c1)
         if (item->_instruction == CSYNC_INSTRUCTION_CONFLICT && !item->isDirectory())
             recurse = false;
-        if (_queryLocal != NormalQuery && _queryServer != NormalQuery)
+        if (_queryLocal != NormalQuery && _queryServer != NormalQuery && !_localFromSnapshot)
             recurse = false;
 
         auto recurseQueryLocal = _queryLocal == ParentNotChanged ? ParentNotChanged : localEntry.isDirectory || item->_instruction == CSYNC_INSTRUCTION_RENAME ? NormalQuery : ParentDontExist;
+        // Subdirectories have snapshots of their own
+        if (_localFromSnapshot && dbEntry.isDirectory())
+            recurseQueryLocal = NormalQuery;
         processFileFinalize(item, path, recurse, recurseQueryLocal, recurseQueryServer);
     };
 
@@ -836,7 +876,7 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
 
     // Check if it is a move
     OCC::SyncJournalFileRecord base;
-    if (!_discoveryData->_statedb->getFileRecordByInode(localEntry.inode, &base)) {
+    if (!_discoveryData->getFileRecordByInode(localEntry.inode, &base)) {
         dbError();
         return;
     }
@@ -1117,8 +1157,11 @@ void ProcessDirectoryJob::processFileFinalize(
         } else {
             connect(job, &ProcessDirectoryJob::finished, this, &ProcessDirectoryJob::subJobFinished);
             _queuedJobs.push_back(job);
+            emit _discoveryData->directoryQueued(item);
         }
     } else {
+        if (item->isDirectory())
+            _discoveryData->dropRemoteSubtreeListings(path._server);
         if (removed
             // For the purpose of rename deletion, restored deleted placeholder is as if it was deleted
             || (item->_type == ItemTypeVirtualFile && item->_instruction == CSYNC_INSTRUCTION_NEW)) {
@@ -1372,7 +1415,14 @@ DiscoverySingleDirectoryJob *ProcessDirectoryJob::startAsyncServerQuery()
         _discoveryData->_remoteFolder + _currentFolder._server, this);
     if (!_dirItem)
         serverJob->setIsRootPath(); // query the fingerprint on the root
+    if (shouldListServerSubtree()) {
+        serverJob->setListSubtree(true);
+        serverJob->setMaxSubtreeEntries(_discoveryData->_syncOptions._maxSubtreeListingEntries);
+    }
     connect(serverJob, &DiscoverySingleDirectoryJob::etag, this, &ProcessDirectoryJob::etag);
+    connect(serverJob, &DiscoverySingleDirectoryJob::subtreeListingRefused, this, [this] {
+        _discoveryData->_listNewRemoteSubtrees = false;
+    });
     _discoveryData->_currentlyActiveJobs++;
     _pendingAsyncJobs++;
     connect(serverJob, &DiscoverySingleDirectoryJob::finished, this, [this, serverJob](const auto &results) {
@@ -1383,8 +1433,11 @@ DiscoverySingleDirectoryJob *ProcessDirectoryJob::startAsyncServerQuery()
             _serverQueryDone = true;
             if (!serverJob->_dataFingerprint.isEmpty() && _discoveryData->_dataFingerprint.isEmpty())
                 _discoveryData->_dataFingerprint = serverJob->_dataFingerprint;
-            if (_localQueryDone)
-                this->process();
+            for (auto it = serverJob->_subtreeResults.begin(); it != serverJob->_subtreeResults.end(); ++it) {
+                auto serverPath = _currentFolder._server.isEmpty() ? it.key() : _currentFolder._server + QLatin1Char('/') + it.key();
+                _discoveryData->_remoteSubtreeListings[serverPath] = std::move(it.value());
+            }
+            processIfReady();
         } else {
             auto fatalError = [&] {
                 emit _discoveryData->fatalError(tr("Server replied with an error while reading directory '%1' : %2")
@@ -1423,6 +1476,28 @@ DiscoverySingleDirectoryJob *ProcessDirectoryJob::startAsyncServerQuery()
     return serverJob;
 }
 
+bool ProcessDirectoryJob::shouldListServerSubtree()
+{
+    if (!_discoveryData->_listNewRemoteSubtrees)
+        return false;
+
+    // Don't fetch listings of subtrees that won't be synced
+    if (_discoveryData->mayExcludeBelow(_currentFolder._server))
+        return false;
+
+    if (_dirItem) {
+        // A directory that is new on the server has no database entries below it
+        return _dirItem->_instruction == CSYNC_INSTRUCTION_NEW
+            && _dirItem->_direction == SyncFileItem::Down;
+    }
+
+    // For the root, only on the initial sync
+    bool hasDbEntries = false;
+    if (!_discoveryData->_statedb->listFilesInPath(QByteArray(), [&](const SyncJournalFileRecord &) { hasDbEntries = true; }))
+        return false;
+    return !hasDbEntries;
+}
+
 void ProcessDirectoryJob::startAsyncLocalQuery()
 {
     QString localPath = _discoveryData->_localDir + _currentFolder._local;
@@ -1437,6 +1512,11 @@ void ProcessDirectoryJob::startAsyncLocalQuery()
         _childIgnored = b;
     });
 
+    connect(localJob, &DiscoverySingleLocalDirectoryJob::directoryStat, this, [this](qint64 modtime, quint64 inode) {
+        _localDirModtime = modtime;
+        _localDirInode = inode;
+    });
+
     connect(localJob, &DiscoverySingleLocalDirectoryJob::finishedFatalError, this, [this](const QString &msg) {
         _discoveryData->_currentlyActiveJobs--;
         _pendingAsyncJobs--;
@@ -1467,14 +1547,66 @@ void ProcessDirectoryJob::startAsyncLocalQuery()
         _localNormalQueryEntries = results;
         _localQueryDone = true;
 
-        if (_serverQueryDone)
-            this->process();
+        processIfReady();
     });
 
     QThreadPool *pool = QThreadPool::globalInstance();
     pool->start(localJob); // QThreadPool takes ownership
 }
 
+void ProcessDirectoryJob::startAsyncDbQuery()
+{
+    auto dbJob = new DiscoverySingleDbDirectoryJob(_discoveryData->_statedb, _currentFolder._original.toUtf8());
+    if (_checkDirectorySnapshot)
+        dbJob->setCheckSnapshot(_discoveryData->_localDir + _currentFolder._local);
+    // Same conditions as for taking a snapshot in process()
+    if (_queryLocal == NormalQuery && _currentFolder._local == _currentFolder._original)
+        dbJob->setLoadSnapshot();
+
+    _pendingAsyncJobs++;
+
+    connect(dbJob, &DiscoverySingleDbDirectoryJob::finishedWithError, this, [this] {
+        _pendingAsyncJobs--;
+        if (_serverJob)
+            _serverJob->abort();
+
+        dbError();
+    });
+
+    connect(dbJob, &DiscoverySingleDbDirectoryJob::snapshotLoaded, this, [this](const SyncJournalDb::DirectorySnapshot &snapshot) {
+        _storedSnapshot = snapshot;
+    });
+
+    connect(dbJob, &DiscoverySingleDbDirectoryJob::directorySnapshotChecked, this, [this](bool unchanged) {
+        if (unchanged) {
+            qCDebug(lcDisco) << "Unchanged since the snapshot, not listing" << _currentFolder._local;
+            _queryLocal = ParentNotChanged;
+            _localFromSnapshot = true;
+        }
+    });
+
+    connect(dbJob, &DiscoverySingleDbDirectoryJob::finished, this, [this](const auto &results) {
+        _pendingAsyncJobs--;
+
+        _dbEntries = results;
+        _dbQueryDone = true;
+
+        if (_checkDirectorySnapshot) {
+            _checkDirectorySnapshot = false;
+            if (_localFromSnapshot) {
+                _localQueryDone = true;
+            } else {
+                startAsyncLocalQuery();
+                return;
+            }
+        }
+
+        processIfReady();
+    });
+
+    _discoveryData->_dbQueryPool.start(dbJob); // QThreadPool takes ownership
+}
+
 
 bool ProcessDirectoryJob::isVfsWithSuffix() const
 {
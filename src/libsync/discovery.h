@@ -199,15 +199,37 @@ private:
     /** Start a remote discovery network job
      *
      * It fills _serverNormalQueryEntries and sets _serverQueryDone when done.
+     *
+     * If the directory is new to the client and the server supports it, the
+     * whole subtree is listed with one request and the listings of the
+     * subdirectories are stored in DiscoveryPhase::_remoteSubtreeListings.
      */
     DiscoverySingleDirectoryJob *startAsyncServerQuery();
 
+    /** Whether the remote subtree of this directory should be listed with a single request
+     *
+     * That's the case for directories without any entries in the database:
+     * new remote directories and the root folder on the initial sync. Not if
+     * parts of the subtree may be excluded by selective sync, see
+     * DiscoveryPhase::mayExcludeBelow().
+     */
+    bool shouldListServerSubtree();
+
     /** Discover the local directory
       *
       * Fills _localNormalQueryEntries.
       */
     void startAsyncLocalQuery();
 
+    /** Read the database entries of the directory in a worker thread
+     *
+     * Fills _dbEntries and sets _dbQueryDone when done.
+     */
+    void startAsyncDbQuery();
+
+    /** Calls process() once the local, remote and database queries are done */
+    void processIfReady();
+
 
     /** Sets _pinState, the directory's pin state
      *
@@ -235,10 +257,26 @@ private:
     QVector<RemoteInfo> _serverNormalQueryEntries;
     QVector<LocalInfo> _localNormalQueryEntries;
 
+    // The database entries of this directory
+    QVector<SyncJournalFileRecord> _dbEntries;
+
     // Whether the local/remote directory item queries are done. Will be set
     // even even for do-nothing (!= NormalQuery) queries.
     bool _serverQueryDone = false;
     bool _localQueryDone = false;
+    bool _dbQueryDone = false;
+
+    // The local query waits for the directory to be compared with its
+    // snapshot, see DiscoveryPhase::_useDirectorySnapshots
+    bool _checkDirectorySnapshot = false;
+    // The directory is unchanged since its snapshot: _queryLocal is
+    // ParentNotChanged, but its subdirectories are queried normally
+    bool _localFromSnapshot = false;
+    // The stat of the directory when it was listed, -1 if unknown
+    qint64 _localDirModtime = -1;
+    quint64 _localDirInode = 0;
+    // The snapshot in the db, a new one is only stored if it differs
+    SyncJournalDb::DirectorySnapshot _storedSnapshot;
 
     RemotePermissions _rootPermissions;
     QPointer<DiscoverySingleDirectoryJob> _serverJob;
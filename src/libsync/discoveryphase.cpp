@@ -18,6 +18,7 @@
 #include "account.h"
 #include "common/asserts.h"
 #include "common/checksums.h"
+#include "common/syncjournaldb.h"
 
 #include <csync_exclude.h>
 #include "vio/csync_vio_local.h"
@@ -77,6 +78,18 @@ bool DiscoveryPhase::isInSelectiveSyncBlackList(const QString &path) const
     return false;
 }
 
+bool DiscoveryPhase::mayExcludeBelow(const QString &path) const
+{
+    const QString pathSlash = path.isEmpty() ? QString() : path + QLatin1Char('/');
+    auto it = std::lower_bound(_selectiveSyncBlackList.begin(), _selectiveSyncBlackList.end(), pathSlash);
+    if (it != _selectiveSyncBlackList.end() && it->startsWith(pathSlash))
+        return true;
+
+    // See checkSelectiveSyncNewFolder(): folders below a white listed one are never held back
+    return _syncOptions._newBigFolderSizeLimit >= 0 && _syncOptions._vfs->mode() == Vfs::Off
+        && !findPathInList(_selectiveSyncWhiteList, path);
+}
+
 void DiscoveryPhase::checkSelectiveSyncNewFolder(const QString &path, RemotePermissions remotePerm,
     std::function<void(bool)> callback)
 {
@@ -176,6 +189,95 @@ QPair<bool, QByteArray> DiscoveryPhase::findAndCancelDeletedJob(const QString &o
     return { result, oldEtag };
 }
 
+void DiscoveryPhase::cancelDbQueries()
+{
+    _dbQueryPool.clear();
+    _dbQueryPool.waitForDone();
+}
+
+bool DiscoveryPhase::ensureRecordIndex()
+{
+    if (_recordIndexLoaded) {
+        if (_statedb->fileRecordsRevision() == _recordIndexRevision)
+            return true;
+
+        // Records were written since the index was loaded. Drop it and go back
+        // to individual queries; wait twice as long before reloading it so a
+        // journal that keeps changing doesn't cause a reload per lookup.
+        qCInfo(lcDiscovery) << "Journal records changed, dropping the record index";
+        _inodeIndex.clear();
+        _fileIdIndex.clear();
+        _recordIndexLoaded = false;
+        _recordLookupsWithoutIndex = 0;
+        _maxLookupsWithoutIndex *= 2;
+    }
+    if (++_recordLookupsWithoutIndex <= _maxLookupsWithoutIndex)
+        return false;
+
+    QElapsedTimer timer;
+    timer.start();
+    _recordIndexRevision = _statedb->fileRecordsRevision();
+    bool ok = _statedb->getFileIdentifiers([this](qint64 phash, quint64 inode, const QByteArray &fileId) {
+        if (inode)
+            _inodeIndex.insert(inode, phash);
+        if (!fileId.isEmpty())
+            _fileIdIndex.insert(qHash(fileId), phash);
+    });
+    if (!ok) {
+        // Keep doing individual queries
+        _inodeIndex.clear();
+        _fileIdIndex.clear();
+        return false;
+    }
+    _recordIndexLoaded = true;
+    qCInfo(lcDiscovery) << "Loaded journal record index with" << _inodeIndex.size() << "inodes and"
+                        << _fileIdIndex.size() << "file ids in" << timer.elapsed() << "ms";
+    return true;
+}
+
+bool DiscoveryPhase::getFileRecordByInode(quint64 inode, SyncJournalFileRecord *rec)
+{
+    if (!ensureRecordIndex())
+        return _statedb->getFileRecordByInode(inode, rec);
+
+    rec->_path.clear();
+    if (!inode)
+        return true;
+    const auto phashes = _inodeIndex.values(inode);
+    if (phashes.isEmpty())
+        return true; // nothing found
+    if (phashes.size() > 1) {
+        // Several records share the inode, let the journal pick the same one
+        // it would pick without the index
+        return _statedb->getFileRecordByInode(inode, rec);
+    }
+    if (!_statedb->getFileRecordByPHash(phashes.first(), rec))
+        return false;
+    // The index is dropped when the journal changes, this is only a safety net
+    if (rec->isValid() && rec->_inode != inode)
+        rec->_path.clear();
+    return true;
+}
+
+bool DiscoveryPhase::getFileRecordsByFileId(const QByteArray &fileId, const std::function<void(const SyncJournalFileRecord &)> &rowCallback)
+{
+    if (!ensureRecordIndex())
+        return _statedb->getFileRecordsByFileId(fileId, rowCallback);
+
+    if (fileId.isEmpty())
+        return true;
+    const auto phashes = _fileIdIndex.values(qHash(fileId));
+    for (auto phash : phashes) {
+        SyncJournalFileRecord rec;
+        if (!_statedb->getFileRecordByPHash(phash, &rec))
+            return false;
+        // Filter out hash collisions
+        if (rec.isValid() && rec._fileId == fileId)
+            rowCallback(rec);
+    }
+    return true;
+}
+
 void DiscoveryPhase::startJob(ProcessDirectoryJob *job)
 {
     ENFORCE(!_currentRootJob);
@@ -192,6 +294,7 @@ void DiscoveryPhase::startJob(ProcessDirectoryJob *job)
             auto nextJob = _queuedDeletedDirectories.take(_queuedDeletedDirectories.firstKey());
             startJob(nextJob);
         } else {
+            releaseDiscoveryState();
             emit finished();
         }
     });
@@ -199,6 +302,35 @@ void DiscoveryPhase::startJob(ProcessDirectoryJob *job)
     job->start();
 }
 
+void DiscoveryPhase::dropRemoteSubtreeListings(const QString &path)
+{
+    // A subtree listing has an entry for every directory in it, and the entries
+    // below a directory are only taken once its own entry was
+    if (!_remoteSubtreeListings.remove(path))
+        return;
+    const QString pathSlash = path + QLatin1Char('/');
+    for (auto it = _remoteSubtreeListings.begin(); it != _remoteSubtreeListings.end();) {
+        if (it.key().startsWith(pathSlash))
+            it = _remoteSubtreeListings.erase(it);
+        else
+            ++it;
+    }
+}
+
+void DiscoveryPhase::releaseDiscoveryState()
+{
+    // The deleted items would otherwise stay alive until the end of the
+    // propagation, and the lookup tables hold an entry per item as well
+    _deletedItem.clear();
+    _renamedItemsRemote.clear();
+    _renamedItemsLocal.clear();
+    _forbiddenDeletes.clear();
+    _remoteSubtreeListings.clear();
+    _inodeIndex.clear();
+    _fileIdIndex.clear();
+    _recordIndexLoaded = false;
+}
+
 void DiscoveryPhase::setSelectiveSyncBlackList(const QStringList &list)
 {
     _selectiveSyncBlackList = list;
@@ -231,6 +363,10 @@ void DiscoverySingleLocalDirectoryJob::run() {
     if (localPath.endsWith('/')) // Happens if _currentFolder._local.isEmpty()
         localPath.chop(1);
 
+    csync_file_stat_t dirStat;
+    if (csync_vio_local_stat(localPath.toUtf8().constData(), &dirStat) == 0)
+        emit directoryStat(dirStat.modtime, dirStat.inode);
+
     auto dh = csync_vio_local_opendir(localPath);
     if (!dh) {
         qCInfo(lcDiscovery) << "Error while opening directory" << (localPath) << errno;
@@ -303,6 +439,50 @@ void DiscoverySingleLocalDirectoryJob::run() {
     emit finished(results);
 }
 
+DiscoverySingleDbDirectoryJob::DiscoverySingleDbDirectoryJob(SyncJournalDb *db, const QByteArray &path, QObject *parent)
+    : QObject(parent)
+    , QRunnable()
+    , _db(db)
+    , _path(path)
+{
+    qRegisterMetaType<QVector<SyncJournalFileRecord>>("QVector<SyncJournalFileRecord>");
+    qRegisterMetaType<SyncJournalDb::DirectorySnapshot>();
+}
+
+// Use as QRunnable
+void DiscoverySingleDbDirectoryJob::run()
+{
+    QVector<SyncJournalFileRecord> results;
+    if (!_db->listFilesInPath(_path, [&](const SyncJournalFileRecord &rec) { results.push_back(rec); })) {
+        emit finishedWithError();
+        return;
+    }
+
+    SyncJournalDb::DirectorySnapshot snapshot;
+    if (_loadSnapshot || !_snapshotLocalPath.isEmpty()) {
+        snapshot = _db->getDirectorySnapshot(_path);
+        if (_loadSnapshot)
+            emit snapshotLoaded(snapshot);
+    }
+
+    if (!_snapshotLocalPath.isEmpty()) {
+        QString localPath = _snapshotLocalPath;
+        if (localPath.endsWith('/'))
+            localPath.chop(1);
+        bool unchanged = false;
+        csync_file_stat_t dirStat;
+        if (snapshot._valid
+            && snapshot._childCount == results.size()
+            && csync_vio_local_stat(localPath.toUtf8().constData(), &dirStat) == 0) {
+            unchanged = dirStat.modtime == snapshot._modtime
+                && dirStat.inode == snapshot._inode
+                && SyncJournalDb::DirectorySnapshot::hashRecords(results) == snapshot._childrenHash;
+        }
+        emit directorySnapshotChecked(unchanged);
+    }
+    emit finished(results);
+}
+
 DiscoverySingleDirectoryJob::DiscoverySingleDirectoryJob(const AccountPtr &account, const QString &path, QObject *parent)
     : QObject(parent)
     , _subPath(path)
@@ -317,6 +497,8 @@ void DiscoverySingleDirectoryJob::start()
 {
     // Start the actual HTTP job
     LsColJob *lsColJob = new LsColJob(_account, _subPath, this);
+    if (_listSubtree)
+        lsColJob->setDepth("infinity");
 
     QList<QByteArray> props;
     props << "resourcetype"
@@ -425,6 +607,7 @@ void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(QString file, con
                 _dataFingerprint = "[empty]";
             }
         }
+        _firstHref = file;
     } else {
 
         RemoteInfo result;
@@ -435,7 +618,40 @@ void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(QString file, con
         if (result.isDirectory)
             result.size = 0;
 
-        if (_isExternalStorage && result.remotePerm.hasPermission(RemotePermissions::IsMounted)) {
+        // For a Depth:infinity listing, find out in which directory the entry is.
+        // The path is relative to this directory and empty for direct children.
+        QString relativePath;
+        QString parentPath;
+        bool isInExternalStorage = _isExternalStorage;
+        if (_listSubtree) {
+            if (!file.startsWith(_firstHref + QLatin1Char('/'))) {
+                qCWarning(lcDiscovery) << "Ignoring unexpected entry in subtree listing" << file << "of" << _firstHref;
+                return;
+            }
+            relativePath = file.mid(_firstHref.size() + 1);
+            int relativeSlash = relativePath.lastIndexOf(QLatin1Char('/'));
+            if (relativeSlash > 0) {
+                if (_subtreeTruncated)
+                    return;
+                if (++_subtreeEntries > _maxSubtreeEntries) {
+                    qCInfo(lcDiscovery) << "Subtree listing of" << _subPath << "has more than" << _maxSubtreeEntries
+                                        << "entries, its subdirectories will be listed separately";
+                    _subtreeTruncated = true;
+                    _subtreeResults.clear();
+                    return;
+                }
+                parentPath = relativePath.left(relativeSlash);
+                isInExternalStorage = _externalStorageSubdirs.contains(parentPath);
+            }
+            if (result.isDirectory && !_subtreeTruncated) {
+                if (isInExternalStorage || result.remotePerm.hasPermission(RemotePermissions::IsMounted))
+                    _externalStorageSubdirs.insert(relativePath);
+                // Make sure that empty directories get a listing too
+                _subtreeResults[relativePath];
+            }
+        }
+
+        if (isInExternalStorage && result.remotePerm.hasPermission(RemotePermissions::IsMounted)) {
             /* All the entries in a external storage have 'M' in their permission. However, for all
                purposes in the desktop client, we only need to know about the mount points.
                So replace the 'M' by a 'm' for every sub entries in an external storage */
@@ -443,12 +659,11 @@ void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(QString file, con
             result.remotePerm.setPermission(RemotePermissions::IsMountedSub);
         }
 
-        QStringRef fileRef(&file);
-        int slashPos = file.lastIndexOf(QLatin1Char('/'));
-        if (slashPos > -1) {
-            fileRef = file.midRef(slashPos + 1);
+        if (parentPath.isEmpty()) {
+            _results.push_back(std::move(result));
+        } else {
+            _subtreeResults[parentPath].push_back(std::move(result));
         }
-        _results.push_back(std::move(result));
     }
 
     //This works in concerto with the RequestEtagJob and the Folder object to check if the remote folder changed.
@@ -484,6 +699,23 @@ void DiscoverySingleDirectoryJob::lsJobFinishedWithErrorSlot(QNetworkReply *r)
     QString httpReason = r->attribute(QNetworkRequest::HttpReasonPhraseAttribute).toString();
     QString msg = r->errorString();
     qCWarning(lcDiscovery) << "LSCOL job error" << r->errorString() << httpCode << r->error();
+    if (_listSubtree && (httpCode == 400 || httpCode == 403 || httpCode == 501)) {
+        // The server does not allow listing the whole subtree, retry with a regular request
+        qCInfo(lcDiscovery) << "Depth:infinity PROPFIND refused for" << _subPath << "falling back to Depth:1";
+        _listSubtree = false;
+        _results.clear();
+        _subtreeResults.clear();
+        _externalStorageSubdirs.clear();
+        _subtreeEntries = 0;
+        _subtreeTruncated = false;
+        _ignoredFirst = false;
+        _firstEtag.clear();
+        _firstHref.clear();
+        _dataFingerprint.clear();
+        emit subtreeListingRefused();
+        start();
+        return;
+    }
     if (r->error() == QNetworkReply::NoError
         && !contentType.contains("application/xml; charset=utf-8")) {
         msg = tr("Server error: PROPFIND reply is not XML formatted!");
@@ -25,9 +25,13 @@
 #include <QWaitCondition>
 #include <QLinkedList>
 #include <QRunnable>
+#include <QThreadPool>
 #include <deque>
+#include <limits>
 #include "syncoptions.h"
 #include "syncfileitem.h"
+#include "common/syncjournalfilerecord.h"
+#include "common/syncjournaldb.h"
 
 class ExcludedFiles;
 
@@ -36,6 +40,7 @@ namespace OCC {
 enum class LocalDiscoveryStyle {
     FilesystemOnly, //< read all local data from the filesystem
     DatabaseAndFilesystem, //< read from the db, except for listed paths
+    DirectorySnapshots, //< like FilesystemOnly, but read unchanged directories from the db
 };
 
 
@@ -97,6 +102,9 @@ signals:
 
     void itemDiscovered(SyncFileItemPtr item);
     void childIgnored(bool b);
+
+    /// The stat of the directory itself, taken before listing it
+    void directoryStat(qint64 modtime, quint64 inode);
 private slots:
 private:
     QString _localPath;
@@ -106,6 +114,51 @@ public:
 };
 
 
+/**
+ * @brief Read the database entries of a directory for Discovery
+ *
+ * Runs in a thread pool like DiscoverySingleLocalDirectoryJob, so that listing
+ * the records of large directories doesn't block the GUI thread. Only the
+ * listing is done here: the lookups of single records while the entries are
+ * reconciled, for rename detection and upload infos, stay in
+ * ProcessDirectoryJob::process().
+ *
+ * @ingroup libsync
+ */
+class DiscoverySingleDbDirectoryJob : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    explicit DiscoverySingleDbDirectoryJob(SyncJournalDb *db, const QByteArray &path, QObject *parent = 0);
+
+    /** Also compare the directory with its snapshot
+     *
+     * directorySnapshotChecked() is emitted before finished().
+     */
+    void setCheckSnapshot(const QString &localPath) { _snapshotLocalPath = localPath; }
+    /** Also read the stored snapshot of the directory
+     *
+     * snapshotLoaded() is emitted before finished().
+     */
+    void setLoadSnapshot() { _loadSnapshot = true; }
+
+    void run() Q_DECL_OVERRIDE;
+signals:
+    void finished(QVector<SyncJournalFileRecord> result);
+    void finishedWithError();
+
+    /// Whether the directory and its records are unchanged since the snapshot
+    void directorySnapshotChecked(bool unchanged);
+    void snapshotLoaded(const SyncJournalDb::DirectorySnapshot &snapshot);
+
+private:
+    SyncJournalDb *_db;
+    QByteArray _path;
+    QString _snapshotLocalPath;
+    bool _loadSnapshot = false;
+};
+
+
 /**
  * @brief Run a PROPFIND on a directory and process the results for Discovery
  *
@@ -118,6 +171,21 @@ public:
     explicit DiscoverySingleDirectoryJob(const AccountPtr &account, const QString &path, QObject *parent = 0);
     // Specify that this is the root and we need to check the data-fingerprint
     void setIsRootPath() { _isRootPath = true; }
+    /** List the whole subtree with a single Depth:infinity PROPFIND
+     *
+     * The direct children are reported through finished() as usual, the listings
+     * of all deeper directories end up in _subtreeResults.
+     *
+     * If the server refuses the request, the job transparently falls back to a
+     * Depth:1 request and emits subtreeListingRefused().
+     */
+    void setListSubtree(bool listSubtree) { _listSubtree = listSubtree; }
+    /** Only keep the listings of the subtree while it has at most this many entries
+     *
+     * Beyond that the deeper entries are dropped and _subtreeResults stays empty,
+     * the direct children are still reported.
+     */
+    void setMaxSubtreeEntries(int maxEntries) { _maxSubtreeEntries = maxEntries; }
     void start();
     void abort();
 
@@ -126,6 +194,7 @@ signals:
     void firstDirectoryPermissions(RemotePermissions);
     void etag(const QString &);
     void finished(const HttpResult<QVector<RemoteInfo>> &result);
+    void subtreeListingRefused();
 
 private slots:
     void directoryListingIteratedSlot(QString, const QMap<QString, QString> &);
@@ -148,8 +217,26 @@ private:
     QString _error;
     QPointer<LsColJob> _lsColJob;
 
+    // Whether a Depth:infinity request is done, see setListSubtree()
+    bool _listSubtree = false;
+    // The href of the directory itself, used to compute relative paths of subtree entries
+    QString _firstHref;
+    // Relative paths of the subtree directories that are or are within an external storage
+    QSet<QString> _externalStorageSubdirs;
+    // See setMaxSubtreeEntries()
+    int _maxSubtreeEntries = std::numeric_limits<int>::max();
+    int _subtreeEntries = 0;
+    bool _subtreeTruncated = false;
+
 public:
     QByteArray _dataFingerprint;
+
+    /** Listings of the directories below this directory.
+     *
+     * Only filled if setListSubtree() was used. Maps the path relative to
+     * this directory to the listing of the directory's direct children.
+     */
+    QHash<QString, QVector<RemoteInfo>> _subtreeResults;
 };
 
 class DiscoveryPhase : public QObject
@@ -184,6 +271,17 @@ class DiscoveryPhase : public QObject
     QMap<QString, QString> _renamedItemsRemote;
     QMap<QString, QString> _renamedItemsLocal;
 
+    /** Remote listings of directories obtained by a Depth:infinity PROPFIND of an ancestor.
+     *
+     * Maps the server path of a directory to its direct children. Entries are
+     * taken out by the ProcessDirectoryJob of that directory instead of doing
+     * a PROPFIND on its own. See ProcessDirectoryJob::startAsyncServerQuery().
+     */
+    QHash<QString, QVector<RemoteInfo>> _remoteSubtreeListings;
+
+    /// Removes the listings of path and of all directories below it, for subtrees that aren't discovered
+    void dropRemoteSubtreeListings(const QString &path);
+
     // set of paths that should not be removed even though they are removed locally:
     // there was a move to an invalid destination and now the source should be restored
     //
@@ -203,14 +301,56 @@ class DiscoveryPhase : public QObject
 
     int _currentlyActiveJobs = 0;
 
+    /** Runs the DiscoverySingleDbDirectoryJobs
+     *
+     * Unlike the global pool it can be waited for, see cancelDbQueries().
+     */
+    QThreadPool _dbQueryPool;
+
+    /** In-memory index of the inodes and file ids in the journal
+     *
+     * Rename detection looks up journal records by inode (local moves) and by
+     * file id (remote moves) for every new item. Once more than a few lookups
+     * were needed, the identifiers of all records are loaded with a single
+     * query so that lookups that find nothing, the common case, don't need a
+     * database round trip. Values are path hashes, see SyncJournalDb::getPHash().
+     *
+     * The index is dropped when SyncJournalDb::fileRecordsRevision() changes.
+     */
+    QMultiHash<quint64, qint64> _inodeIndex;
+    QMultiHash<uint, qint64> _fileIdIndex; // keyed by qHash(fileId)
+    bool _recordIndexLoaded = false;
+    quint64 _recordIndexRevision = 0;
+    int _recordLookupsWithoutIndex = 0;
+    // Below this number of lookups individual queries are cheaper than loading the index
+    int _maxLookupsWithoutIndex = 100;
+
+    bool ensureRecordIndex();
+
+    /// Like SyncJournalDb::getFileRecordByInode(), but uses the record index once it's loaded
+    bool getFileRecordByInode(quint64 inode, SyncJournalFileRecord *rec);
+
+    /// Like SyncJournalDb::getFileRecordsByFileId(), but uses the record index once it's loaded
+    bool getFileRecordsByFileId(const QByteArray &fileId, const std::function<void(const SyncJournalFileRecord &)> &rowCallback);
+
     // both must contain a sorted list
     QStringList _selectiveSyncBlackList;
     QStringList _selectiveSyncWhiteList;
 
     void scheduleMoreJobs();
 
+    /// Drops what is only needed while the discovery runs, keeps the outputs
+    void releaseDiscoveryState();
+
     bool isInSelectiveSyncBlackList(const QString &path) const;
 
+    /** Whether directories below path may be left out of the sync
+     *
+     * True if the selective sync black list has entries below path, or if
+     * new folders below it may still be held back for their size.
+     */
+    bool mayExcludeBelow(const QString &path) const;
+
     // Check if the new folder should be deselected or not.
     // May be async. "Return" via the callback, true if the item is blacklisted
     void checkSelectiveSyncNewFolder(const QString &path, RemotePermissions rp,
@@ -249,20 +389,52 @@ public:
     bool _ignoreHiddenFiles = false;
     std::function<bool(const QString &)> _shouldDiscoverLocaly;
 
+    /** Whether remote directories that are new to the client may be listed
+     * recursively with a single request.
+     *
+     * Set if the server supports Depth:infinity PROPFINDs, reset if the
+     * server refused such a request.
+     */
+    bool _listNewRemoteSubtrees = false;
+
+    /** Whether the local listing of directories that are unchanged since
+     * their snapshot is skipped, see LocalDiscoveryStyle::DirectorySnapshots.
+     */
+    bool _useDirectorySnapshots = false;
+
     void startJob(ProcessDirectoryJob *);
 
     void setSelectiveSyncBlackList(const QStringList &list);
     void setSelectiveSyncWhiteList(const QStringList &list);
 
+    /** Drops the queued database queries and waits for the running ones
+     *
+     * They use _statedb, which may be gone once the discovery is torn down.
+     */
+    void cancelDbQueries();
+
     // output
     QByteArray _dataFingerprint;
     bool _anotherSyncNeeded = false;
 
+    /** Snapshots of the directories that were listed locally, by db-path
+     *
+     * Only directories whose entries were all in sync with the db are
+     * included. SyncEngine stores them once the sync succeeded.
+     */
+    QHash<QByteArray, SyncJournalDb::DirectorySnapshot> _directorySnapshots;
+
 signals:
     void fatalError(const QString &errorString);
     void itemDiscovered(const SyncFileItemPtr &item);
     void finished();
 
+    /** A directory will be recursed into
+     *
+     * itemDiscovered() follows for the same item once its contents are done.
+     */
+    void directoryQueued(const SyncFileItemPtr &item);
+
     // A new folder was discovered and was not synced because of the confirmation feature
     void newBigFolder(const QString &folder, bool isExternal);
 
@@ -32,6 +32,13 @@ void LocalDiscoveryTracker::addTouchedPath(const QString &relativePath)
     _localDiscoveryPaths.insert(relativePath);
 }
 
+void LocalDiscoveryTracker::addTouchedPaths(const QStringList &relativePaths)
+{
+    qCDebug(lcLocalDiscoveryTracker) << "inserted" << relativePaths.size() << "touched paths";
+    for (const auto &path : relativePaths)
+        _localDiscoveryPaths.insert(path);
+}
+
 void LocalDiscoveryTracker::startSyncFullDiscovery()
 {
     _localDiscoveryPaths.clear();
@@ -59,6 +59,9 @@ public:
      */
     void addTouchedPath(const QString &relativePath);
 
+    /** Adds several paths, like addTouchedPath() */
+    void addTouchedPaths(const QStringList &relativePaths);
+
     /** Call when a sync run starts that rediscovers all local files */
     void startSyncFullDiscovery();
 
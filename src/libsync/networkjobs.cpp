@@ -176,133 +176,195 @@ bool MkColJob::finished()
 }
 
 /*********************************************************************************************/
-// supposed to read <D:collection> when pointing to <D:resourcetype><D:collection></D:resourcetype>..
-static QString readContentsAsString(QXmlStreamReader &reader)
-{
-    QString result;
-    int level = 0;
-    do {
-        QXmlStreamReader::TokenType type = reader.readNext();
-        if (type == QXmlStreamReader::StartElement) {
-            level++;
-            result += "<" + reader.name().toString() + ">";
-        } else if (type == QXmlStreamReader::Characters) {
-            result += reader.text();
-        } else if (type == QXmlStreamReader::EndElement) {
-            level--;
-            if (level < 0) {
-                break;
-            }
-            result += "</" + reader.name().toString() + ">";
-        }
 
-    } while (!reader.atEnd());
-    return result;
+LsColXMLParser::LsColXMLParser()
+{
 }
 
+bool LsColXMLParser::parse(const QByteArray &xml, QHash<QString, qint64> *sizes, const QString &expectedPath)
+{
+    start(expectedPath, sizes);
+    if (!addData(xml)) {
+        return false;
+    }
+    return finish();
+}
 
-LsColXMLParser::LsColXMLParser()
+void LsColXMLParser::start(const QString &expectedPath, QHash<QString, qint64> *sizes)
 {
+    _reader.clear();
+    _reader.addExtraNamespaceDeclaration(QXmlStreamNamespaceDeclaration("d", "DAV:"));
+    _expectedPath = expectedPath;
+    _sizes = sizes;
+    _failed = false;
+
+    _folders.clear();
+    _currentHref.clear();
+    _currentTmpProperties.clear();
+    _currentHttp200Properties.clear();
+    _currentPropsHaveHttp200 = false;
+    _insidePropstat = false;
+    _insideProp = false;
+    _insideMultiStatus = false;
+    _multiStatusFinished = false;
+    _textTarget = TextTarget::None;
+    _text.clear();
+    _propertyLevel = 0;
 }
 
-bool LsColXMLParser::parse(const QByteArray &xml, QHash<QString, qint64> *sizes, const QString &expectedPath)
+bool LsColXMLParser::addData(const QByteArray &data)
 {
-    // Parse DAV response
-    QXmlStreamReader reader(xml);
-    reader.addExtraNamespaceDeclaration(QXmlStreamNamespaceDeclaration("d", "DAV:"));
-
-    QStringList folders;
-    QString currentHref;
-    QMap<QString, QString> currentTmpProperties;
-    QMap<QString, QString> currentHttp200Properties;
-    bool currentPropsHaveHttp200 = false;
-    bool insidePropstat = false;
-    bool insideProp = false;
-    bool insideMultiStatus = false;
-
-    while (!reader.atEnd()) {
-        QXmlStreamReader::TokenType type = reader.readNext();
-        QString name = reader.name().toString();
-        // Start elements with DAV:
-        if (type == QXmlStreamReader::StartElement && reader.namespaceUri() == QLatin1String("DAV:")) {
-            if (name == QLatin1String("href")) {
-                // We don't use URL encoding in our request URL (which is the expected path) (QNAM will do it for us)
-                // but the result will have URL encoding..
-                QString hrefString = QString::fromUtf8(QByteArray::fromPercentEncoding(reader.readElementText().toUtf8()));
-                if (!hrefString.startsWith(expectedPath)) {
-                    qCWarning(lcLsColJob) << "Invalid href" << hrefString << "expected starting with" << expectedPath;
-                    return false;
+    if (_failed) {
+        return false;
+    }
+    _reader.addData(data);
+    if (!parseAvailableTokens()) {
+        _failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool LsColXMLParser::finish()
+{
+    if (_failed) {
+        return false;
+    }
+    // An incremental reader reports a premature end while waiting for more data,
+    // that is only an error if the multistatus element was not complete yet.
+    if (_reader.hasError()
+        && (_reader.error() != QXmlStreamReader::PrematureEndOfDocumentError || !_multiStatusFinished)) {
+        qCWarning(lcLsColJob) << "ERROR" << _reader.errorString() << "at line" << _reader.lineNumber();
+        return false;
+    } else if (!_insideMultiStatus) {
+        qCWarning(lcLsColJob) << "ERROR no WebDAV response?";
+        return false;
+    }
+    emit directoryListingSubfolders(_folders);
+    emit finishedWithoutError();
+    return true;
+}
+
+// Processes all tokens that are available in the data passed so far.
+// Returns false on a fatal error. Running out of data is not an error.
+bool LsColXMLParser::parseAvailableTokens()
+{
+    while (!_reader.atEnd()) {
+        QXmlStreamReader::TokenType type = _reader.readNext();
+        if (type == QXmlStreamReader::Invalid) {
+            if (_reader.error() == QXmlStreamReader::PrematureEndOfDocumentError) {
+                // wait for more data
+                return true;
+            }
+            // XML Parser error? Whatever had been emitted before will come as directoryListingIterated
+            qCWarning(lcLsColJob) << "ERROR" << _reader.errorString() << "at line" << _reader.lineNumber();
+            return false;
+        }
+
+        // Reading the contents of a property:
+        // <d:resourcetype><d:collection/></d:resourcetype> is read as "<collection></collection>"
+        if (_textTarget == TextTarget::Property) {
+            if (type == QXmlStreamReader::StartElement) {
+                _propertyLevel++;
+                _text += "<" + _reader.name().toString() + ">";
+            } else if (type == QXmlStreamReader::Characters || type == QXmlStreamReader::EntityReference) {
+                _text += _reader.text();
+            } else if (type == QXmlStreamReader::EndElement) {
+                _propertyLevel--;
+                if (_propertyLevel >= 0) {
+                    _text += "</" + _reader.name().toString() + ">";
+                    continue;
                 }
-                currentHref = hrefString;
-            } else if (name == QLatin1String("response")) {
-            } else if (name == QLatin1String("propstat")) {
-                insidePropstat = true;
-            } else if (name == QLatin1String("status") && insidePropstat) {
-                QString httpStatus = reader.readElementText();
-                if (httpStatus.startsWith("HTTP/1.1 200")) {
-                    currentPropsHaveHttp200 = true;
+                QString name = _reader.name().toString();
+                if (name == QLatin1String("resourcetype") && _text.contains("collection")) {
+                    _folders.append(_currentHref);
+                } else if (name == QLatin1String("size")) {
+                    bool ok = false;
+                    auto s = _text.toLongLong(&ok);
+                    if (ok && _sizes) {
+                        _sizes->insert(_currentHref, s);
+                    }
+                }
+                _currentTmpProperties.insert(name, _text);
+                _textTarget = TextTarget::None;
+                _text.clear();
+            }
+            continue;
+        }
+
+        // Reading the text of <d:href> or <d:status>
+        if (_textTarget != TextTarget::None) {
+            if (type == QXmlStreamReader::Characters || type == QXmlStreamReader::EntityReference) {
+                _text += _reader.text();
+            } else if (type == QXmlStreamReader::EndElement) {
+                if (_textTarget == TextTarget::Href) {
+                    // We don't use URL encoding in our request URL (which is the expected path) (QNAM will do it for us)
+                    // but the result will have URL encoding..
+                    QString hrefString = QString::fromUtf8(QByteArray::fromPercentEncoding(_text.toUtf8()));
+                    if (!hrefString.startsWith(_expectedPath)) {
+                        qCWarning(lcLsColJob) << "Invalid href" << hrefString << "expected starting with" << _expectedPath;
+                        return false;
+                    }
+                    _currentHref = hrefString;
                 } else {
-                    currentPropsHaveHttp200 = false;
+                    _currentPropsHaveHttp200 = _text.startsWith("HTTP/1.1 200");
                 }
+                _textTarget = TextTarget::None;
+                _text.clear();
+            }
+            continue;
+        }
+
+        QStringRef name = _reader.name();
+        // Start elements with DAV:
+        if (type == QXmlStreamReader::StartElement && _reader.namespaceUri() == QLatin1String("DAV:")) {
+            if (name == QLatin1String("href")) {
+                _textTarget = TextTarget::Href;
+                continue;
+            } else if (name == QLatin1String("propstat")) {
+                _insidePropstat = true;
+            } else if (name == QLatin1String("status") && _insidePropstat) {
+                _textTarget = TextTarget::Status;
+                continue;
             } else if (name == QLatin1String("prop")) {
-                insideProp = true;
+                _insideProp = true;
                 continue;
             } else if (name == QLatin1String("multistatus")) {
-                insideMultiStatus = true;
+                _insideMultiStatus = true;
                 continue;
             }
         }
 
-        if (type == QXmlStreamReader::StartElement && insidePropstat && insideProp) {
+        if (type == QXmlStreamReader::StartElement && _insidePropstat && _insideProp) {
             // All those elements are properties
-            QString propertyContent = readContentsAsString(reader);
-            if (name == QLatin1String("resourcetype") && propertyContent.contains("collection")) {
-                folders.append(currentHref);
-            } else if (name == QLatin1String("size")) {
-                bool ok = false;
-                auto s = propertyContent.toLongLong(&ok);
-                if (ok && sizes) {
-                    sizes->insert(currentHref, s);
-                }
-            }
-            currentTmpProperties.insert(reader.name().toString(), propertyContent);
+            _textTarget = TextTarget::Property;
+            _propertyLevel = 0;
+            continue;
         }
 
         // End elements with DAV:
-        if (type == QXmlStreamReader::EndElement) {
-            if (reader.namespaceUri() == QLatin1String("DAV:")) {
-                if (reader.name() == "response") {
-                    if (currentHref.endsWith('/')) {
-                        currentHref.chop(1);
-                    }
-                    emit directoryListingIterated(currentHref, currentHttp200Properties);
-                    currentHref.clear();
-                    currentHttp200Properties.clear();
-                } else if (reader.name() == "propstat") {
-                    insidePropstat = false;
-                    if (currentPropsHaveHttp200) {
-                        currentHttp200Properties = QMap<QString, QString>(currentTmpProperties);
-                    }
-                    currentTmpProperties.clear();
-                    currentPropsHaveHttp200 = false;
-                } else if (reader.name() == "prop") {
-                    insideProp = false;
+        if (type == QXmlStreamReader::EndElement && _reader.namespaceUri() == QLatin1String("DAV:")) {
+            if (name == QLatin1String("response")) {
+                if (_currentHref.endsWith('/')) {
+                    _currentHref.chop(1);
+                }
+                emit directoryListingIterated(_currentHref, _currentHttp200Properties);
+                _currentHref.clear();
+                _currentHttp200Properties.clear();
+            } else if (name == QLatin1String("propstat")) {
+                _insidePropstat = false;
+                if (_currentPropsHaveHttp200) {
+                    _currentHttp200Properties = QMap<QString, QString>(_currentTmpProperties);
                 }
+                _currentTmpProperties.clear();
+                _currentPropsHaveHttp200 = false;
+            } else if (name == QLatin1String("prop")) {
+                _insideProp = false;
+            } else if (name == QLatin1String("multistatus")) {
+                _multiStatusFinished = true;
             }
         }
     }
-
-    if (reader.hasError()) {
-        // XML Parser error? Whatever had been emitted before will come as directoryListingIterated
-        qCWarning(lcLsColJob) << "ERROR" << reader.errorString() << xml;
-        return false;
-    } else if (!insideMultiStatus) {
-        qCWarning(lcLsColJob) << "ERROR no WebDAV response?" << xml;
-        return false;
-    } else {
-        emit directoryListingSubfolders(folders);
-        emit finishedWithoutError();
-    }
     return true;
 }
 
@@ -331,6 +393,13 @@ QList<QByteArray> LsColJob::properties() const
 
 void LsColJob::start()
 {
+    connect(&_parser, &LsColXMLParser::directoryListingSubfolders,
+        this, &LsColJob::directoryListingSubfolders);
+    connect(&_parser, &LsColXMLParser::directoryListingIterated,
+        this, &LsColJob::directoryListingIterated);
+    connect(&_parser, &LsColXMLParser::finishedWithoutError,
+        this, &LsColJob::finishedWithoutError);
+
     QList<QByteArray> properties = _properties;
 
     if (properties.isEmpty()) {
@@ -352,7 +421,7 @@ void LsColJob::start()
     }
 
     QNetworkRequest req;
-    req.setRawHeader("Depth", "1");
+    req.setRawHeader("Depth", _depth);
     QByteArray xml("<?xml version=\"1.0\" ?>\n"
                    "<d:propfind xmlns:d=\"DAV:\" xmlns:oc=\"http://owncloud.org/ns\">\n"
                    "  <d:prop>\n"
@@ -369,29 +438,49 @@ void LsColJob::start()
     AbstractNetworkJob::start();
 }
 
-// TODO: Instead of doing all in this slot, we should iteratively parse in readyRead(). This
-// would allow us to be more asynchronous in processing while data is coming from the network,
-// not all in one big blob at the end.
+void LsColJob::newReplyHook(QNetworkReply *reply)
+{
+    // Redirects and authentication retries send a new request: start over
+    QString expectedPath = reply->request().url().path(); // something like "/owncloud/remote.php/webdav/folder"
+    _sizes.clear();
+    _parser.start(expectedPath, &_sizes);
+    _parseFailed = false;
+
+    connect(reply, &QIODevice::readyRead, this, &LsColJob::slotReadyRead);
+}
+
+bool LsColJob::isMultiStatusReply() const
+{
+    QString contentType = reply()->header(QNetworkRequest::ContentTypeHeader).toString();
+    int httpCode = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    return httpCode == 207 && contentType.contains("application/xml; charset=utf-8");
+}
+
+void LsColJob::slotReadyRead()
+{
+    // Other replies are kept in the buffer for the error handling in finished()
+    if (_parseFailed || !reply() || !isMultiStatusReply())
+        return;
+
+    // Parse the entries as they are coming in, so that directoryListingIterated
+    // is emitted early and the whole body never needs to be held in memory.
+    if (!_parser.addData(reply()->readAll())) {
+        _parseFailed = true;
+    }
+}
+
 bool LsColJob::finished()
 {
     qCInfo(lcLsColJob) << "LSCOL of" << reply()->request().url() << "FINISHED WITH STATUS"
                        << replyStatusString();
 
-    QString contentType = reply()->header(QNetworkRequest::ContentTypeHeader).toString();
     int httpCode = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-    if (httpCode == 207 && contentType.contains("application/xml; charset=utf-8")) {
-        LsColXMLParser parser;
-        connect(&parser, &LsColXMLParser::directoryListingSubfolders,
-            this, &LsColJob::directoryListingSubfolders);
-        connect(&parser, &LsColXMLParser::directoryListingIterated,
-            this, &LsColJob::directoryListingIterated);
-        connect(&parser, &LsColXMLParser::finishedWithError,
-            this, &LsColJob::finishedWithError);
-        connect(&parser, &LsColXMLParser::finishedWithoutError,
-            this, &LsColJob::finishedWithoutError);
-
-        QString expectedPath = reply()->request().url().path(); // something like "/owncloud/remote.php/webdav/folder"
-        if (!parser.parse(reply()->readAll(), &_sizes, expectedPath)) {
+    if (isMultiStatusReply()) {
+        // Parse whatever was not handled in slotReadyRead yet
+        if (!_parseFailed && reply()->bytesAvailable() > 0) {
+            _parseFailed = !_parser.addData(reply()->readAll());
+        }
+        if (_parseFailed || !_parser.finish()) {
             // XML parse error
             emit finishedWithError(reply());
         }
@@ -19,6 +19,7 @@
 #include "abstractnetworkjob.h"
 #include "common/result.h"
 #include <QUrlQuery>
+#include <QXmlStreamReader>
 #include <functional>
 
 class QUrl;
@@ -66,13 +67,70 @@ class OWNCLOUDSYNC_EXPORT LsColXMLParser : public QObject
 public:
     explicit LsColXMLParser();
 
+    /** Parses a complete PROPFIND reply in one go.
+     *
+     * Equivalent to start(), addData() and finish().
+     */
     bool parse(const QByteArray &xml, QHash<QString, qint64> *sizes, const QString &expectedPath);
 
+    /** Prepares the parser for incremental parsing of a new reply.
+     *
+     * The reply body can then be passed to addData() in pieces as it arrives
+     * from the network. directoryListingIterated() is emitted as soon as a
+     * <d:response> element is complete.
+     */
+    void start(const QString &expectedPath, QHash<QString, qint64> *sizes);
+
+    /** Feeds the next piece of the reply body.
+     *
+     * Returns false if the data could not be parsed. Once that happened, all
+     * subsequent calls return false.
+     */
+    bool addData(const QByteArray &data);
+
+    /** Called once the whole reply was passed to addData().
+     *
+     * Emits directoryListingSubfolders() and finishedWithoutError() and returns
+     * true if a complete multistatus reply was received.
+     */
+    bool finish();
+
 signals:
     void directoryListingSubfolders(const QStringList &items);
     void directoryListingIterated(const QString &name, const QMap<QString, QString> &properties);
     void finishedWithError(QNetworkReply *reply);
     void finishedWithoutError();
+
+private:
+    bool parseAvailableTokens();
+
+    QXmlStreamReader _reader;
+    QString _expectedPath;
+    QHash<QString, qint64> *_sizes = nullptr;
+    bool _failed = false;
+
+    QStringList _folders;
+    QString _currentHref;
+    QMap<QString, QString> _currentTmpProperties;
+    QMap<QString, QString> _currentHttp200Properties;
+    bool _currentPropsHaveHttp200 = false;
+    bool _insidePropstat = false;
+    bool _insideProp = false;
+    bool _insideMultiStatus = false;
+    bool _multiStatusFinished = false;
+
+    // Text of the element currently being read. Characters may arrive in
+    // several pieces when the reply is split across network packets.
+    enum class TextTarget {
+        None,
+        Href,
+        Status,
+        Property
+    };
+    TextTarget _textTarget = TextTarget::None;
+    QString _text;
+    // Nesting level below the property element that is currently read
+    int _propertyLevel = 0;
 };
 
 class OWNCLOUDSYNC_EXPORT LsColJob : public AbstractNetworkJob
@@ -95,18 +153,37 @@ public:
     void setProperties(QList<QByteArray> properties);
     QList<QByteArray> properties() const;
 
+    /** The value of the Depth header, "1" by default.
+     *
+     * With "infinity" the whole subtree is listed and directoryListingIterated
+     * is emitted for entries at all levels.
+     */
+    void setDepth(const QByteArray &depth) { _depth = depth; }
+    QByteArray depth() const { return _depth; }
+
 signals:
     void directoryListingSubfolders(const QStringList &items);
     void directoryListingIterated(const QString &name, const QMap<QString, QString> &properties);
     void finishedWithError(QNetworkReply *reply);
     void finishedWithoutError();
 
+protected:
+    void newReplyHook(QNetworkReply *reply) override;
+
 private slots:
     virtual bool finished() Q_DECL_OVERRIDE;
+    void slotReadyRead();
 
 private:
+    bool isMultiStatusReply() const;
+
     QList<QByteArray> _properties;
+    QByteArray _depth = "1";
     QUrl _url; // Used instead of path() if the url is specified in the constructor
+
+    // The reply body is parsed while it is arriving
+    LsColXMLParser _parser;
+    bool _parseFailed = false;
 };
 
 /**
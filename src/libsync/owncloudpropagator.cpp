@@ -40,8 +40,11 @@
 #include <QTimer>
 #include <QObject>
 #include <QTimerEvent>
+#include <QSet>
 #include <qmath.h>
 
+#include <limits>
+
 namespace OCC {
 
 Q_LOGGING_CATEGORY(lcPropagator, "sync.propagator", QtInfoMsg)
@@ -74,20 +77,41 @@ qint64 freeSpaceLimit()
     return value;
 }
 
+// The running propagators, they share the budget of network jobs
+Q_GLOBAL_STATIC(QSet<OwncloudPropagator *>, runningPropagators)
+
 OwncloudPropagator::~OwncloudPropagator()
 {
+    leaveJobBudget();
+}
+
+void OwncloudPropagator::leaveJobBudget()
+{
+    if (!runningPropagators.exists() || !runningPropagators->remove(this))
+        return;
+    // The others may run more jobs now
+    for (auto propagator : *runningPropagators)
+        propagator->scheduleNextJob();
 }
 
 
 int OwncloudPropagator::maximumActiveTransferJob()
 {
-    if (_downloadLimit.fetchAndAddAcquire(0) != 0
-        || _uploadLimit.fetchAndAddAcquire(0) != 0
+    if (_downloadLimit.fetchAndAddAcquire(0) < 0
+        || _uploadLimit.fetchAndAddAcquire(0) < 0
         || !_syncOptions._parallelNetworkJobs) {
-        // disable parallelism when there is a network limit.
+        // disable parallelism when there is a relative network limit:
+        // the BandwidthManager measures it on a single transfer.
         return 1;
     }
-    return qMin(3, qCeil(_syncOptions._parallelNetworkJobs / 2.));
+    // With absolute limits the controller stops adding transfers once
+    // they don't improve the throughput anymore.
+    return qMin(_transferConcurrency.current(), hardMaximumActiveJob());
+}
+
+void OwncloudPropagator::reportResponseLatency(qint64 msecs)
+{
+    _transferConcurrency.addResponseLatency(msecs);
 }
 
 /* The maximum number of active jobs in parallel  */
@@ -95,7 +119,19 @@ int OwncloudPropagator::hardMaximumActiveJob()
 {
     if (!_syncOptions._parallelNetworkJobs)
         return 1;
-    return _syncOptions._parallelNetworkJobs;
+    const int running = qMax(1, runningPropagators->size());
+    return qMax(1, _syncOptions._parallelNetworkJobs / running);
+}
+
+void PropagateItemJob::schedule()
+{
+    const char *instruction_str = csync_instruction_str(_item->_instruction);
+    qCInfo(lcPropagator) << "Starting" << instruction_str << "propagation of" << _item->destination() << "by" << this;
+
+    _state = Running;
+    if (parallelism() == WaitForFinished)
+        propagator()->addBlockingJob(this);
+    QMetaObject::invokeMethod(this, "start"); // We could be in a different thread (neon jobs)
 }
 
 PropagateItemJob::~PropagateItemJob()
@@ -359,12 +395,164 @@ PropagateItemJob *OwncloudPropagator::createJob(const SyncFileItemPtr &item)
     return 0;
 }
 
+bool OwncloudPropagator::isBulkUploadCandidate(const SyncFileItem &item)
+{
+    return item._direction == SyncFileItem::Up
+        && (item._instruction == CSYNC_INSTRUCTION_NEW || item._instruction == CSYNC_INSTRUCTION_SYNC)
+        && item._type == ItemTypeFile
+        && item._size < smallFileSize()
+        && account()->capabilities().bulkUpload();
+}
+
 qint64 OwncloudPropagator::smallFileSize()
 {
     const qint64 smallFileSize = 100 * 1024; //default to 1 MB. Not dynamic right now.
     return smallFileSize;
 }
 
+/**
+ * Placeholder in a composite job that only finishes once it is released
+ *
+ * Keeps the root job and the jobs of streamed directories running until
+ * the streaming ends, see OwncloudPropagator::startStreaming(). Also holds
+ * back the metadata of directories with streamed items below them.
+ */
+class PropagateStreamingGate : public PropagatorJob
+{
+public:
+    using PropagatorJob::PropagatorJob;
+
+    void schedule() Q_DECL_OVERRIDE
+    {
+        _state = _released ? Finished : Running;
+        if (_released)
+            emit finished(SyncFileItem::Success);
+    }
+
+    void release()
+    {
+        _released = true;
+        if (_state != Running)
+            return;
+        _state = Finished;
+        emit finished(SyncFileItem::Success);
+    }
+
+private:
+    bool _released = false;
+};
+
+static void releaseGate(PropagatorJob *gate)
+{
+    if (gate)
+        static_cast<PropagateStreamingGate *>(gate)->release();
+}
+
+void OwncloudPropagator::createRootJob()
+{
+    runningPropagators->insert(this);
+    connect(this, &OwncloudPropagator::finished, this, &OwncloudPropagator::leaveJobBudget);
+
+    // The controller may go up to the whole budget, which is shared while
+    // other syncs run
+    _transferConcurrency.reset(qMin(3, qCeil(hardMaximumActiveJob() / 2.)), 1, qMax(1, _syncOptions._parallelNetworkJobs));
+    _transferTimer.start();
+    connect(this, &OwncloudPropagator::itemCompleted, this, [this](const SyncFileItemPtr &item) {
+        _transferProgress.remove(item->_file);
+    });
+
+    _rootJob.reset(new PropagateRootDirectory(this));
+    connect(_rootJob.data(), &PropagatorJob::finished, this, &OwncloudPropagator::emitFinished);
+}
+
+void OwncloudPropagator::startStreaming()
+{
+    createRootJob();
+    connect(this, &OwncloudPropagator::itemCompleted, this, &OwncloudPropagator::slotStreamedItemCompleted);
+
+    _streamingGate = new PropagateStreamingGate(this);
+    _rootJob->appendJob(_streamingGate);
+    _jobScheduled = false;
+    _rootJob->schedule();
+}
+
+void OwncloudPropagator::appendStreamedItem(const SyncFileItemPtr &item)
+{
+    ASSERT(isStreaming());
+    _streamedItems.insert(item.data());
+
+    // The parent is there already, or it is streamed itself
+    const int slashPos = item->_file.lastIndexOf(QLatin1Char('/'));
+    PropagateDirectory *parentJob = slashPos == -1
+        ? _rootJob.data()
+        : _streamedDirectories.value(item->_file.left(slashPos), _rootJob.data());
+
+    if (item->isDirectory()) {
+        // Stays open for the items that start() adds below it
+        auto dir = new PropagateDirectory(this, item);
+        auto gate = new PropagateStreamingGate(this);
+        dir->appendJob(gate);
+        _streamedDirectoryGates.append(gate);
+        _streamedDirectories.insert(item->_file, dir);
+        connect(dir, &PropagatorJob::finished, this, [this, item](SyncFileItem::Status status) {
+            streamedItemDone(item->_file, status);
+        });
+        parentJob->appendJob(dir);
+    } else {
+        parentJob->appendTask(item);
+    }
+    countStreamedItem(item->_file, 1);
+}
+
+void OwncloudPropagator::slotStreamedItemCompleted(const SyncFileItemPtr &item)
+{
+    // Streamed directories are done when their job finishes
+    if (item->isDirectory() || !_streamedItems.contains(item.data()))
+        return;
+    streamedItemDone(item->_file, item->_status);
+}
+
+void OwncloudPropagator::streamedItemDone(const QString &path, SyncFileItem::Status status)
+{
+    // The jobs of the directories above it don't see the failure: make sure
+    // the next sync looks at it again
+    if (status == SyncFileItem::FatalError
+        || status == SyncFileItem::NormalError
+        || status == SyncFileItem::SoftError
+        || status == SyncFileItem::DetailError
+        || status == SyncFileItem::BlacklistedError) {
+        _journal->schedulePathForRemoteDiscovery(path);
+    }
+    countStreamedItem(path, -1);
+}
+
+void OwncloudPropagator::countStreamedItem(const QString &path, int delta)
+{
+    // Up to the first streamed directory, its job waits for its contents anyway
+    for (int slash = path.lastIndexOf(QLatin1Char('/')); slash > 0; slash = path.lastIndexOf(QLatin1Char('/'), slash - 1)) {
+        const QString dir = path.left(slash);
+        if (_streamedDirectories.contains(dir))
+            return;
+        auto it = _pendingStreamedItems.insert(dir, _pendingStreamedItems.value(dir) + delta);
+        if (it.value() == 0) {
+            _pendingStreamedItems.erase(it);
+            releaseGate(_streamedItemGates.take(dir));
+        }
+    }
+}
+
+void OwncloudPropagator::holdForStreamedItems(PropagateDirectory *dir)
+{
+    // Its new etag must not be stored before the streamed items below it are
+    // done: if the sync is interrupted, the next one would not look at them
+    const QString path = dir->_item->_file;
+    if (!_pendingStreamedItems.contains(path))
+        return;
+    auto gate = new PropagateStreamingGate(this);
+    dir->appendJob(gate);
+    _streamedItemGates.insert(path, gate);
+}
+
 void OwncloudPropagator::start(const SyncFileItemVector &items)
 {
     Q_ASSERT(std::is_sorted(items.begin(), items.end()));
@@ -374,13 +562,27 @@ void OwncloudPropagator::start(const SyncFileItemVector &items)
      * In order to do that we loop over the items. (which are sorted by destination)
      * When we enter a directory, we can create the directory job and push it on the stack. */
 
-    _rootJob.reset(new PropagateRootDirectory(this));
+    const bool streaming = isStreaming();
+    if (!streaming)
+        createRootJob();
+
     QStack<QPair<QString /* directory name */, PropagateDirectory * /* job */>> directories;
     directories.push(qMakePair(QString(), _rootJob.data()));
     QVector<PropagatorJob *> directoriesToRemove;
     QString removedDirectory;
     QString maybeConflictDirectory;
     foreach (const SyncFileItemPtr &item, items) {
+        if (streaming && _streamedItems.contains(item.data())) {
+            // Already propagating since the discovery. The other items below
+            // a streamed directory go into its job.
+            if (auto dir = _streamedDirectories.value(item->_file)) {
+                while (!item->destination().startsWith(directories.top().first))
+                    directories.pop();
+                directories.push(qMakePair(item->destination() + "/", dir));
+            }
+            continue;
+        }
+
         if (!removedDirectory.isEmpty() && item->_file.startsWith(removedDirectory)) {
             // this is an item in a directory which is going to be removed.
             PropagateDirectory *delDirJob = qobject_cast<PropagateDirectory *>(directoriesToRemove.first());
@@ -433,6 +635,8 @@ void OwncloudPropagator::start(const SyncFileItemVector &items)
 
         if (item->isDirectory()) {
             PropagateDirectory *dir = new PropagateDirectory(this, item);
+            if (streaming)
+                holdForStreamedItems(dir);
 
             if (item->_instruction == CSYNC_INSTRUCTION_TYPE_CHANGE
                 && item->_direction == SyncFileItem::Up) {
@@ -489,10 +693,19 @@ void OwncloudPropagator::start(const SyncFileItemVector &items)
         _rootJob->_dirDeletionJobs.appendJob(it);
     }
 
-    connect(_rootJob.data(), &PropagatorJob::finished, this, &OwncloudPropagator::emitFinished);
+    if (streaming) {
+        // The jobs added to the running jobs are scheduled already
+        for (const auto &gate : _streamedDirectoryGates)
+            releaseGate(gate);
+        _streamedDirectoryGates.clear();
+        auto gate = _streamingGate.data();
+        _streamingGate.clear();
+        releaseGate(gate);
+        return;
+    }
 
     _jobScheduled = false;
-    scheduleNextJob();
+    _rootJob->schedule();
 }
 
 const SyncOptions &OwncloudPropagator::syncOptions() const
@@ -594,40 +807,93 @@ void OwncloudPropagator::scheduleNextJob()
 {
     if (_jobScheduled) return; // don't schedule more than 1
     _jobScheduled = true;
-    QTimer::singleShot(3, this, &OwncloudPropagator::scheduleNextJobImpl);
+    QTimer::singleShot(0, this, &OwncloudPropagator::scheduleNextJobImpl);
 }
 
 void OwncloudPropagator::scheduleNextJobImpl()
+{
+    _jobScheduled = false;
+
+    // Jobs that finish right away make room for the next one immediately,
+    // give the event loop a chance to run in between
+    const int maximumJobsPerRound = 100;
+    for (int i = 0; i < maximumJobsPerRound; ++i) {
+        if (_abortRequested.fetchAndAddRelaxed(0) || !_rootJob || _rootJob->_state == PropagatorJob::Finished)
+            return;
+        if (!canStartAnotherJob())
+            return;
+        auto composite = nextReadyComposite();
+        if (!composite)
+            return;
+        composite->startNextJob();
+    }
+    scheduleNextJob();
+}
+
+bool OwncloudPropagator::canStartAnotherJob()
 {
     // TODO: If we see that the automatic up-scaling has a bad impact we
     // need to check how to avoid this.
     // Down-scaling on slow networks? https://github.com/owncloud/client/issues/3382
     // Making sure we do up/down at same time? https://github.com/owncloud/client/issues/1633
 
-    _jobScheduled = false;
+    if (_activeJobList.count() < maximumActiveTransferJob())
+        return true;
+    if (_activeJobList.count() >= hardMaximumActiveJob())
+        return false;
 
-    if (_activeJobList.count() < maximumActiveTransferJob()) {
-        if (_rootJob->scheduleSelfOrChild()) {
-            scheduleNextJob();
+    int likelyFinishedQuicklyCount = 0;
+    // NOTE: Only counts the first 3 jobs! Then for each
+    // one that is likely finished quickly, we can launch another one.
+    // When a job finishes another one will "move up" to be one of the first 3 and then
+    // be counted too.
+    for (int i = 0; i < maximumActiveTransferJob() && i < _activeJobList.count(); i++) {
+        if (_activeJobList.at(i)->isLikelyFinishedQuickly()) {
+            likelyFinishedQuicklyCount++;
         }
-    } else if (_activeJobList.count() < hardMaximumActiveJob()) {
-        int likelyFinishedQuicklyCount = 0;
-        // NOTE: Only counts the first 3 jobs! Then for each
-        // one that is likely finished quickly, we can launch another one.
-        // When a job finishes another one will "move up" to be one of the first 3 and then
-        // be counted too.
-        for (int i = 0; i < maximumActiveTransferJob() && i < _activeJobList.count(); i++) {
-            if (_activeJobList.at(i)->isLikelyFinishedQuickly()) {
-                likelyFinishedQuicklyCount++;
-            }
+    }
+    if (_activeJobList.count() < maximumActiveTransferJob() + likelyFinishedQuicklyCount) {
+        qCDebug(lcPropagator) << "Can pump in another request! activeJobs =" << _activeJobList.count();
+        return true;
+    }
+    return false;
+}
+
+PropagatorCompositeJob *OwncloudPropagator::nextReadyComposite()
+{
+    while (!_readyComposites.isEmpty()) {
+        auto it = _readyComposites.begin();
+        PropagatorCompositeJob *composite = it.value();
+        if (!composite || composite->_state != PropagatorJob::Running || !composite->hasJobsToDo()) {
+            _readyComposites.erase(it);
+            continue;
         }
-        if (_activeJobList.count() < maximumActiveTransferJob() + likelyFinishedQuicklyCount) {
-            qCDebug(lcPropagator) << "Can pump in another request! activeJobs =" << _activeJobList.count();
-            if (_rootJob->scheduleSelfOrChild()) {
-                scheduleNextJob();
-            }
+
+        // Everything after a running WaitForFinished job has to wait
+        while (!_blockingJobs.isEmpty()) {
+            auto blocking = _blockingJobs.begin();
+            if (blocking.value() && blocking.value()->_state == PropagatorJob::Running)
+                break;
+            _blockingJobs.erase(blocking);
         }
+        if (!_blockingJobs.isEmpty() && _blockingJobs.firstKey() < it.key())
+            return nullptr;
+        return composite;
     }
+    return nullptr;
+}
+
+void OwncloudPropagator::addReadyComposite(PropagatorCompositeJob *composite)
+{
+    auto position = composite->_position;
+    position.append(std::numeric_limits<quint64>::max());
+    _readyComposites.insert(position, composite);
+    scheduleNextJob();
+}
+
+void OwncloudPropagator::addBlockingJob(PropagatorJob *job)
+{
+    _blockingJobs.insert(job->_position, job);
 }
 
 void OwncloudPropagator::reportFileTotal(const SyncFileItem &item, qint64 newSize)
@@ -637,6 +903,14 @@ void OwncloudPropagator::reportFileTotal(const SyncFileItem &item, qint64 newSiz
 
 void OwncloudPropagator::reportProgress(const SyncFileItem &item, qint64 bytes)
 {
+    auto &reported = _transferProgress[item._file];
+    _transferConcurrency.addTransferredBytes(bytes - reported);
+    reported = bytes;
+    if (_transferTimer.isValid() && _transferConcurrency.update(_transferTimer.elapsed())) {
+        // More transfers may be started now
+        scheduleNextJob();
+    }
+
     emit progress(item, bytes);
 }
 
@@ -766,17 +1040,6 @@ OwncloudPropagator *PropagatorJob::propagator() const
 
 // ================================================================================
 
-PropagatorJob::JobParallelism PropagatorCompositeJob::parallelism()
-{
-    // If any of the running sub jobs is not parallel, we have to wait
-    for (int i = 0; i < _runningJobs.count(); ++i) {
-        if (_runningJobs.at(i)->parallelism() != FullParallelism) {
-            return _runningJobs.at(i)->parallelism();
-        }
-    }
-    return FullParallelism;
-}
-
 void PropagatorCompositeJob::slotSubJobAbortFinished()
 {
     // Count that job has been finished
@@ -791,41 +1054,51 @@ void PropagatorCompositeJob::slotSubJobAbortFinished()
 void PropagatorCompositeJob::appendJob(PropagatorJob *job)
 {
     job->setAssociatedComposite(this);
-    _jobsToDo.append(job);
+    _jobsToDo.enqueue(job);
+    if (_state == Running)
+        propagator()->addReadyComposite(this);
 }
 
-bool PropagatorCompositeJob::scheduleSelfOrChild()
+void PropagatorCompositeJob::appendTask(const SyncFileItemPtr &item)
+{
+    _tasksToDo.enqueue(item);
+    if (_state == Running)
+        propagator()->addReadyComposite(this);
+}
+
+void PropagatorCompositeJob::schedule()
 {
     if (_state == Finished) {
-        return false;
+        return;
     }
+    _state = Running;
 
-    // Start the composite job
-    if (_state == NotYetStarted) {
-        _state = Running;
+    if (hasJobsToDo()) {
+        propagator()->addReadyComposite(this);
+    } else if (_runningJobs.isEmpty()) {
+        // Nothing to do at all
+        QMetaObject::invokeMethod(this, "finalize", Qt::QueuedConnection);
     }
+}
 
-    // Ask all the running composite jobs if they have something new to schedule.
-    for (int i = 0; i < _runningJobs.size(); ++i) {
-        ASSERT(_runningJobs.at(i)->_state == Running);
-
-        if (possiblyRunNextJob(_runningJobs.at(i))) {
-            return true;
-        }
-
-        // If any of the running sub jobs is not parallel, we have to cancel the scheduling
-        // of the rest of the list and wait for the blocking job to finish and schedule the next one.
-        auto paral = _runningJobs.at(i)->parallelism();
-        if (paral == WaitForFinished) {
-            return false;
-        }
-    }
+bool PropagatorCompositeJob::hasJobsToDo()
+{
+    while (!_tasksToDo.isEmpty() && !_tasksToDo.head())
+        _tasksToDo.dequeue();
+    return !_jobsToDo.isEmpty() || !_tasksToDo.isEmpty();
+}
 
-    // Now it's our turn, check if we have something left to do.
+void PropagatorCompositeJob::startNextJob()
+{
     // First, convert a task to a job if necessary
     while (_jobsToDo.isEmpty() && !_tasksToDo.isEmpty()) {
-        SyncFileItemPtr nextTask = _tasksToDo.first();
-        _tasksToDo.remove(0);
+        SyncFileItemPtr nextTask = _tasksToDo.dequeue();
+        if (!nextTask)
+            continue;
+        if (propagator()->isBulkUploadCandidate(*nextTask)) {
+            appendBulkUploadJobs(nextTask);
+            break;
+        }
         PropagatorJob *job = propagator()->createJob(nextTask);
         if (!job) {
             qCWarning(lcDirectory) << "Useless task found for file" << nextTask->destination() << "instruction" << nextTask->_instruction;
@@ -834,22 +1107,47 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
         appendJob(job);
         break;
     }
-    // Then run the next job
-    if (!_jobsToDo.isEmpty()) {
-        PropagatorJob *nextJob = _jobsToDo.first();
-        _jobsToDo.remove(0);
-        _runningJobs.append(nextJob);
-        return possiblyRunNextJob(nextJob);
+
+    if (_jobsToDo.isEmpty()) {
+        // If neither us or our children had stuff left to do we could hang. Make sure
+        // we mark this job as finished so that the propagator can schedule a new one.
+        if (_runningJobs.isEmpty())
+            QMetaObject::invokeMethod(this, "finalize", Qt::QueuedConnection);
+        return;
     }
 
-    // If neither us or our children had stuff left to do we could hang. Make sure
-    // we mark this job as finished so that the propagator can schedule a new one.
-    if (_jobsToDo.isEmpty() && _tasksToDo.isEmpty() && _runningJobs.isEmpty()) {
-        // Our parent jobs are already iterating over their running jobs, post to the event loop
-        // to avoid removing ourself from that list while they iterate.
-        QMetaObject::invokeMethod(this, "finalize", Qt::QueuedConnection);
+    PropagatorJob *nextJob = _jobsToDo.dequeue();
+    nextJob->_position = _position;
+    nextJob->_position.append(_startedJobCount++);
+    _runningJobs.append(nextJob);
+    connect(nextJob, &PropagatorJob::finished, this, &PropagatorCompositeJob::slotSubJobFinished);
+    nextJob->schedule();
+}
+
+void PropagatorCompositeJob::appendBulkUploadJobs(const SyncFileItemPtr &firstTask)
+{
+    // Gather other small uploads of this directory into the same batch
+    SyncFileItemVector batchItems = { firstTask };
+    qint64 batchSize = firstTask->_size;
+    for (int i = 0; i < _tasksToDo.size() && batchItems.size() < BulkUploadBatch::maximumFileCount(); ++i) {
+        const SyncFileItemPtr task = _tasksToDo.at(i);
+        if (task && propagator()->isBulkUploadCandidate(*task) && batchSize + task->_size <= BulkUploadBatch::maximumSize()) {
+            batchSize += task->_size;
+            batchItems.append(task);
+            // Removing it would move all the tasks after it
+            _tasksToDo[i].reset();
+        }
     }
-    return false;
+
+    if (batchItems.size() == 1) {
+        // Nothing to gain
+        appendJob(propagator()->createJob(firstTask));
+        return;
+    }
+
+    QSharedPointer<BulkUploadBatch> batch(new BulkUploadBatch(propagator()));
+    for (const auto &item : batchItems)
+        appendJob(new PropagateUploadFileBulk(propagator(), item, batch));
 }
 
 void PropagatorCompositeJob::slotSubJobFinished(SyncFileItem::Status status)
@@ -873,7 +1171,7 @@ void PropagatorCompositeJob::slotSubJobFinished(SyncFileItem::Status status)
         _hasError = status;
     }
 
-    if (_jobsToDo.isEmpty() && _tasksToDo.isEmpty() && _runningJobs.isEmpty()) {
+    if (!hasJobsToDo() && _runningJobs.isEmpty()) {
         finalize();
     } else {
         propagator()->scheduleNextJob();
@@ -915,39 +1213,22 @@ PropagateDirectory::PropagateDirectory(OwncloudPropagator *propagator, const Syn
     connect(&_subJobs, &PropagatorJob::finished, this, &PropagateDirectory::slotSubJobsFinished);
 }
 
-PropagatorJob::JobParallelism PropagateDirectory::parallelism()
+void PropagateDirectory::schedule()
 {
-    // If any of the non-finished sub jobs is not parallel, we have to wait
-    if (_firstJob && _firstJob->parallelism() != FullParallelism) {
-        return WaitForFinished;
-    }
-    if (_subJobs.parallelism() != FullParallelism) {
-        return WaitForFinished;
-    }
-    return FullParallelism;
-}
-
-
-bool PropagateDirectory::scheduleSelfOrChild()
-{
-    if (_state == Finished) {
-        return false;
-    }
-
-    if (_state == NotYetStarted) {
-        _state = Running;
-    }
-
-    if (_firstJob && _firstJob->_state == NotYetStarted) {
-        return _firstJob->scheduleSelfOrChild();
+    if (_state != NotYetStarted) {
+        return;
     }
+    _state = Running;
 
-    if (_firstJob && _firstJob->_state == Running) {
+    // The sub jobs are below this job in the job tree
+    _subJobs._position = _position;
+    if (_firstJob) {
         // Don't schedule any more job until this is done.
-        return false;
+        _firstJob->_position = _position;
+        _firstJob->schedule();
+    } else {
+        _subJobs.schedule();
     }
-
-    return _subJobs.scheduleSelfOrChild();
 }
 
 void PropagateDirectory::slotFirstJobFinished(SyncFileItem::Status status)
@@ -966,7 +1247,7 @@ void PropagateDirectory::slotFirstJobFinished(SyncFileItem::Status status)
         return;
     }
 
-    propagator()->scheduleNextJob();
+    _subJobs.schedule();
 }
 
 void PropagateDirectory::slotSubJobsFinished(SyncFileItem::Status status)
@@ -1009,12 +1290,6 @@ PropagateRootDirectory::PropagateRootDirectory(OwncloudPropagator *propagator)
     connect(&_dirDeletionJobs, &PropagatorJob::finished, this, &PropagateRootDirectory::slotDirDeletionJobsFinished);
 }
 
-PropagatorJob::JobParallelism PropagateRootDirectory::parallelism()
-{
-    // the root directory parallelism isn't important
-    return WaitForFinished;
-}
-
 void PropagateRootDirectory::abort(PropagatorJob::AbortType abortType)
 {
     if (_firstJob)
@@ -1049,21 +1324,6 @@ qint64 PropagateRootDirectory::committedDiskSpace() const
     return _subJobs.committedDiskSpace() + _dirDeletionJobs.committedDiskSpace();
 }
 
-bool PropagateRootDirectory::scheduleSelfOrChild()
-{
-    if (_state == Finished)
-        return false;
-
-    if (PropagateDirectory::scheduleSelfOrChild())
-        return true;
-
-    // Important: Finish _subJobs before scheduling any deletes.
-    if (_subJobs._state != Finished)
-        return false;
-
-    return _dirDeletionJobs.scheduleSelfOrChild();
-}
-
 void PropagateRootDirectory::slotSubJobsFinished(SyncFileItem::Status status)
 {
     if (status != SyncFileItem::Success
@@ -1078,7 +1338,9 @@ void PropagateRootDirectory::slotSubJobsFinished(SyncFileItem::Status status)
         return;
     }
 
-    propagator()->scheduleNextJob();
+    // Important: Finish _subJobs before scheduling any deletes.
+    _dirDeletionJobs._position = { std::numeric_limits<quint64>::max() };
+    _dirDeletionJobs.schedule();
 }
 
 void PropagateRootDirectory::slotDirDeletionJobsFinished(SyncFileItem::Status status)
@@ -24,11 +24,14 @@
 #include <QPointer>
 #include <QIODevice>
 #include <QMutex>
+#include <QQueue>
+#include <QSet>
 
 #include "csync_util.h"
 #include "syncfileitem.h"
 #include "common/syncjournaldb.h"
 #include "bandwidthmanager.h"
+#include "concurrencycontroller.h"
 #include "accountfwd.h"
 #include "syncoptions.h"
 
@@ -85,12 +88,21 @@ public:
 
         /** No other job shall be started until this one has finished.
             So this job is guaranteed to finish before any jobs below it
-            are executed. */
+            are executed. Jobs above it may still start. */
         WaitForFinished,
     };
 
+    /// Only asked of item jobs, when they are started
     virtual JobParallelism parallelism() { return FullParallelism; }
 
+    /** The position of the job in the job tree
+     *
+     * The position of its composite job followed by the number of jobs that
+     * were started in that composite job before it. Set when the job is started;
+     * jobs at smaller positions are started first, see OwncloudPropagator::scheduleNextJobImpl().
+     */
+    QVector<quint64> _position;
+
     /**
      * For "small" jobs
      */
@@ -121,10 +133,12 @@ public slots:
             emit abortFinished();
     }
 
-    /** Starts this job, or a new subjob
-     * returns true if a job was started.
+    /** Starts this job
+     *
+     * Called once the jobs it depends on are finished and the propagator
+     * has room for another job.
      */
-    virtual bool scheduleSelfOrChild() = 0;
+    virtual void schedule() = 0;
 signals:
     /**
      * Emitted when the job is fully finished
@@ -186,18 +200,7 @@ public:
     }
     ~PropagateItemJob();
 
-    bool scheduleSelfOrChild() Q_DECL_OVERRIDE
-    {
-        if (_state != NotYetStarted) {
-            return false;
-        }
-        const char *instruction_str = csync_instruction_str(_item->_instruction);
-        qCInfo(lcPropagator) << "Starting" << instruction_str << "propagation of" << _item->destination() << "by" << this;
-
-        _state = Running;
-        QMetaObject::invokeMethod(this, "start"); // We could be in a different thread (neon jobs)
-        return true;
-    }
+    void schedule() Q_DECL_OVERRIDE;
 
     SyncFileItemPtr _item;
 
@@ -207,14 +210,19 @@ public slots:
 
 /**
  * @brief Job that runs subjobs. It becomes finished only when all subjobs are finished.
+ *
+ * Once started, the composite job is in the ready queue of the propagator
+ * while it has jobs or tasks to do, and the propagator takes them one by one
+ * with startNextJob().
+ *
  * @ingroup libsync
  */
 class PropagatorCompositeJob : public PropagatorJob
 {
     Q_OBJECT
 public:
-    QVector<PropagatorJob *> _jobsToDo;
-    SyncFileItemVector _tasksToDo;
+    QQueue<PropagatorJob *> _jobsToDo;
+    QQueue<SyncFileItemPtr> _tasksToDo; // null for tasks taken by a bulk upload
     QVector<PropagatorJob *> _runningJobs;
     SyncFileItem::Status _hasError; // NoStatus,  or NormalError / SoftError if there was an error
     quint64 _abortsCount;
@@ -233,13 +241,15 @@ public:
     }
 
     void appendJob(PropagatorJob *job);
-    void appendTask(const SyncFileItemPtr &item)
-    {
-        _tasksToDo.append(item);
-    }
+    void appendTask(const SyncFileItemPtr &item);
 
-    virtual bool scheduleSelfOrChild() Q_DECL_OVERRIDE;
-    virtual JobParallelism parallelism() Q_DECL_OVERRIDE;
+    /// Puts the composite job into the ready queue of the propagator
+    void schedule() Q_DECL_OVERRIDE;
+
+    bool hasJobsToDo();
+
+    /// Starts the next job, creating it from the next task if necessary
+    void startNextJob();
 
     /*
      * Abort synchronously or asynchronously - some jobs
@@ -264,16 +274,14 @@ public:
 
     qint64 committedDiskSpace() const Q_DECL_OVERRIDE;
 
+private:
+    /// Appends upload jobs for firstTask and other small files that can be sent together
+    void appendBulkUploadJobs(const SyncFileItemPtr &firstTask);
+
+    quint64 _startedJobCount = 0;
+
 private slots:
     void slotSubJobAbortFinished();
-    bool possiblyRunNextJob(PropagatorJob *next)
-    {
-        if (next->_state == NotYetStarted) {
-            connect(next, &PropagatorJob::finished, this, &PropagatorCompositeJob::slotSubJobFinished);
-        }
-        return next->scheduleSelfOrChild();
-    }
-
     void slotSubJobFinished(SyncFileItem::Status status);
     void finalize();
 };
@@ -304,8 +312,8 @@ public:
         _subJobs.appendTask(item);
     }
 
-    virtual bool scheduleSelfOrChild() Q_DECL_OVERRIDE;
-    virtual JobParallelism parallelism() Q_DECL_OVERRIDE;
+    /// Starts the first job, and the sub jobs once it has finished
+    virtual void schedule() Q_DECL_OVERRIDE;
     virtual void abort(PropagatorJob::AbortType abortType) Q_DECL_OVERRIDE
     {
         if (_firstJob)
@@ -352,8 +360,6 @@ public:
 
     explicit PropagateRootDirectory(OwncloudPropagator *propagator);
 
-    bool scheduleSelfOrChild() override;
-    JobParallelism parallelism() override;
     void abort(PropagatorJob::AbortType abortType) override;
 
     qint64 committedDiskSpace() const override;
@@ -419,6 +425,29 @@ public:
 
     void start(const SyncFileItemVector &_syncedItems);
 
+    /** Starts propagating before the discovery has finished
+     *
+     * While the discovery runs, items are passed one by one with
+     * appendStreamedItem(). The propagation can't finish before start() was
+     * called with all the items; the streamed ones are skipped there.
+     */
+    void startStreaming();
+
+    /** Propagates an item that was discovered while streaming
+     *
+     * The item must not depend on anything the rest of the discovery may find.
+     * It goes into the job of its parent if that was streamed, into the root
+     * job otherwise. The jobs that start() creates for the directories above
+     * it only store their metadata once it is done.
+     */
+    void appendStreamedItem(const SyncFileItemPtr &item);
+
+    /// Whether the directory was passed to appendStreamedItem()
+    bool isStreamedDirectory(const QString &path) const { return _streamedDirectories.contains(path); }
+
+    /// Whether startStreaming() was called, but not start() yet
+    bool isStreaming() const { return !_streamingGate.isNull(); }
+
     const SyncOptions &syncOptions() const;
     void setSyncOptions(const SyncOptions &syncOptions);
 
@@ -452,9 +481,19 @@ public:
      */
     QHash<QString, qint64> _folderQuota;
 
-    /* the maximum number of jobs using bandwidth (uploads or downloads, in parallel) */
+    /** The maximum number of jobs using bandwidth (uploads or downloads, in parallel)
+     *
+     * Adjusted during the sync from the measured throughput and latency,
+     * see ConcurrencyController.
+     */
     int maximumActiveTransferJob();
 
+    /** Reports the time a transfer request took to get a response.
+     *
+     * Used as the latency signal for the transfer concurrency.
+     */
+    void reportResponseLatency(qint64 msecs);
+
     /** The size to use for upload chunks.
      *
      * Will be dynamically adjusted after each chunk upload finishes
@@ -464,7 +503,17 @@ public:
     qint64 _chunkSize;
     qint64 smallFileSize();
 
-    /* The maximum number of active jobs in parallel  */
+    /** Whether the item's upload may be sent along with other small files.
+     *
+     * See PropagateUploadFileBulk.
+     */
+    bool isBulkUploadCandidate(const SyncFileItem &item);
+
+    /** The maximum number of active jobs in parallel
+     *
+     * The parallelNetworkJobs budget is shared by all propagators that run
+     * at the same time.
+     */
     int hardMaximumActiveJob();
 
     /** Check whether a download would clash with an existing file
@@ -489,7 +538,19 @@ public:
      */
     PropagateItemJob *createJob(const SyncFileItemPtr &item);
 
+    /** Starts jobs from the ready queue soon
+     *
+     * To be called whenever a job may be started: when jobs finish or are
+     * added, and when the limits change.
+     */
     void scheduleNextJob();
+
+    /// The composite job has jobs to start, see PropagatorCompositeJob::schedule()
+    void addReadyComposite(PropagatorCompositeJob *composite);
+
+    /// Holds back all jobs after its position until it has finished
+    void addBlockingJob(PropagatorJob *job);
+
     void reportProgress(const SyncFileItem &, qint64 bytes);
     void reportFileTotal(const SyncFileItem &item, qint64 newSize);
 
@@ -572,6 +633,8 @@ private slots:
 
     void scheduleNextJobImpl();
 
+    void slotStreamedItemCompleted(const SyncFileItemPtr &item);
+
 signals:
     void newItem(const SyncFileItemPtr &);
     void itemCompleted(const SyncFileItemPtr &);
@@ -597,6 +660,49 @@ private:
     QScopedPointer<PropagateRootDirectory> _rootJob;
     SyncOptions _syncOptions;
     bool _jobScheduled = false;
+
+    /** The scheduler's ready queue
+     *
+     * The started composite jobs that have jobs to do, by the position of
+     * their next job: their own position followed by the largest number, so
+     * that jobs below the ones they already started come first. This is the
+     * order of a walk through the job tree.
+     *
+     * Taking the first entry is cheap, but adding a composite compares
+     * positions: O(log n * depth) for n ready composites. n is small, it is
+     * the number of started directories that still have jobs to start.
+     */
+    QMap<QVector<quint64>, QPointer<PropagatorCompositeJob>> _readyComposites;
+    /// The running WaitForFinished jobs, by position
+    QMap<QVector<quint64>, QPointer<PropagatorJob>> _blockingJobs;
+
+    bool canStartAnotherJob();
+    PropagatorCompositeJob *nextReadyComposite();
+
+    void createRootJob();
+
+    /// Keeps the root job running while streaming, see startStreaming()
+    QPointer<PropagatorJob> _streamingGate;
+    /// Keep the jobs of the streamed directories running while streaming
+    QVector<QPointer<PropagatorJob>> _streamedDirectoryGates;
+    /// The items passed to appendStreamedItem()
+    QSet<const SyncFileItem *> _streamedItems;
+    /// The jobs of the streamed directories, by path
+    QHash<QString, PropagateDirectory *> _streamedDirectories;
+    /// The unfinished streamed items below the directories that are not streamed
+    QHash<QString, int> _pendingStreamedItems;
+    /// Hold back the jobs of those directories, see holdForStreamedItems()
+    QHash<QString, QPointer<PropagatorJob>> _streamedItemGates;
+
+    void streamedItemDone(const QString &path, SyncFileItem::Status status);
+    void countStreamedItem(const QString &path, int delta);
+    void holdForStreamedItems(PropagateDirectory *dir);
+
+    void leaveJobBudget();
+
+    ConcurrencyController _transferConcurrency;
+    QElapsedTimer _transferTimer;
+    QHash<QString, qint64> _transferProgress; // bytes reported so far, by file
 };
 
 
@@ -147,6 +147,7 @@ void ProgressInfo::reset()
     _currentItems.clear();
     _currentDiscoveredRemoteFolder.clear();
     _currentDiscoveredLocalFolder.clear();
+    _transferConcurrency = 0;
     _sizeProgress = Progress();
     _fileProgress = Progress();
     _totalSizeOfCompletedJobs = 0;
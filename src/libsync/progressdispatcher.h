@@ -205,6 +205,9 @@ public:
     QString _currentDiscoveredRemoteFolder;
     QString _currentDiscoveredLocalFolder;
 
+    // Used during propagation: number of transfers allowed to run in parallel
+    int _transferConcurrency;
+
     void setProgressComplete(const SyncFileItem &item);
 
     void setProgressItem(const SyncFileItem &item, qint64 completed);
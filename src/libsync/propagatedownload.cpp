@@ -66,6 +66,16 @@ QString OWNCLOUDSYNC_EXPORT createDownloadTmpFileName(const QString &previous)
     }
 }
 
+// The checksum header of a GET reply, used for validating the download
+static QByteArray checksumHeaderFromReply(QNetworkReply *reply)
+{
+    auto checksumHeader = findBestChecksum(reply->rawHeader(checkSumHeaderC));
+    auto contentMd5Header = reply->rawHeader(contentMd5HeaderC);
+    if (checksumHeader.isEmpty() && !contentMd5Header.isEmpty())
+        checksumHeader = "MD5:" + contentMd5Header;
+    return checksumHeader;
+}
+
 // DOES NOT take ownership of the device.
 GETFileJob::GETFileJob(AccountPtr account, const QString &path, QIODevice *device,
     const QMap<QByteArray, QByteArray> &headers, const QByteArray &expectedEtagForResume,
@@ -118,6 +128,8 @@ void GETFileJob::start()
         sendRequest("GET", _directDownloadUrl, req);
     }
 
+    _requestTimer.start();
+
     qCDebug(lcGetJob) << _bandwidthManager << _bandwidthChoked << _bandwidthLimited;
     if (_bandwidthManager) {
         _bandwidthManager->registerDownloadJob(this);
@@ -233,9 +245,29 @@ void GETFileJob::slotMetaDataChanged()
         _lastModified = Utility::qDateTimeToTime_t(lastModified.toDateTime());
     }
 
+    _checksumCalculators.clear();
+    _computedChecksums.clear();
+    if (_computeChecksums && _resumeStart == 0) {
+        QByteArrayList types = { parseChecksumHeaderType(checksumHeaderFromReply(reply())), _additionalChecksumType };
+        types.removeAll(QByteArray());
+        types.removeDuplicates();
+        for (const auto &type : types) {
+            auto calculator = std::make_unique<ChecksumCalculator>(type);
+            if (calculator->isValid())
+                _checksumCalculators.push_back(std::move(calculator));
+        }
+    }
+
+    _responseLatency = _requestTimer.elapsed();
     _saveBodyToFile = true;
 }
 
+void GETFileJob::enableChecksumComputation(const QByteArray &additionalType)
+{
+    _computeChecksums = true;
+    _additionalChecksumType = additionalType;
+}
+
 void GETJob::setBandwidthManager(BandwidthManager *bwm)
 {
     _bandwidthManager = bwm;
@@ -282,6 +314,9 @@ void GETFileJob::slotReadyRead()
         }
         qint64 toRead = bufferSize;
         if (_bandwidthLimited) {
+            if (_bandwidthQuota <= 0 && _bandwidthManager) {
+                _bandwidthQuota = _bandwidthManager->takeDownloadQuota(this, bufferSize);
+            }
             toRead = qMin(qint64(bufferSize), _bandwidthQuota);
             if (toRead == 0) {
                 qCWarning(lcGetJob) << "Out of quota";
@@ -307,10 +342,17 @@ void GETFileJob::slotReadyRead()
             reply()->abort();
             return;
         }
+        for (const auto &calculator : _checksumCalculators)
+            calculator->addData(buffer.constData(), r);
     }
 
     if (reply()->isFinished() && (reply()->bytesAvailable() == 0 || !_saveBodyToFile)) {
         qCDebug(lcGetJob) << "Actually finished!";
+        if (_saveBodyToFile && reply()->error() == QNetworkReply::NoError) {
+            for (const auto &calculator : _checksumCalculators)
+                _computedChecksums[calculator->checksumType()] = calculator->result();
+        }
+        _checksumCalculators.clear();
         if (_bandwidthManager) {
             _bandwidthManager->unregisterDownloadJob(this);
         }
@@ -584,6 +626,7 @@ void PropagateDownloadFile::startFullDownload()
             &_tmpFile, headers, _expectedEtagForResume, _resumeStart, this);
     }
     _job->setBandwidthManager(&propagator()->_bandwidthManager);
+    qobject_cast<GETFileJob *>(_job.data())->enableChecksumComputation(contentChecksumType());
     connect(_job.data(), &GETJob::finishedSignal, this, &PropagateDownloadFile::slotGetFinished);
     connect(qobject_cast<GETFileJob *>(_job.data()), &GETFileJob::downloadProgress,
         this, &PropagateDownloadFile::slotDownloadProgress);
@@ -611,6 +654,7 @@ void PropagateDownloadFile::slotGetFinished()
 
     GETJob *job = _job;
     ASSERT(job);
+    propagator()->reportResponseLatency(job->responseLatency());
 
     SyncFileItem::Status status = job->errorStatus();
 
@@ -795,10 +839,36 @@ void PropagateDownloadFile::slotGetFinished()
         this, &PropagateDownloadFile::transmissionChecksumValidated);
     connect(validator, &ValidateChecksumHeader::validationFailed,
         this, &PropagateDownloadFile::slotChecksumFail);
-    auto checksumHeader = findBestChecksum(job->reply()->rawHeader(checkSumHeaderC));
-    auto contentMd5Header = job->reply()->rawHeader(contentMd5HeaderC);
-    if (checksumHeader.isEmpty() && !contentMd5Header.isEmpty())
-        checksumHeader = "MD5:" + contentMd5Header;
+    connect(validator, &ValidateChecksumHeader::contentChecksumComputed, this,
+        [this](const QByteArray &checksumType, const QByteArray &checksum) {
+            _validatedContentChecksumType = checksumType;
+            _validatedContentChecksum = checksum;
+        });
+    _validatedContentChecksumType.clear();
+    _validatedContentChecksum.clear();
+    auto checksumHeader = checksumHeaderFromReply(job->reply());
+
+    // Use the checksums computed while downloading, if there are any,
+    // to avoid reading the file again.
+    if (auto fileJob = qobject_cast<GETFileJob *>(job)) {
+        const auto theContentChecksumType = contentChecksumType();
+        const auto contentChecksum = fileJob->computedChecksum(theContentChecksumType);
+        if (!contentChecksum.isEmpty()) {
+            _validatedContentChecksumType = theContentChecksumType;
+            _validatedContentChecksum = contentChecksum;
+        }
+
+        const auto transmissionChecksumType = parseChecksumHeaderType(checksumHeader);
+        const auto transmissionChecksum = fileJob->computedChecksum(transmissionChecksumType);
+        if (!transmissionChecksum.isEmpty()) {
+            validator->validate(checksumHeader, transmissionChecksumType, transmissionChecksum);
+            return;
+        }
+    }
+
+    // Otherwise compute the content checksum in the same pass over the downloaded file
+    if (_validatedContentChecksumType.isEmpty())
+        validator->setContentChecksumType(contentChecksumType());
     validator->start(_tmpFile.fileName(), checksumHeader);
 }
 
@@ -917,6 +987,11 @@ void PropagateDownloadFile::transmissionChecksumValidated(const QByteArray &chec
         return contentChecksumComputed(checksumType, checksum);
     }
 
+    // Maybe it was computed together with the transmission checksum?
+    if (_validatedContentChecksumType == theContentChecksumType) {
+        return contentChecksumComputed(_validatedContentChecksumType, _validatedContentChecksum);
+    }
+
     // Compute the content checksum.
     auto computeChecksum = new ComputeChecksum(this);
     computeChecksum->setChecksumType(theContentChecksumType);
@@ -1056,7 +1131,11 @@ void PropagateDownloadFile::updateMetadata(bool isConflict)
         return;
     }
     propagator()->_journal->setDownloadInfo(_item->_file, SyncJournalDb::DownloadInfo());
-    propagator()->_journal->commit("download file start2");
+    // The conflict record can't be reconstructed if it got lost
+    if (isConflict)
+        propagator()->_journal->commit("download file start2");
+    else
+        propagator()->_journal->groupCommit("download file start2");
 
     done(isConflict ? SyncFileItem::Conflict : SyncFileItem::Success);
 
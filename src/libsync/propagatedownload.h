@@ -16,10 +16,15 @@
 #include "owncloudpropagator.h"
 #include "networkjobs.h"
 #include "propagatecommonzsync.h"
+#include "common/checksums.h"
 
 #include <QBuffer>
+#include <QElapsedTimer>
 #include <QFile>
 
+#include <memory>
+#include <vector>
+
 namespace OCC {
 
 class OWNCLOUDSYNC_EXPORT GETJob : public AbstractNetworkJob
@@ -35,6 +40,9 @@ protected:
     qint64 _bandwidthQuota = 0;
     QPointer<BandwidthManager> _bandwidthManager = nullptr;
 
+    QElapsedTimer _requestTimer;
+    qint64 _responseLatency = -1;
+
 public:
     GETJob(AccountPtr account, const QString &path, QObject *parent = 0)
         : AbstractNetworkJob(account, path, parent)
@@ -51,6 +59,9 @@ public:
     virtual qint64 currentDownloadPosition() = 0;
     virtual qint64 resumeStart() { return 0; }
 
+    /// Milliseconds until the response headers arrived, -1 if unknown
+    qint64 responseLatency() const { return _responseLatency; }
+
     QByteArray &etag() { return _etag; }
     time_t lastModified() { return _lastModified; }
 
@@ -83,9 +94,32 @@ class GETFileZsyncJob : public GETJob
     bool _hasEmittedFinishedSignal;
     QByteArray _zsyncData;
     int _nrange = 0;
-    int _current = 0;
-    off_t _pos = 0;
+    int _nextRange = 0; // first entry of _zbyterange that wasn't requested yet
     off_t _received = 0;
+
+    /** A byte range that is part of the running request.
+     *
+     * Nearby ranges from _zbyterange are coalesced into one.
+     */
+    struct RequestedRange
+    {
+        qint64 begin;
+        qint64 end; // inclusive, may exceed the file size
+        qint64 receivedUntil; // data in [begin, receivedUntil) was received
+    };
+    QVector<RequestedRange> _requestedRanges;
+
+    /** Reply parsing state
+     *
+     * Replies with a single range are written directly; for
+     * multipart/byteranges replies, _boundary is set and the part
+     * headers are collected in _partHeader.
+     */
+    QByteArray _boundary;
+    QByteArray _partHeader;
+    bool _multipartDone = false;
+    qint64 _partOffset = 0; // file offset of the next byte of the current part
+    qint64 _partRemaining = 0; // bytes left in the current part
     /* these must be in this order so the destructors are done in the right order */
     zsync_unique_ptr<struct zsync_state> _zs = nullptr;
     zsync_unique_ptr<struct zsync_receiver> _zr = nullptr;
@@ -115,7 +149,14 @@ private:
     void seedFinished(void *zs);
     void seedFailed(const QString &errorString);
 
-    void startCurrentRange(qint64 start = 0, qint64 end = 0);
+    /// Requests the next ranges of _zbyterange, as many as fit in one request
+    void startNextRequest();
+
+    bool processReceivedData(const char *data, qint64 len);
+    bool receiveData(const char *data, qint64 offset, qint64 len);
+
+    /// Returns the offset of the part body in _partHeader, 0 if incomplete and -1 on errors
+    int parsePartHeader();
 
 private slots:
     void slotReadyRead();
@@ -148,6 +189,12 @@ class OWNCLOUDSYNC_EXPORT GETFileJob : public GETJob
     /// Will be set to true once we've seen a 2xx response header
     bool _saveBodyToFile = false;
 
+    /// Checksums are computed from the written data, see enableChecksumComputation()
+    bool _computeChecksums = false;
+    QByteArray _additionalChecksumType;
+    std::vector<std::unique_ptr<ChecksumCalculator>> _checksumCalculators;
+    QMap<QByteArray, QByteArray> _computedChecksums;
+
 public:
     // DOES NOT take ownership of the device.
     explicit GETFileJob(AccountPtr account, const QString &path, QIODevice *device,
@@ -185,6 +232,18 @@ public:
     qint64 expectedContentLength() const { return _expectedContentLength; }
     void setExpectedContentLength(qint64 size) { _expectedContentLength = size; }
 
+    /**
+     * Compute checksums of the body while it is written to the device.
+     *
+     * The type of the checksum announced in the reply headers and
+     * \a additionalType are computed. Nothing is computed when a partial
+     * download is resumed, since that would need the existing data.
+     */
+    void enableChecksumComputation(const QByteArray &additionalType);
+
+    /// The checksum of the whole downloaded body, empty if it wasn't computed
+    QByteArray computedChecksum(const QByteArray &checksumType) const { return _computedChecksums.value(checksumType); }
+
 private slots:
     void slotReadyRead();
     void slotMetaDataChanged();
@@ -228,10 +287,12 @@ signals:
                   done?+> slotGetFinished() <--------+               |
                             +                                        |
                             +-> validate checksum header             |
+                                (and compute the content checksum)   |
                                                                      |
                   done?+> transmissionChecksumValidated()            |
                             +                                        |
                             +-> compute the content checksum         |
+                                if not done yet                      |
                                                                      |
                   done?+> contentChecksumComputed()                  |
                             +                                        |
@@ -307,6 +368,10 @@ private:
     bool _deleteExisting;
     ConflictRecord _conflictRecord;
 
+    /// Content checksum computed while validating the transmission checksum
+    QByteArray _validatedContentChecksumType;
+    QByteArray _validatedContentChecksum;
+
     QElapsedTimer _stopwatch;
 };
 }
@@ -62,15 +62,70 @@ GETFileZsyncJob::GETFileZsyncJob(OwncloudPropagator *propagator, SyncFileItemPtr
 {
 }
 
-void GETFileZsyncJob::startCurrentRange(qint64 start, qint64 end)
+// Ranges closer than that are requested as one, it is cheaper than another round trip
+static const qint64 maximumRangeGap = 64 * 1024;
+// Servers and proxies limit the size of request headers
+static const int maximumRangeHeaderSize = 4000;
+// Apache's default MaxRanges
+static const int maximumRangesPerRequest = 200;
+// The headers of a part of a multipart/byteranges reply
+static const int maximumPartHeaderSize = 16 * 1024;
+
+// Parses "bytes begin-end/total" of a Content-Range header
+static bool parseContentRange(const QByteArray &header, qint64 *begin, qint64 *end)
 {
-    // The end of the range might exceed the file size.
-    // It's size-1 because the Range header is end-inclusive.
-    end = qMin(end, _item->_size - 1);
+    const QByteArray value = header.trimmed();
+    if (!value.startsWith("bytes "))
+        return false;
+    const int dash = value.indexOf('-');
+    const int slash = value.indexOf('/');
+    if (dash < 0 || slash < dash)
+        return false;
+    bool okBegin = false;
+    bool okEnd = false;
+    *begin = value.mid(6, dash - 6).trimmed().toLongLong(&okBegin);
+    *end = value.mid(dash + 1, slash - dash - 1).trimmed().toLongLong(&okEnd);
+    return okBegin && okEnd && *begin <= *end;
+}
+
+void GETFileZsyncJob::startNextRequest()
+{
+    _requestedRanges.clear();
+    QByteArray rangeHeader = "bytes=";
+    while (_nextRange < _nrange) {
+        const off_t *ranges = _zbyterange.get();
+        int last = _nextRange;
+        const qint64 begin = ranges[2 * last];
+        qint64 end = ranges[2 * last + 1];
+        while (last + 1 < _nrange && ranges[2 * (last + 1)] - end - 1 <= maximumRangeGap) {
+            ++last;
+            end = ranges[2 * last + 1];
+        }
+
+        // The end of the range might exceed the file size.
+        // It's size-1 because the Range header is end-inclusive.
+        const QByteArray spec = QByteArray::number(begin) + '-' + QByteArray::number(qMin(end, _item->_size - 1));
+        if (!_requestedRanges.isEmpty()
+            && (rangeHeader.size() + 1 + spec.size() > maximumRangeHeaderSize
+                   || _requestedRanges.size() >= maximumRangesPerRequest)) {
+            break;
+        }
+        if (!_requestedRanges.isEmpty())
+            rangeHeader += ',';
+        rangeHeader += spec;
+        _requestedRanges.append({ begin, end, begin });
+        _nextRange = last + 1;
+    }
+    ASSERT(!_requestedRanges.isEmpty());
+    _headers["Range"] = rangeHeader;
 
-    _headers["Range"] = "bytes=" + QByteArray::number(start) + '-' + QByteArray::number(end);
+    qCDebug(lcZsyncGet) << path() << "HTTP GET with" << _requestedRanges.size() << "ranges" << _headers["Range"].left(100);
 
-    qCDebug(lcZsyncGet) << path() << "HTTP GET with range" << _headers["Range"];
+    _boundary.clear();
+    _partHeader.clear();
+    _multipartDone = false;
+    _partOffset = 0;
+    _partRemaining = 0;
 
     QNetworkRequest req;
     for (QMap<QByteArray, QByteArray>::const_iterator it = _headers.begin(); it != _headers.end(); ++it) {
@@ -90,8 +145,6 @@ void GETFileZsyncJob::startCurrentRange(qint64 start, qint64 end)
         qCWarning(lcZsyncGet) << " Network error: " << errorString();
     }
 
-    _pos = 0;
-
     connect(reply(), &QNetworkReply::downloadProgress, this, &GETFileZsyncJob::slotOverallDownloadProgress);
     connect(reply(), &QIODevice::readyRead, this, &GETFileZsyncJob::slotReadyRead);
     connect(reply(), &QNetworkReply::metaDataChanged, this, &GETFileZsyncJob::slotMetaDataChanged);
@@ -106,12 +159,21 @@ bool GETFileZsyncJob::finished()
         return false;
     }
 
+    if (reply()->error() != QNetworkReply::NoError || _errorStatus != SyncFileItem::NoStatus) {
+        // The download handles the error
+        if (!_hasEmittedFinishedSignal)
+            emit finishedSignal();
+        _hasEmittedFinishedSignal = true;
+        return true;
+    }
+
     // zsync_receive_data will only complete once we have sent block aligned data
-    off_t range_size = _zbyterange.get()[(2 * _current) + 1] - _zbyterange.get()[(2 * _current)] + 1;
-    if (_pos < range_size) {
-        QByteArray fill(range_size - _pos, 0);
-        qCDebug(lcZsyncGet) << "About to zsync" << range_size - _pos << "filler bytes @" << _zbyterange.get()[2 * _current] << "pos:" << _pos << "of" << path();
-        if (zsync_receive_data(_zr.get(), (const unsigned char *)fill.constData(), _zbyterange.get()[2 * _current] + _pos, range_size - _pos) != 0) {
+    for (const auto &range : _requestedRanges) {
+        if (range.receivedUntil > range.end)
+            continue;
+        QByteArray fill(range.end - range.receivedUntil + 1, 0);
+        qCDebug(lcZsyncGet) << "About to zsync" << fill.size() << "filler bytes @" << range.receivedUntil << "of" << path();
+        if (zsync_receive_data(_zr.get(), (const unsigned char *)fill.constData(), range.receivedUntil, fill.size()) != 0) {
             _errorString = "Failed to receive data for: " + _propagator->getFilePath(_item->_file);
             _errorStatus = SyncFileItem::NormalError;
             qCWarning(lcZsyncGet) << "Error while writing to file:" << _errorString;
@@ -121,10 +183,9 @@ bool GETFileZsyncJob::finished()
         }
     }
 
-    // chain the next range if we still have some
-    if (_current < _nrange - 1) {
-        _current++;
-        startCurrentRange(_zbyterange.get()[2 * _current], _zbyterange.get()[(2 * _current) + 1]);
+    // chain the next request if we still have ranges
+    if (_nextRange < _nrange) {
+        startNextRequest();
         return false;
     }
 
@@ -206,8 +267,8 @@ void GETFileZsyncJob::seedFinished(void *zs)
     qCDebug(lcZsyncGet) << "Total bytes:" << totalBytes;
     _propagator->reportFileTotal(*_item, totalBytes);
 
-    /* start getting bytes for first zsync byte range */
-    startCurrentRange(_zbyterange.get()[0], _zbyterange.get()[1]);
+    /* start getting bytes for the first zsync byte ranges */
+    startNextRequest();
 }
 
 void GETFileZsyncJob::seedFailed(const QString &errorString)
@@ -255,6 +316,9 @@ void GETFileZsyncJob::slotReadyRead()
         }
         qint64 toRead = bufferSize;
         if (_bandwidthLimited) {
+            if (_bandwidthQuota <= 0 && _bandwidthManager) {
+                _bandwidthQuota = _bandwidthManager->takeDownloadQuota(this, bufferSize);
+            }
             toRead = qMin(qint64(bufferSize), _bandwidthQuota);
             if (toRead == 0) {
                 qCWarning(lcZsyncGet) << "Out of quota";
@@ -272,26 +336,109 @@ void GETFileZsyncJob::slotReadyRead()
             return;
         }
 
-        if (!_nrange) {
-            qCWarning(lcZsyncGet) << "No ranges to fetch.";
-            _received += r;
-            _pos += r;
-            return;
-        }
-
-        qCDebug(lcZsyncGet) << "About to zsync" << r << "bytes @" << _zbyterange.get()[2 * _current] << "pos:" << _pos << "of" << path();
-
-        if (zsync_receive_data(_zr.get(), (const unsigned char *)buffer.constData(), _zbyterange.get()[2 * _current] + _pos, r) != 0) {
-            _errorString = "Failed to receive data for: " + _propagator->getFilePath(_item->_file);
+        if (!processReceivedData(buffer.constData(), r)) {
+            if (_errorString.isEmpty())
+                _errorString = "Failed to receive data for: " + _propagator->getFilePath(_item->_file);
             _errorStatus = SyncFileItem::NormalError;
             qCWarning(lcZsyncGet) << "Error while writing to file:" << _errorString;
             reply()->abort();
             return;
         }
+    }
+}
+
+bool GETFileZsyncJob::processReceivedData(const char *data, qint64 len)
+{
+    QByteArray rest;
+    while (len > 0) {
+        if (_partRemaining > 0) {
+            const qint64 n = qMin(len, _partRemaining);
+            if (!receiveData(data, _partOffset, n))
+                return false;
+            _partOffset += n;
+            _partRemaining -= n;
+            data += n;
+            len -= n;
+            continue;
+        }
 
-        _received += r;
-        _pos += r;
+        if (_boundary.isEmpty() || _multipartDone) {
+            // Trailing data of a single part reply, or the multipart epilogue
+            return true;
+        }
+
+        // Between two parts: collect the delimiter and the headers of the next part
+        _partHeader.append(data, len);
+        len = 0;
+        const int bodyStart = parsePartHeader();
+        if (bodyStart < 0)
+            return false;
+        if (bodyStart == 0) {
+            if (_partHeader.size() > maximumPartHeaderSize) {
+                _errorString = tr("The server sent invalid multipart data.");
+                return false;
+            }
+            break;
+        }
+        rest = _partHeader.mid(bodyStart);
+        _partHeader.clear();
+        data = rest.constData();
+        len = rest.size();
+    }
+    return true;
+}
+
+int GETFileZsyncJob::parsePartHeader()
+{
+    const QByteArray delimiter = "--" + _boundary;
+    const int delimiterPos = _partHeader.indexOf(delimiter);
+    if (delimiterPos < 0)
+        return 0;
+    const int afterDelimiter = delimiterPos + delimiter.size();
+    if (_partHeader.size() < afterDelimiter + 2)
+        return 0;
+    if (_partHeader.mid(afterDelimiter, 2) == "--") {
+        _multipartDone = true;
+        _partHeader.clear();
+        return 0;
+    }
+    const int headerEnd = _partHeader.indexOf("\r\n\r\n", afterDelimiter);
+    if (headerEnd < 0)
+        return 0;
+
+    const auto lines = _partHeader.mid(afterDelimiter, headerEnd - afterDelimiter).split('\n');
+    for (const auto &line : lines) {
+        const int colon = line.indexOf(':');
+        if (colon < 0 || line.left(colon).trimmed().toLower() != "content-range")
+            continue;
+        qint64 begin = 0;
+        qint64 end = 0;
+        if (!parseContentRange(line.mid(colon + 1), &begin, &end)) {
+            break;
+        }
+        _partOffset = begin;
+        _partRemaining = end - begin + 1;
+        return headerEnd + 4;
     }
+    _errorString = tr("The server sent a multipart part without a valid Content-Range.");
+    return -1;
+}
+
+bool GETFileZsyncJob::receiveData(const char *data, qint64 offset, qint64 len)
+{
+    qCDebug(lcZsyncGet) << "About to zsync" << len << "bytes @" << offset << "of" << path();
+
+    if (zsync_receive_data(_zr.get(), (const unsigned char *)data, offset, len) != 0)
+        return false;
+
+    // Coalesced or reordered parts may cover several of the requested ranges
+    for (auto &range : _requestedRanges) {
+        if (offset <= range.receivedUntil && offset + len > range.receivedUntil)
+            range.receivedUntil = qMin(range.end + 1, offset + len);
+    }
+
+    _received += len;
+    return true;
 }
 
 void GETFileZsyncJob::slotMetaDataChanged()
@@ -326,6 +473,47 @@ void GETFileZsyncJob::slotMetaDataChanged()
     if (!lastModified.isNull()) {
         _lastModified = Utility::qDateTimeToTime_t(lastModified.toDateTime());
     }
+
+    const QByteArray contentType = reply()->rawHeader("Content-Type");
+    qint64 begin = 0;
+    qint64 end = 0;
+    if (httpStatus != 206) {
+        // The server ignored the ranges and sends the whole file: take
+        // the remaining ranges from it as well.
+        qCInfo(lcZsyncGet) << "Server sent the whole file instead of" << _requestedRanges.size() << "ranges";
+        for (; _nextRange < _nrange; ++_nextRange) {
+            const off_t *ranges = _zbyterange.get();
+            _requestedRanges.append({ ranges[2 * _nextRange], ranges[2 * _nextRange + 1], ranges[2 * _nextRange] });
+        }
+        _partOffset = 0;
+        _partRemaining = _item->_size;
+    } else if (contentType.startsWith("multipart/byteranges")) {
+        const int boundaryPos = contentType.indexOf("boundary=");
+        if (boundaryPos >= 0) {
+            _boundary = contentType.mid(boundaryPos + 9).split(';').first().trimmed();
+            if (_boundary.startsWith('"') && _boundary.endsWith('"'))
+                _boundary = _boundary.mid(1, _boundary.size() - 2);
+        }
+        if (_boundary.isEmpty()) {
+            _errorString = tr("The server sent a multipart reply without boundary.");
+            _errorStatus = SyncFileItem::NormalError;
+            reply()->abort();
+            return;
+        }
+    } else if (parseContentRange(reply()->rawHeader("Content-Range"), &begin, &end)) {
+        _partOffset = begin;
+        _partRemaining = end - begin + 1;
+    } else {
+        // Without Content-Range we can only make sense of a single range
+        if (_requestedRanges.size() != 1) {
+            _errorString = tr("The server sent a range reply without Content-Range.");
+            _errorStatus = SyncFileItem::NormalError;
+            reply()->abort();
+            return;
+        }
+        _partOffset = _requestedRanges.first().begin;
+        _partRemaining = qMin(_requestedRanges.first().end, _item->_size - 1) - _partOffset + 1;
+    }
 }
 
 void GETFileZsyncJob::slotOverallDownloadProgress(qint64, qint64)
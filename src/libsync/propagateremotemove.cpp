@@ -242,7 +242,7 @@ void PropagateRemoteMove::finalize()
         }
     }
 
-    propagator()->_journal->commit("Remote Rename");
+    propagator()->_journal->groupCommit("Remote Rename");
     done(SyncFileItem::Success);
 }
 
@@ -245,17 +245,44 @@ void PropagateUploadFileCommon::slotComputeContentChecksum()
         return;
     }
 
-    // Compute the content checksum.
+    // Compute the content checksum. If it can't be reused as the transmission
+    // checksum, compute that one in the same pass to read the file only once.
+    QByteArrayList checksumTypes = { checksumType };
+    const auto transmissionChecksumType = transmissionChecksumTypeFor(checksumType);
+    if (!checksumType.isEmpty() && !transmissionChecksumType.isEmpty())
+        checksumTypes.append(transmissionChecksumType);
+
     auto computeChecksum = new ComputeChecksum(this);
-    computeChecksum->setChecksumType(checksumType);
+    computeChecksum->setChecksumTypes(checksumTypes);
 
-    connect(computeChecksum, &ComputeChecksum::done,
-        this, &PropagateUploadFileCommon::slotComputeTransmissionChecksum);
+    connect(computeChecksum, &ComputeChecksum::checksumsComputed,
+        this, &PropagateUploadFileCommon::slotChecksumsComputed);
     connect(computeChecksum, &ComputeChecksum::done,
         computeChecksum, &QObject::deleteLater);
     computeChecksum->start(filePath);
 }
 
+QByteArray PropagateUploadFileCommon::transmissionChecksumTypeFor(const QByteArray &contentChecksumType) const
+{
+    // Reuse the content checksum as the transmission checksum if possible
+    const auto supportedTransmissionChecksums =
+        propagator()->account()->capabilities().supportedChecksumTypes();
+    if (supportedTransmissionChecksums.contains(contentChecksumType) || !uploadChecksumEnabled())
+        return QByteArray();
+    return propagator()->account()->capabilities().uploadChecksumType();
+}
+
+void PropagateUploadFileCommon::slotChecksumsComputed(const QByteArrayList &checksumTypes, const QByteArrayList &checksums)
+{
+    if (checksumTypes.size() < 2) {
+        slotComputeTransmissionChecksum(checksumTypes.value(0), checksums.value(0));
+        return;
+    }
+
+    _item->_checksumHeader = makeChecksumHeader(checksumTypes[0], checksums[0]);
+    slotStartUpload(checksumTypes[1], checksums[1]);
+}
+
 void PropagateUploadFileCommon::slotComputeTransmissionChecksum(const QByteArray &contentChecksumType, const QByteArray &contentChecksum)
 {
     _item->_checksumHeader = makeChecksumHeader(contentChecksumType, contentChecksum);
@@ -331,6 +358,7 @@ void PropagateUploadFileCommon::slotStartUpload(const QByteArray &transmissionCh
 
 UploadDevice::UploadDevice(const QString &fileName, qint64 start, qint64 size, BandwidthManager *bwm)
     : _file(fileName)
+    , _source(&_file)
     , _start(start)
     , _size(size)
     , _read(0)
@@ -343,6 +371,21 @@ UploadDevice::UploadDevice(const QString &fileName, qint64 start, qint64 size, B
     _bandwidthManager->registerUploadDevice(this);
 }
 
+UploadDevice::UploadDevice(const QByteArray &data, BandwidthManager *bwm)
+    : _source(&_buffer)
+    , _start(0)
+    , _size(data.size())
+    , _read(0)
+    , _bandwidthManager(bwm)
+    , _bandwidthQuota(0)
+    , _readWithProgress(0)
+    , _bandwidthLimited(false)
+    , _choked(false)
+{
+    _buffer.setData(data);
+    _bandwidthManager->registerUploadDevice(this);
+}
+
 
 UploadDevice::~UploadDevice()
 {
@@ -356,6 +399,15 @@ bool UploadDevice::open(QIODevice::OpenMode mode)
     if (mode & QIODevice::WriteOnly)
         return false;
 
+    if (_source == &_buffer) {
+        if (!_buffer.open(QIODevice::ReadOnly)) {
+            setErrorString(_buffer.errorString());
+            return false;
+        }
+        _read = 0;
+        return QIODevice::open(mode);
+    }
+
     // Get the file size now: _file.fileName() is no longer reliable
     // on all platforms after openAndSeekFileSharedRead().
     auto fileDiskSize = FileSystem::getSize(_file.fileName());
@@ -374,7 +426,7 @@ bool UploadDevice::open(QIODevice::OpenMode mode)
 
 void UploadDevice::close()
 {
-    _file.close();
+    _source->close();
     QIODevice::close();
 }
 
@@ -401,6 +453,9 @@ qint64 UploadDevice::readData(char *data, qint64 maxlen)
         return 0;
     }
     if (isBandwidthLimited()) {
+        if (_bandwidthQuota <= 0 && _bandwidthManager) {
+            _bandwidthQuota = _bandwidthManager->takeUploadQuota(this, maxlen);
+        }
         maxlen = qMin(maxlen, _bandwidthQuota);
         if (maxlen <= 0) { // no quota
             return 0;
@@ -408,9 +463,9 @@ qint64 UploadDevice::readData(char *data, qint64 maxlen)
         _bandwidthQuota -= maxlen;
     }
 
-    auto c = _file.read(data, maxlen);
+    auto c = _source->read(data, maxlen);
     if (c < 0) {
-        setErrorString(_file.errorString());
+        setErrorString(_source->errorString());
         return -1;
     }
     _read += c;
@@ -455,7 +510,7 @@ bool UploadDevice::seek(qint64 pos)
         return false;
     }
     _read = pos;
-    _file.seek(_start + pos);
+    _source->seek(_start + pos);
     return true;
 }
 
@@ -674,7 +729,7 @@ void PropagateUploadFileCommon::finalize()
 
     // Remove from the progress database:
     propagator()->_journal->setUploadInfo(_item->_file, SyncJournalDb::UploadInfo());
-    propagator()->_journal->commit("upload file start");
+    propagator()->_journal->groupCommit("upload file start");
 
     done(SyncFileItem::Success);
 }
@@ -20,6 +20,9 @@
 #include <QBuffer>
 #include <QFile>
 #include <QElapsedTimer>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QTimer>
 
 namespace OCC {
 
@@ -37,6 +40,8 @@ class UploadDevice : public QIODevice
     Q_OBJECT
 public:
     UploadDevice(const QString &fileName, qint64 start, qint64 size, BandwidthManager *bwm);
+    /// Uploads \a data from memory, used for requests that are assembled by the client
+    UploadDevice(const QByteArray &data, BandwidthManager *bwm);
     ~UploadDevice();
 
     bool open(QIODevice::OpenMode mode) override;
@@ -61,6 +66,10 @@ signals:
 private:
     /// The local file to read data from
     QFile _file;
+    /// The data to read from, if not uploading from a file
+    QBuffer _buffer;
+    /// Either _file or _buffer
+    QIODevice *_source;
 
     /// Start of the file data to use
     qint64 _start = 0;
@@ -187,7 +196,7 @@ signals:
  *   +--> slotComputeContentChecksum()  <---+
  *                   |
  *                   v
- *    slotComputeTransmissionChecksum()
+ *    slotComputeTransmissionChecksum()  (or slotChecksumsComputed() if both were computed at once)
  *         |
  *         v
  *    slotStartUpload()  -> doStartUpload()
@@ -239,6 +248,8 @@ private slots:
     void slotComputeContentChecksum();
     // Content checksum computed, compute the transmission checksum
     void slotComputeTransmissionChecksum(const QByteArray &contentChecksumType, const QByteArray &contentChecksum);
+    // Content and transmission checksums computed in the same pass
+    void slotChecksumsComputed(const QByteArrayList &checksumTypes, const QByteArrayList &checksums);
     // transmission checksum computed, prepare the upload
     void slotStartUpload(const QByteArray &transmissionChecksumType, const QByteArray &transmissionChecksum);
 
@@ -249,6 +260,9 @@ public:
     void finalize();
     void abortWithError(SyncFileItem::Status status, const QString &error);
 
+    /// The checksum type to send with the upload, empty if the content checksum can be reused or none is wanted
+    QByteArray transmissionChecksumTypeFor(const QByteArray &contentChecksumType) const;
+
 public slots:
     void slotJobDestroyed(QObject *job);
 
@@ -340,6 +354,118 @@ private slots:
     void slotUploadProgress(qint64, qint64);
 };
 
+/**
+ * @brief Network job for the multipart POST of a BulkUploadBatch
+ * @ingroup libsync
+ */
+class BulkUploadJob : public AbstractNetworkJob
+{
+    Q_OBJECT
+
+private:
+    QIODevice *_device;
+    QByteArray _boundary;
+
+public:
+    explicit BulkUploadJob(AccountPtr account, std::unique_ptr<QIODevice> device, const QByteArray &boundary, QObject *parent = 0)
+        : AbstractNetworkJob(account, QString(), parent)
+        , _device(device.release())
+        , _boundary(boundary)
+    {
+        _device->setParent(this);
+    }
+
+    void start() Q_DECL_OVERRIDE;
+    bool finished() Q_DECL_OVERRIDE;
+
+signals:
+    void finishedSignal();
+    void uploadProgress(qint64, qint64);
+};
+
+class BulkUploadBatch;
+
+/**
+ * @ingroup libsync
+ *
+ * Propagation job for a small file that is uploaded together with other
+ * small files in a single request, see BulkUploadBatch.
+ *
+ * The checksum computation and the finalization are the same as for every
+ * other upload. If the bulk request fails, or the server reports an error
+ * for this file, the file is uploaded with a regular PUT instead so the
+ * error handling of PropagateUploadFileV1 applies.
+ */
+class PropagateUploadFileBulk : public PropagateUploadFileV1
+{
+    Q_OBJECT
+    QSharedPointer<BulkUploadBatch> _batch;
+
+public:
+    PropagateUploadFileBulk(OwncloudPropagator *propagator, const SyncFileItemPtr &item,
+        const QSharedPointer<BulkUploadBatch> &batch);
+
+    void doStartUpload() Q_DECL_OVERRIDE;
+
+    /// Called by the batch with this file's part of the bulk reply
+    void bulkUploadSucceeded(const QByteArray &etag, const QByteArray &fileId);
+    /// Called by the batch when this file needs to be uploaded on its own
+    void bulkUploadFailed(const QString &reason);
+
+public slots:
+    void abort(PropagatorJob::AbortType abortType) Q_DECL_OVERRIDE;
+
+protected:
+    void done(SyncFileItem::Status status, const QString &errorString = QString()) Q_DECL_OVERRIDE;
+};
+
+/**
+ * @brief Sends the data of several PropagateUploadFileBulk jobs in one request
+ * @ingroup libsync
+ *
+ * The jobs of a batch are created together (see
+ * PropagatorCompositeJob::startNextJob()) and each of them hands its
+ * file data to the batch once it is ready to upload. When all jobs that are
+ * still alive are ready, or shortly after the first one became ready, a
+ * multipart POST with the ready ones is sent to the bulk endpoint and
+ * the per-file results of its JSON reply are dispatched back to the jobs.
+ */
+class BulkUploadBatch : public QObject
+{
+    Q_OBJECT
+public:
+    explicit BulkUploadBatch(OwncloudPropagator *propagator);
+
+    /** The maximum number of files and bytes in one request */
+    static int maximumFileCount();
+    static qint64 maximumSize();
+
+    void addJob(PropagateUploadFileBulk *job);
+    /// The job is ready, send its data with the next request
+    void jobReady(PropagateUploadFileBulk *job, const QByteArray &data);
+    /// The job finished or was aborted, don't wait for it anymore
+    void removeJob(PropagateUploadFileBulk *job);
+
+private slots:
+    void slotRequestFinished();
+    /// Sends the jobs that are ready, even if others of the batch are not
+    void sendReadyJobs();
+
+private:
+    void sendIfComplete();
+    /// Keeps one job of the batch in the active job list while it holds file data
+    void updateActiveJob();
+    QByteArray encodedPath(const PropagateUploadFileBulk *job) const;
+
+    QPointer<OwncloudPropagator> _propagator;
+    QVector<PropagateUploadFileBulk *> _jobs; /// jobs that haven't been sent yet
+    QVector<QPair<PropagateUploadFileBulk *, QByteArray>> _readyJobs;
+    QVector<PropagateUploadFileBulk *> _sentJobs;
+    QPointer<BulkUploadJob> _request;
+    PropagateUploadFileBulk *_activeJob = nullptr; /// the batch's entry in the active job list
+    QTimer _flushTimer;
+};
+
 /**
  * @ingroup libsync
  *
@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "config.h"
+#include "propagateupload.h"
+#include "owncloudpropagator_p.h"
+#include "networkjobs.h"
+#include "account.h"
+#include "filesystem.h"
+#include "propagatorjobs.h"
+#include "common/asserts.h"
+
+#include <QCryptographicHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QUrl>
+#include <QUuid>
+
+namespace OCC {
+
+void BulkUploadJob::start()
+{
+    QNetworkRequest req;
+    req.setRawHeader("Content-Type", "multipart/related; boundary=" + _boundary);
+    req.setPriority(QNetworkRequest::LowPriority); // Long uploads must not block non-propagation jobs.
+
+    sendRequest("POST", makeAccountUrl(QStringLiteral("remote.php/dav/bulk")), req, _device);
+
+    connect(reply(), &QNetworkReply::uploadProgress, this, &BulkUploadJob::uploadProgress);
+    connect(this, &AbstractNetworkJob::networkActivity, account().data(), &Account::propagatorNetworkActivity);
+    AbstractNetworkJob::start();
+}
+
+bool BulkUploadJob::finished()
+{
+    qCInfo(lcPutJob) << "POST of" << reply()->request().url().toString() << "FINISHED WITH STATUS"
+                     << replyStatusString()
+                     << reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute)
+                     << reply()->attribute(QNetworkRequest::HttpReasonPhraseAttribute);
+
+    emit finishedSignal();
+    return true;
+}
+
+BulkUploadBatch::BulkUploadBatch(OwncloudPropagator *propagator)
+    : _propagator(propagator)
+{
+    // Jobs of the batch that need longer to get ready (checksums, locked files)
+    // must not hold back the ones that are ready.
+    _flushTimer.setSingleShot(true);
+    _flushTimer.setInterval(100);
+    connect(&_flushTimer, &QTimer::timeout, this, &BulkUploadBatch::sendReadyJobs);
+}
+
+int BulkUploadBatch::maximumFileCount()
+{
+    return 100;
+}
+
+qint64 BulkUploadBatch::maximumSize()
+{
+    return 5 * 1000 * 1000; // 5 MB, the files are held in memory
+}
+
+void BulkUploadBatch::addJob(PropagateUploadFileBulk *job)
+{
+    _jobs.append(job);
+}
+
+void BulkUploadBatch::jobReady(PropagateUploadFileBulk *job, const QByteArray &data)
+{
+    ASSERT(_jobs.contains(job));
+    _readyJobs.append(qMakePair(job, data));
+    updateActiveJob();
+    sendIfComplete();
+
+    // Only the batch as a whole is in the active job list, let the
+    // propagator start the other jobs of the batch.
+    if (_propagator)
+        _propagator->scheduleNextJob();
+}
+
+void BulkUploadBatch::removeJob(PropagateUploadFileBulk *job)
+{
+    _jobs.removeOne(job);
+    _sentJobs.removeOne(job);
+    for (int i = 0; i < _readyJobs.size(); ++i) {
+        if (_readyJobs[i].first == job) {
+            _readyJobs.remove(i);
+            break;
+        }
+    }
+    updateActiveJob();
+
+    if (_request && _sentJobs.isEmpty()) {
+        // Nobody is interested in the result anymore
+        _request->reply()->abort();
+    }
+    sendIfComplete();
+}
+
+QByteArray BulkUploadBatch::encodedPath(const PropagateUploadFileBulk *job) const
+{
+    // Percent-encoded: the path must not be able to end the header line.
+    // The reply uses the path as it was sent as key.
+    return QUrl::toPercentEncoding(_propagator->_remoteFolder + job->_item->_file, "/");
+}
+
+void BulkUploadBatch::updateActiveJob()
+{
+    // While the batch holds file data, either waiting or in the request, it
+    // counts as one active transfer. Otherwise the propagator would keep
+    // starting uploads and the data of all of them would be held in memory.
+    PropagateUploadFileBulk *holder = nullptr;
+    if (!_readyJobs.isEmpty()) {
+        holder = _readyJobs.first().first;
+    } else if (_request && !_sentJobs.isEmpty()) {
+        holder = _sentJobs.first();
+    }
+    if (holder == _activeJob)
+        return;
+    if (_propagator) {
+        if (_activeJob)
+            _propagator->_activeJobList.removeOne(_activeJob);
+        if (holder)
+            _propagator->_activeJobList.append(holder);
+    }
+    _activeJob = holder;
+}
+
+void BulkUploadBatch::sendIfComplete()
+{
+    // Wait for the previous request
+    if (_request || !_propagator || _readyJobs.isEmpty())
+        return;
+
+    // Wait a little for the other jobs of the batch
+    if (_readyJobs.size() < _jobs.size()) {
+        if (!_flushTimer.isActive())
+            _flushTimer.start();
+        return;
+    }
+
+    sendReadyJobs();
+}
+
+void BulkUploadBatch::sendReadyJobs()
+{
+    _flushTimer.stop();
+    if (_request || !_propagator || _readyJobs.isEmpty())
+        return;
+
+    const QByteArray boundary = "boundary_" + QUuid::createUuid().toByteArray().mid(1, 36);
+    QByteArray body;
+    for (const auto &ready : _readyJobs) {
+        auto job = ready.first;
+        const auto &data = ready.second;
+        body += "--" + boundary + "\r\n";
+        body += "X-File-Path: " + encodedPath(job) + "\r\n";
+        body += "X-File-Mtime: " + QByteArray::number(qint64(job->_item->_modtime)) + "\r\n";
+        body += "X-File-MD5: " + QCryptographicHash::hash(data, QCryptographicHash::Md5).toHex() + "\r\n";
+        if (!job->_item->_checksumHeader.isEmpty())
+            body += QByteArray(checkSumHeaderC) + ": " + job->_item->_checksumHeader + "\r\n";
+        body += "Content-Length: " + QByteArray::number(data.size()) + "\r\n";
+        body += "\r\n";
+        body += data;
+        body += "\r\n";
+        _sentJobs.append(job);
+        _jobs.removeOne(job);
+    }
+    body += "--" + boundary + "--\r\n";
+    _readyJobs.clear();
+
+    qCInfo(lcPropagateUpload) << "Bulk upload of" << _sentJobs.size() << "files," << body.size() << "bytes";
+
+    // Through an UploadDevice, so the bandwidth limits apply
+    auto device = std::unique_ptr<UploadDevice>(new UploadDevice(body, &_propagator->_bandwidthManager));
+    device->open(QIODevice::ReadOnly);
+    auto devicePtr = device.get(); // for connections later
+    _request = new BulkUploadJob(_propagator->account(), std::move(device), boundary, this);
+    connect(_request.data(), &BulkUploadJob::finishedSignal, this, &BulkUploadBatch::slotRequestFinished);
+    connect(_request.data(), &BulkUploadJob::uploadProgress, devicePtr, &UploadDevice::slotJobUploadProgress);
+    _request->start();
+    updateActiveJob();
+}
+
+void BulkUploadBatch::slotRequestFinished()
+{
+    auto job = qobject_cast<BulkUploadJob *>(sender());
+    ASSERT(job);
+    _request.clear();
+
+    const auto sentJobs = _sentJobs;
+    _sentJobs.clear();
+    updateActiveJob();
+
+    QJsonObject results;
+    QString failureReason;
+    const int httpCode = job->reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (job->reply()->error() != QNetworkReply::NoError) {
+        failureReason = job->errorString();
+    } else {
+        QJsonParseError error;
+        const auto json = QJsonDocument::fromJson(job->reply()->readAll(), &error);
+        if (error.error != QJsonParseError::NoError || !json.isObject()) {
+            failureReason = QStringLiteral("Invalid bulk upload reply: %1").arg(error.errorString());
+        } else {
+            results = json.object();
+        }
+    }
+
+    for (auto sentJob : sentJobs) {
+        sentJob->_item->_httpErrorCode = httpCode;
+        sentJob->_item->_responseTimeStamp = job->responseTimestamp();
+        sentJob->_item->_requestId = job->requestId();
+
+        if (!failureReason.isEmpty()) {
+            sentJob->bulkUploadFailed(failureReason);
+            continue;
+        }
+        const auto result = results.value(QString::fromUtf8(encodedPath(sentJob))).toObject();
+        if (result.isEmpty()) {
+            sentJob->bulkUploadFailed(QStringLiteral("Missing from bulk upload reply"));
+        } else if (result.value(QStringLiteral("error")).toBool()) {
+            sentJob->bulkUploadFailed(result.value(QStringLiteral("message")).toString());
+        } else {
+            sentJob->bulkUploadSucceeded(
+                parseEtag(result.value(QStringLiteral("etag")).toString().toUtf8().constData()),
+                result.value(QStringLiteral("fileid")).toString().toUtf8());
+        }
+    }
+
+    // Jobs that became ready in the meantime
+    sendIfComplete();
+}
+
+PropagateUploadFileBulk::PropagateUploadFileBulk(OwncloudPropagator *propagator, const SyncFileItemPtr &item,
+    const QSharedPointer<BulkUploadBatch> &batch)
+    : PropagateUploadFileV1(propagator, item)
+    , _batch(batch)
+{
+    _batch->addJob(this);
+}
+
+void PropagateUploadFileBulk::doStartUpload()
+{
+    const QString fileName = propagator()->getFilePath(_item->_file);
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCWarning(lcPropagateUpload) << "Could not open" << fileName << "for bulk upload:" << file.errorString();
+
+        // If the file is currently locked, we want to retry the sync
+        // when it becomes available again.
+        if (FileSystem::isFileLocked(fileName)) {
+            emit propagator()->seenLockedFile(fileName);
+        }
+        // Soft error because this is likely caused by the user modifying his files while syncing
+        abortWithError(SyncFileItem::SoftError, file.errorString());
+        return;
+    }
+    const QByteArray data = file.readAll();
+    if (data.size() != _item->_size) {
+        propagator()->_anotherSyncNeeded = true;
+        abortWithError(SyncFileItem::SoftError, tr("Local file changed during sync."));
+        return;
+    }
+
+    propagator()->reportProgress(*_item, 0);
+    _batch->jobReady(this, data);
+}
+
+void PropagateUploadFileBulk::bulkUploadSucceeded(const QByteArray &etag, const QByteArray &fileId)
+{
+    if (etag.isEmpty()) {
+        bulkUploadFailed(QStringLiteral("No etag in bulk upload reply"));
+        return;
+    }
+
+    // Same checks as after a PUT: the upload is done, but maybe another sync is needed
+    const QString fullFilePath(propagator()->getFilePath(_item->_file));
+    if (!FileSystem::fileExists(fullFilePath)
+        || !FileSystem::verifyFileUnchanged(fullFilePath, _item->_size, _item->_modtime)) {
+        propagator()->_anotherSyncNeeded = true;
+    }
+
+    if (!fileId.isEmpty()) {
+        if (!_item->_fileId.isEmpty() && _item->_fileId != fileId) {
+            qCWarning(lcPropagateUpload) << "File ID changed!" << _item->_fileId << fileId;
+        }
+        _item->_fileId = fileId;
+    }
+    _item->_etag = etag;
+
+    propagator()->reportProgress(*_item, _item->_size);
+    finalize();
+}
+
+void PropagateUploadFileBulk::bulkUploadFailed(const QString &reason)
+{
+    qCInfo(lcPropagateUpload) << "Bulk upload of" << _item->_file << "failed:" << reason << "- uploading it alone";
+    _batch->removeJob(this);
+    PropagateUploadFileV1::doStartUpload();
+}
+
+void PropagateUploadFileBulk::abort(PropagatorJob::AbortType abortType)
+{
+    _batch->removeJob(this);
+    PropagateUploadFileV1::abort(abortType);
+}
+
+void PropagateUploadFileBulk::done(SyncFileItem::Status status, const QString &errorString)
+{
+    _batch->removeJob(this);
+    PropagateUploadFileV1::done(status, errorString);
+}
+}
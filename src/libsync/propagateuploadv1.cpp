@@ -211,6 +211,11 @@ void PropagateUploadFileV1::slotPutFinished()
         return;
     }
 
+    // For small files the request duration is dominated by the latency
+    if (_item->_size < propagator()->smallFileSize()) {
+        propagator()->reportResponseLatency(job->msSinceStart().count());
+    }
+
     // The server needs some time to process the request and provide us with a poll URL
     if (_item->_httpErrorCode == 202) {
         QString path = QString::fromUtf8(job->reply()->rawHeader("OC-JobStatus-Location"));
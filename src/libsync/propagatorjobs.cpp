@@ -86,6 +86,49 @@ bool PropagateLocalRemove::removeRecursively(const QString &path)
     return success;
 }
 
+/**
+ * Looks for local files that differ from what the journal knows.
+ *
+ * The discovery may have read unchanged directories from the journal
+ * (LocalDiscoveryStyle::DirectorySnapshots), and files modified in place
+ * don't change their directory. Such an edit must not be removed along
+ * with the server's deletion.
+ */
+bool PropagateLocalRemove::findLocalChange(QString *changedFile)
+{
+    const QString filename = propagator()->_localDir + _item->_file;
+    if (!_item->isDirectory()) {
+        // Placeholders don't have the size of the file
+        if (_item->_type == ItemTypeVirtualFile || _item->_type == ItemTypeVirtualFileDownload)
+            return false;
+        if (FileSystem::fileExists(filename)
+            && !FileSystem::verifyFileUnchanged(filename, _item->_previousSize, _item->_previousModtime)) {
+            *changedFile = filename;
+            return true;
+        }
+        return false;
+    }
+
+    QDirIterator it(filename, QDir::Files | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString path = it.next();
+        SyncJournalFileRecord record;
+        if (!propagator()->_journal->getFileRecord(path.mid(propagator()->_localDir.size()), &record)) {
+            *changedFile = path;
+            return true;
+        }
+        // Files the journal doesn't know may be excluded ones, as before they
+        // are removed with the directory
+        if (!record.isValid() || record.isVirtualFile())
+            continue;
+        if (!FileSystem::verifyFileUnchanged(path, record._fileSize, record._modtime)) {
+            *changedFile = path;
+            return true;
+        }
+    }
+    return false;
+}
+
 void PropagateLocalRemove::start()
 {
     _moveToTrash = propagator()->syncOptions()._moveFilesToTrash;
@@ -101,6 +144,14 @@ void PropagateLocalRemove::start()
         return;
     }
 
+    QString changedFile;
+    if (findLocalChange(&changedFile)) {
+        // The next sync discovers the change locally and uploads it
+        propagator()->_anotherSyncNeeded = true;
+        done(SyncFileItem::SoftError, tr("Could not remove %1 because it was changed locally").arg(QDir::toNativeSeparators(changedFile)));
+        return;
+    }
+
     QString removeError;
     if (_moveToTrash) {
         if ((QDir(filename).exists() || FileSystem::fileExists(filename))
@@ -124,7 +175,7 @@ void PropagateLocalRemove::start()
     }
     propagator()->reportProgress(*_item, 0);
     propagator()->_journal->deleteFileRecord(_item->_originalFile, _item->isDirectory());
-    propagator()->_journal->commit("Local remove");
+    propagator()->_journal->groupCommit("Local remove");
     done(SyncFileItem::Success);
 }
 
@@ -180,7 +231,7 @@ void PropagateLocalMkdir::start()
         done(SyncFileItem::FatalError, tr("Error writing metadata to the database"));
         return;
     }
-    propagator()->_journal->commit("localMkdir");
+    propagator()->_journal->groupCommit("localMkdir");
 
     auto resultStatus = _item->_instruction == CSYNC_INSTRUCTION_CONFLICT
         ? SyncFileItem::Conflict
@@ -262,7 +313,7 @@ void PropagateLocalRename::start()
         return;
     }
 
-    propagator()->_journal->commit("localRename");
+    propagator()->_journal->groupCommit("localRename");
 
     done(SyncFileItem::Success);
 }
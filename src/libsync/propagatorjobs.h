@@ -43,6 +43,7 @@ public:
 
 private:
     bool removeRecursively(const QString &path);
+    bool findLocalChange(QString *changedFile);
     QString _error;
     bool _moveToTrash;
 };
@@ -28,6 +28,7 @@
 #include "common/asserts.h"
 #include "discovery.h"
 #include "common/vfs.h"
+#include "vio/csync_vio_local.h"
 
 #ifdef Q_OS_WIN
 #include <windows.h>
@@ -58,7 +59,7 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcEngine, "sync.engine", QtInfoMsg)
 
-bool SyncEngine::s_anySyncRunning = false;
+int SyncEngine::s_runningSyncCount = 0;
 
 /** When the client touches a file, block change notifications for this duration (ms)
  *
@@ -261,6 +262,30 @@ void SyncEngine::deleteStaleErrorBlacklistEntries(const SyncFileItemVector &sync
     _journal->deleteStaleErrorBlacklistEntries(blacklist_file_paths);
 }
 
+void SyncEngine::deleteStaleDirectorySnapshots(const SyncFileItemVector &syncItems)
+{
+    // A directory is only in sync with the db if nothing is done to its entries
+    QSet<QByteArray> changedDirectories;
+    auto addParent = [&](const QString &path) {
+        const int slash = path.lastIndexOf(QLatin1Char('/'));
+        changedDirectories.insert(slash < 0 ? QByteArray() : path.left(slash).toUtf8());
+    };
+    foreach (const SyncFileItemPtr &it, syncItems) {
+        if (it->_instruction == CSYNC_INSTRUCTION_NONE)
+            continue;
+        addParent(it->_file);
+        if (!it->_renameTarget.isEmpty())
+            addParent(it->_renameTarget);
+        if (it->isDirectory())
+            changedDirectories.insert(it->_file.toUtf8());
+    }
+
+    for (const auto &path : changedDirectories) {
+        _discoveryPhase->_directorySnapshots.remove(path);
+        _journal->setDirectorySnapshot(path, SyncJournalDb::DirectorySnapshot());
+    }
+}
+
 void SyncEngine::conflictRecordMaintenance()
 {
     // Remove stale conflict entries from the database
@@ -279,10 +304,7 @@ void SyncEngine::conflictRecordMaintenance()
     //
     // This happens when the conflicts table is new or when conflict files
     // are downlaoded but the server doesn't send conflict headers.
-    for (const auto &path : _seenFiles) {
-        if (!Utility::isConflictFile(path))
-            continue;
-
+    for (const auto &path : _seenConflictFiles) {
         auto bapath = path.toUtf8();
         if (!conflictRecordPaths.contains(bapath)) {
             ConflictRecord record;
@@ -304,10 +326,13 @@ void SyncEngine::conflictRecordMaintenance()
 
 void OCC::SyncEngine::slotItemDiscovered(const OCC::SyncFileItemPtr &item)
 {
-    _seenFiles.insert(item->_file);
-    if (!item->_renameTarget.isEmpty()) {
+    // Only the conflict files are needed later; remembering every path would
+    // keep all their strings alive until the end of the sync
+    if (Utility::isConflictFile(item->_file))
+        _seenConflictFiles.insert(item->_file);
+    if (!item->_renameTarget.isEmpty() && Utility::isConflictFile(item->_renameTarget)) {
         // Yes, this records both the rename renameTarget and the original so we keep both in case of a rename
-        _seenFiles.insert(item->_renameTarget);
+        _seenConflictFiles.insert(item->_renameTarget);
     }
     if (item->_instruction == CSYNC_INSTRUCTION_UPDATE_METADATA && !item->isDirectory()) {
         // For directories, metadata-only updates will be done after all their files are propagated.
@@ -403,6 +428,10 @@ void OCC::SyncEngine::slotItemDiscovered(const OCC::SyncFileItemPtr &item)
 
     slotNewItem(item);
 
+    // Directories are streamed before their contents, see startSync()
+    if (_propagator && _propagator->isStreaming() && !item->isDirectory() && canPropagateDuringDiscovery(*item))
+        _propagator->appendStreamedItem(item);
+
     if (item->isDirectory()) {
         slotFolderDiscovered(item->_etag.isEmpty(), item->_file);
     }
@@ -423,19 +452,21 @@ void SyncEngine::startSync()
         }
     }
 
-    if (s_anySyncRunning || _syncRunning) {
+    if (_syncRunning) {
         ASSERT(false);
         return;
     }
 
-    s_anySyncRunning = true;
+    ++s_runningSyncCount;
     _syncRunning = true;
     _anotherSyncNeeded = NoFollowUpSync;
     _clearTouchedFilesTimer.stop();
 
     _hasNoneFiles = false;
     _hasRemoveFile = false;
-    _seenFiles.clear();
+    _seenConflictFiles.clear();
+    _itemsCompletedDuringDiscovery.clear();
+    _lastCheckedParentDir.clear();
 
     _progressInfo->reset();
 
@@ -567,6 +598,8 @@ void SyncEngine::startSync()
         _discoveryPhase->_invalidFilenameRx = QRegExp(invalidFilenamePattern);
     _discoveryPhase->_serverBlacklistedFiles = _account->capabilities().blacklistedFiles();
     _discoveryPhase->_ignoreHiddenFiles = ignoreHiddenFiles();
+    _discoveryPhase->_listNewRemoteSubtrees = _account->capabilities().propfindDepthInfinity();
+    _discoveryPhase->_useDirectorySnapshots = _localDiscoveryStyle == LocalDiscoveryStyle::DirectorySnapshots;
 
     connect(_discoveryPhase.data(), &DiscoveryPhase::itemDiscovered, this, &SyncEngine::slotItemDiscovered);
     connect(_discoveryPhase.data(), &DiscoveryPhase::newBigFolder, this, &SyncEngine::newBigFolder);
@@ -578,6 +611,15 @@ void SyncEngine::startSync()
     connect(_discoveryPhase.data(), &DiscoveryPhase::silentlyExcluded,
         _syncFileStatusTracker.data(), &SyncFileStatusTracker::slotAddSilentlyExcluded);
 
+    if (_syncOptions._propagateDuringDiscovery) {
+        createPropagator();
+        _propagator->startStreaming();
+        connect(_discoveryPhase.data(), &DiscoveryPhase::directoryQueued, this, [this](const SyncFileItemPtr &item) {
+            if (_propagator && _propagator->isStreaming() && canPropagateDuringDiscovery(*item))
+                _propagator->appendStreamedItem(item);
+        });
+    }
+
     auto discoveryJob = new ProcessDirectoryJob(
         _discoveryPhase.data(), PinState::AlwaysLocal, _discoveryPhase.data());
     _discoveryPhase->startJob(discoveryJob);
@@ -707,6 +749,35 @@ void SyncEngine::slotDiscoveryFinished()
     // do a database commit
     _journal->commit("post treewalk");
 
+    // The propagator exists already if it was streaming during discovery
+    if (!_propagator)
+        createPropagator();
+
+    deleteStaleDownloadInfos(_syncItems);
+    deleteStaleUploadInfos(_syncItems);
+    deleteStaleErrorBlacklistEntries(_syncItems);
+    deleteStaleDirectorySnapshots(_syncItems);
+    _journal->commit("post stale entry removal");
+
+    // Records of propagated items may be committed in groups from now on
+    _journal->setGroupCommitLimits(_syncOptions._journalGroupCommitSize, _syncOptions._journalGroupCommitInterval);
+
+    // Emit the started signal only after the propagator has been set up.
+    if (_needsUpdate)
+        emit(started());
+
+    _propagator->start(_syncItems);
+    _syncItems.clear();
+
+    for (const auto &item : _itemsCompletedDuringDiscovery)
+        emit itemCompleted(item);
+    _itemsCompletedDuringDiscovery.clear();
+
+    qCInfo(lcEngine) << "#### Post-Reconcile end #################################################### " << _stopWatch.addLapTime(QLatin1String("Post-Reconcile Finished")) << "ms";
+}
+
+void SyncEngine::createPropagator()
+{
     _propagator = QSharedPointer<OwncloudPropagator>(
         new OwncloudPropagator(_account, _localPath, _remotePath, _journal));
     _propagator->setSyncOptions(_syncOptions);
@@ -725,20 +796,54 @@ void SyncEngine::slotDiscoveryFinished()
 
     // apply the network limits to the propagator
     setNetworkLimits(_uploadLimit, _downloadLimit);
+}
 
-    deleteStaleDownloadInfos(_syncItems);
-    deleteStaleUploadInfos(_syncItems);
-    deleteStaleErrorBlacklistEntries(_syncItems);
-    _journal->commit("post stale entry removal");
-
-    // Emit the started signal only after the propagator has been set up.
-    if (_needsUpdate)
-        emit(started());
-
-    _propagator->start(_syncItems);
-    _syncItems.clear();
+bool SyncEngine::canPropagateDuringDiscovery(const SyncFileItem &item)
+{
+    if (item._instruction != CSYNC_INSTRUCTION_NEW
+        || item._direction != SyncFileItem::Down
+        || item._file != item._originalFile) {
+        return false;
+    }
+    if (item.isDirectory()) {
+        // Only directories that are new on both sides: nothing below them can
+        // be moved or removed locally, and the moves into them are not streamed
+        SyncJournalFileRecord record;
+        csync_file_stat_t buf;
+        if (item._type != ItemTypeDirectory
+            || !_journal->getFileRecord(item._file, &record)
+            || record.isValid()
+            || csync_vio_local_stat((_localPath + item._file).toUtf8().constData(), &buf) == 0
+            || _journal->errorBlacklistEntry(item._file).isValid()) {
+            return false;
+        }
+    } else if (item._type != ItemTypeFile && item._type != ItemTypeVirtualFile) {
+        return false;
+    }
 
-    qCInfo(lcEngine) << "#### Post-Reconcile end #################################################### " << _stopWatch.addLapTime(QLatin1String("Post-Reconcile Finished")) << "ms";
+    const int slashPos = item._file.lastIndexOf(QLatin1Char('/'));
+    if (slashPos == -1)
+        return true;
+    const QString parentDir = item._file.left(slashPos);
+    if (_propagator->isStreamedDirectory(parentDir))
+        return true;
+    if (parentDir == _lastCheckedParentDir)
+        return _lastCheckedParentDirUnchanged;
+
+    // The directory item itself is only discovered after its contents, so
+    // compare the directory on disk with the database instead: a different
+    // inode means it was replaced or moved there
+    SyncJournalFileRecord record;
+    csync_file_stat_t buf;
+    _lastCheckedParentDir = parentDir;
+    _lastCheckedParentDirUnchanged = _journal->getFileRecord(parentDir, &record)
+        && record.isValid()
+        && record.isDirectory()
+        && record._inode != 0
+        && csync_vio_local_stat((_localPath + parentDir).toUtf8().constData(), &buf) == 0
+        && buf.type == ItemTypeDirectory
+        && buf.inode == record._inode;
+    return _lastCheckedParentDirUnchanged;
 }
 
 void SyncEngine::slotCleanPollsJobAborted(const QString &error)
@@ -769,8 +874,16 @@ void SyncEngine::setNetworkLimits(int upload, int download)
 void SyncEngine::slotItemCompleted(const SyncFileItemPtr &item)
 {
     _progressInfo->setProgressComplete(*item);
+    if (_propagator)
+        _progressInfo->_transferConcurrency = _propagator->maximumActiveTransferJob();
 
     emit transmissionProgress(*_progressInfo);
+
+    if (_propagator && _propagator->isStreaming()) {
+        // Announced after the discovery, see slotDiscoveryFinished()
+        _itemsCompletedDuringDiscovery.append(item);
+        return;
+    }
     emit itemCompleted(item);
 }
 
@@ -782,6 +895,9 @@ void SyncEngine::slotPropagationFinished(bool success)
 
     if (success && _discoveryPhase) {
         _journal->setDataFingerprint(_discoveryPhase->_dataFingerprint);
+
+        for (auto it = _discoveryPhase->_directorySnapshots.constBegin(); it != _discoveryPhase->_directorySnapshots.constEnd(); ++it)
+            _journal->setDirectorySnapshot(it.key(), it.value());
     }
 
     conflictRecordMaintenance();
@@ -805,15 +921,26 @@ void SyncEngine::finalize(bool success)
     _stopWatch.stop();
 
     if (_discoveryPhase) {
+        _discoveryPhase->cancelDbQueries();
         _discoveryPhase.take()->deleteLater();
     }
-    s_anySyncRunning = false;
+    if (_syncRunning)
+        --s_runningSyncCount;
     _syncRunning = false;
+
+    if (_propagator && _propagator->isStreaming()) {
+        // The sync ended before the discovery did: stop what was started early
+        disconnect(_propagator.data(), nullptr, this, nullptr);
+        _propagator->abort();
+    }
+    _itemsCompletedDuringDiscovery.clear();
+    // Flushes anything still waiting for a group commit
+    _journal->setGroupCommitLimits(1, std::chrono::milliseconds(0));
     emit finished(success);
 
     // Delete the propagator only after emitting the signal.
     _propagator.clear();
-    _seenFiles.clear();
+    _seenConflictFiles.clear();
     _uniqueErrors.clear();
     _localDiscoveryPaths.clear();
     _localDiscoveryStyle = LocalDiscoveryStyle::FilesystemOnly;
@@ -824,6 +951,8 @@ void SyncEngine::finalize(bool success)
 void SyncEngine::slotProgress(const SyncFileItem &item, qint64 current)
 {
     _progressInfo->setProgressItem(item, current);
+    if (_propagator)
+        _progressInfo->_transferConcurrency = _propagator->maximumActiveTransferJob();
     emit transmissionProgress(*_progressInfo);
 }
 
@@ -936,7 +1065,7 @@ void SyncEngine::setLocalDiscoveryOptions(LocalDiscoveryStyle style, std::set<QS
 
 bool SyncEngine::shouldDiscoverLocally(const QString &path) const
 {
-    if (_localDiscoveryStyle == LocalDiscoveryStyle::FilesystemOnly)
+    if (_localDiscoveryStyle != LocalDiscoveryStyle::DatabaseAndFilesystem)
         return true;
 
     // The intention is that if "A/X" is in _localDiscoveryPaths:
@@ -1003,12 +1132,19 @@ void SyncEngine::abort()
         qCInfo(lcEngine) << "Aborting sync";
 
     if (_propagator) {
+        if (_propagator->isStreaming() && _discoveryPhase) {
+            // The discovery would go on to start the rest of the propagation
+            disconnect(_discoveryPhase.data(), 0, this, 0);
+            _discoveryPhase->cancelDbQueries();
+            _discoveryPhase.take()->deleteLater();
+        }
         // If we're already in the propagation phase, aborting that is sufficient
         _propagator->abort();
     } else if (_discoveryPhase) {
         // Delete the discovery and all child jobs after ensuring
         // it can't finish and start the propagator
         disconnect(_discoveryPhase.data(), 0, this, 0);
+        _discoveryPhase->cancelDbQueries();
         _discoveryPhase.take()->deleteLater();
 
         syncError(tr("Aborted"));
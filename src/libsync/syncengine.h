@@ -106,6 +106,12 @@ public:
      * the synced folder. All the parent directories of these paths will not
      * be read from the db and scanned on the filesystem.
      *
+     * If style is DirectorySnapshots, every directory is checked with a
+     * single stat against the snapshot that an earlier sync stored for it.
+     * Unchanged directories are read from the db. This can't notice files
+     * that were modified in place, so it should only be used where the
+     * alternative is not knowing about any change, like at startup.
+     *
      * Note, the style and paths are only retained for the next sync and
      * revert afterwards. Use _lastLocalDiscoveryStyle to discover the last
      * sync's style.
@@ -217,13 +223,31 @@ private:
     // Removes stale error blacklist entries from the journal.
     void deleteStaleErrorBlacklistEntries(const SyncFileItemVector &syncItems);
 
+    // Removes the snapshots of directories that propagation will change,
+    // the remaining ones are stored after the sync succeeded.
+    void deleteStaleDirectorySnapshots(const SyncFileItemVector &syncItems);
+
     // Removes stale and adds missing conflict records after sync
     void conflictRecordMaintenance();
 
     // cleanup and emit the finished signal
     void finalize(bool success);
 
-    static bool s_anySyncRunning; //true when one sync is running somewhere (for debugging)
+    // Creates _propagator and connects it to the engine
+    void createPropagator();
+
+    /**
+     * Whether the item can be propagated before the discovery has finished.
+     *
+     * Only new remote files and directories: the rest of the discovery can't
+     * affect what happens to them. Their parent must exist unchanged on disk
+     * or be streamed itself, and new directories must not exist locally or in
+     * the database. Directories that were moved, removed or replaced are held
+     * back with everything in them.
+     */
+    bool canPropagateDuringDiscovery(const SyncFileItem &item);
+
+    static int s_runningSyncCount; // sync runs of all engines, several folders may sync at once (for debugging)
 
     // Must only be acessed during update and reconcile
     QVector<SyncFileItemPtr> _syncItems;
@@ -238,8 +262,15 @@ private:
     QScopedPointer<DiscoveryPhase> _discoveryPhase;
     QSharedPointer<OwncloudPropagator> _propagator;
 
-    // List of all files we seen
-    QSet<QString> _seenFiles;
+    // The conflict files seen during discovery
+    QSet<QString> _seenConflictFiles;
+
+    // Items propagated during discovery are only announced after aboutToPropagate()
+    SyncFileItemVector _itemsCompletedDuringDiscovery;
+
+    // Last result of canPropagateDuringDiscovery() for a parent directory
+    QString _lastCheckedParentDir;
+    bool _lastCheckedParentDirUnchanged = false;
 
     QScopedPointer<ProgressInfo> _progressInfo;
 
@@ -20,6 +20,7 @@
 #include "common/asserts.h"
 #include "csync_exclude.h"
 
+#include <QFileInfo>
 #include <QLoggingCategory>
 
 namespace OCC {
@@ -130,6 +131,9 @@ SyncFileStatus SyncFileStatusTracker::fileStatus(const QString &relativePath)
         return resolveSyncAndErrorStatus(QString(), NotShared);
     }
 
+    SyncJournalFileRecord rec;
+    const bool hasRecord = _syncEngine->journal()->getFileRecord(relativePath, &rec) && rec.isValid();
+
     // The SyncEngine won't notify us at all for CSYNC_FILE_SILENTLY_EXCLUDED
     // and CSYNC_FILE_EXCLUDE_AND_REMOVE excludes. Even though it's possible
     // that the status of CSYNC_FILE_EXCLUDE_LIST excludes will change if the user
@@ -138,9 +142,7 @@ SyncFileStatus SyncFileStatusTracker::fileStatus(const QString &relativePath)
     // it's an acceptable compromize to treat all exclude types the same.
     // Update: This extra check shouldn't hurt even though silently excluded files
     // are now available via slotAddSilentlyExcluded().
-    if (_syncEngine->excludedFiles().isExcluded(_syncEngine->localPath() + relativePath,
-            _syncEngine->localPath(),
-            _syncEngine->ignoreHiddenFiles())) {
+    if (isExcluded(relativePath, hasRecord ? &rec : nullptr)) {
         return SyncFileStatus(SyncFileStatus::StatusExcluded);
     }
 
@@ -148,8 +150,7 @@ SyncFileStatus SyncFileStatusTracker::fileStatus(const QString &relativePath)
         return SyncFileStatus::StatusSync;
 
     // First look it up in the database to know if it's shared
-    SyncJournalFileRecord rec;
-    if (_syncEngine->journal()->getFileRecord(relativePath, &rec) && rec.isValid()) {
+    if (hasRecord) {
         return resolveSyncAndErrorStatus(relativePath, rec._remotePerm.hasPermission(RemotePermissions::IsShared) ? Shared : NotShared);
     }
 
@@ -157,6 +158,27 @@ SyncFileStatus SyncFileStatusTracker::fileStatus(const QString &relativePath)
     return resolveSyncAndErrorStatus(relativePath, NotShared, PathUnknown);
 }
 
+bool SyncFileStatusTracker::isExcluded(const QString &relativePath, const SyncJournalFileRecord *rec) const
+{
+    // File managers ask for the status of every file they show: avoid looking
+    // at the disk. The hidden attribute isn't known here, dot files are still
+    // recognized by their name.
+    const auto &excludes = _syncEngine->excludedFiles();
+    const auto &localPath = _syncEngine->localPath();
+    const bool excludeHidden = _syncEngine->ignoreHiddenFiles();
+    if (rec) {
+        return excludes.isExcludedRelative(relativePath, localPath,
+            rec->isDirectory() ? ItemTypeDirectory : ItemTypeFile, false, excludeHidden);
+    }
+
+    // Unknown items: only when the type makes a difference it is looked up
+    const bool excludedAsFile = excludes.isExcludedRelative(relativePath, localPath, ItemTypeFile, false, excludeHidden);
+    const bool excludedAsDir = excludes.isExcludedRelative(relativePath, localPath, ItemTypeDirectory, false, excludeHidden);
+    if (excludedAsFile == excludedAsDir)
+        return excludedAsFile;
+    return QFileInfo(localPath + relativePath).isDir() ? excludedAsDir : excludedAsFile;
+}
+
 void SyncFileStatusTracker::slotPathTouched(const QString &fileName)
 {
     QString folderPath = _syncEngine->localPath();
@@ -25,6 +25,7 @@
 namespace OCC {
 
 class SyncEngine;
+class SyncJournalFileRecord;
 
 /**
  * @brief Takes care of tracking the status of individual files as they
@@ -64,6 +65,8 @@ private:
         Shared };
     enum PathKnownFlag { PathUnknown = 0,
         PathKnown };
+    // Without touching the disk unless the record is missing and the type matters
+    bool isExcluded(const QString &relativePath, const SyncJournalFileRecord *rec) const;
     SyncFileStatus resolveSyncAndErrorStatus(const QString &relativePath, SharedFlag sharedState, PathKnownFlag isPathKnown = PathKnown);
 
     void invalidateParentPaths(const QString &path);
@@ -46,6 +46,14 @@ void SyncOptions::fillFromEnvironmentVariables()
     int maxParallel = qgetenv("OWNCLOUD_MAX_PARALLEL").toInt();
     if (maxParallel > 0)
         _parallelNetworkJobs = maxParallel;
+
+    int groupCommitSize = qgetenv("OWNCLOUD_JOURNAL_GROUP_COMMIT_SIZE").toInt();
+    if (groupCommitSize > 0)
+        _journalGroupCommitSize = groupCommitSize;
+
+    QByteArray propagateDuringDiscoveryEnv = qgetenv("OWNCLOUD_PROPAGATE_DURING_DISCOVERY");
+    if (!propagateDuringDiscoveryEnv.isEmpty())
+        _propagateDuringDiscovery = propagateDuringDiscoveryEnv != "0";
 }
 
 void SyncOptions::verifyChunkSizes()
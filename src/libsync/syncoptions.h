@@ -67,6 +67,30 @@ struct OWNCLOUDSYNC_EXPORT SyncOptions
     /** The maximum number of active jobs in parallel  */
     int _parallelNetworkJobs = 6;
 
+    /** Commit the journal after this many propagated items at most
+     *
+     * Each commit is a sync to disk, so committing after every single item
+     * limits how fast many small files can be propagated. 1 commits every
+     * item on its own. See SyncJournalDb::groupCommit().
+     */
+    int _journalGroupCommitSize = 100;
+
+    /** Commit the journal at the latest this long after an item was propagated */
+    std::chrono::milliseconds _journalGroupCommitInterval = std::chrono::seconds(2);
+
+    /** Start propagating new remote files while the discovery is still running
+     *
+     * Otherwise nothing is propagated before the whole tree has been discovered.
+     * See SyncEngine::canPropagateDuringDiscovery().
+     */
+    bool _propagateDuringDiscovery = false;
+
+    /** Maximum number of entries kept from the Depth:infinity listing of a new directory
+     *
+     * The subdirectories of larger subtrees are listed one level at a time.
+     */
+    int _maxSubtreeListingEntries = 10000;
+
     /** Whether delta-synchronization is enabled */
     bool _deltaSyncEnabled = false;
 
@@ -76,7 +100,8 @@ struct OWNCLOUDSYNC_EXPORT SyncOptions
     /** Reads settings from env vars where available.
      *
      * Currently reads _initialChunkSize, _minChunkSize, _maxChunkSize,
-     * _targetChunkUploadDuration, _parallelNetworkJobs.
+     * _targetChunkUploadDuration, _parallelNetworkJobs, _journalGroupCommitSize,
+     * _propagateDuringDiscovery.
      */
     void fillFromEnvironmentVariables();
 
@@ -0,0 +1,101 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtCore>
+
+#include "csync_exclude.h"
+
+using namespace OCC;
+
+// Compares traversal exclude matching with the glob matchers and with the
+// regular expressions. Pass the number of extra exclude patterns as argument;
+// the default of 400 is in the range of large corporate exclude lists.
+
+#define EXCLUDE_LIST_FILE SOURCEDIR "/../../sync-exclude.lst"
+
+static QStringList makePatterns(int count)
+{
+    QStringList patterns;
+    for (int i = 0; patterns.size() < count; ++i) {
+        const QString n = QString::number(i);
+        patterns << (QStringLiteral("generated") + n + QStringLiteral(".tmp"))
+                 << (QStringLiteral("*.ext") + n)
+                 << (QStringLiteral("cache") + n + QStringLiteral("*"))
+                 << (QStringLiteral("build") + n + QStringLiteral("/"))
+                 << (QStringLiteral("*backup") + n + QStringLiteral("*.old"))
+                 << (QStringLiteral("[Tt]emp") + n + QStringLiteral("?"))
+                 << (QStringLiteral("]project") + n + QStringLiteral("/out/*"))
+                 << (QStringLiteral("docs/draft") + n + QStringLiteral("/*.bak"));
+    }
+    return patterns.mid(0, count);
+}
+
+static QStringList makePaths()
+{
+    QStringList paths;
+    const char *names[] = { "report.docx", "Thumbs.db", "main.cpp", "notes.txt~", "cache12_data", "image.ext7",
+        "file.part", "Temp3x", "x.backup4.old", "generated9.tmp", "README", "photo_2019-04-01.jpg" };
+    for (int d = 0; d < 100; ++d) {
+        const QString dir = QStringLiteral("project") + QString::number(d);
+        paths << dir << (dir + QStringLiteral("/out")) << (dir + QStringLiteral("/src"));
+        for (int f = 0; f < 100; ++f) {
+            const QString name = QString::fromUtf8(names[f % (sizeof(names) / sizeof(names[0]))]);
+            paths << (dir + QStringLiteral("/src/") + QString::number(f) + name)
+                  << (dir + QStringLiteral("/out/") + name);
+        }
+    }
+    return paths;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const int patternCount = argc > 1 ? QByteArray(argv[1]).toInt() : 400;
+
+    ExcludedFiles excludes;
+    excludes.addExcludeFilePath(EXCLUDE_LIST_FILE);
+    for (const auto &pattern : makePatterns(patternCount))
+        excludes.addManualExclude(pattern);
+
+    QElapsedTimer timer;
+    timer.start();
+    excludes.reloadExcludeFiles();
+    qDebug() << "PREPARE:" << timer.restart() << "ms," << patternCount << "extra patterns";
+
+    const auto paths = makePaths();
+    auto run = [&](bool useGlobMatchers, QVector<int> &results) {
+        excludes.setUseGlobMatchers(useGlobMatchers);
+        results.clear();
+        results.reserve(paths.size() * 2);
+        QElapsedTimer runTimer;
+        runTimer.start();
+        for (const auto &path : paths) {
+            results.append(excludes.traversalPatternMatch(path, ItemTypeFile));
+            results.append(excludes.traversalPatternMatch(path, ItemTypeDirectory));
+        }
+        return runTimer.elapsed();
+    };
+
+    QVector<int> regexResults;
+    QVector<int> globResults;
+    // The first glob run fills the DFA cache
+    qDebug() << "GLOB (cold):" << run(true, globResults) << "ms," << paths.size() * 2 << "checks";
+    qDebug() << "GLOB:" << run(true, globResults) << "ms";
+    qDebug() << "REGEX:" << run(false, regexResults) << "ms";
+
+    int excluded = 0;
+    for (int result : globResults) {
+        if (result != CSYNC_NOT_EXCLUDED)
+            ++excluded;
+    }
+    qDebug() << "EXCLUDED:" << excluded;
+    if (globResults != regexResults) {
+        qWarning() << "The glob matchers and the regexes disagree";
+        return 1;
+    }
+    return 0;
+}
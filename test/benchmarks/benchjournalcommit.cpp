@@ -0,0 +1,58 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtCore>
+
+#include "common/syncjournaldb.h"
+#include "common/syncjournalfilerecord.h"
+
+using namespace OCC;
+
+// Measures writing the records of propagated items with a commit after each
+// of them, and with group commits. Pass the number of items as argument;
+// the default is 5000.
+
+static qint64 writeRecords(SyncJournalDb &journal, const QByteArray &prefix, int count, bool group)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < count; ++i) {
+        SyncJournalFileRecord record;
+        record._path = prefix + "/file" + QByteArray::number(i);
+        record._type = ItemTypeFile;
+        record._inode = i + 1;
+        record._fileId = prefix + QByteArray::number(i);
+        record._etag = "etag";
+        record._remotePerm = RemotePermissions::fromDbValue("RW");
+        journal.setFileRecord(record);
+        if (group)
+            journal.groupCommit("bench");
+        else
+            journal.commit("bench");
+    }
+    journal.commit("bench done");
+    return timer.elapsed();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const int count = argc > 1 ? QByteArray(argv[1]).toInt() : 5000;
+
+    QTemporaryDir tempDir;
+    SyncJournalDb journal(tempDir.path() + "/sync.db");
+    journal.commit("bench start");
+
+    qDebug() << "COMMIT EACH:" << writeRecords(journal, "single", count, false) << "ms," << count << "items";
+
+    journal.setGroupCommitLimits(100, std::chrono::seconds(2));
+    qDebug() << "GROUP COMMIT (100):" << writeRecords(journal, "group", count, true) << "ms," << count << "items";
+
+    journal.setGroupCommitLimits(1, std::chrono::milliseconds(0));
+    journal.close();
+    return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtCore>
+
+#include "common/syncjournaldb.h"
+#include "common/syncjournalfilerecord.h"
+#include "common/ownsql.h"
+
+using namespace OCC;
+
+// Measures reading the journal in the path||'/' order used by discovery.
+// Pass the number of entries per directory level as argument; the default of
+// 100 creates 100 directories with 100 subdirectories of 100 files each,
+// about one million rows.
+
+static qint64 timeQuery(SqlDatabase &db, const QByteArray &sql)
+{
+    QElapsedTimer timer;
+    timer.start();
+    SqlQuery query(db);
+    if (query.prepare(sql) != 0 || !query.exec())
+        return -1;
+    int rows = 0;
+    while (query.next().hasData)
+        ++rows;
+    qDebug() << rows << "rows";
+    return timer.elapsed();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const int perLevel = argc > 1 ? QByteArray(argv[1]).toInt() : 100;
+
+    QTemporaryDir tempDir;
+    const QString dbPath = tempDir.path() + "/sync.db";
+
+    QElapsedTimer timer;
+    timer.start();
+    {
+        SyncJournalDb journal(dbPath);
+        qint64 inode = 1;
+        auto makeEntry = [&](const QByteArray &path, ItemType type) {
+            SyncJournalFileRecord record;
+            record._path = path;
+            record._type = type;
+            record._inode = inode++;
+            record._fileId = QByteArray::number(record._inode);
+            record._etag = "etag";
+            record._remotePerm = RemotePermissions::fromDbValue("RW");
+            journal.setFileRecord(record);
+        };
+        for (int i = 0; i < perLevel; ++i) {
+            const QByteArray dir = "dir" + QByteArray::number(i);
+            makeEntry(dir, ItemTypeDirectory);
+            for (int j = 0; j < perLevel; ++j) {
+                // The '-' sorts before '/', exercising the trailing slash ordering
+                const QByteArray subDir = dir + "/sub-" + QByteArray::number(j);
+                makeEntry(subDir, ItemTypeDirectory);
+                for (int k = 0; k < perLevel; ++k)
+                    makeEntry(subDir + "/file" + QByteArray::number(k), ItemTypeFile);
+            }
+        }
+        journal.commit("bench");
+        qDebug() << "FILL:" << timer.restart() << "ms," << inode - 1 << "rows";
+
+        int count = 0;
+        journal.getFilesBelowPath("", [&](const SyncJournalFileRecord &) { ++count; });
+        qDebug() << "getFilesBelowPath(\"\"):" << timer.restart() << "ms," << count << "rows";
+
+        count = 0;
+        journal.getFilesBelowPath("dir1", [&](const SyncJournalFileRecord &) { ++count; });
+        qDebug() << "getFilesBelowPath(\"dir1\"):" << timer.restart() << "ms," << count << "rows";
+
+        count = 0;
+        for (int i = 0; i < perLevel; ++i)
+            journal.listFilesInPath("dir" + QByteArray::number(i), [&](const SyncJournalFileRecord &) { ++count; });
+        qDebug() << "listFilesInPath(dirN):" << timer.restart() << "ms," << count << "rows";
+
+        journal.close();
+    }
+
+    // Compare the same ordering with and without the path||'/' index
+    SqlDatabase db;
+    if (!db.openReadOnly(dbPath))
+        return -1;
+    qDebug() << "ORDER BY path||'/' NOT INDEXED:"
+             << timeQuery(db, "SELECT path, inode, fileid FROM metadata NOT INDEXED ORDER BY path||'/' ASC;") << "ms";
+    qDebug() << "ORDER BY path||'/' INDEXED:"
+             << timeQuery(db, "SELECT path, inode, fileid FROM metadata INDEXED BY metadata_path_sort ORDER BY path||'/' ASC;") << "ms";
+    return 0;
+}
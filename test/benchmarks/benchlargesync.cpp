@@ -8,6 +8,16 @@
 #include "syncenginetestutils.h"
 #include <syncengine.h>
 
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+#ifdef Q_OS_MAC
+#include <mach/mach.h>
+#endif
+
 using namespace OCC;
 
 int numDirs = 0;
@@ -31,19 +41,61 @@ void addBunchOfFiles(int depth, const QString &path, FileModifier &fi) {
     }
 }
 
+// Current resident memory of the process in KiB, -1 if unknown
+//
+// Memory that was freed is handed back to the system first, so the numbers
+// can also go down.
+static long residentMemoryKiB()
+{
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+#ifdef Q_OS_LINUX
+    QFile statm(QStringLiteral("/proc/self/statm"));
+    if (statm.open(QIODevice::ReadOnly)) {
+        const auto fields = statm.readAll().split(' ');
+        if (fields.size() > 1)
+            return fields.at(1).toLong() * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+#elif defined(Q_OS_MAC)
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) == KERN_SUCCESS)
+        return info.resident_size / 1024;
+#endif
+    return -1;
+}
+
+// Runs a sync and reports its duration and the memory it left behind
+static bool benchSync(FakeFolder &fakeFolder, const char *name, QElapsedTimer &timer)
+{
+    const long before = residentMemoryKiB();
+    timer.restart();
+    bool result = fakeFolder.syncOnce();
+    qDebug() << name << result << timer.elapsed();
+
+    // The engine deletes the jobs and items of the run with deleteLater()
+    QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+    const long after = residentMemoryKiB();
+    qDebug() << name << "MEMORY (KiB) before:" << before << "after:" << after
+             << "bytes per item:" << (after - before) * 1024 / (numFiles + numDirs);
+    return result;
+}
+
 int main(int argc, char *argv[])
 {
     QCoreApplication app(argc, argv);
     FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
-    addBunchOfFiles<10, 8, 4>(0, "", fakeFolder.localModifier());
+    // On the server, so that its files are allocated before the first
+    // measurement and only the client's memory is counted
+    addBunchOfFiles<10, 8, 4>(0, "", fakeFolder.remoteModifier());
 
     qDebug() << "NUMFILES" << numFiles;
     qDebug() << "NUMDIRS" << numDirs;
+    qDebug() << "SIZEOF SYNCFILEITEM" << sizeof(SyncFileItem);
     QElapsedTimer timer;
     timer.start();
-    bool result1 = fakeFolder.syncOnce();
-    qDebug() << "FIRST SYNC: " << result1 << timer.restart();
-    bool result2 = fakeFolder.syncOnce();
-    qDebug() << "SECOND SYNC: " << result2 << timer.restart();
+    bool result1 = benchSync(fakeFolder, "FIRST SYNC:", timer);
+    bool result2 = benchSync(fakeFolder, "SECOND SYNC:", timer);
     return (result1 && result2) ? 0 : -1;
 }
@@ -18,6 +18,8 @@
 #include <cstring>
 
 #include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QNetworkReply>
 #include <QMap>
 #include <QtTest>
@@ -410,8 +412,15 @@ public:
         };
 
         writeFileResponse(*fileInfo);
-        foreach(const FileInfo &childFileInfo, fileInfo->children)
-           writeFileResponse(childFileInfo);
+        const bool depthInfinity = request.rawHeader("Depth") == "infinity";
+        std::function<void(const FileInfo &)> writeChildren = [&](const FileInfo &dirInfo) {
+            foreach(const FileInfo &childFileInfo, dirInfo.children) {
+                writeFileResponse(childFileInfo);
+                if (depthInfinity && childFileInfo.isDir)
+                    writeChildren(childFileInfo);
+            }
+        };
+        writeChildren(*fileInfo);
         xml.writeEndElement(); // multistatus
         xml.writeEndDocument();
 
@@ -613,7 +622,7 @@ public:
         QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
     }
 
-    Q_INVOKABLE void respond() {
+    Q_INVOKABLE virtual void respond() {
         if (aborted) {
             setError(OperationCanceledError, "Operation Canceled");
             emit metaDataChanged();
@@ -662,6 +671,7 @@ public:
     QByteArray payload;
     quint64 offset = 0;
     bool aborted = false;
+    bool partial = false; // 206 reply to a Range request
 
     FakeGetWithDataReply(FileInfo &remoteRootFileInfo, const QByteArray &data, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
         : QNetworkReply{ parent }
@@ -680,13 +690,35 @@ public:
 
         if (request.hasRawHeader("Range")) {
             const QString range = request.rawHeader("Range");
-            const QRegularExpression bytesPattern(QStringLiteral("bytes=(?<start>\\d+)-(?<end>\\d+)"));
-            const QRegularExpressionMatch match = bytesPattern.match(range);
-            if (match.hasMatch())
-            {
+            const QRegularExpression bytesPattern(QStringLiteral("(?<start>\\d+)-(?<end>\\d+)"));
+            QVector<QPair<int, int>> ranges;
+            auto it = bytesPattern.globalMatch(range);
+            while (it.hasNext()) {
+                const QRegularExpressionMatch match = it.next();
                 const int start = match.captured(QStringLiteral("start")).toInt();
-                const int end = match.captured(QStringLiteral("end")).toInt();
-                payload = payload.mid(start, end - start + 1);
+                const int end = qMin(match.captured(QStringLiteral("end")).toInt(), data.size() - 1);
+                ranges.append(qMakePair(start, end));
+            }
+            auto contentRange = [&](const QPair<int, int> &r) -> QByteArray {
+                return "bytes " + QByteArray::number(r.first) + '-' + QByteArray::number(r.second) + '/' + QByteArray::number(data.size());
+            };
+            if (ranges.size() == 1) {
+                payload = data.mid(ranges[0].first, ranges[0].second - ranges[0].first + 1);
+                setRawHeader("Content-Range", contentRange(ranges[0]));
+                partial = true;
+            } else if (ranges.size() > 1) {
+                // multipart/byteranges, RFC 7233 Appendix A
+                const QByteArray boundary = "THIS_STRING_SEPARATES";
+                payload.clear();
+                for (const auto &r : ranges) {
+                    payload += "\r\n--" + boundary + "\r\n";
+                    payload += "Content-Type: application/octet-stream\r\n";
+                    payload += "Content-Range: " + contentRange(r) + "\r\n\r\n";
+                    payload += data.mid(r.first, r.second - r.first + 1);
+                }
+                payload += "\r\n--" + boundary + "--\r\n";
+                setRawHeader("Content-Type", "multipart/byteranges; boundary=" + boundary);
+                partial = true;
             }
         }
     }
@@ -700,7 +732,7 @@ public:
             return;
         }
         setHeader(QNetworkRequest::ContentLengthHeader, payload.size());
-        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 200);
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, partial ? 206 : 200);
         setRawHeader("OC-ETag", fileInfo->etag.toLatin1());
         setRawHeader("ETag", fileInfo->etag.toLatin1());
         setRawHeader("OC-FileId", fileInfo->fileId);
@@ -993,6 +1025,60 @@ public:
     QByteArray _body;
 };
 
+// Stores the parts of a multipart bulk upload POST and replies with the per-file results
+class FakeBulkUploadReply : public FakePayloadReply
+{
+    Q_OBJECT
+public:
+    FakeBulkUploadReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request,
+        const QByteArray &postPayload, QObject *parent)
+        : FakePayloadReply{ op, request, perform(remoteRootFileInfo, request, postPayload), parent }
+    {
+    }
+
+    static QByteArray perform(FileInfo &remoteRootFileInfo, const QNetworkRequest &request, const QByteArray &postPayload)
+    {
+        const QByteArray contentType = request.rawHeader("Content-Type");
+        const QByteArray boundary = "--" + contentType.mid(contentType.indexOf("boundary=") + 9);
+        QJsonObject result;
+        int pos = 0;
+        while ((pos = postPayload.indexOf(boundary, pos)) != -1) {
+            pos += boundary.size();
+            if (postPayload.mid(pos, 2) == "--")
+                break;
+            const int headersEnd = postPayload.indexOf("\r\n\r\n", pos);
+            QMap<QByteArray, QByteArray> headers;
+            for (const auto &line : postPayload.mid(pos, headersEnd - pos).trimmed().split('\n')) {
+                const int colon = line.indexOf(':');
+                headers[line.left(colon).trimmed().toLower()] = line.mid(colon + 1).trimmed();
+            }
+            pos = headersEnd + 4;
+            const QByteArray data = postPayload.mid(pos, headers["content-length"].toInt());
+            pos += data.size();
+
+            const QString path = QUrl::fromPercentEncoding(headers["x-file-path"]);
+            const QString fileName = path.mid(1); // the path starts with '/'
+            FileInfo *fileInfo = remoteRootFileInfo.find(fileName);
+            const char contentChar = data.isEmpty() ? 'W' : data.at(0);
+            if (fileInfo) {
+                fileInfo->size = data.size();
+                fileInfo->contentChar = contentChar;
+            } else {
+                fileInfo = remoteRootFileInfo.create(fileName, data.size(), contentChar);
+            }
+            fileInfo->lastModified = OCC::Utility::qDateTimeFromTime_t(headers["x-file-mtime"].toLongLong());
+            remoteRootFileInfo.find(fileName, /*invalidate_etags=*/true);
+
+            QJsonObject fileResult;
+            fileResult["error"] = false;
+            fileResult["etag"] = fileInfo->etag;
+            fileResult["fileid"] = QString::fromUtf8(fileInfo->fileId);
+            // Keyed by the header value, as the server does
+            result[QString::fromUtf8(headers["x-file-path"])] = fileResult;
+        }
+        return QJsonDocument(result).toJson();
+    }
+};
 
 class FakeErrorReply : public QNetworkReply
 {
@@ -1118,6 +1204,9 @@ protected:
             if (auto reply = _override(op, request, outgoingData))
                 return reply;
         }
+        if (request.url().path().endsWith(QLatin1String("/remote.php/dav/bulk")))
+            return new FakeBulkUploadReply{_remoteRootFileInfo, op, request, outgoingData->readAll(), this};
+
         const QString fileName = getFilePathFromUrl(request.url());
         Q_ASSERT(!fileName.isNull());
         if (_errorPaths.contains(fileName))
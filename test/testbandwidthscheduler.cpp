@@ -0,0 +1,199 @@
+/*
+ * This software is in the public domain, furnished "as is", without technical
+ * support, and with no warranty, express or implied, as to its usefulness for
+ * any purpose.
+ *
+ */
+
+#include <QtTest>
+
+#include "account.h"
+#include "bandwidthscheduler.h"
+
+using namespace OCC;
+
+class Consumer : public QObject
+{
+    Q_OBJECT
+public:
+    int wakeUps = 0;
+
+public slots:
+    void wakeUp() { ++wakeUps; }
+};
+
+class TestBandwidthScheduler : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cleanup()
+    {
+        auto scheduler = BandwidthScheduler::instance();
+        scheduler->setGlobalLimit(BandwidthScheduler::Upload, 0);
+        scheduler->setGlobalLimit(BandwidthScheduler::Download, 0);
+    }
+
+    void testTokenBucket()
+    {
+        TokenBucket bucket;
+        QVERIFY(!bucket.isLimited());
+        bucket.setRate(100000);
+        QVERIFY(bucket.isLimited());
+        QCOMPARE(bucket.burst(), 10000LL);
+
+        bucket.refill(0);
+        QCOMPARE(bucket.available(), 0LL);
+        bucket.refill(50);
+        QCOMPARE(bucket.available(), 5000LL);
+        bucket.consume(4000);
+        QCOMPARE(bucket.available(), 1000LL);
+
+        // Does not fill beyond the burst
+        bucket.refill(10000);
+        QCOMPARE(bucket.available(), 10000LL);
+        bucket.consume(20000);
+        QCOMPARE(bucket.available(), 0LL);
+    }
+
+    void testUnlimited()
+    {
+        auto scheduler = BandwidthScheduler::instance();
+        Consumer consumer;
+        QCOMPARE(scheduler->take(&consumer, 8192), 8192LL);
+
+        auto account = Account::create();
+        scheduler->registerConsumer(&consumer, account.data(), BandwidthScheduler::Upload, nullptr, "wakeUp");
+        QVERIFY(!scheduler->isLimited(account.data(), BandwidthScheduler::Upload));
+        QCOMPARE(scheduler->take(&consumer, 8192), 8192LL);
+        scheduler->unregisterConsumer(&consumer);
+    }
+
+    void testGlobalLimitIsShared()
+    {
+        auto scheduler = BandwidthScheduler::instance();
+        auto account1 = Account::create();
+        auto account2 = Account::create();
+        Consumer consumer1;
+        Consumer consumer2;
+        Consumer downloader;
+        scheduler->registerConsumer(&consumer1, account1.data(), BandwidthScheduler::Upload, nullptr, "wakeUp");
+        scheduler->registerConsumer(&consumer2, account2.data(), BandwidthScheduler::Upload, nullptr, "wakeUp");
+        scheduler->registerConsumer(&downloader, account1.data(), BandwidthScheduler::Download, nullptr, "wakeUp");
+
+        scheduler->setGlobalLimit(BandwidthScheduler::Upload, 100000);
+        QVERIFY(scheduler->isLimited(account2.data(), BandwidthScheduler::Upload));
+        QVERIFY(!scheduler->isLimited(account2.data(), BandwidthScheduler::Download));
+
+        // Download is not affected
+        QCOMPARE(scheduler->take(&downloader, 1000000), 1000000LL);
+
+        // Take everything there is: the consumers get a fair share each, and are
+        // woken up when there is quota again
+        qint64 total1 = 0;
+        qint64 total2 = 0;
+        QElapsedTimer timer;
+        timer.start();
+        while (timer.elapsed() < 1000) {
+            total1 += scheduler->take(&consumer1, 1000000);
+            total2 += scheduler->take(&consumer2, 1000000);
+            QTest::qWait(10);
+        }
+        QVERIFY(consumer1.wakeUps > 0);
+        QVERIFY(consumer2.wakeUps > 0);
+        QVERIFY(total1 + total2 <= 100000 + 10000);
+        QVERIFY(total1 + total2 >= 50000);
+        QVERIFY(qAbs(total1 - total2) <= (total1 + total2) / 3);
+
+        scheduler->unregisterConsumer(&consumer1);
+        scheduler->unregisterConsumer(&consumer2);
+        scheduler->unregisterConsumer(&downloader);
+    }
+
+    void testAccountsShareGlobalLimit()
+    {
+        auto scheduler = BandwidthScheduler::instance();
+        auto account1 = Account::create();
+        auto account2 = Account::create();
+        Consumer consumer1;
+        Consumer consumer2;
+        scheduler->registerConsumer(&consumer1, account1.data(), BandwidthScheduler::Upload, nullptr, "wakeUp");
+        scheduler->registerConsumer(&consumer2, account2.data(), BandwidthScheduler::Upload, nullptr, "wakeUp");
+
+        // The first account is limited further than the global limit, the
+        // other one must not be slowed down to its rate
+        scheduler->setGlobalLimit(BandwidthScheduler::Upload, 100000);
+        scheduler->setAccountLimit(account1.data(), BandwidthScheduler::Upload, 20000);
+
+        qint64 total1 = 0;
+        qint64 total2 = 0;
+        QElapsedTimer timer;
+        timer.start();
+        while (timer.elapsed() < 1000) {
+            total1 += scheduler->take(&consumer1, 1000000);
+            total2 += scheduler->take(&consumer2, 1000000);
+            QTest::qWait(10);
+        }
+        QVERIFY(total1 <= 20000 + 4096);
+        QVERIFY(total1 >= 10000);
+        QVERIFY(total2 >= 2 * total1);
+        QVERIFY(total1 + total2 <= 100000 + 10000);
+
+        scheduler->setAccountLimit(account1.data(), BandwidthScheduler::Upload, 0);
+        scheduler->unregisterConsumer(&consumer1);
+        scheduler->unregisterConsumer(&consumer2);
+    }
+
+    void testAccountAndLocalLimits()
+    {
+        auto scheduler = BandwidthScheduler::instance();
+        auto account1 = Account::create();
+        auto account2 = Account::create();
+        Consumer consumer1;
+        Consumer consumer2;
+        Consumer consumer3;
+        TokenBucket local;
+        scheduler->registerConsumer(&consumer1, account1.data(), BandwidthScheduler::Download, nullptr, "wakeUp");
+        scheduler->registerConsumer(&consumer2, account2.data(), BandwidthScheduler::Download, nullptr, "wakeUp");
+        scheduler->registerConsumer(&consumer3, account2.data(), BandwidthScheduler::Download, &local, "wakeUp");
+
+        scheduler->setAccountLimit(account1.data(), BandwidthScheduler::Download, 100000);
+        QCOMPARE(scheduler->accountLimit(account1.data(), BandwidthScheduler::Download), 100000LL);
+        QVERIFY(scheduler->isLimited(account1.data(), BandwidthScheduler::Download));
+        QVERIFY(!scheduler->isLimited(account2.data(), BandwidthScheduler::Download));
+
+        QCOMPARE(scheduler->take(&consumer2, 1000000), 1000000LL);
+        QCOMPARE(scheduler->take(&consumer3, 1000000), 1000000LL);
+
+        QCOMPARE(scheduler->take(&consumer1, 1000000), 0LL);
+        QTRY_VERIFY(consumer1.wakeUps > 0);
+        const auto taken = scheduler->take(&consumer1, 1000000);
+        QVERIFY(taken > 0 && taken <= 10000);
+
+        // The local bucket only limits its own consumer
+        local.setRate(100000);
+        QCOMPARE(scheduler->take(&consumer2, 1000000), 1000000LL);
+        QVERIFY(scheduler->take(&consumer3, 1000000) <= 10000);
+
+        scheduler->setAccountLimit(account1.data(), BandwidthScheduler::Download, 0);
+        scheduler->unregisterConsumer(&consumer1);
+        scheduler->unregisterConsumer(&consumer2);
+        scheduler->unregisterConsumer(&consumer3);
+    }
+
+    void testAccountLimitRemovedWithAccount()
+    {
+        auto scheduler = BandwidthScheduler::instance();
+        auto account = Account::create();
+        const Account *rawAccount = account.data();
+        scheduler->setAccountLimit(rawAccount, BandwidthScheduler::Upload, 100000);
+        QCOMPARE(scheduler->accountLimit(rawAccount, BandwidthScheduler::Upload), 100000LL);
+
+        account.reset();
+        QCOMPARE(scheduler->accountLimit(rawAccount, BandwidthScheduler::Upload), 0LL);
+        QVERIFY(!scheduler->isLimited(rawAccount, BandwidthScheduler::Upload));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestBandwidthScheduler)
+#include "testbandwidthscheduler.moc"
@@ -0,0 +1,218 @@
+/*
+ * This software is in the public domain, furnished "as is", without technical
+ * support, and with no warranty, express or implied, as to its usefulness for
+ * any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include "changenotificationlistener.h"
+
+using namespace OCC;
+
+static const char endpointC[] = "ocs/v2.php/apps/notify_push/changes";
+
+// A long-poll request that is answered once there are changes
+class LongPollReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    LongPollReply(QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+        : QNetworkReply(parent)
+    {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(op);
+        open(QIODevice::ReadOnly);
+    }
+
+    void respond(const QByteArray &body)
+    {
+        _body = body;
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 200);
+        setHeader(QNetworkRequest::ContentLengthHeader, _body.size());
+        emit metaDataChanged();
+        emit readyRead();
+        setFinished(true);
+        emit finished();
+    }
+
+    void abort() override
+    {
+        aborted = true;
+        close();
+        setError(OperationCanceledError, QStringLiteral("Operation canceled"));
+        emit error(OperationCanceledError);
+        setFinished(true);
+        emit finished();
+    }
+    qint64 readData(char *buf, qint64 max) override
+    {
+        max = qMin<qint64>(max, _body.size());
+        memcpy(buf, _body.constData(), max);
+        _body = _body.mid(max);
+        return max;
+    }
+    qint64 bytesAvailable() const override { return _body.size(); }
+
+    bool aborted = false;
+
+private:
+    QByteArray _body;
+};
+
+/* Stand-in for the server side of the change notifications.
+ *
+ * Changes are numbered; the cursor is the number of changes a client has seen.
+ * Changes that are older than forgetBefore are not available anymore.
+ */
+class FakeChangeServer
+{
+public:
+    QStringList changes;
+    int forgetBefore = 0;
+    bool failing = false;
+    QList<QPointer<LongPollReply>> waiting;
+    QStringList cursors; // the cursors of all requests, "" for none
+
+    QNetworkReply *handle(QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+    {
+        QUrlQuery query(request.url());
+        const QString cursor = query.queryItemValue(QStringLiteral("cursor"));
+        cursors.append(cursor);
+        if (failing)
+            return new FakeErrorReply(op, request, parent, 503);
+        auto reply = new LongPollReply(op, request, parent);
+        waiting.append(reply);
+        if (cursor.isEmpty() || cursor.toInt() < changes.size())
+            QTimer::singleShot(0, reply, [this] { answer(); });
+        return reply;
+    }
+
+    void push(const QString &path)
+    {
+        changes.append(path);
+        answer();
+    }
+
+    void answer()
+    {
+        const auto replies = waiting;
+        waiting.clear();
+        for (const auto &reply : replies) {
+            if (!reply || reply->isFinished())
+                continue;
+            const QString cursor = QUrlQuery(reply->url()).queryItemValue(QStringLiteral("cursor"));
+            const bool reset = !cursor.isEmpty() && cursor.toInt() < forgetBefore;
+            QStringList paths;
+            if (!cursor.isEmpty() && !reset)
+                paths = changes.mid(cursor.toInt());
+            QJsonObject data {
+                { QStringLiteral("cursor"), QString::number(changes.size()) },
+                { QStringLiteral("paths"), QJsonArray::fromStringList(paths) },
+                { QStringLiteral("reset"), reset }
+            };
+            QJsonObject ocs {
+                { QStringLiteral("meta"), QJsonObject { { QStringLiteral("statuscode"), 200 }, { QStringLiteral("message"), QStringLiteral("OK") } } },
+                { QStringLiteral("data"), data }
+            };
+            reply->respond(QJsonDocument(QJsonObject { { QStringLiteral("ocs"), ocs } }).toJson(QJsonDocument::Compact));
+        }
+    }
+};
+
+class TestChangeNotificationListener : public QObject
+{
+    Q_OBJECT
+
+    void setUp(FakeFolder &fakeFolder, FakeChangeServer &server)
+    {
+        fakeFolder.account()->setCapabilities({ { "core", QVariantMap { { "change-notifications", QVariantMap { { "endpoint", endpointC } } } } } });
+        fakeFolder.setServerOverride([&server](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (request.url().path().endsWith(QLatin1String(endpointC)))
+                return server.handle(op, request, nullptr);
+            return nullptr;
+        });
+    }
+
+private slots:
+    void testNotSupported()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        QVERIFY(!ChangeNotificationListener::isSupported(fakeFolder.account()));
+        FakeChangeServer server;
+        setUp(fakeFolder, server);
+        QVERIFY(ChangeNotificationListener::isSupported(fakeFolder.account()));
+    }
+
+    void testPathsChanged()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        FakeChangeServer server;
+        setUp(fakeFolder, server);
+
+        ChangeNotificationListener listener(fakeFolder.account());
+        QSignalSpy pathsSpy(&listener, &ChangeNotificationListener::pathsChanged);
+        QSignalSpy lostSpy(&listener, &ChangeNotificationListener::lostChanges);
+        listener.start();
+
+        // The first request only establishes the cursor
+        QTRY_VERIFY(listener.isActive());
+        QTRY_COMPARE(server.cursors, QStringList({ "", "0" }));
+        QCOMPARE(pathsSpy.count(), 0);
+
+        server.push(QStringLiteral("/A/a1"));
+        QTRY_COMPARE(pathsSpy.count(), 1);
+        QCOMPARE(pathsSpy[0][0].toStringList(), QStringList{ "/A/a1" });
+        QTRY_COMPARE(server.cursors.last(), QStringLiteral("1"));
+
+        // Changes that happen between two requests are not lost
+        server.changes << QStringLiteral("/B") << QStringLiteral("/C/c1");
+        server.push(QStringLiteral("/S"));
+        QTRY_COMPARE(pathsSpy.count(), 2);
+        QCOMPARE(pathsSpy[1][0].toStringList(), QStringList({ "/B", "/C/c1", "/S" }));
+        QTRY_COMPARE(server.cursors.last(), QStringLiteral("4"));
+        QCOMPARE(lostSpy.count(), 0);
+        QVERIFY(listener.isActive());
+
+        // The server forgot the changes since the cursor
+        server.changes << QStringLiteral("/A");
+        server.forgetBefore = 5;
+        server.answer();
+        QTRY_COMPARE(lostSpy.count(), 1);
+        QCOMPARE(pathsSpy.count(), 2);
+
+        // Stopping cancels the outstanding request
+        QTRY_COMPARE(server.waiting.size(), 1);
+        QPointer<LongPollReply> reply = server.waiting.first();
+        listener.stop();
+        QVERIFY(!listener.isActive());
+        QVERIFY(!reply || reply->aborted);
+    }
+
+    void testErrorDeactivates()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        FakeChangeServer server;
+        setUp(fakeFolder, server);
+
+        ChangeNotificationListener listener(fakeFolder.account());
+        QSignalSpy activeSpy(&listener, &ChangeNotificationListener::activeChanged);
+        listener.start();
+        QTRY_VERIFY(listener.isActive());
+        QTRY_COMPARE(server.waiting.size(), 1);
+
+        // The outstanding request fails; the next one is only sent after the retry delay
+        server.failing = true;
+        server.waiting.first()->abort();
+        QTRY_VERIFY(!listener.isActive());
+        QCOMPARE(activeSpy.count(), 2);
+        const int requests = server.cursors.size();
+        QTest::qWait(200);
+        QCOMPARE(server.cursors.size(), requests);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestChangeNotificationListener)
+#include "testchangenotificationlistener.moc"
@@ -111,6 +111,43 @@ using namespace OCC::Utility;
         QCOMPARE(sSum, sum);
     }
 
+    void testMultipleChecksums()
+    {
+        QFile file(_testfile);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        const QByteArray md5 = calcMd5(&file);
+        file.seek(0);
+        const QByteArray sha1 = calcSha1(&file);
+        file.seek(0);
+
+        auto sums = ComputeChecksum::computeMultipleNow(&file, { checkSumSHA1C, "Klaas32", checkSumMD5C });
+        QCOMPARE(sums.size(), 3);
+        QCOMPARE(sums[0], sha1);
+        QVERIFY(sums[1].isEmpty());
+        QCOMPARE(sums[2], md5);
+
+        // The same through the threaded computation
+        qRegisterMetaType<QByteArrayList>();
+        ComputeChecksum vali;
+        vali.setChecksumTypes({ checkSumMD5C, checkSumSHA1C });
+        QSignalSpy spy(&vali, &ComputeChecksum::checksumsComputed);
+        vali.start(_testfile);
+        QTRY_COMPARE(spy.count(), 1);
+        QCOMPARE(spy[0][0].value<QByteArrayList>(), QByteArrayList({ checkSumMD5C, checkSumSHA1C }));
+        QCOMPARE(spy[0][1].value<QByteArrayList>(), QByteArrayList({ md5, sha1 }));
+
+        // And while validating a download
+        ValidateChecksumHeader validator;
+        validator.setContentChecksumType(checkSumSHA1C);
+        QSignalSpy contentSpy(&validator, &ValidateChecksumHeader::contentChecksumComputed);
+        QSignalSpy validatedSpy(&validator, &ValidateChecksumHeader::validated);
+        validator.start(_testfile, QByteArray("MD5:") + md5);
+        QTRY_COMPARE(validatedSpy.count(), 1);
+        QCOMPARE(contentSpy.count(), 1);
+        QCOMPARE(contentSpy[0][0].toByteArray(), QByteArray(checkSumSHA1C));
+        QCOMPARE(contentSpy[0][1].toByteArray(), sha1);
+    }
+
     void testUploadChecksummingAdler() {
 #ifndef ZLIB_FOUND
         QSKIP("ZLIB not found.", SkipSingle);
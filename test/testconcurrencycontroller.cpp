@@ -0,0 +1,106 @@
+/*
+ * This software is in the public domain, furnished "as is", without technical
+ * support, and with no warranty, express or implied, as to its usefulness for
+ * any purpose.
+ *
+ */
+
+#include <QtTest>
+
+#include "concurrencycontroller.h"
+
+using namespace OCC;
+
+class TestConcurrencyController : public QObject
+{
+    Q_OBJECT
+
+    // Simulates one measurement window of a link that scales up to linkLimit transfers
+    static bool simulateWindow(ConcurrencyController &controller, qint64 &now, int linkLimit, qint64 latency)
+    {
+        const qint64 bytesPerTransfer = 1000 * 1000;
+        controller.addTransferredBytes(qMin(controller.current(), linkLimit) * bytesPerTransfer * ConcurrencyController::windowMsecs / 1000);
+        controller.addResponseLatency(latency);
+        now += ConcurrencyController::windowMsecs;
+        return controller.update(now);
+    }
+
+private slots:
+    void testBounds()
+    {
+        ConcurrencyController controller;
+        controller.reset(10, 1, 4);
+        QCOMPARE(controller.current(), 4);
+        controller.reset(0, 1, 4);
+        QCOMPARE(controller.current(), 1);
+        controller.reset(3, 0, 0);
+        QCOMPARE(controller.current(), 1);
+    }
+
+    void testIncreaseWhileThroughputGrows()
+    {
+        ConcurrencyController controller;
+        controller.reset(3, 1, 20);
+        qint64 now = 0;
+        QVERIFY(!controller.update(now));
+
+        QVERIFY(simulateWindow(controller, now, 5, 50));
+        QCOMPARE(controller.current(), 4);
+        QVERIFY(simulateWindow(controller, now, 5, 50));
+        QCOMPARE(controller.current(), 5);
+        QVERIFY(simulateWindow(controller, now, 5, 50));
+        QCOMPARE(controller.current(), 6);
+        QCOMPARE(controller.throughput(), 5 * 1000 * 1000LL);
+
+        // The sixth transfer did not help: go back and stay there for a while
+        QVERIFY(simulateWindow(controller, now, 5, 50));
+        QCOMPARE(controller.current(), 5);
+        for (int i = 0; i < 5; ++i) {
+            QVERIFY(!simulateWindow(controller, now, 5, 50));
+            QCOMPARE(controller.current(), 5);
+        }
+
+        // Then probe again
+        for (int i = 0; i < 20; ++i) {
+            simulateWindow(controller, now, 5, 50);
+            QVERIFY(controller.current() >= 5 && controller.current() <= 6);
+        }
+    }
+
+    void testDecreaseOnLatency()
+    {
+        ConcurrencyController controller;
+        controller.reset(6, 1, 6);
+        qint64 now = 0;
+        controller.update(now);
+
+        QVERIFY(!simulateWindow(controller, now, 20, 50));
+        QCOMPARE(controller.current(), 6);
+
+        QVERIFY(simulateWindow(controller, now, 20, 400));
+        QCOMPARE(controller.current(), 3);
+        QVERIFY(simulateWindow(controller, now, 20, 400));
+        QCOMPARE(controller.current(), 1);
+        QVERIFY(!simulateWindow(controller, now, 20, 400));
+        QCOMPARE(controller.current(), 1);
+
+        // Latency back to normal: additive increase
+        QVERIFY(simulateWindow(controller, now, 20, 60));
+        QCOMPARE(controller.current(), 2);
+    }
+
+    void testIdleWindows()
+    {
+        ConcurrencyController controller;
+        controller.reset(3, 1, 6);
+        controller.update(0);
+        QVERIFY(!controller.update(1000));
+        QVERIFY(!controller.update(ConcurrencyController::windowMsecs));
+        QVERIFY(!controller.update(3 * ConcurrencyController::windowMsecs));
+        QCOMPARE(controller.current(), 3);
+        QCOMPARE(controller.throughput(), 0LL);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestConcurrencyController)
+#include "testconcurrencycontroller.moc"
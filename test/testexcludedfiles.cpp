@@ -62,6 +62,16 @@ static auto check_dir_traversal(const char *path)
     return excludedFiles->traversalPatternMatch(path, ItemTypeDirectory);
 }
 
+static int matchWhole(const GlobMatcher &matcher, const QString &str)
+{
+    return matcher.matchWhole(QStringRef(&str));
+}
+
+static int matchPrefixes(const GlobMatcher &matcher, const QString &str)
+{
+    return matcher.matchPrefixes(QStringRef(&str));
+}
+
 
 private slots:
     void testFun()
@@ -87,6 +97,48 @@ private slots:
         QVERIFY(excluded.isExcluded("/a/.b", "/a", excludeHidden));
     }
 
+    void testIsExcludedRelative()
+    {
+        ExcludedFiles excluded;
+        const QString base = "/nonexistent/";
+        const bool excludeHidden = true;
+        const bool keepHidden = false;
+
+        QVERIFY(!excluded.isExcludedRelative("", base, ItemTypeDirectory, true, excludeHidden));
+        QVERIFY(!excluded.isExcludedRelative("a/b", base, ItemTypeFile, false, excludeHidden));
+        QVERIFY(excluded.isExcludedRelative("a/b", base, ItemTypeFile, true, excludeHidden));
+        QVERIFY(!excluded.isExcludedRelative("a/b", base, ItemTypeFile, true, keepHidden));
+        QVERIFY(excluded.isExcludedRelative("a/.b", base, ItemTypeFile, false, excludeHidden));
+        QVERIFY(excluded.isExcludedRelative(".a/b", base, ItemTypeFile, false, excludeHidden));
+        QVERIFY(!excluded.isExcludedRelative(".a/b", base, ItemTypeFile, false, keepHidden));
+
+        // Excluded parent directories are cached, and the cache is
+        // dropped when the patterns change
+        excluded.addManualExclude("build/");
+        QVERIFY(excluded.isExcludedRelative("x/build", base, ItemTypeDirectory, false, keepHidden));
+        QVERIFY(!excluded.isExcludedRelative("x/build", base, ItemTypeFile, false, keepHidden));
+        QVERIFY(excluded.isExcludedRelative("x/build/y/z", base, ItemTypeFile, false, keepHidden));
+        QVERIFY(!excluded.isExcludedRelative("x/y/z", base, ItemTypeFile, false, keepHidden));
+        excluded.addManualExclude("y");
+        QVERIFY(excluded.isExcludedRelative("x/y/z", base, ItemTypeFile, false, keepHidden));
+        excluded.clearManualExcludes();
+        QVERIFY(!excluded.isExcludedRelative("x/build/y/z", base, ItemTypeFile, false, keepHidden));
+
+        // Agrees with the full pattern match
+        excluded.addExcludeFilePath(EXCLUDE_LIST_FILE);
+        excluded.addManualExclude("latex/*/*.tex.tmp");
+        excluded.reloadExcludeFiles();
+        for (const auto &path : { "a/b~", "a/.Trashes", "a/.Trashes/b", "foo_conflict-bar", "a/foo (conflicted copy bar)",
+                 "latex/a/b.tex.tmp", "latex/a/b/c.tex.tmp", "a/Desktop.ini", "Desktop.ini", "a/.sync_5bdd60bdfcfa.db", "a/b" }) {
+            QCOMPARE(excluded.isExcludedRelative(path, base, ItemTypeFile, false, keepHidden),
+                excluded.fullPatternMatch(path, ItemTypeFile) != CSYNC_NOT_EXCLUDED);
+        }
+
+        // Like during a sync run, the contents of directories that are excluded
+        // by name are excluded too
+        QVERIFY(excluded.isExcludedRelative("a/foo (conflicted copy bar)/c", base, ItemTypeFile, false, keepHidden));
+    }
+
     void check_csync_exclude_add()
     {
         setup();
@@ -465,6 +517,104 @@ private slots:
         QCOMPARE(check_file_traversal("e/foo/barA"), CSYNC_FILE_EXCLUDE_LIST);
     }
 
+    void check_glob_matcher()
+    {
+        GlobMatcher matcher;
+        QVERIFY(matcher.addPattern("literal", 1, false));
+        QVERIFY(matcher.addPattern("pre*", 2, false));
+        QVERIFY(matcher.addPattern("*.suf", 3, false));
+        QVERIFY(matcher.addPattern("a?c*[x-z]", 4, false));
+        QVERIFY(matcher.addPattern("[!0-9]\\*", 5, false));
+        QVERIFY(!matcher.addPattern("[[:digit:]]", 6, false));
+        QVERIFY(!matcher.addPattern("[\\w]", 6, false));
+
+        auto whole = [&](const char *str) { return matchWhole(matcher, str); };
+        QCOMPARE(whole("literal"), 1);
+        QCOMPARE(whole("literally"), 0);
+        QCOMPARE(whole("prefix"), 2);
+        QCOMPARE(whole("pre/fix"), 0);
+        QCOMPARE(whole("file.suf"), 3);
+        QCOMPARE(whole("pre.suf"), 3);
+        QCOMPARE(whole("abcx"), 4);
+        QCOMPARE(whole("abc123y"), 4);
+        QCOMPARE(whole("abc/y"), 0);
+        QCOMPARE(whole("abc"), 0);
+        QCOMPARE(whole("a*"), 5);
+        QCOMPARE(whole("1*"), 0);
+        QCOMPARE(whole("a\\*"), 0);
+
+        auto prefixes = [&](const char *str) { return matchPrefixes(matcher, str); };
+        QCOMPARE(prefixes("literal/foo"), 1);
+        QCOMPARE(prefixes("foo/literal"), 0);
+        QCOMPARE(prefixes("abcz/foo"), 4);
+
+        GlobMatcher slashMatcher;
+        QVERIFY(slashMatcher.addPattern("a*b", 1, true));
+        QVERIFY(slashMatcher.addPattern("x*", 2, true));
+        QCOMPARE(matchWhole(slashMatcher, "a/b"), 1);
+        QCOMPARE(matchWhole(slashMatcher, "x/y"), 2);
+        QCOMPARE(matchPrefixes(slashMatcher, "a/b/c"), 1);
+
+        GlobMatcher caseMatcher;
+        caseMatcher.setCaseInsensitive(true);
+        QVERIFY(caseMatcher.addPattern("Thumbs.db", 1, false));
+        QVERIFY(caseMatcher.addPattern("*.TMP", 2, false));
+        QVERIFY(caseMatcher.addPattern("[a-c]?x", 3, false));
+        QCOMPARE(matchWhole(caseMatcher, "THUMBS.DB"), 1);
+        QCOMPARE(matchWhole(caseMatcher, "foo.tmp"), 2);
+        QCOMPARE(matchWhole(caseMatcher, "BzX"), 3);
+
+        GlobMatcher unicodeMatcher;
+        QVERIFY(unicodeMatcher.addPattern("?.💩", 1, false));
+        QVERIFY(unicodeMatcher.addPattern("*💩?", 2, false));
+        QCOMPARE(matchWhole(unicodeMatcher, "💩.💩"), 1);
+        QCOMPARE(matchWhole(unicodeMatcher, "a💩💩"), 2);
+    }
+
+    void check_glob_matchers_agree_with_regex()
+    {
+        setup_init();
+        excludedFiles->addManualExclude("a*b?c");
+        excludedFiles->addManualExclude("[a-c]x*");
+        excludedFiles->addManualExclude("*.[Tt][Mm][Pp]");
+        excludedFiles->addManualExclude("]*.rem");
+        excludedFiles->addManualExclude("]remdir/");
+        excludedFiles->addManualExclude("dir/*/x/");
+        excludedFiles->addManualExclude("full/path");
+        excludedFiles->addManualExclude("top*/?ub");
+        excludedFiles->addManualExclude("\\*star");
+        excludedFiles->addManualExclude("foo[!0-9]");
+
+        const char *paths[] = {
+            "", "a", "abxc", "a/b/c", "axxbyc", "bx", "bx/y", "dx", "file.tmp", "dir/file.TmP", "x.rem", "x/y.rem",
+            "remdir", "remdir/x", "dir/a/x", "dir/a/x/y", "dir/x", "full/path", "full/path/below", "full", "other/full/path",
+            "top/sub", "topX/sub/more", "top/su/b", "*star", "xstar", "foo1", "fooa", "foo/a", "krawel_krawel",
+            ".kde/share/config/kwin.eventsrc", "mozilla/.directory", "foo/bar/.apdisk", "a/b~", "пятницы.txt", "x.💩",
+            "latex/x/y.tex.tmp", "latexfoo/y.run.xml", "a/b/c.out"
+        };
+        for (bool wildcardsMatchSlash : { false, true }) {
+            excludedFiles->setWildcardsMatchSlash(wildcardsMatchSlash);
+            QVERIFY(excludedFiles->_globMatchersUsable);
+            for (auto path : paths) {
+                for (auto type : { ItemTypeFile, ItemTypeDirectory }) {
+                    excludedFiles->setUseGlobMatchers(true);
+                    const auto glob = excludedFiles->traversalPatternMatch(path, type);
+                    excludedFiles->setUseGlobMatchers(false);
+                    const auto regex = excludedFiles->traversalPatternMatch(path, type);
+                    QVERIFY2(glob == regex, path);
+                }
+            }
+        }
+        excludedFiles->setUseGlobMatchers(true);
+
+        // Patterns the glob matchers don't support make it fall back to the regexes
+        excludedFiles->addManualExclude("[\\d]x");
+        QVERIFY(!excludedFiles->_globMatchersUsable);
+        QCOMPARE(check_file_traversal("1x"), CSYNC_FILE_EXCLUDE_LIST);
+        QCOMPARE(check_file_traversal("ax"), CSYNC_FILE_EXCLUDE_LIST);
+        QCOMPARE(check_file_traversal("dx"), CSYNC_NOT_EXCLUDED);
+    }
+
     void check_csync_regex_translation()
     {
         setup();
@@ -97,7 +97,8 @@ class TestFolderWatcher : public QObject
     }
 
 #ifdef Q_OS_LINUX
-#define CHECK_WATCH_COUNT(n) QCOMPARE(_watcher->testLinuxWatchCount(), (n))
+// The watches are registered in the background
+#define CHECK_WATCH_COUNT(n) QTRY_COMPARE(_watcher->testLinuxWatchCount(), (n))
 #else
 #define CHECK_WATCH_COUNT(n) do {} while (false)
 #endif
@@ -171,6 +172,43 @@ private slots:
         QVERIFY(waitForPathChanged(file2));
     }
 
+    void testMoveInATree() {
+        QTemporaryDir outside;
+        QDir outsideDir(outside.path());
+        outsideDir.mkpath("tree/d1/e1/f1");
+        outsideDir.mkpath("tree/d1/e2");
+        outsideDir.mkpath("tree/d2");
+        mv(outside.path() + "/tree", _rootPath + "/tree");
+        QVERIFY(waitForPathChanged(_rootPath + "/tree"));
+        CHECK_WATCH_COUNT(countFolders(_rootPath) + 1);
+
+        // The directories below it are watched too
+        QString file(_rootPath + "/tree/d1/e1/f1/contained");
+        touch(file);
+        QVERIFY(waitForPathChanged(file));
+    }
+
+    void testManyChangesInADirectory() {
+        QSignalSpy pathsChangedSpy(_watcher.data(), &FolderWatcher::pathsChanged);
+        QString dir(_rootPath + "/a2/many");
+        mkdir(dir);
+        QVERIFY(waitForPathChanged(dir));
+
+        // Only the directory is reported for a flood of changes
+        for (int i = 0; i < 3 * FolderWatcher::collapseThreshold; ++i)
+            Utility::writeRandomFile(dir + "/file" + QString::number(i), 10);
+        auto rescanned = [&]() {
+            for (const auto &args : pathsChangedSpy) {
+                if (args.at(1).value<QSet<QString>>().contains(dir)) {
+                    // Its entries are not listed
+                    return !args.at(0).value<QSet<QString>>().contains(dir + "/file0");
+                }
+            }
+            return false;
+        };
+        QTRY_VERIFY(rescanned());
+    }
+
     void testRemoveADir() {
         QString file(_rootPath+"/a1/b3/c3");
         rmdir(file);
@@ -7,6 +7,7 @@
 #include <QtTest>
 
 #include "folderwatcher_linux.h"
+#include "configfile.h"
 #include "common/utility.h"
 
 using namespace OCC;
@@ -34,32 +35,70 @@ private slots:
 
     }
 
-    // Test the recursive path listing function findFoldersBelow
+    // Test the directory listing of FolderWatcherWalkJob
     void testDirsBelowPath() {
         QStringList dirs;
 
-        bool ok = findFoldersBelow(QDir(_root), dirs);
+        FolderWatcherWalkJob job(_root, 0, QSharedPointer<QAtomicInt>::create(0));
+        job.setAutoDelete(false);
+        connect(&job, &FolderWatcherWalkJob::foldersFound, this, [&](const QVector<FolderWatcherWalkEntry> &entries) {
+            for (const auto &entry : entries)
+                dirs.append(entry.parent == -1 ? _root : dirs.at(entry.parent) + "/" + entry.name);
+        });
+        job.run();
+
+        QCOMPARE(dirs.first(), _root);
         QVERIFY( dirs.indexOf(_root + "/a1")>-1);
         QVERIFY( dirs.indexOf(_root + "/a1/b1")>-1);
         QVERIFY( dirs.indexOf(_root + "/a1/b1/c1")>-1);
         QVERIFY( dirs.indexOf(_root + "/a1/b1/c2")>-1);
 
-        QVERIFY(Utility::writeRandomFile(_root+"/a1/rand1.dat"));
-        QVERIFY(Utility::writeRandomFile(_root+"/a1/b1/rand2.dat"));
-        QVERIFY(Utility::writeRandomFile(_root+"/a1/b1/c1/rand3.dat"));
-
         QVERIFY( dirs.indexOf(_root + "/a1/b2")>-1);
         QVERIFY( dirs.indexOf(_root + "/a1/b2/c1")>-1);
         QVERIFY( dirs.indexOf(_root + "/a1/b3")>-1);
         QVERIFY( dirs.indexOf(_root + "/a1/b3/c3")>-1);
 
-        QVERIFY( dirs.indexOf(_root + "/a2"));
-        QVERIFY( dirs.indexOf(_root + "/a2/b3"));
-        QVERIFY( dirs.indexOf(_root + "/a2/b3/c3"));
+        QVERIFY( dirs.indexOf(_root + "/a2")>-1);
+        QVERIFY( dirs.indexOf(_root + "/a2/b3")>-1);
+        QVERIFY( dirs.indexOf(_root + "/a2/b3/c3")>-1);
 
-        QVERIFY2(dirs.count() == 11, "Directory count wrong.");
+        QVERIFY2(dirs.count() == 12, "Directory count wrong.");
+    }
 
-        QVERIFY2(ok, "findFoldersBelow failed.");
+    // With the fanotify backend configured the watcher uses fanotify if it
+    // is permitted and falls back to inotify otherwise
+    void testFanotifyBackend() {
+        QTemporaryDir configDir;
+        ConfigFile::setConfDir(configDir.path());
+        QSettings(ConfigFile().configFile(), QSettings::IniFormat).setValue("folderWatcherBackend", "fanotify");
+
+        FolderWatcher watcher;
+        QSignalSpy pathChangedSpy(&watcher, &FolderWatcher::pathChanged);
+        watcher.init(_root);
+        if (watcher.testLinuxUsesFanotify()) {
+            QCOMPARE(watcher.testLinuxWatchCount(), 0);
+        } else {
+            qDebug() << "fanotify is not permitted, testing the fallback to inotify";
+            QTRY_COMPARE(watcher.testLinuxWatchCount(), 12);
+        }
+        auto changed = [&](const QString &path) {
+            for (const auto &args : pathChangedSpy) {
+                if (args.first().toString() == path)
+                    return true;
+            }
+            return false;
+        };
+
+        QVERIFY(Utility::writeRandomFile(_root + "/a1/b1/c1/fanotify.dat"));
+        QTRY_VERIFY(changed(_root + "/a1/b1/c1/fanotify.dat"));
+
+        // The changes below a renamed directory have the new path
+        QVERIFY(QDir(_root).rename("a1/b1", "a1/brenamed"));
+        QTRY_VERIFY(changed(_root + "/a1/brenamed"));
+        QVERIFY(Utility::writeRandomFile(_root + "/a1/brenamed/c1/fanotify2.dat"));
+        QTRY_VERIFY(changed(_root + "/a1/brenamed/c1/fanotify2.dat"));
+
+        QVERIFY(QDir(_root).rename("a1/brenamed", "a1/b1"));
     }
 
     void cleanupTestCase() {
@@ -69,5 +108,5 @@ private slots:
     }
 };
 
-QTEST_APPLESS_MAIN(TestInotifyWatcher)
+QTEST_GUILESS_MAIN(TestInotifyWatcher)
 #include "testinotifywatcher.moc"
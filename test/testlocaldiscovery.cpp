@@ -9,6 +9,7 @@
 #include "syncenginetestutils.h"
 #include <syncengine.h>
 #include <localdiscoverytracker.h>
+#include <discoveryphase.h>
 
 using namespace OCC;
 
@@ -203,6 +204,117 @@ private slots:
         QVERIFY(!fakeFolder.currentRemoteState().find("C/.foo"));
         QVERIFY(!fakeFolder.currentRemoteState().find("C/bar"));
     }
+
+    // Directories that are unchanged since their snapshot are read from the db
+    void testDirectorySnapshots()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.localModifier().mkdir("A/X");
+        fakeFolder.localModifier().insert("A/X/x1");
+        QVERIFY(fakeFolder.syncOnce());
+
+        // Directories that changed recently don't get snapshots
+        QVERIFY(!fakeFolder.syncJournal().getDirectorySnapshot("A/X")._valid);
+        for (const auto dir : { "A", "A/X", "B", "C", "S" })
+            fakeFolder.localModifier().setModTime(dir, QDateTime::currentDateTimeUtc().addSecs(-60));
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(fakeFolder.syncJournal().getDirectorySnapshot("A")._valid);
+        QVERIFY(fakeFolder.syncJournal().getDirectorySnapshot("A/X")._valid);
+        QVERIFY(fakeFolder.syncJournal().getDirectorySnapshot("C")._valid);
+
+        // A is unchanged: its file that was modified in place is not noticed,
+        // but its subdirectory is still checked
+        fakeFolder.localModifier().appendByte("A/a1");
+        fakeFolder.localModifier().insert("A/X/x2");
+        fakeFolder.localModifier().insert("B/b3");
+        fakeFolder.remoteModifier().insert("C/c3");
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(LocalDiscoveryStyle::DirectorySnapshots);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.syncEngine().lastLocalDiscoveryStyle(), LocalDiscoveryStyle::DirectorySnapshots);
+        QVERIFY(fakeFolder.currentRemoteState().find("A/X/x2"));
+        QVERIFY(fakeFolder.currentRemoteState().find("B/b3"));
+        QVERIFY(fakeFolder.currentLocalState().find("C/c3"));
+        QCOMPARE(fakeFolder.currentRemoteState().find("A/a1")->size + 1, fakeFolder.currentLocalState().find("A/a1")->size);
+
+        // Propagation changed C, so its snapshot is gone
+        QVERIFY(fakeFolder.syncJournal().getDirectorySnapshot("A")._valid);
+        QVERIFY(!fakeFolder.syncJournal().getDirectorySnapshot("C")._valid);
+
+        // The records of A changing invalidates the snapshot, too
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArrayLiteral("A/a2"), &record));
+        record._modtime += 1;
+        QVERIFY(fakeFolder.syncJournal().setFileRecord(record));
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(LocalDiscoveryStyle::DirectorySnapshots);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    // Edits the snapshot discovery didn't see aren't removed with the server's deletion
+    void testDirectorySnapshotsKeepLocalEdits()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.localModifier().mkdir("A/X");
+        fakeFolder.localModifier().insert("A/X/x1");
+        QVERIFY(fakeFolder.syncOnce());
+        for (const auto dir : { "A", "A/X", "B", "C", "S" })
+            fakeFolder.localModifier().setModTime(dir, QDateTime::currentDateTimeUtc().addSecs(-60));
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(fakeFolder.syncJournal().getDirectorySnapshot("A")._valid);
+        QVERIFY(fakeFolder.syncJournal().getDirectorySnapshot("A/X")._valid);
+
+        fakeFolder.localModifier().appendByte("A/a1");
+        fakeFolder.localModifier().appendByte("A/X/x1");
+        fakeFolder.remoteModifier().remove("A/a1");
+        fakeFolder.remoteModifier().remove("A/X");
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(LocalDiscoveryStyle::DirectorySnapshots);
+        QVERIFY(!fakeFolder.syncOnce());
+        QVERIFY(fakeFolder.currentLocalState().find("A/a1"));
+        QVERIFY(fakeFolder.currentLocalState().find("A/X/x1"));
+
+        // A full local discovery finds the edits and uploads them
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(LocalDiscoveryStyle::FilesystemOnly);
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(fakeFolder.currentRemoteState().find("A/a1"));
+        QVERIFY(fakeFolder.currentRemoteState().find("A/X/x1"));
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    // The records read in the thread pool are the ones the synchronous listing finds
+    void testDbDirectoryJob()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.localModifier().mkdir("A/X");
+        fakeFolder.localModifier().insert("A/X/x1");
+        QVERIFY(fakeFolder.syncOnce());
+
+        for (const auto &path : { QByteArray(), QByteArray("A"), QByteArray("A/X"), QByteArray("B") }) {
+            QVector<SyncJournalFileRecord> expected;
+            QVERIFY(fakeFolder.syncJournal().listFilesInPath(path, [&](const SyncJournalFileRecord &rec) { expected.append(rec); }));
+            QVERIFY(!expected.isEmpty());
+
+            QVector<SyncJournalFileRecord> results;
+            bool failed = false;
+            DiscoverySingleDbDirectoryJob job(&fakeFolder.syncJournal(), path);
+            job.setAutoDelete(false);
+            connect(&job, &DiscoverySingleDbDirectoryJob::finished, this,
+                [&](const QVector<SyncJournalFileRecord> &records) { results = records; }, Qt::DirectConnection);
+            connect(&job, &DiscoverySingleDbDirectoryJob::finishedWithError, this,
+                [&] { failed = true; }, Qt::DirectConnection);
+            QThreadPool pool;
+            pool.start(&job);
+            pool.waitForDone();
+
+            QVERIFY(!failed);
+            QCOMPARE(results, expected);
+        }
+
+        // Nothing left for a sync that reads the records this way
+        ItemCompletedSpy completeSpy(fakeFolder);
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(completeSpy.isEmpty());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
 };
 
 QTEST_GUILESS_MAIN(TestLocalDiscovery)
@@ -170,6 +170,141 @@ private slots:
         QVERIFY(completeSpy.findItem("nofileid")->_errorString.contains("file id"));
         QVERIFY(completeSpy.findItem("nopermissions/A")->_errorString.contains("permissions"));
     }
+
+    void testDepthInfinityDiscovery()
+    {
+        FakeFolder fakeFolder{ FileInfo() };
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "propfind", QVariantMap{ { "depth_infinity", true } } } } } });
+        fakeFolder.remoteModifier().mkdir("A");
+        fakeFolder.remoteModifier().mkdir("A/a");
+        fakeFolder.remoteModifier().insert("A/a/file");
+        fakeFolder.remoteModifier().mkdir("A/empty");
+        fakeFolder.remoteModifier().mkdir("B");
+        fakeFolder.remoteModifier().insert("B/b");
+
+        QStringList propfindDepths;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &req, QIODevice *)
+                -> QNetworkReply *{
+            if (req.attribute(QNetworkRequest::CustomVerbAttribute) == "PROPFIND")
+                propfindDepths.append(QString::fromLatin1(req.rawHeader("Depth")));
+            return nullptr;
+        });
+
+        // The initial sync lists everything with a single request
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(propfindDepths, QStringList{ "infinity" });
+
+        // Known directories are discovered one level at a time
+        propfindDepths.clear();
+        fakeFolder.remoteModifier().insert("B/b2");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(!propfindDepths.isEmpty());
+        QVERIFY(!propfindDepths.contains("infinity"));
+
+        // New remote directories are listed recursively
+        propfindDepths.clear();
+        fakeFolder.remoteModifier().mkdir("C");
+        fakeFolder.remoteModifier().mkdir("C/c");
+        fakeFolder.remoteModifier().insert("C/c/file");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(propfindDepths, QStringList({ "1", "infinity" }));
+    }
+
+    void testDepthInfinitySkipsExcludedSubtrees()
+    {
+        FakeFolder fakeFolder{ FileInfo() };
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "propfind", QVariantMap{ { "depth_infinity", true } } } } } });
+        fakeFolder.remoteModifier().mkdir("A");
+        fakeFolder.remoteModifier().mkdir("A/a");
+        fakeFolder.remoteModifier().insert("A/a/file");
+        fakeFolder.remoteModifier().mkdir("A/b");
+        fakeFolder.remoteModifier().mkdir("A/b/b");
+        fakeFolder.remoteModifier().insert("A/b/b/file");
+        fakeFolder.syncEngine().journal()->setSelectiveSyncList(SyncJournalDb::SelectiveSyncBlackList, { "A/a/" });
+
+        QMap<QString, QByteArray> propfindDepths;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &req, QIODevice *)
+                -> QNetworkReply *{
+            if (req.attribute(QNetworkRequest::CustomVerbAttribute) == "PROPFIND")
+                propfindDepths[getFilePathFromUrl(req.url())] = req.rawHeader("Depth");
+            return nullptr;
+        });
+
+        // Directories with black listed directories below them are listed one level at a time
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(propfindDepths.value(""), QByteArray("1"));
+        QCOMPARE(propfindDepths.value("A"), QByteArray("1"));
+        QVERIFY(!propfindDepths.contains("A/a"));
+        QCOMPARE(propfindDepths.value("A/b"), QByteArray("infinity"));
+        QVERIFY(!fakeFolder.currentLocalState().find("A/a"));
+        QVERIFY(fakeFolder.currentLocalState().find("A/b/b/file"));
+
+        // On the initial sync with a big folder limit, only folders whose size was checked are listed recursively
+        FakeFolder bigFolder{ FileInfo() };
+        bigFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "propfind", QVariantMap{ { "depth_infinity", true } } } } } });
+        SyncOptions options;
+        options._newBigFolderSizeLimit = 20000;
+        bigFolder.syncEngine().setSyncOptions(options);
+        bigFolder.remoteModifier().mkdir("big");
+        bigFolder.remoteModifier().mkdir("big/sub");
+        bigFolder.remoteModifier().insert("big/sub/file", options._newBigFolderSizeLimit + 10);
+        bigFolder.remoteModifier().find("big")->extraDavProperties = "<oc:size>20020</oc:size>";
+        bigFolder.remoteModifier().mkdir("small");
+        bigFolder.remoteModifier().mkdir("small/sub");
+        bigFolder.remoteModifier().insert("small/sub/file", 10);
+        bigFolder.remoteModifier().find("small")->extraDavProperties = "<oc:size>10</oc:size>";
+        propfindDepths.clear();
+        bigFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &req, QIODevice *)
+                -> QNetworkReply *{
+            if (req.attribute(QNetworkRequest::CustomVerbAttribute) == "PROPFIND")
+                propfindDepths[getFilePathFromUrl(req.url())] = req.rawHeader("Depth");
+            return nullptr;
+        });
+        QVERIFY(bigFolder.syncOnce());
+        QCOMPARE(propfindDepths.value(""), QByteArray("1"));
+        QCOMPARE(propfindDepths.value("big"), QByteArray("0")); // only the size
+        QCOMPARE(propfindDepths.value("small"), QByteArray("infinity"));
+        QVERIFY(!bigFolder.currentLocalState().find("big"));
+        QVERIFY(bigFolder.currentLocalState().find("small/sub/file"));
+    }
+
+    void testDepthInfinityEntryLimit()
+    {
+        FakeFolder fakeFolder{ FileInfo() };
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "propfind", QVariantMap{ { "depth_infinity", true } } } } } });
+        SyncOptions options;
+        options._maxSubtreeListingEntries = 2;
+        fakeFolder.syncEngine().setSyncOptions(options);
+        fakeFolder.remoteModifier().mkdir("A");
+        fakeFolder.remoteModifier().insert("A/file");
+        fakeFolder.remoteModifier().mkdir("A/a1");
+        fakeFolder.remoteModifier().insert("A/a1/file");
+        fakeFolder.remoteModifier().mkdir("A/a2");
+        fakeFolder.remoteModifier().insert("A/a2/file");
+        fakeFolder.remoteModifier().mkdir("A/a2/sub");
+        fakeFolder.remoteModifier().insert("A/a2/sub/file");
+
+        QMap<QString, QByteArray> propfindDepths;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &req, QIODevice *)
+                -> QNetworkReply *{
+            if (req.attribute(QNetworkRequest::CustomVerbAttribute) == "PROPFIND")
+                propfindDepths[getFilePathFromUrl(req.url())] = req.rawHeader("Depth");
+            return nullptr;
+        });
+
+        // The subtrees of the root and of A have too many entries, so their directories
+        // are listed on their own; the subtree of A/a2 is small enough
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(propfindDepths.value(""), QByteArray("infinity"));
+        QCOMPARE(propfindDepths.value("A"), QByteArray("infinity"));
+        QCOMPARE(propfindDepths.value("A/a1"), QByteArray("infinity"));
+        QCOMPARE(propfindDepths.value("A/a2"), QByteArray("infinity"));
+        QVERIFY(!propfindDepths.contains("A/a2/sub"));
+    }
 };
 
 QTEST_GUILESS_MAIN(TestRemoteDiscovery)
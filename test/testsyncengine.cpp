@@ -537,6 +537,10 @@ private slots:
         contentMd5Value = "d8a73157ce10cd94a91c2079fc9a92c8"; // printf 'A%.0s' {1..16} | md5sum -
         QVERIFY(fakeFolder.syncOnce());
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        // The content checksum was computed along with the transmission checksum
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArrayLiteral("A/a5"), &record));
+        QCOMPARE(record._checksumHeader, QByteArray("SHA1:19b1928d58a2030d08023f3d7054516dbc186f20"));
 
         // Invalid OC-Checksum is ignored
         checksumValue = "garbage";
@@ -559,6 +563,43 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     }
 
+    // The checksums of a download are computed from the received data, the
+    // temporary file is not read again for them
+    void testChecksumOfDownloadNotReadBack()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        QObject parent;
+        int tampered = 0;
+
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation) {
+                auto reply = new FakeGetReply(fakeFolder.remoteModifier(), op, request, &parent);
+                reply->setRawHeader("OC-Checksum", "SHA1:19b1928d58a2030d08023f3d7054516dbc186f20"); // 16 'A'
+                // Connected before the job's connection: runs after the body
+                // was written, but before the download is validated.
+                connect(reply, &QNetworkReply::finished, &parent, [&] {
+                    const QDir dir(fakeFolder.localPath() + "A");
+                    for (const auto &name : dir.entryList({ ".a9.~*" }, QDir::Files | QDir::Hidden)) {
+                        QFile file(dir.filePath(name));
+                        if (file.open(QFile::ReadWrite) && file.write(QByteArray(16, 'B')) == 16)
+                            ++tampered;
+                    }
+                });
+                return reply;
+            }
+            return nullptr;
+        });
+
+        fakeFolder.remoteModifier().create("A/a9", 16, 'A');
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(tampered, 1);
+        // Reading the file again would have failed the validation
+        QCOMPARE(fakeFolder.currentLocalState().find("A/a9")->contentChar, 'B');
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArrayLiteral("A/a9"), &record));
+        QCOMPARE(record._checksumHeader, QByteArray("SHA1:19b1928d58a2030d08023f3d7054516dbc186f20"));
+    }
+
     // Tests the behavior of invalid filename detection
     void testInvalidFilenameRegex()
     {
@@ -745,6 +786,221 @@ private slots:
 
         QCOMPARE(QFileInfo(fakeFolder.localPath() + "foo").lastModified(), datetime);
     }
+
+    // Small files of a directory are uploaded together when the server supports it
+    void testBulkUpload()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "bulkupload", "1.0" } } } });
+
+        int nPost = 0;
+        int nPut = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PostOperation)
+                ++nPost;
+            if (op == QNetworkAccessManager::PutOperation)
+                ++nPut;
+            return nullptr;
+        });
+
+        for (int i = 0; i < 10; ++i)
+            fakeFolder.localModifier().insert(QString("A/bulk%1").arg(i), 100);
+        fakeFolder.localModifier().appendByte("A/a1");
+        fakeFolder.localModifier().insert("A/big", 1000 * 1000); // not small, uploaded alone
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(nPost, 1);
+        QCOMPARE(nPut, 1);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // The etags were stored: nothing is uploaded again
+        nPost = nPut = 0;
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(nPost, 0);
+        QCOMPARE(nPut, 0);
+
+        // A file rejected by the server falls back to a regular PUT
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PostOperation) {
+                ++nPost;
+                return new FakeErrorReply(op, request, this, 500);
+            }
+            if (op == QNetworkAccessManager::PutOperation)
+                ++nPut;
+            return nullptr;
+        });
+        fakeFolder.localModifier().insert("B/bulk1", 100);
+        fakeFolder.localModifier().insert("B/bulk2", 100);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(nPost, 1);
+        QCOMPARE(nPut, 2);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    void testBulkUploadSmallFilesOnly()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "bulkupload", "1.0" } } } });
+
+        int nPost = 0;
+        int nPut = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PostOperation)
+                ++nPost;
+            if (op == QNetworkAccessManager::PutOperation)
+                ++nPut;
+            return nullptr;
+        });
+
+        // Nothing but the small files re-arms the scheduling
+        fakeFolder.localModifier().mkdir("D");
+        for (int i = 0; i < 20; ++i)
+            fakeFolder.localModifier().insert(QString("D/small%1").arg(i), 100);
+        // Characters that need to be encoded in the part header
+        fakeFolder.localModifier().insert("D/with space%20and%", 100);
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(nPost >= 1);
+        QCOMPARE(nPut, 0);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    void testPropagateDuringDiscovery()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        auto options = fakeFolder.syncEngine().syncOptions();
+        options._propagateDuringDiscovery = true;
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        // New files in an unchanged or in a new directory can go right away
+        fakeFolder.remoteModifier().insert("A/new1");
+        fakeFolder.remoteModifier().insert("A/new2");
+        fakeFolder.remoteModifier().insert("new3");
+        fakeFolder.remoteModifier().mkdir("N");
+        fakeFolder.remoteModifier().insert("N/new4");
+        // Everything else waits for the discovery: a moved directory and one
+        // that was removed locally
+        fakeFolder.remoteModifier().rename("B", "B2");
+        fakeFolder.remoteModifier().insert("B2/new5");
+        fakeFolder.localModifier().remove("C");
+        fakeFolder.remoteModifier().insert("C/new6");
+
+        bool aboutToPropagate = false;
+        QStringList earlyGets;
+        connect(&fakeFolder.syncEngine(), &SyncEngine::aboutToPropagate, this, [&] { aboutToPropagate = true; });
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation && !aboutToPropagate)
+                earlyGets.append(getFilePathFromUrl(request.url()));
+            return nullptr;
+        });
+        // Items done early are only reported after the discovery
+        bool completedBeforeAboutToPropagate = false;
+        connect(&fakeFolder.syncEngine(), &SyncEngine::itemCompleted, this, [&](const SyncFileItemPtr &item) {
+            if (item->_instruction != CSYNC_INSTRUCTION_UPDATE_METADATA && !aboutToPropagate)
+                completedBeforeAboutToPropagate = true;
+        });
+        ItemCompletedSpy completeSpy(fakeFolder);
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(!completedBeforeAboutToPropagate);
+        QVERIFY(!earlyGets.isEmpty());
+        for (const auto &path : earlyGets)
+            QVERIFY(path == "A/new1" || path == "A/new2" || path == "new3" || path == "N/new4");
+        QCOMPARE(completeSpy.findItem("A/new1")->_status, SyncFileItem::Success);
+        QCOMPARE(completeSpy.findItem("new3")->_status, SyncFileItem::Success);
+
+        // Nothing left to do
+        completeSpy.clear();
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(completeSpy.isEmpty());
+
+        // A failure outside of the directory's job still keeps its etag from being stored
+        fakeFolder.serverErrorPaths().append("A/new7");
+        fakeFolder.remoteModifier().insert("A/new7");
+        QVERIFY(!fakeFolder.syncOnce());
+        SyncJournalFileRecord rec;
+        fakeFolder.syncJournal().getFileRecord(QByteArrayLiteral("A"), &rec);
+        QVERIFY(rec.isValid());
+        QCOMPARE(rec._etag, QByteArrayLiteral("_invalid_"));
+    }
+
+    // The new etag of a directory is only stored once the files streamed into it are done
+    void testPropagateDuringDiscoveryParentEtag()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        auto options = fakeFolder.syncEngine().syncOptions();
+        options._propagateDuringDiscovery = true;
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        fakeFolder.remoteModifier().insert("A/new1");
+        const QByteArray newEtag = fakeFolder.remoteModifier().find("A")->etag.toUtf8();
+        QByteArray etagWhileDownloading;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op != QNetworkAccessManager::GetOperation || getFilePathFromUrl(request.url()) != "A/new1")
+                return nullptr;
+            // Slow enough for the rest of the sync to be done
+            auto reply = new DelayedReply<FakeGetReply>(300, fakeFolder.remoteModifier(), op, request, &fakeFolder.syncEngine());
+            connect(reply, &QNetworkReply::metaDataChanged, this, [&] {
+                SyncJournalFileRecord rec;
+                fakeFolder.syncJournal().getFileRecord(QByteArrayLiteral("A"), &rec);
+                etagWhileDownloading = rec._etag;
+            });
+            return reply;
+        });
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(!etagWhileDownloading.isEmpty());
+        QVERIFY(etagWhileDownloading != newEtag);
+        SyncJournalFileRecord rec;
+        fakeFolder.syncJournal().getFileRecord(QByteArrayLiteral("A"), &rec);
+        QCOMPARE(rec._etag, newEtag);
+    }
+
+    // On a fresh sync the contents of new directories are downloaded while the
+    // deeper levels are still being listed
+    void testPropagateDuringDiscoveryDeepTree()
+    {
+        FakeFolder fakeFolder{ FileInfo{} };
+        auto options = fakeFolder.syncEngine().syncOptions();
+        options._propagateDuringDiscovery = true;
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        QString path;
+        for (int depth = 1; depth <= 6; ++depth) {
+            path += QStringLiteral("d%1/").arg(depth);
+            fakeFolder.remoteModifier().mkdir(path.left(path.size() - 1));
+            fakeFolder.remoteModifier().insert(path + "a");
+            fakeFolder.remoteModifier().insert(path + "b");
+        }
+
+        bool aboutToPropagate = false;
+        QStringList earlyGets;
+        connect(&fakeFolder.syncEngine(), &SyncEngine::aboutToPropagate, this, [&] { aboutToPropagate = true; });
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation && !aboutToPropagate)
+                earlyGets.append(getFilePathFromUrl(request.url()));
+            return nullptr;
+        });
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(earlyGets.contains("d1/a"));
+        QVERIFY(earlyGets.contains("d1/d2/a"));
+        QVERIFY(earlyGets.contains("d1/d2/d3/a"));
+
+        // The directories are in the database with their etags
+        for (const auto &dir : { "d1", "d1/d2", "d1/d2/d3/d4/d5/d6" }) {
+            SyncJournalFileRecord rec;
+            QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArray(dir), &rec));
+            QVERIFY(rec.isValid());
+            QCOMPARE(rec._etag, fakeFolder.remoteModifier().find(dir)->etag.toUtf8());
+        }
+
+        // Nothing left to do
+        ItemCompletedSpy completeSpy(fakeFolder);
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(completeSpy.isEmpty());
+    }
 };
 
 QTEST_GUILESS_MAIN(TestSyncEngine)
@@ -277,6 +277,55 @@ private slots:
         QCOMPARE(getEtag("foodir/sub"), initialEtag);
     }
 
+    void testFileIdentifiers()
+    {
+        SyncJournalFileRecord record;
+        record._path = "identifiers/file";
+        record._inode = std::numeric_limits<quint64>::max() - 7;
+        record._fileId = "identifiersid";
+        QVERIFY(_db.setFileRecord(record));
+
+        qint64 foundPHash = 0;
+        QVERIFY(_db.getFileIdentifiers([&](qint64 phash, quint64 inode, const QByteArray &fileId) {
+            if (fileId == "identifiersid") {
+                QCOMPARE(inode, record._inode);
+                foundPHash = phash;
+            }
+        }));
+        QCOMPARE(foundPHash, SyncJournalDb::getPHash("identifiers/file"));
+
+        SyncJournalFileRecord storedRecord;
+        QVERIFY(_db.getFileRecordByPHash(foundPHash, &storedRecord));
+        QVERIFY(storedRecord == record);
+
+        QVERIFY(_db.deleteFileRecord("identifiers/file"));
+        QVERIFY(_db.getFileRecordByPHash(foundPHash, &storedRecord));
+        QVERIFY(!storedRecord.isValid());
+    }
+
+    void testFileRecordsRevision()
+    {
+        SyncJournalFileRecord record;
+        record._path = "revision/file";
+        record._inode = 4711;
+
+        auto revision = _db.fileRecordsRevision();
+        QVERIFY(_db.setFileRecord(record));
+        QVERIFY(_db.fileRecordsRevision() != revision);
+
+        revision = _db.fileRecordsRevision();
+        QVERIFY(_db.updateLocalMetadata("revision/file", 42, 7, 4712));
+        QVERIFY(_db.fileRecordsRevision() != revision);
+
+        revision = _db.fileRecordsRevision();
+        SyncJournalFileRecord storedRecord;
+        QVERIFY(_db.getFileRecord(QByteArrayLiteral("revision/file"), &storedRecord));
+        QCOMPARE(_db.fileRecordsRevision(), revision);
+
+        QVERIFY(_db.deleteFileRecord("revision/file"));
+        QVERIFY(_db.fileRecordsRevision() != revision);
+    }
+
     void testRecursiveDelete()
     {
         auto makeEntry = [&](const QByteArray &path) {
@@ -451,6 +500,17 @@ private slots:
         list = _db.internalPinStates().rawList();
         QCOMPARE(list->size(), 4 + 9 + 27 - 4);
 
+        // The lookups give the same results after reading the states back from the table
+        _db.close();
+        QCOMPARE(getRaw("local"), PinState::AlwaysLocal);
+        QCOMPARE(getRaw("local/local"), PinState::Inherited);
+        QCOMPARE(get("local/local/online"), PinState::AlwaysLocal);
+        QCOMPARE(get("online/local/inherit"), PinState::AlwaysLocal);
+        QCOMPARE(getRecursive("online"), PinState::Inherited);
+        QCOMPARE(getRecursive("local/online"), PinState::Inherited);
+        QCOMPARE(getRecursive("online/online"), PinState::Inherited);
+        QCOMPARE(getRecursive("online/local/inherit"), PinState::AlwaysLocal);
+
         // Wiping everything
         _db.internalPinStates().wipeForPathAndBelow("");
         QCOMPARE(getRaw(""), PinState::Inherited);
@@ -659,6 +659,32 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     }
 
+    // Many new items make discovery load the journal record index, moves must still be found through it
+    void testMoveDetectionWithRecordIndex()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        OperationCounter counter;
+        fakeFolder.setServerOverride(counter.functor());
+
+        // Each new item needs a rename lookup; these come before the moves in S
+        for (int i = 0; i < 80; ++i) {
+            fakeFolder.localModifier().insert(QStringLiteral("A/local%1").arg(i));
+            fakeFolder.remoteModifier().insert(QStringLiteral("B/remote%1").arg(i));
+        }
+        fakeFolder.localModifier().rename("C/c1", "S/c1_local_renamed");
+        fakeFolder.remoteModifier().rename("C/c2", "S/c2_server_renamed");
+
+        ItemCompletedSpy completeSpy(fakeFolder);
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(itemSuccessfulMove(completeSpy, "S/c1_local_renamed"));
+        QVERIFY(itemSuccessfulMove(completeSpy, "S/c2_server_renamed"));
+        QCOMPARE(counter.nGET, 80);
+        QCOMPARE(counter.nMOVE, 1);
+        QCOMPARE(counter.nDELETE, 0);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(printDbData(fakeFolder.dbState()), printDbData(fakeFolder.currentRemoteState()));
+    }
+
     // Test for https://github.com/owncloud/client/issues/6694
     void testInvertFolderHierarchy()
     {
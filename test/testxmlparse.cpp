@@ -402,6 +402,92 @@ private slots:
         QVERIFY(!_success);
     }
 
+    void testParserIncremental() {
+        const QByteArray testXml = "<?xml version='1.0' encoding='utf-8'?>"
+              "<d:multistatus xmlns:d=\"DAV:\" xmlns:s=\"http://sabredav.org/ns\" xmlns:oc=\"http://owncloud.org/ns\">"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/</d:href>"
+              "<d:propstat>"
+              "<d:prop>"
+              "<oc:id>00004213ocobzus5kn6s</oc:id>"
+              "<oc:size>121780</oc:size>"
+              "<d:getetag>\"5527beb0400b0\"</d:getetag>"
+              "<d:resourcetype>"
+              "<d:collection/>"
+              "</d:resourcetype>"
+              "</d:prop>"
+              "<d:status>HTTP/1.1 200 OK</d:status>"
+              "</d:propstat>"
+              "</d:response>"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/quitte%20&amp;.pdf</d:href>"
+              "<d:propstat>"
+              "<d:prop>"
+              "<oc:id>00004215ocobzus5kn6s</oc:id>"
+              "<d:getetag>\"2fa2f0d9ed49ea0c3e409d49e652dea0\"</d:getetag>"
+              "<d:resourcetype/>"
+              "<d:getcontentlength>121780</d:getcontentlength>"
+              "</d:prop>"
+              "<d:status>HTTP/1.1 200 OK</d:status>"
+              "</d:propstat>"
+              "</d:response>"
+              "</d:multistatus>";
+
+        LsColXMLParser parser;
+
+        QMap<QString, QString> lastProperties;
+        connect(&parser, &LsColXMLParser::directoryListingSubfolders,
+                this, &TestXmlParse::slotDirectoryListingSubFolders);
+        connect(&parser, &LsColXMLParser::directoryListingIterated,
+                this, &TestXmlParse::slotDirectoryListingIterated);
+        connect(&parser, &LsColXMLParser::directoryListingIterated,
+                this, [&](const QString &, const QMap<QString, QString> &props) { lastProperties = props; });
+        connect(&parser, &LsColXMLParser::finishedWithoutError,
+                this, &TestXmlParse::slotFinishedSuccessfully);
+
+        // Feed the reply in small pieces, as it would come from the network
+        QHash <QString, qint64> sizes;
+        parser.start("/oc/remote.php/webdav/sharefolder", &sizes);
+        const int responseEnd = testXml.indexOf("</d:response>") + 13;
+        for (int i = 0; i < testXml.size(); i += 7) {
+            QVERIFY(parser.addData(testXml.mid(i, 7)));
+            if (i + 7 < responseEnd)
+                QCOMPARE(_items.size(), 0);
+            else if (i + 7 < testXml.indexOf("</d:response>", responseEnd))
+                QCOMPARE(_items.size(), 1); // emitted before the reply is complete
+        }
+        QVERIFY(!_success);
+        QVERIFY(parser.finish());
+        QVERIFY(_success);
+
+        QCOMPARE(_items.size(), 2);
+        QCOMPARE(_items.last(), QString("/oc/remote.php/webdav/sharefolder/quitte &.pdf"));
+        QCOMPARE(lastProperties.value("getetag"), QString("\"2fa2f0d9ed49ea0c3e409d49e652dea0\""));
+        QCOMPARE(lastProperties.value("getcontentlength"), QString("121780"));
+        QCOMPARE(lastProperties.value("resourcetype"), QString());
+        QCOMPARE(sizes.size(), 1);
+        QVERIFY(_subdirs.contains("/oc/remote.php/webdav/sharefolder/"));
+        QCOMPARE(_subdirs.size(), 1);
+    }
+
+    void testParserIncrementalTruncated() {
+        const QByteArray testXml = "<?xml version='1.0' encoding='utf-8'?>"
+              "<d:multistatus xmlns:d=\"DAV:\">"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/</d:href>"
+              "<d:propstat>";
+
+        LsColXMLParser parser;
+        connect(&parser, &LsColXMLParser::finishedWithoutError,
+                this, &TestXmlParse::slotFinishedSuccessfully);
+
+        QHash <QString, qint64> sizes;
+        parser.start("/oc/remote.php/webdav/sharefolder", &sizes);
+        QVERIFY(parser.addData(testXml));
+        QVERIFY(!parser.finish());
+        QVERIFY(!_success);
+    }
+
     void testHrefUrlEncoding() {
         const QByteArray testXml = "<?xml version='1.0' encoding='utf-8'?>"
               "<d:multistatus xmlns:d=\"DAV:\" xmlns:s=\"http://sabredav.org/ns\" xmlns:oc=\"http://owncloud.org/ns\">"
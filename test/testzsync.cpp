@@ -106,6 +106,7 @@ private slots:
         auto currentMtime = QDateTime::currentDateTimeUtc();
         fakeFolder.remoteModifier().setModTime("A/a0", currentMtime);
         quint64 transferedData = 0;
+        int rangeRequests = 0;
         fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
             QUrlQuery query(request.url());
             if (op == QNetworkAccessManager::GetOperation) {
@@ -115,6 +116,7 @@ private slots:
 
                 auto reply = new FakeGetWithDataReply{ fakeFolder.remoteModifier(), data, op, request, this };
                 transferedData += reply->payload.size();
+                ++rangeRequests;
                 return reply;
             }
 
@@ -125,6 +127,8 @@ private slots:
         // We didn't transfer the whole file
         // (plus one because of the new trailing byte)
         QVERIFY(transferedData <= (nModifications + 1) * ZSYNC_BLOCKSIZE);
+        // All the ranges were fetched with one request
+        QCOMPARE(rangeRequests, 1);
 
         // Verify that the newly propagated file was assembled to have the expected data
         f.open(QIODevice::ReadOnly);